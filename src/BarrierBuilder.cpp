@@ -0,0 +1,172 @@
+#include "BarrierBuilder.hpp"
+#include <stdexcept>
+
+namespace {
+
+    bool isReadOnly(ImageAccess access) {
+        return access == ImageAccess::EncodeSrc || access == ImageAccess::ComputeRead ||
+               access == ImageAccess::ComputeSampled || access == ImageAccess::TransferSrc;
+    }
+
+    ImageState ownedState(ImageAccess access, uint32_t queueFamily) {
+        ImageState state;
+        state.access = access;
+        state.queueFamily = queueFamily;
+        return state;
+    }
+
+} // namespace
+
+ImageState ImageStateTracker::getState(VkImage image) const {
+    auto it = states.find(image);
+    return it != states.end() ? it->second : ImageState{};
+}
+
+void ImageStateTracker::setState(VkImage image, const ImageState& state) {
+    states[image] = state;
+}
+
+void ImageStateTracker::forget(VkImage image) {
+    states.erase(image);
+}
+
+BarrierBuilder::BarrierBuilder(ImageStateTracker& tracker) : tracker(tracker) {}
+
+ImageAccessInfo BarrierBuilder::getAccessInfo(ImageAccess access) {
+    switch (access) {
+        case ImageAccess::Undefined:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+        case ImageAccess::DecodeDst:
+            return {VK_IMAGE_LAYOUT_VIDEO_DECODE_DST_KHR, VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR, VK_ACCESS_2_VIDEO_DECODE_WRITE_BIT_KHR};
+        case ImageAccess::DecodeDpb:
+            return {VK_IMAGE_LAYOUT_VIDEO_DECODE_DPB_KHR, VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR,
+                    VK_ACCESS_2_VIDEO_DECODE_READ_BIT_KHR | VK_ACCESS_2_VIDEO_DECODE_WRITE_BIT_KHR};
+        case ImageAccess::EncodeSrc:
+            return {VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR, VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR};
+        case ImageAccess::EncodeDpb:
+            return {VK_IMAGE_LAYOUT_VIDEO_ENCODE_DPB_KHR, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR,
+                    VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR | VK_ACCESS_2_VIDEO_ENCODE_WRITE_BIT_KHR};
+        case ImageAccess::ComputeRead:
+            return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        case ImageAccess::ComputeWrite:
+            return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+        case ImageAccess::ComputeSampled:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+        case ImageAccess::TransferSrc:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+        case ImageAccess::TransferDst:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+    }
+    throw std::logic_error("Unknown image access");
+}
+
+VkImageMemoryBarrier2& BarrierBuilder::addBarrier(VkImage image, ImageAccess from, ImageAccess to) {
+    ImageAccessInfo src = getAccessInfo(from);
+    ImageAccessInfo dst = getAccessInfo(to);
+
+    VkImageMemoryBarrier2 barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = src.stageMask;
+    // Only writes need to be made available; a read-to-anything hazard is an execution dependency.
+    barrier.srcAccessMask = isReadOnly(from) ? VK_ACCESS_2_NONE : src.accessMask;
+    barrier.dstStageMask = dst.stageMask;
+    barrier.dstAccessMask = dst.accessMask;
+    barrier.oldLayout = src.layout;
+    barrier.newLayout = dst.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barriers.push_back(barrier);
+    return barriers.back();
+}
+
+BarrierBuilder& BarrierBuilder::transition(VkImage image, ImageAccess access, uint32_t queueFamily, bool discardContents) {
+    ImageState state = tracker.getState(image);
+    bool otherOwner = state.queueFamily != VK_QUEUE_FAMILY_IGNORED && state.queueFamily != queueFamily;
+    if (!discardContents && (otherOwner || state.acquirePending)) {
+        throw std::logic_error("Image is owned by another queue family; use release() and acquire().");
+    }
+
+    if (discardContents) {
+        // Work on the previous owner is ordered by the semaphore that made this reuse
+        // possible; on the same queue the barrier still orders it after the last use.
+        ImageAccess from = otherOwner ? ImageAccess::Undefined : state.access;
+        VkImageMemoryBarrier2& barrier = addBarrier(image, from, access);
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    } else if (state.access != access || !isReadOnly(access)) {
+        addBarrier(image, state.access, access);
+    }
+
+    tracker.setState(image, ownedState(access, queueFamily));
+    return *this;
+}
+
+BarrierBuilder& BarrierBuilder::release(VkImage image, ImageAccess dstAccess, uint32_t dstQueueFamily) {
+    ImageState state = tracker.getState(image);
+    if (state.queueFamily == VK_QUEUE_FAMILY_IGNORED || state.acquirePending) {
+        throw std::logic_error("Only an image owned by a queue family can be released.");
+    }
+    if (state.queueFamily == dstQueueFamily) {
+        return transition(image, dstAccess, dstQueueFamily);
+    }
+
+    // The destination half of a release is ignored; the acquire provides it.
+    VkImageMemoryBarrier2& barrier = addBarrier(image, state.access, dstAccess);
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    barrier.srcQueueFamilyIndex = state.queueFamily;
+    barrier.dstQueueFamilyIndex = dstQueueFamily;
+
+    ImageState released = ownedState(dstAccess, dstQueueFamily);
+    released.acquirePending = true;
+    released.releasedBy = state.queueFamily;
+    released.releasedFrom = state.access;
+    tracker.setState(image, released);
+    return *this;
+}
+
+BarrierBuilder& BarrierBuilder::acquire(VkImage image, ImageAccess access, uint32_t queueFamily) {
+    ImageState state = tracker.getState(image);
+    if (!state.acquirePending) {
+        if (state.queueFamily == queueFamily && state.access == access) {
+            return *this;
+        }
+        throw std::logic_error("acquire() without a matching release().");
+    }
+    if (state.queueFamily != queueFamily || state.access != access) {
+        throw std::logic_error("acquire() does not match the pending release().");
+    }
+
+    // The layout transition must repeat the release exactly. The source stage is the
+    // consuming stage so the barrier chains with the semaphore wait at that stage.
+    VkImageMemoryBarrier2& barrier = addBarrier(image, state.releasedFrom, access);
+    barrier.srcStageMask = getAccessInfo(access).stageMask;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.srcQueueFamilyIndex = state.releasedBy;
+    barrier.dstQueueFamilyIndex = queueFamily;
+
+    tracker.setState(image, ownedState(access, queueFamily));
+    return *this;
+}
+
+BarrierBuilder& BarrierBuilder::acquireFrom(VkImage image, QueueAccess from, QueueAccess to) {
+    ImageState handoff = ownedState(to.access, to.queueFamily);
+    if (from.queueFamily != to.queueFamily) {
+        handoff.acquirePending = true;
+        handoff.releasedBy = from.queueFamily;
+        handoff.releasedFrom = from.access;
+    }
+    tracker.setState(image, handoff);
+    return acquire(image, to.access, to.queueFamily);
+}
+
+void BarrierBuilder::record(VkCommandBuffer commandBuffer) {
+    if (barriers.empty()) {
+        return;
+    }
+    VkDependencyInfo dependencyInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+    dependencyInfo.pImageMemoryBarriers = barriers.data();
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    barriers.clear();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// How an image is accessed next. Each value maps to one layout and the exact
+// pipeline stage and access masks of that use.
+enum class ImageAccess {
+    Undefined,
+    DecodeDst,      // Written by vkCmdDecodeVideoKHR.
+    DecodeDpb,      // Read and written as a decode reference picture.
+    EncodeSrc,      // Read by vkCmdEncodeVideoKHR.
+    EncodeDpb,      // Read and written as an encode reference picture.
+    ComputeRead,    // Read as a storage image by a compute shader.
+    ComputeWrite,   // Written as a storage image by a compute shader.
+    ComputeSampled, // Read through a sampler by a compute shader.
+    TransferSrc,
+    TransferDst
+};
+
+// The layout, stages and accesses that correspond to an ImageAccess.
+struct ImageAccessInfo {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 stageMask;
+    VkAccessFlags2 accessMask;
+};
+
+// An access on a specific queue family: one end of a picture handoff between stages.
+struct QueueAccess {
+    ImageAccess access;
+    uint32_t queueFamily;
+};
+
+// The last recorded use of an image, as seen by the CPU while recording.
+struct ImageState {
+    ImageAccess access = ImageAccess::Undefined;
+    // Queue family that owns the image; VK_QUEUE_FAMILY_IGNORED until first use.
+    uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED;
+    // Set between a queue family release and the matching acquire.
+    bool acquirePending = false;
+    // The family and access the image was released from, needed to build the matching acquire.
+    uint32_t releasedBy = VK_QUEUE_FAMILY_IGNORED;
+    ImageAccess releasedFrom = ImageAccess::Undefined;
+};
+
+// The ImageStateTracker class remembers the layout and owning queue family of each
+// image in command recording order. Command buffers that are recorded once and
+// resubmitted must leave their images in the state they found them in, or start
+// with a discarding transition.
+class ImageStateTracker {
+public:
+    // Returns the tracked state, or the Undefined state for an image not seen yet.
+    ImageState getState(VkImage image) const;
+    void setState(VkImage image, const ImageState& state);
+    // Drops an image that is about to be destroyed.
+    void forget(VkImage image);
+
+    size_t size() const { return states.size(); }
+
+private:
+    std::unordered_map<VkImage, ImageState> states;
+};
+
+// The BarrierBuilder class collects VkImageMemoryBarrier2 entries with stage and
+// access masks derived from the previous and next use of each image, updates the
+// tracker, and records them in a single vkCmdPipelineBarrier2.
+class BarrierBuilder {
+public:
+    explicit BarrierBuilder(ImageStateTracker& tracker);
+
+    // Transitions an image for access on queueFamily. discardContents transitions from
+    // UNDEFINED, which is also how an image is taken over from another queue family
+    // without an ownership transfer. Throws a std::logic_error if the image is owned by
+    // another family and its contents are to be kept.
+    BarrierBuilder& transition(VkImage image, ImageAccess access, uint32_t queueFamily, bool discardContents = false);
+
+    // Records the release half of an ownership transfer on the owning queue and moves
+    // the image to the layout of dstAccess. Degenerates to transition() when the
+    // destination family is the current owner.
+    BarrierBuilder& release(VkImage image, ImageAccess dstAccess, uint32_t dstQueueFamily);
+
+    // Records the acquire half matching a previous release(), on the destination queue.
+    // A no-op if the image already is in that state on this family.
+    BarrierBuilder& acquire(VkImage image, ImageAccess access, uint32_t queueFamily);
+
+    // Acquires an image that the previous stage hands over by releasing it from
+    // `from` to `to` (or, within one family, by transitioning it to `to`). The tracker
+    // is set from this contract rather than from the last recording, so command
+    // buffers recorded once per picture and replayed in any combination stay correct.
+    BarrierBuilder& acquireFrom(VkImage image, QueueAccess from, QueueAccess to);
+
+    // Records all pending barriers into commandBuffer and clears the builder.
+    void record(VkCommandBuffer commandBuffer);
+
+    const std::vector<VkImageMemoryBarrier2>& getBarriers() const { return barriers; }
+
+    static ImageAccessInfo getAccessInfo(ImageAccess access);
+
+private:
+    ImageStateTracker& tracker;
+    std::vector<VkImageMemoryBarrier2> barriers;
+
+    VkImageMemoryBarrier2& addBarrier(VkImage image, ImageAccess from, ImageAccess to);
+};
@@ -0,0 +1,133 @@
+#include "Checkpoint.hpp"
+#include "JsonObject.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bumped whenever the fields change; older checkpoints are refused rather than misread.
+constexpr uint32_t CHECKPOINT_FORMAT_VERSION = 1;
+
+namespace {
+    // Writes the whole file and waits until it is on disk.
+    bool writeDurably(const std::string& path, const std::string& contents) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        size_t written = 0;
+        while (written < contents.size()) {
+            ssize_t result = ::write(fd, contents.data() + written, contents.size() - written);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(result);
+        }
+        bool ok = written == contents.size() && ::fsync(fd) == 0;
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return ok;
+    }
+
+    // Makes a rename in the directory durable. Best effort: some file systems refuse
+    // to sync directories, and the rename itself has already succeeded.
+    void syncDirectoryOf(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+}
+
+namespace Checkpoint {
+
+    std::string pathFor(const std::string& outputPath) {
+        return outputPath + ".checkpoint";
+    }
+
+    void save(const std::string& path, const TranscodeCheckpoint& checkpoint) {
+        JsonObject object;
+        object.set("version", CHECKPOINT_FORMAT_VERSION)
+              .set("input", checkpoint.inputPath)
+              .set("input_size", checkpoint.inputSize)
+              .set("output_bytes", checkpoint.outputBytes)
+              .set("fragments", checkpoint.fragmentCount)
+              .set("output_streams", checkpoint.outputStreamCount)
+              .set("video_packet_index", checkpoint.videoPacketIndex)
+              .set("frame_number", checkpoint.frameNumber)
+              .set("input_pts", checkpoint.inputPts)
+              .set("input_dts", checkpoint.inputDts)
+              .set("last_output_pts", checkpoint.lastOutputPts)
+              .set("last_output_dts", checkpoint.lastOutputDts);
+        // The JSON is flat, so the per-stream values get one key each.
+        for (size_t i = 0; i < checkpoint.passthroughDts.size(); ++i) {
+            if (checkpoint.passthroughDts[i] != INT64_MIN) {
+                object.set("passthrough_dts_" + std::to_string(i), checkpoint.passthroughDts[i]);
+            }
+        }
+
+        // The new contents must be on disk before the rename, or a crash soon after it
+        // can leave the checkpoint name on an empty file.
+        std::string temporaryPath = path + ".tmp";
+        if (!writeDurably(temporaryPath, object.dump() + "\n")) {
+            throw std::runtime_error("Checkpoint: Could not write " + temporaryPath + ": " + std::strerror(errno));
+        }
+        if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Checkpoint: Could not replace " + path + ": " + std::strerror(errno));
+        }
+        syncDirectoryOf(path);
+    }
+
+    TranscodeCheckpoint load(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!file || !std::getline(file, line)) {
+            throw std::runtime_error("Checkpoint: Could not read " + path);
+        }
+        try {
+            JsonObject object = JsonObject::parse(line);
+            if (object.getUint32("version", 0) != CHECKPOINT_FORMAT_VERSION) {
+                throw std::invalid_argument("unsupported version");
+            }
+            TranscodeCheckpoint checkpoint;
+            checkpoint.inputPath = object.getString("input");
+            checkpoint.inputSize = object.getUint64("input_size");
+            checkpoint.outputBytes = object.getUint64("output_bytes");
+            checkpoint.fragmentCount = object.getUint32("fragments", 0);
+            checkpoint.outputStreamCount = object.getUint32("output_streams", 0);
+            checkpoint.videoPacketIndex = object.getUint64("video_packet_index");
+            checkpoint.frameNumber = object.getUint64("frame_number");
+            checkpoint.inputPts = object.getInt64("input_pts");
+            checkpoint.inputDts = object.getInt64("input_dts");
+            checkpoint.lastOutputPts = object.getInt64("last_output_pts");
+            checkpoint.lastOutputDts = object.getInt64("last_output_dts");
+            checkpoint.passthroughDts.assign(checkpoint.outputStreamCount, INT64_MIN);
+            for (uint32_t i = 0; i < checkpoint.outputStreamCount; ++i) {
+                std::string key = "passthrough_dts_" + std::to_string(i);
+                if (object.has(key)) {
+                    checkpoint.passthroughDts[i] = object.getInt64(key);
+                }
+            }
+            if (checkpoint.fragmentCount == 0 || checkpoint.outputStreamCount == 0) {
+                throw std::invalid_argument("no complete fragment");
+            }
+            return checkpoint;
+        } catch (const std::invalid_argument& e) {
+            throw std::runtime_error("Checkpoint: " + path + " is malformed: " + e.what());
+        }
+    }
+
+} // namespace Checkpoint
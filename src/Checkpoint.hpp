@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A point a transcode can restart from. The output file up to outputBytes holds every
+// frame decoded before the source IDR at inputPts, closed at a fragment boundary, and
+// the frame encoded next is an IDR, so a later run can truncate the file there and
+// append from the same source position.
+struct TranscodeCheckpoint {
+    // Identifies the source, so a checkpoint is not applied to a different file.
+    std::string inputPath;
+    uint64_t inputSize = 0;
+    // Output bytes that form complete fragments, how many fragments they hold, and the
+    // stream layout the header was written with.
+    uint64_t outputBytes = 0;
+    uint32_t fragmentCount = 0;
+    uint32_t outputStreamCount = 0;
+    // Video packets read and frames decoded before the restart IDR; every decoded frame
+    // before it is in the output.
+    uint64_t videoPacketIndex = 0;
+    uint64_t frameNumber = 0;
+    // The restart IDR's timestamps, in the video stream's time base.
+    int64_t inputPts = 0;
+    int64_t inputDts = 0;
+    // Timestamps of the last video frame written, in the output time base.
+    int64_t lastOutputPts = 0;
+    int64_t lastOutputDts = 0;
+    // Decode time in microseconds of the last passthrough packet written to each output
+    // stream, INT64_MIN when there is none; packets up to it are not written again.
+    std::vector<int64_t> passthroughDts;
+};
+
+// Reading and writing checkpoint files; they are single-line JSON objects.
+namespace Checkpoint {
+
+    // The checkpoint kept next to an output file.
+    std::string pathFor(const std::string& outputPath);
+
+    // Replaces the file atomically (temporary file, fsync and rename), so a kill or a
+    // crash while saving leaves the previous checkpoint. Throws a std::runtime_error
+    // on failure.
+    void save(const std::string& path, const TranscodeCheckpoint& checkpoint);
+
+    // Throws a std::runtime_error if the file is missing or malformed.
+    TranscodeCheckpoint load(const std::string& path);
+
+} // namespace Checkpoint
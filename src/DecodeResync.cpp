@@ -0,0 +1,59 @@
+#include "DecodeResync.hpp"
+#include "H264Parser.hpp"
+#include "PictureAssembler.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+DecodeResync::DecodeResync(uint32_t nalLengthSize, uint64_t bitstreamBufferSize, uint64_t bitstreamAlignment,
+                           bool resilient, uint64_t maxErrors)
+    : nalLengthSize(nalLengthSize), bitstreamBufferSize(bitstreamBufferSize),
+      bitstreamAlignment(std::max<uint64_t>(bitstreamAlignment, 1)), resilient(resilient), maxErrors(maxErrors) {
+}
+
+DecodeResync::Verdict DecodeResync::admit(const uint8_t* data, size_t size, bool flaggedCorrupt, uint64_t packetIndex) {
+    H264PacketInfo info;
+    const char* error = nullptr;
+    if (!H264Parser::inspectPacket(data, size, nalLengthSize, info)) {
+        error = info.error;
+    } else if (flaggedCorrupt) {
+        error = "flagged corrupt by the demuxer";
+    } else {
+        uint64_t packed = PictureAssembler::packedSizeBound(size, info.nalCount);
+        if ((packed + bitstreamAlignment - 1) / bitstreamAlignment * bitstreamAlignment > bitstreamBufferSize) {
+            error = "larger than the decode bitstream buffer";
+        }
+    }
+
+    if (error) {
+        if (!resilient) {
+            throw std::runtime_error("Damaged video packet " + std::to_string(packetIndex) + ": " + error +
+                                     " (a resilient decode would skip it)");
+        }
+        ++stats.corruptPackets;
+        if (maxErrors && stats.corruptPackets > maxErrors) {
+            throw std::runtime_error("More than " + std::to_string(maxErrors) + " damaged video packets, giving up.");
+        }
+        VT_LOG_WARNING("Decode: Skipping damaged packet " << packetIndex << " (" << error
+                       << "), resuming at the next IDR");
+        awaitingIdr = true;
+        ++stats.droppedFrames;
+        return Verdict::Damaged;
+    }
+
+    // Later frames may reference the lost one, so only an IDR is safe to decode.
+    if (awaitingIdr) {
+        if (!info.idr) {
+            ++stats.droppedFrames;
+            return Verdict::AwaitingIdr;
+        }
+        awaitingIdr = false;
+        ++stats.resyncs;
+        VT_LOG_INFO("Decode: Resynchronised at IDR packet " << packetIndex << ", "
+                    << stats.droppedFrames << " frames dropped so far");
+        return Verdict::Resync;
+    }
+    return Verdict::Decode;
+}
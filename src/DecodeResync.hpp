@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Damaged input handled by a resilient decode.
+struct DecodeErrorStats {
+    uint64_t corruptPackets = 0;
+    // Frames not decoded: the damaged ones and those skipped while waiting for an IDR.
+    uint64_t droppedFrames = 0;
+    // Times decoding restarted at an IDR.
+    uint64_t resyncs = 0;
+    uint64_t injectedErrors = 0;
+};
+
+// The DecodeResync class decides which video packets reach the decoder. A packet
+// that is damaged, flagged corrupt or too large for the decode bitstream buffer is
+// skipped, and so is every packet after it until an IDR, since later frames may
+// reference the lost one. Without a resilient decode, a damaged packet throws.
+class DecodeResync {
+public:
+    enum class Verdict {
+        Decode,
+        // Decode, after restarting the decoder: the IDR after a damaged packet.
+        Resync,
+        // Not decoded: the packet is damaged.
+        Damaged,
+        // Not decoded: an IDR has not followed the last damaged packet yet.
+        AwaitingIdr,
+    };
+
+    // nalLengthSize is the packets' NAL length prefix size, or 0 for Annex B. Packed
+    // pictures are aligned up to bitstreamAlignment and must fit bitstreamBufferSize.
+    // maxErrors is the number of damaged packets tolerated, 0 for any.
+    DecodeResync(uint32_t nalLengthSize, uint64_t bitstreamBufferSize, uint64_t bitstreamAlignment, bool resilient,
+                 uint64_t maxErrors);
+
+    // Checks packet number packetIndex. Throws a std::runtime_error for a damaged
+    // packet when not resilient, or once more than maxErrors were damaged.
+    Verdict admit(const uint8_t* data, size_t size, bool flaggedCorrupt, uint64_t packetIndex);
+
+    // The decode bitstream buffers were replaced by ones of size bytes.
+    void setBitstreamBufferSize(uint64_t size) { bitstreamBufferSize = size; }
+
+    // Counts a packet damaged on purpose; returns the count before it.
+    uint64_t countInjectedError() { return stats.injectedErrors++; }
+
+    bool isAwaitingIdr() const { return awaitingIdr; }
+    const DecodeErrorStats& getStats() const { return stats; }
+
+private:
+    uint32_t nalLengthSize;
+    uint64_t bitstreamBufferSize;
+    uint64_t bitstreamAlignment;
+    bool resilient;
+    uint64_t maxErrors;
+    bool awaitingIdr = false;
+    DecodeErrorStats stats;
+};
@@ -0,0 +1,101 @@
+#include "DecodedPicturePool.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // Totals over every pool in the process.
+    struct PoolMetrics {
+        MetricGauge& capacity;
+        MetricGauge& inUse;
+        MetricCounter& exhausted;
+    };
+
+    PoolMetrics& poolMetrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static PoolMetrics metrics{
+            registry.gauge("transcoder_picture_pool_capacity", "Decoded pictures allocated."),
+            registry.gauge("transcoder_picture_pool_in_use", "Decoded pictures referenced by frames in flight."),
+            registry.counter("transcoder_picture_pool_exhausted_total", "Acquires that found the picture pool exhausted."),
+        };
+        return metrics;
+    }
+}
+
+DecodedPicturePool::DecodedPicturePool(uint32_t initialSize, uint32_t maxSize, CreateFunction create, DestroyFunction destroy)
+    : maxSize(maxSize), create(std::move(create)), destroy(std::move(destroy)) {
+    if (initialSize == 0 || initialSize > maxSize) {
+        throw std::invalid_argument("Decoded picture pool size must be between 1 and its maximum size.");
+    }
+    // The vector never reallocates, so references returned by get() stay valid.
+    pictures.reserve(maxSize);
+    refCounts.reserve(maxSize);
+    for (uint32_t i = 0; i < initialSize; ++i) {
+        grow();
+    }
+    stats.growCount = 0;
+}
+
+DecodedPicturePool::~DecodedPicturePool() {
+    poolMetrics().capacity.add(-static_cast<int64_t>(pictures.size()));
+    poolMetrics().inUse.add(-static_cast<int64_t>(stats.inUse));
+    for (auto& picture : pictures) {
+        destroy(picture);
+    }
+}
+
+void DecodedPicturePool::grow() {
+    DecodedPicture picture;
+    picture.index = static_cast<uint32_t>(pictures.size());
+    create(picture);
+    pictures.push_back(picture);
+    refCounts.push_back(0);
+    stats.capacity = static_cast<uint32_t>(pictures.size());
+    ++stats.growCount;
+    poolMetrics().capacity.add(1);
+}
+
+int32_t DecodedPicturePool::take(uint32_t index) {
+    refCounts[index] = 1;
+    ++stats.inUse;
+    poolMetrics().inUse.add(1);
+    stats.peakInUse = std::max(stats.peakInUse, stats.inUse);
+    ++stats.acquireCount;
+    stats.occupancySum += stats.inUse;
+    return static_cast<int32_t>(index);
+}
+
+int32_t DecodedPicturePool::acquire(uint32_t preferred) {
+    if (preferred < refCounts.size() && refCounts[preferred] == 0) {
+        return take(preferred);
+    }
+    for (uint32_t i = 0; i < refCounts.size(); ++i) {
+        if (refCounts[i] == 0) {
+            return take(i);
+        }
+    }
+    if (pictures.size() < maxSize) {
+        grow();
+        return take(static_cast<uint32_t>(pictures.size() - 1));
+    }
+    ++stats.exhaustedCount;
+    poolMetrics().exhausted.add();
+    return -1;
+}
+
+void DecodedPicturePool::addRef(uint32_t index) {
+    if (refCounts.at(index) == 0) {
+        throw std::logic_error("addRef() on a picture that is not acquired.");
+    }
+    ++refCounts[index];
+}
+
+void DecodedPicturePool::release(uint32_t index) {
+    if (refCounts.at(index) == 0) {
+        throw std::logic_error("release() on a picture that is not acquired.");
+    }
+    if (--refCounts[index] == 0) {
+        --stats.inUse;
+        poolMetrics().inUse.add(-1);
+    }
+}
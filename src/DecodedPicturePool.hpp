@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// One decoded picture and, when downconverting, the 8-bit picture produced from it.
+struct DecodedPicture {
+    uint32_t index = 0;
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkImage encodeInputImage = VK_NULL_HANDLE;
+    VkDeviceMemory encodeInputMemory = VK_NULL_HANDLE;
+    VkImageView encodeInputView = VK_NULL_HANDLE;
+};
+
+// Occupancy counters for sizing the pool against VRAM use.
+struct DecodedPicturePoolStats {
+    uint32_t capacity = 0;
+    uint32_t inUse = 0;
+    uint32_t peakInUse = 0;
+    uint64_t acquireCount = 0;
+    // Acquires that found every picture busy and the pool at its maximum size.
+    uint64_t exhaustedCount = 0;
+    uint32_t growCount = 0;
+    // Sum of inUse after each acquire; divided by acquireCount gives the mean occupancy.
+    uint64_t occupancySum = 0;
+};
+
+// The DecodedPicturePool class owns the decode output pictures independently of the
+// per-frame submission resources. A picture is acquired by the decoder with one
+// reference, other stages (e.g. lookahead analysis) may add references, and it
+// returns to the pool when the last reference is released after encode completion.
+// When every picture is referenced the pool grows up to its maximum size.
+class DecodedPicturePool {
+public:
+    using CreateFunction = std::function<void(DecodedPicture&)>;
+    using DestroyFunction = std::function<void(DecodedPicture&)>;
+
+    // Creates initialSize pictures with create; destroy is called for each on destruction.
+    DecodedPicturePool(uint32_t initialSize, uint32_t maxSize, CreateFunction create, DestroyFunction destroy);
+    ~DecodedPicturePool();
+
+    DecodedPicturePool(const DecodedPicturePool&) = delete;
+    DecodedPicturePool& operator=(const DecodedPicturePool&) = delete;
+
+    // Returns a free picture with a reference count of one, or -1 if the pool is
+    // exhausted. The preferred picture is returned when it is free, which keeps the
+    // pictures referenced by cached command buffers stable.
+    int32_t acquire(uint32_t preferred = UINT32_MAX);
+
+    void addRef(uint32_t index);
+    void release(uint32_t index);
+
+    DecodedPicture& get(uint32_t index) { return pictures.at(index); }
+    uint32_t getRefCount(uint32_t index) const { return refCounts.at(index); }
+
+    const DecodedPicturePoolStats& getStats() const { return stats; }
+
+private:
+    uint32_t maxSize;
+    CreateFunction create;
+    DestroyFunction destroy;
+    std::vector<DecodedPicture> pictures;
+    std::vector<uint32_t> refCounts;
+    DecodedPicturePoolStats stats;
+
+    void grow();
+    int32_t take(uint32_t index);
+};
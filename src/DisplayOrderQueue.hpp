@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The DisplayOrderQueue class puts decoded pictures, which arrive in decode order, back
+// into display order. Pictures are sorted by PicOrderCnt, and the first one in display
+// order is released once more than the stream's reorder delay (its num_reorder_frames,
+// has_b_frames in FFmpeg) are held after it, or at an IDR, before which everything
+// earlier is displayed. Storage is reserved up front, so pushing and popping do not
+// allocate.
+template <typename T>
+class DisplayOrderQueue {
+public:
+    explicit DisplayOrderQueue(uint32_t reorderDelay = 0) : reorderDelay(reorderDelay) {
+        entries.reserve(reorderDelay + 1);
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    // Adds the next picture in decode order. An IDR restarts the order count.
+    void push(T value, int32_t picOrderCnt, bool idr) {
+        if (idr) {
+            ++epoch;
+        }
+        Entry entry{ epoch, picOrderCnt, std::move(value) };
+        // Pictures mostly arrive close to their place, so search from the back.
+        auto position = entries.end();
+        while (position != entries.begin() && entry.before(*(position - 1))) {
+            --position;
+        }
+        entries.insert(position, std::move(entry));
+    }
+
+    // True when the first picture in display order is known. At end of stream
+    // (flush = true) every picture is.
+    bool ready(bool flush) const {
+        return !entries.empty() && (flush || entries.size() > reorderDelay || entries.front().epoch != epoch);
+    }
+
+    // Removes and returns the first picture in display order.
+    T pop() {
+        Entry& first = entries.front();
+        // A picture that should have been displayed before one already released means
+        // the stream reorders more than its reorder delay says.
+        if (havePopped && first.epoch == lastEpoch && first.picOrderCnt < maxPicOrderCnt) {
+            ++lateCount;
+        } else {
+            maxPicOrderCnt = first.picOrderCnt;
+        }
+        havePopped = true;
+        lastEpoch = first.epoch;
+        T value = std::move(first.value);
+        entries.erase(entries.begin());
+        return value;
+    }
+
+    // Pictures released after a later one in display order had already been.
+    uint64_t getLateCount() const { return lateCount; }
+
+private:
+    struct Entry {
+        uint64_t epoch;
+        int32_t picOrderCnt;
+        T value;
+
+        bool before(const Entry& other) const {
+            return epoch != other.epoch ? epoch < other.epoch : picOrderCnt < other.picOrderCnt;
+        }
+    };
+
+    uint32_t reorderDelay;
+    // Counts IDRs, so pictures after one sort after everything before it.
+    uint64_t epoch = 0;
+    std::vector<Entry> entries;
+    bool havePopped = false;
+    uint64_t lastEpoch = 0;
+    int32_t maxPicOrderCnt = 0;
+    uint64_t lateCount = 0;
+};
@@ -0,0 +1,347 @@
+#include "FormatConverter.hpp"
+#include "FormatKernels.hpp"
+#include "VulkanUtils.hpp"
+#include "Log.hpp"
+
+#include <stdexcept>
+
+#ifdef VT_HAVE_COMPUTE_SHADERS
+// SPIR-V generated at build time from shaders/downconvert_p010.comp.
+static const uint32_t kDownconvertShaderCode[] =
+#include "downconvert_p010.comp.spv.h"
+;
+#endif
+
+namespace {
+    // Plane formats used to reinterpret the multi-planar pictures as storage images.
+    constexpr VkFormat SRC_LUMA_FORMAT = VK_FORMAT_R16_UINT;
+    constexpr VkFormat SRC_CHROMA_FORMAT = VK_FORMAT_R16G16_UINT;
+    constexpr VkFormat DST_LUMA_FORMAT = VK_FORMAT_R8_UINT;
+    constexpr VkFormat DST_CHROMA_FORMAT = VK_FORMAT_R8G8_UINT;
+    constexpr uint32_t WORKGROUP_SIZE = 16;
+}
+
+FormatConverter::FormatConverter(VulkanBase* vulkanBase, ImageStateTracker& imageStates, VkExtent2D extent,
+                                 uint32_t slotCount, DownconvertMode mode)
+    : vulkanBase(vulkanBase), imageStates(imageStates), extent(extent) {
+    if (mode == DownconvertMode::None) {
+        throw std::invalid_argument("FormatConverter requires a downconvert mode.");
+    }
+    if (!vulkanBase->getQueueFamilyIndices().computeFamily.has_value()) {
+        throw std::runtime_error("10->8 bit downconvert requires a compute queue!");
+    }
+
+    bool gpuSupported = isGpuPathSupported();
+    if (mode == DownconvertMode::Gpu && !gpuSupported) {
+        throw std::runtime_error("GPU downconvert requested but not supported by this build or device!");
+    }
+    gpuPath = (mode != DownconvertMode::Cpu) && gpuSupported;
+
+    VkDevice device = vulkanBase->getDevice();
+    VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = vulkanBase->getQueueFamilyIndices().computeFamily.value();
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create format converter command pool!");
+    }
+
+    slots.resize(slotCount);
+    if (gpuPath) {
+        createGpuPipeline(slotCount);
+    } else {
+        createStagingBuffers();
+    }
+    VT_LOG_INFO("Format converter: 10-bit -> 8-bit on " << (gpuPath ? "GPU (compute shader)" : "CPU (SIMD)"));
+}
+
+FormatConverter::~FormatConverter() {
+    VkDevice device = vulkanBase->getDevice();
+    for (auto& slot : slots) {
+        for (VkImageView view : slot.views) {
+            if (view) vkDestroyImageView(device, view, nullptr);
+        }
+    }
+    if (pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+    if (pipelineLayout) vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    if (descriptorPool) vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    if (descriptorSetLayout) vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    if (readbackBuffer) {
+        vkUnmapMemory(device, readbackBufferMemory);
+        vkDestroyBuffer(device, readbackBuffer, nullptr);
+        vkFreeMemory(device, readbackBufferMemory, nullptr);
+    }
+    if (uploadBuffer) {
+        vkUnmapMemory(device, uploadBufferMemory);
+        vkDestroyBuffer(device, uploadBuffer, nullptr);
+        vkFreeMemory(device, uploadBufferMemory, nullptr);
+    }
+    stagingTimeline.reset();
+    if (commandPool) vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+bool FormatConverter::isGpuPathSupported() const {
+#ifdef VT_HAVE_COMPUTE_SHADERS
+    VkPhysicalDevice physicalDevice = vulkanBase->getPhysicalDevice();
+    for (VkFormat format : {SRC_LUMA_FORMAT, SRC_CHROMA_FORMAT, DST_LUMA_FORMAT, DST_CHROMA_FORMAT}) {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+        if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+VkImageUsageFlags FormatConverter::getSourceUsage() const {
+    return gpuPath ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+}
+
+VkImageUsageFlags FormatConverter::getDestinationUsage() const {
+    return gpuPath ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+}
+
+VkImageCreateFlags FormatConverter::getImageCreateFlags() const {
+    // Plane views with a different format and usage than the video picture itself.
+    return gpuPath ? (VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) : 0;
+}
+
+void FormatConverter::createGpuPipeline(uint32_t slotCount) {
+#ifdef VT_HAVE_COMPUTE_SHADERS
+    VkDevice device = vulkanBase->getDevice();
+
+    VkDescriptorSetLayoutBinding bindings[4]{};
+    for (uint32_t i = 0; i < 4; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downconvert descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4 * slotCount};
+    VkDescriptorPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    poolInfo.maxSets = slotCount;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downconvert descriptor pool!");
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downconvert pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    moduleInfo.codeSize = sizeof(kDownconvertShaderCode);
+    moduleInfo.pCode = kDownconvertShaderCode;
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downconvert shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    VkResult result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downconvert compute pipeline!");
+    }
+#else
+    (void)slotCount;
+#endif
+}
+
+void FormatConverter::createStagingBuffers() {
+    VkDevice device = vulkanBase->getDevice();
+    VkPhysicalDevice physicalDevice = vulkanBase->getPhysicalDevice();
+
+    // Both pictures are 4:2:0: one luma sample per pixel plus half as many chroma samples.
+    VkDeviceSize sampleCount = static_cast<VkDeviceSize>(extent.width) * extent.height * 3 / 2;
+    VulkanUtils::createBuffer(physicalDevice, device, sampleCount * sizeof(uint16_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+    vkMapMemory(device, readbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &pReadbackHost);
+
+    VulkanUtils::createBuffer(physicalDevice, device, sampleCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uploadBuffer, uploadBufferMemory);
+    vkMapMemory(device, uploadBufferMemory, 0, VK_WHOLE_SIZE, 0, &pUploadHost);
+
+    stagingTimeline = std::make_unique<TimelineSemaphore>(device);
+}
+
+void FormatConverter::bindSlot(uint32_t slotIndex, VkImage srcImage, VkImage dstImage, QueueAccess from) {
+    VkDevice device = vulkanBase->getDevice();
+    Slot& slot = slots.at(slotIndex);
+    slot.srcImage = srcImage;
+    slot.dstImage = dstImage;
+
+    VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate format converter command buffer!");
+    }
+
+    if (gpuPath) {
+        slot.views[0] = VulkanUtils::createPlaneImageView(device, srcImage, SRC_LUMA_FORMAT, VK_IMAGE_ASPECT_PLANE_0_BIT, VK_IMAGE_USAGE_STORAGE_BIT);
+        slot.views[1] = VulkanUtils::createPlaneImageView(device, srcImage, SRC_CHROMA_FORMAT, VK_IMAGE_ASPECT_PLANE_1_BIT, VK_IMAGE_USAGE_STORAGE_BIT);
+        slot.views[2] = VulkanUtils::createPlaneImageView(device, dstImage, DST_LUMA_FORMAT, VK_IMAGE_ASPECT_PLANE_0_BIT, VK_IMAGE_USAGE_STORAGE_BIT);
+        slot.views[3] = VulkanUtils::createPlaneImageView(device, dstImage, DST_CHROMA_FORMAT, VK_IMAGE_ASPECT_PLANE_1_BIT, VK_IMAGE_USAGE_STORAGE_BIT);
+
+        VkDescriptorSetAllocateInfo setInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        setInfo.descriptorPool = descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &descriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &setInfo, &slot.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate downconvert descriptor set!");
+        }
+
+        VkDescriptorImageInfo imageInfos[4]{};
+        VkWriteDescriptorSet writes[4]{};
+        for (uint32_t i = 0; i < 4; ++i) {
+            imageInfos[i].imageView = slot.views[i];
+            imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = slot.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].pImageInfo = &imageInfos[i];
+        }
+        vkUpdateDescriptorSets(device, 4, writes, 0, nullptr);
+        recordGpuCommands(slot, from);
+    } else {
+        if (vkAllocateCommandBuffers(device, &allocInfo, &slot.uploadCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate format converter command buffer!");
+        }
+        recordCpuCommands(slot, from);
+    }
+}
+
+// The slot's images never change, so its command buffers are recorded once and resubmitted.
+void FormatConverter::recordGpuCommands(Slot& slot, QueueAccess from) {
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    uint32_t computeFamily = qfIndices.computeFamily.value();
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+    // The destination is fully overwritten, so it is taken over without an ownership transfer.
+    BarrierBuilder barriers(imageStates);
+    barriers.acquireFrom(slot.srcImage, from, {ImageAccess::ComputeRead, computeFamily})
+            .transition(slot.dstImage, ImageAccess::ComputeWrite, computeFamily, true)
+            .record(slot.commandBuffer);
+
+    vkCmdBindPipeline(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &slot.descriptorSet, 0, nullptr);
+    vkCmdDispatch(slot.commandBuffer,
+        (extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+        (extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+    barriers.release(slot.dstImage, ImageAccess::EncodeSrc, qfIndices.encodeFamily.value())
+            .record(slot.commandBuffer);
+
+    vkEndCommandBuffer(slot.commandBuffer);
+}
+
+void FormatConverter::recordCpuCommands(Slot& slot, QueueAccess from) {
+    VkExtent3D lumaExtent{extent.width, extent.height, 1};
+    VkExtent3D chromaExtent{(extent.width + 1) / 2, (extent.height + 1) / 2, 1};
+    VkDeviceSize lumaSamples = static_cast<VkDeviceSize>(extent.width) * extent.height;
+
+    VkBufferImageCopy regions[2]{};
+    regions[0].imageSubresource = {VK_IMAGE_ASPECT_PLANE_0_BIT, 0, 0, 1};
+    regions[0].imageExtent = lumaExtent;
+    regions[1].imageSubresource = {VK_IMAGE_ASPECT_PLANE_1_BIT, 0, 0, 1};
+    regions[1].imageExtent = chromaExtent;
+
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    uint32_t computeFamily = qfIndices.computeFamily.value();
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    BarrierBuilder barriers(imageStates);
+
+    // Readback: 16-bit samples, chroma plane after the luma plane.
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+    barriers.acquireFrom(slot.srcImage, from, {ImageAccess::TransferSrc, computeFamily}).record(slot.commandBuffer);
+    regions[1].bufferOffset = lumaSamples * sizeof(uint16_t);
+    vkCmdCopyImageToBuffer(slot.commandBuffer, slot.srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 2, regions);
+    vkEndCommandBuffer(slot.commandBuffer);
+
+    // Upload: 8-bit samples with the same plane arrangement.
+    vkBeginCommandBuffer(slot.uploadCommandBuffer, &beginInfo);
+    barriers.transition(slot.dstImage, ImageAccess::TransferDst, computeFamily, true).record(slot.uploadCommandBuffer);
+    regions[1].bufferOffset = lumaSamples;
+    vkCmdCopyBufferToImage(slot.uploadCommandBuffer, uploadBuffer, slot.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 2, regions);
+    barriers.release(slot.dstImage, ImageAccess::EncodeSrc, qfIndices.encodeFamily.value())
+            .record(slot.uploadCommandBuffer);
+    vkEndCommandBuffer(slot.uploadCommandBuffer);
+}
+
+void FormatConverter::submit(uint32_t slotIndex, const VkSemaphoreSubmitInfo& wait, const VkSemaphoreSubmitInfo& signal) {
+    VkQueue queue = vulkanBase->getComputeQueue();
+    Slot& slot = slots.at(slotIndex);
+
+    VkCommandBufferSubmitInfo commandBufferInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+    commandBufferInfo.commandBuffer = slot.commandBuffer;
+
+    VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+    submitInfo.waitSemaphoreInfoCount = 1;
+    submitInfo.pWaitSemaphoreInfos = &wait;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+
+    if (gpuPath) {
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signal;
+        if (vulkanBase->queueSubmit(queue, 1, &submitInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit downconvert work!");
+        }
+        return;
+    }
+
+    // The staging buffers are shared by all slots, so the previous upload must have
+    // consumed the upload buffer before it is overwritten.
+    stagingTimeline->wait(lastUploadValue);
+
+    uint64_t readbackValue = stagingTimeline->nextValue();
+    VkSemaphoreSubmitInfo readbackSignal = stagingTimeline->submitInfo(readbackValue, VK_PIPELINE_STAGE_2_COPY_BIT);
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &readbackSignal;
+    if (vulkanBase->queueSubmit(queue, 1, &submitInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit downconvert readback!");
+    }
+    stagingTimeline->wait(readbackValue);
+
+    size_t sampleCount = static_cast<size_t>(extent.width) * extent.height +
+                         2 * static_cast<size_t>((extent.width + 1) / 2) * ((extent.height + 1) / 2);
+    FormatKernels::downconvertRow(static_cast<const uint16_t*>(pReadbackHost), static_cast<uint8_t*>(pUploadHost), sampleCount);
+
+    lastUploadValue = stagingTimeline->nextValue();
+    VkSemaphoreSubmitInfo uploadSignals[2] = {
+        signal,
+        stagingTimeline->submitInfo(lastUploadValue, VK_PIPELINE_STAGE_2_COPY_BIT)
+    };
+    commandBufferInfo.commandBuffer = slot.uploadCommandBuffer;
+    VkSubmitInfo2 uploadInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+    uploadInfo.commandBufferInfoCount = 1;
+    uploadInfo.pCommandBufferInfos = &commandBufferInfo;
+    uploadInfo.signalSemaphoreInfoCount = 2;
+    uploadInfo.pSignalSemaphoreInfos = uploadSignals;
+    if (vulkanBase->queueSubmit(queue, 1, &uploadInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit downconvert upload!");
+    }
+}
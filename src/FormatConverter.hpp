@@ -0,0 +1,102 @@
+#pragma once
+
+#include "VulkanBase.hpp"
+#include "TimelineSemaphore.hpp"
+#include "BarrierBuilder.hpp"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Selects how 10-bit decoded pictures are converted to 8-bit for Main profile output.
+enum class DownconvertMode {
+    None,   // Encode at the source bit depth (Main10 for 10-bit sources).
+    Auto,   // Use the compute shader when the device supports it, otherwise the CPU path.
+    Gpu,    // Require the compute shader path.
+    Cpu     // Force the SIMD CPU path (readback, convert, upload).
+};
+
+// The FormatConverter class converts 10-bit 4:2:0 pictures (P010) into 8-bit NV12
+// pictures on the compute queue. The GPU path runs a compute shader over per-plane
+// storage views; the CPU fallback copies the planes into host-visible staging memory,
+// converts them with SIMD and uploads the result.
+class FormatConverter {
+public:
+    // Creates the pipeline (or staging buffers) for slotCount picture pairs of the given extent.
+    // Barriers are derived from, and recorded into, the caller's image state tracker.
+    // Throws a std::runtime_error if the requested mode cannot be supported.
+    FormatConverter(VulkanBase* vulkanBase, ImageStateTracker& imageStates, VkExtent2D extent,
+                    uint32_t slotCount, DownconvertMode mode);
+    ~FormatConverter();
+
+    // Returns true if conversions run in the compute shader.
+    bool usesGpu() const { return gpuPath; }
+
+    // Extra usage and create flags the source (10-bit) and destination (8-bit)
+    // images need for the selected path.
+    VkImageUsageFlags getSourceUsage() const;
+    VkImageUsageFlags getDestinationUsage() const;
+    VkImageCreateFlags getImageCreateFlags() const;
+
+    // How the converter reads the source picture; the decoder releases it for this access.
+    ImageAccess getSourceAccess() const { return gpuPath ? ImageAccess::ComputeRead : ImageAccess::TransferSrc; }
+
+    // How the converter writes the destination picture before releasing it to the encoder.
+    ImageAccess getDestinationAccess() const { return gpuPath ? ImageAccess::ComputeWrite : ImageAccess::TransferDst; }
+
+    // Associates a slot with its source and destination images and records its command
+    // buffers once: the source is handed over from `from`, the destination is released
+    // to the encode queue family. The buffers are reused by every submit().
+    void bindSlot(uint32_t slot, VkImage srcImage, VkImage dstImage, QueueAccess from);
+
+    // Converts the picture in a slot on the compute queue. Waits for the previous
+    // stage's timeline point and signals the signal point once the destination is in
+    // VIDEO_ENCODE_SRC layout. The CPU path blocks until the readback completes.
+    void submit(uint32_t slot, const VkSemaphoreSubmitInfo& wait, const VkSemaphoreSubmitInfo& signal);
+
+private:
+    struct Slot {
+        VkImage srcImage = VK_NULL_HANDLE;
+        VkImage dstImage = VK_NULL_HANDLE;
+        VkImageView views[4] = {};
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        // GPU path: the whole conversion. CPU path: the readback copy.
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // CPU path only: the upload copy.
+        VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+    };
+
+    VulkanBase* vulkanBase = nullptr;
+    ImageStateTracker& imageStates;
+    VkExtent2D extent{};
+    bool gpuPath = false;
+    std::vector<Slot> slots;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+
+    // --- GPU Path ---
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    // --- CPU Path ---
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackBufferMemory = VK_NULL_HANDLE;
+    void* pReadbackHost = nullptr;
+    VkBuffer uploadBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory uploadBufferMemory = VK_NULL_HANDLE;
+    void* pUploadHost = nullptr;
+    // Orders readbacks and uploads through the shared staging buffers.
+    std::unique_ptr<TimelineSemaphore> stagingTimeline;
+    uint64_t lastUploadValue = 0;
+
+    // Returns true if the device can run the conversion shader.
+    bool isGpuPathSupported() const;
+    void createGpuPipeline(uint32_t slotCount);
+    void createStagingBuffers();
+    void recordGpuCommands(Slot& slot, QueueAccess from);
+    void recordCpuCommands(Slot& slot, QueueAccess from);
+};
@@ -0,0 +1,51 @@
+#include "FormatKernels.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VT_DOWNCONVERT_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VT_DOWNCONVERT_NEON 1
+#endif
+
+namespace FormatKernels {
+
+    bool hasSimd() {
+#if defined(VT_DOWNCONVERT_SSE2) || defined(VT_DOWNCONVERT_NEON)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void downconvertRow(const uint16_t* src, uint8_t* dst, size_t count) {
+        size_t i = 0;
+#if defined(VT_DOWNCONVERT_SSE2)
+        const __m128i rounding = _mm_set1_epi16(2);
+        for (; i + 16 <= count; i += 16) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+            lo = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(lo, 6), rounding), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(hi, 6), rounding), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+#elif defined(VT_DOWNCONVERT_NEON)
+        const uint16x8_t rounding = vdupq_n_u16(2);
+        for (; i + 16 <= count; i += 16) {
+            uint16x8_t lo = vshrq_n_u16(vaddq_u16(vshrq_n_u16(vld1q_u16(src + i), 6), rounding), 2);
+            uint16x8_t hi = vshrq_n_u16(vaddq_u16(vshrq_n_u16(vld1q_u16(src + i + 8), 6), rounding), 2);
+            vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+        }
+#endif
+        downconvertRowScalar(src + i, dst + i, count - i);
+    }
+
+    void downconvertRowScalar(const uint16_t* src, uint8_t* dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = static_cast<uint8_t>(std::min<uint32_t>(((src[i] >> 6) + 2) >> 2, 255));
+        }
+    }
+
+} // namespace FormatKernels
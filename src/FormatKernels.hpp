@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The CPU kernels of the format converter. Each has a SIMD version (SSE2 or NEON,
+// whichever the target has) and a scalar one that gives the same results.
+namespace FormatKernels {
+
+    // True when the SIMD versions use vector instructions on this target.
+    bool hasSimd();
+
+    // Converts count MSB-aligned 10-bit samples into 8-bit samples with rounding,
+    // ((v >> 6) + 2) >> 2 saturated to 255. Bit-exact with the downconvert shader.
+    void downconvertRow(const uint16_t* src, uint8_t* dst, size_t count);
+    void downconvertRowScalar(const uint16_t* src, uint8_t* dst, size_t count);
+
+} // namespace FormatKernels
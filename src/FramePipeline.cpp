@@ -0,0 +1,102 @@
+#include "FramePipeline.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+FramePipeline::FramePipeline(FrameStages& stages, TaskPool& pool, size_t depth, PacketPool* payloads)
+    : stages(stages), payloads(payloads), strand(pool), slots(depth == 0 ? 1 : depth) {
+    for (Slot& slot : slots) {
+        slot.job.packet = av_packet_alloc();
+        if (!slot.job.packet) {
+            for (Slot& allocated : slots) {
+                av_packet_free(&allocated.job.packet);
+            }
+            throw std::runtime_error("Failed to allocate AVPacket");
+        }
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    failed = true;
+    // run() catches what the stages throw, so this does not.
+    strand.wait();
+    for (Slot& slot : slots) {
+        av_packet_free(&slot.job.packet);
+    }
+}
+
+void FramePipeline::push(AVPacket* packet, const FrameJob& job) {
+    Slot& slot = slots[nextSlot];
+    nextSlot = (nextSlot + 1) % slots.size();
+    if (slot.done.valid()) {
+        slot.done.wait();
+    }
+    rethrowIfFailed();
+
+    AVPacket* held = slot.job.packet;
+    slot.job = job;
+    slot.job.packet = held;
+    av_packet_move_ref(held, packet);
+    FrameJob* queued = &slot.job;
+    if (!job.video) {
+        slot.done = strand.post([this, queued] {
+            run(*queued, &FrameStages::passthrough);
+            av_packet_unref(queued->packet);
+        });
+        return;
+    }
+    if (payloads) {
+        copyPayload(slot);
+    }
+    Slot* parsed = &slot;
+    strand.post([this, parsed] {
+        run(parsed->job, &FrameStages::parse);
+        av_packet_unref(parsed->job.packet);
+        parsed->payload.reset();
+    });
+    strand.post([this, queued] { run(*queued, &FrameStages::submit); });
+    strand.post([this, queued] { run(*queued, &FrameStages::readback); });
+    slot.done = strand.post([this, queued] { run(*queued, &FrameStages::mux); });
+}
+
+void FramePipeline::finish() {
+    strand.wait();
+    rethrowIfFailed();
+}
+
+void FramePipeline::copyPayload(Slot& slot) {
+    AVPacket* packet = slot.job.packet;
+    if (packet->size <= 0 || static_cast<size_t>(packet->size) > payloads->getBufferSize()) {
+        return;
+    }
+    slot.payload = payloads->getBuffer();
+    uint8_t* data = slot.payload.data();
+    memcpy(data, packet->data, packet->size);
+    // A reused buffer holds an earlier packet's bytes where the padding goes.
+    memset(data + packet->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_buffer_unref(&packet->buf);
+    packet->data = data;
+}
+
+void FramePipeline::run(FrameJob& job, void (FrameStages::*stage)(FrameJob&)) {
+    if (failed.load(std::memory_order_acquire)) {
+        return;
+    }
+    try {
+        (stages.*stage)(job);
+    } catch (...) {
+        error = std::current_exception();
+        failed.store(true, std::memory_order_release);
+    }
+}
+
+void FramePipeline::rethrowIfFailed() const {
+    if (failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(error);
+    }
+}
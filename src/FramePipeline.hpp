@@ -0,0 +1,101 @@
+#pragma once
+
+#include "PacketPool.hpp"
+#include "TaskPool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+struct AVPacket;
+
+// A demuxed packet on its way through a transcode's stages, with what the transcode
+// thread decided about it before handing it over.
+struct FrameJob {
+    // Owned by the pipeline; blank once the packet's first stage is done. A video packet
+    // may have no buffer reference, its payload being a pooled copy.
+    AVPacket* packet = nullptr;
+    // Video packets go through the frame stages, the others through passthrough().
+    bool video = false;
+    int outputStream = -1; // Passthrough packets only.
+    int frameNumber = 0;
+    // Video packets read before this one, damaged and skipped ones included.
+    uint64_t packetIndex = 0;
+    // Encoded as an IDR starting a segment; parse() may set it too.
+    bool segmentStart = false;
+    // The decoder resets at this packet: an IDR after damaged packets.
+    bool resync = false;
+};
+
+// The CPU stages of one transcode, as FramePipeline runs them.
+class FrameStages {
+public:
+    virtual ~FrameStages() = default;
+
+    // Packs and parses the packet; the packet is released afterwards.
+    virtual void parse(FrameJob& job) = 0;
+    // Records and submits the decode, and the encodes the lookahead lets go.
+    virtual void submit(FrameJob& job) = 0;
+    // Collects the finished encodes.
+    virtual void readback(FrameJob& job) = 0;
+    // Writes the packets whose timestamps are settled.
+    virtual void mux(FrameJob& job) = 0;
+    // Hands a packet of a copied stream to the muxer.
+    virtual void passthrough(FrameJob& job) = 0;
+};
+
+// The FramePipeline class runs a transcode's stages as tasks on the shared TaskPool:
+// parse, submit, readback and mux for each video packet, each depending on the one
+// before, and passthrough for the other streams. They all go on one strand, so the
+// stages of consecutive packets never overlap and share the transcode's state without
+// locks, while the thread pushing packets demuxes and admits the next ones. At most
+// depth packets are in the pipeline; push() waits for the oldest beyond that.
+//
+// Given a PacketPool, video payloads that fit are copied into its buffers and the
+// demuxer's buffer is let go at once, so the packets in flight hold pooled memory.
+//
+// Once a stage throws, the stages still queued are skipped, and push() and finish()
+// rethrow the exception.
+class FramePipeline {
+public:
+    // Allocates depth packets. Throws a std::runtime_error on failure. payloads may be
+    // null, and must outlive the pipeline.
+    FramePipeline(FrameStages& stages, TaskPool& pool, size_t depth, PacketPool* payloads = nullptr);
+    // Skips the stages still queued, e.g. when the transcode fails before finish(), and
+    // waits for the one running.
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // Takes over packet's reference, leaving it blank, and queues the stages for it.
+    // job describes the packet; its packet field is ignored.
+    void push(AVPacket* packet, const FrameJob& job);
+    // Waits until every queued stage has run. Not to be called from a task.
+    void finish();
+
+private:
+    struct Slot {
+        FrameJob job;
+        // The pooled copy of the packet's payload, until parse() is done with it.
+        PacketBuffer payload;
+        // The slot's last stage; the slot is free again once it has run.
+        TaskHandle done;
+    };
+
+    FrameStages& stages;
+    PacketPool* payloads;
+    TaskStrand strand;
+    std::vector<Slot> slots;
+    size_t nextSlot = 0;
+    // Set by the stage that threw, which the strand runs alone.
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+
+    // Moves packet's payload into a pooled buffer, if it fits.
+    void copyPayload(Slot& slot);
+    void run(FrameJob& job, void (FrameStages::*stage)(FrameJob&));
+    void rethrowIfFailed() const;
+};
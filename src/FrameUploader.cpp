@@ -0,0 +1,307 @@
+#include "FrameUploader.hpp"
+#include "VulkanUtils.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VT_UPLOAD_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VT_UPLOAD_NEON 1
+#endif
+
+namespace {
+    // Raw input is 10-bit in the low bits; P010 keeps it in the high bits.
+    constexpr int P010_SHIFT = 6;
+
+    struct UploaderMetrics {
+        MetricCounter& bytes;
+        MetricHistogram& slotWait;
+    };
+
+    UploaderMetrics& metrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static UploaderMetrics metrics{
+            registry.counter("uploader_bytes_total", "Raw frame bytes uploaded to encoder pictures."),
+            registry.histogram("uploader_slot_wait_seconds", "Time waiting for the transfer queue to free a staging slot."),
+        };
+        return metrics;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Y4M frame headers can have any length, so 16-bit samples in the mapping may be unaligned.
+    uint16_t loadSample(const uint16_t* src) {
+        uint16_t sample;
+        memcpy(&sample, src, sizeof(sample));
+        return sample;
+    }
+
+    // Repeats the last sample, or CbCr pair, of a row up to the padded width.
+    template <typename Sample>
+    void padRow(Sample* row, size_t filled, size_t padded, size_t components) {
+        for (size_t i = filled; i < padded; i += components) {
+            memcpy(row + i, row + filled - components, components * sizeof(Sample));
+        }
+    }
+}
+
+FrameUploader::FrameUploader(VulkanBase* vulkanBase, ImageStateTracker& imageStates, const RawVideoReader& reader,
+                             VkExtent2D codedExtent, uint32_t slotCount)
+    : vulkanBase(vulkanBase), imageStates(imageStates), format(reader.getPixelFormat()),
+      width(reader.getWidth()), height(reader.getHeight()), codedExtent(codedExtent),
+      frameSize(reader.getFrameSize()) {
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    if (!qfIndices.transferFamily.has_value()) {
+        throw std::runtime_error("Raw input needs a queue family that supports transfers!");
+    }
+    if (slotCount == 0 || codedExtent.width < width || codedExtent.height < height) {
+        throw std::invalid_argument("FrameUploader: Invalid slot count or coded extent.");
+    }
+    queueFamily = qfIndices.transferFamily.value();
+    encodeFamily = qfIndices.encodeFamily.value();
+
+    // The coded extent is even, so both planes have the same row size in bytes.
+    size_t bytesPerSample = reader.getBitDepth() > 8 ? 2 : 1;
+    stagingPitch = static_cast<size_t>(codedExtent.width) * bytesPerSample;
+    chromaOffset = stagingPitch * codedExtent.height;
+    VkDeviceSize stagingSize = chromaOffset + stagingPitch * codedExtent.height / 2;
+
+    VkDevice device = vulkanBase->getDevice();
+    VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload command pool!");
+    }
+    timeline = std::make_unique<TimelineSemaphore>(device);
+
+    slots.resize(slotCount);
+    for (Slot& slot : slots) {
+        VulkanUtils::createBuffer(vulkanBase->getPhysicalDevice(), device, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot.buffer, slot.memory);
+        vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.pHost);
+
+        VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        allocInfo.commandPool = commandPool;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate upload command buffer!");
+        }
+    }
+
+    const char* queueKind = queueFamily == encodeFamily ? "encode queue"
+        : qfIndices.computeFamily == qfIndices.transferFamily ? "compute queue" : "dedicated transfer queue";
+    VT_LOG_INFO("Frame uploader: " << slotCount << " staging slots of " << (stagingSize >> 10) << " KiB on the "
+                << queueKind << " (family " << queueFamily << ")");
+}
+
+FrameUploader::~FrameUploader() {
+    VkDevice device = vulkanBase->getDevice();
+    for (Slot& slot : slots) {
+        if (slot.pHost) vkUnmapMemory(device, slot.memory);
+        vkDestroyBuffer(device, slot.buffer, nullptr);
+        vkFreeMemory(device, slot.memory, nullptr);
+    }
+    timeline.reset();
+    if (commandPool) vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+uint64_t FrameUploader::upload(const uint8_t* frame, VkImage image) {
+    // The slot's previous copy must have read the staging buffer before it is refilled.
+    Slot& slot = slots[currentSlot];
+    if (!timeline->isComplete(slot.uploadValue)) {
+        auto waitStart = std::chrono::steady_clock::now();
+        timeline->wait(slot.uploadValue);
+        double waited = secondsSince(waitStart);
+        stats.stallSeconds += waited;
+        metrics().slotWait.observe(waited);
+    }
+
+    auto copyStart = std::chrono::steady_clock::now();
+    fillStaging(frame, static_cast<uint8_t*>(slot.pHost));
+    stats.copySeconds += secondsSince(copyStart);
+
+    // The commands start by discarding the picture, so a recording can be replayed
+    // whatever the encoder left the picture in.
+    if (slot.recordedImage != image) {
+        recordCommands(slot, image);
+        slot.recordedImage = image;
+    }
+
+    slot.uploadValue = timeline->nextValue();
+    VkSemaphoreSubmitInfo signal = timeline->submitInfo(slot.uploadValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+    VkCommandBufferSubmitInfo commandBufferInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+    commandBufferInfo.commandBuffer = slot.commandBuffer;
+    VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &signal;
+    if (vulkanBase->queueSubmit(vulkanBase->getTransferQueue(), 1, &submitInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit frame upload!");
+    }
+
+    ++stats.frames;
+    stats.bytes += frameSize;
+    metrics().bytes.add(frameSize);
+    currentSlot = (currentSlot + 1) % slots.size();
+    return slot.uploadValue;
+}
+
+void FrameUploader::recordCommands(Slot& slot, VkImage image) {
+    vkResetCommandBuffer(slot.commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+    // Whole planes are copied: any queue's image transfer granularity allows that.
+    VkBufferImageCopy regions[2]{};
+    regions[0].imageSubresource = {VK_IMAGE_ASPECT_PLANE_0_BIT, 0, 0, 1};
+    regions[0].imageExtent = {codedExtent.width, codedExtent.height, 1};
+    regions[1].bufferOffset = chromaOffset;
+    regions[1].imageSubresource = {VK_IMAGE_ASPECT_PLANE_1_BIT, 0, 0, 1};
+    regions[1].imageExtent = {codedExtent.width / 2, codedExtent.height / 2, 1};
+
+    BarrierBuilder barriers(imageStates);
+    barriers.transition(image, ImageAccess::TransferDst, queueFamily, true).record(slot.commandBuffer);
+    vkCmdCopyBufferToImage(slot.commandBuffer, slot.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 2, regions);
+    barriers.release(image, ImageAccess::EncodeSrc, encodeFamily).record(slot.commandBuffer);
+
+    vkEndCommandBuffer(slot.commandBuffer);
+}
+
+void FrameUploader::fillStaging(const uint8_t* frame, uint8_t* staging) const {
+    bool tenBit = format == RawPixelFormat::I420P10 || format == RawPixelFormat::P010;
+    size_t bytesPerSample = tenBit ? 2 : 1;
+    size_t chromaWidth = (width + 1) / 2;
+    size_t chromaHeight = (height + 1) / 2;
+    size_t lumaRowSize = width * bytesPerSample;
+    size_t chromaRowSize = chromaWidth * bytesPerSample;
+    const uint8_t* srcChroma = frame + lumaRowSize * height;
+    // Second chroma plane of the three-plane layouts.
+    const uint8_t* srcCr = srcChroma + chromaRowSize * chromaHeight;
+    uint8_t* dstChroma = staging + chromaOffset;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* src = frame + y * lumaRowSize;
+        uint8_t* dst = staging + y * stagingPitch;
+        if (format == RawPixelFormat::I420P10) {
+            shiftToMsb(reinterpret_cast<const uint16_t*>(src), reinterpret_cast<uint16_t*>(dst), width);
+        } else {
+            memcpy(dst, src, lumaRowSize);
+        }
+        if (tenBit) {
+            padRow(reinterpret_cast<uint16_t*>(dst), width, codedExtent.width, 1);
+        } else {
+            padRow(dst, width, codedExtent.width, 1);
+        }
+    }
+    for (uint32_t y = height; y < codedExtent.height; ++y) {
+        memcpy(staging + y * stagingPitch, staging + (height - 1) * stagingPitch, stagingPitch);
+    }
+
+    for (size_t y = 0; y < chromaHeight; ++y) {
+        uint8_t* dst = dstChroma + y * stagingPitch;
+        switch (format) {
+        case RawPixelFormat::Nv12:
+        case RawPixelFormat::P010:
+            memcpy(dst, srcChroma + y * 2 * chromaRowSize, 2 * chromaRowSize);
+            break;
+        case RawPixelFormat::I420:
+            interleaveChroma(srcChroma + y * chromaRowSize, srcCr + y * chromaRowSize, dst, chromaWidth);
+            break;
+        case RawPixelFormat::I420P10:
+            interleaveChroma10(reinterpret_cast<const uint16_t*>(srcChroma + y * chromaRowSize),
+                               reinterpret_cast<const uint16_t*>(srcCr + y * chromaRowSize),
+                               reinterpret_cast<uint16_t*>(dst), chromaWidth);
+            break;
+        default:
+            throw std::logic_error("FrameUploader: No pixel format.");
+        }
+        if (tenBit) {
+            padRow(reinterpret_cast<uint16_t*>(dst), 2 * chromaWidth, codedExtent.width, 2);
+        } else {
+            padRow(dst, 2 * chromaWidth, codedExtent.width, 2);
+        }
+    }
+    for (size_t y = chromaHeight; y < codedExtent.height / 2; ++y) {
+        memcpy(dstChroma + y * stagingPitch, dstChroma + (chromaHeight - 1) * stagingPitch, stagingPitch);
+    }
+}
+
+void FrameUploader::printStats() const {
+    if (stats.frames == 0) {
+        return;
+    }
+    VT_LOG_INFO("Upload: " << stats.frames << " frames, " << (stats.bytes >> 20) << " MiB at "
+                << stats.gigabytesPerSecond() << " GB/s (staging copy "
+                << (stats.copySeconds > 0.0 ? stats.bytes / stats.copySeconds / 1e9 : 0.0) << " GB/s, "
+                << stats.stallSeconds * 1000.0 << " ms waiting for the transfer queue)");
+}
+
+void FrameUploader::interleaveChroma(const uint8_t* cb, const uint8_t* cr, uint8_t* cbcr, size_t count) {
+    size_t i = 0;
+#if defined(VT_UPLOAD_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + i));
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cbcr + 2 * i), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cbcr + 2 * i + 16), _mm_unpackhi_epi8(u, v));
+    }
+#elif defined(VT_UPLOAD_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs = { { vld1q_u8(cb + i), vld1q_u8(cr + i) } };
+        vst2q_u8(cbcr + 2 * i, pairs);
+    }
+#endif
+    for (; i < count; ++i) {
+        cbcr[2 * i] = cb[i];
+        cbcr[2 * i + 1] = cr[i];
+    }
+}
+
+void FrameUploader::interleaveChroma10(const uint16_t* cb, const uint16_t* cr, uint16_t* cbcr, size_t count) {
+    size_t i = 0;
+#if defined(VT_UPLOAD_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i u = _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + i)), P010_SHIFT);
+        __m128i v = _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cr + i)), P010_SHIFT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cbcr + 2 * i), _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cbcr + 2 * i + 8), _mm_unpackhi_epi16(u, v));
+    }
+#elif defined(VT_UPLOAD_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8x2_t pairs = { { vshlq_n_u16(vld1q_u16(cb + i), P010_SHIFT), vshlq_n_u16(vld1q_u16(cr + i), P010_SHIFT) } };
+        vst2q_u16(cbcr + 2 * i, pairs);
+    }
+#endif
+    for (; i < count; ++i) {
+        cbcr[2 * i] = static_cast<uint16_t>(loadSample(cb + i) << P010_SHIFT);
+        cbcr[2 * i + 1] = static_cast<uint16_t>(loadSample(cr + i) << P010_SHIFT);
+    }
+}
+
+void FrameUploader::shiftToMsb(const uint16_t* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#if defined(VT_UPLOAD_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_slli_epi16(samples, P010_SHIFT));
+    }
+#elif defined(VT_UPLOAD_NEON)
+    for (; i + 8 <= count; i += 8) {
+        vst1q_u16(dst + i, vshlq_n_u16(vld1q_u16(src + i), P010_SHIFT));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = static_cast<uint16_t>(loadSample(src + i) << P010_SHIFT);
+    }
+}
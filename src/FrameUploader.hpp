@@ -0,0 +1,103 @@
+#pragma once
+
+#include "VulkanBase.hpp"
+#include "TimelineSemaphore.hpp"
+#include "BarrierBuilder.hpp"
+#include "RawVideoReader.hpp"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Totals over the frames uploaded so far.
+struct UploadStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    // CPU time copying frames into staging memory, which includes reading them from disk.
+    double copySeconds = 0.0;
+    // Time spent waiting for the transfer queue to free a staging slot.
+    double stallSeconds = 0.0;
+
+    // Rate at which frames went into the upload path, stalls included.
+    double gigabytesPerSecond() const {
+        double seconds = copySeconds + stallSeconds;
+        return seconds > 0.0 ? bytes / seconds / 1e9 : 0.0;
+    }
+};
+
+// The FrameUploader class copies raw frames into encoder input pictures on the transfer
+// queue. Each frame is written into the next slot of a ring of host-visible staging
+// buffers, converted to the picture's NV12 or P010 layout on the way, and copied into
+// the picture by a command buffer that releases it to the encode queue. With two or
+// more slots, the CPU fills one slot while the transfer queue copies the previous one
+// and the encoder works on the frame before that.
+class FrameUploader {
+public:
+    // Creates slotCount staging slots for frames of the reader's size and layout, laid
+    // out at the pictures' coded extent. Throws a std::runtime_error if the device has
+    // no queue family that can copy.
+    FrameUploader(VulkanBase* vulkanBase, ImageStateTracker& imageStates, const RawVideoReader& reader,
+                  VkExtent2D codedExtent, uint32_t slotCount);
+    ~FrameUploader();
+
+    FrameUploader(const FrameUploader&) = delete;
+    FrameUploader& operator=(const FrameUploader&) = delete;
+
+    // Extra usage the encoder input pictures need.
+    static VkImageUsageFlags getPictureUsage() { return VK_IMAGE_USAGE_TRANSFER_DST_BIT; }
+
+    // How the uploader leaves a picture for the encoder to acquire.
+    QueueAccess getHandoff() const { return { ImageAccess::TransferDst, queueFamily }; }
+
+    // Uploads a frame of the reader's layout into image and submits the copy. Returns
+    // the upload timeline value at which the picture is released to the encode queue.
+    uint64_t upload(const uint8_t* frame, VkImage image);
+
+    const TimelineSemaphore& getTimeline() const { return *timeline; }
+    const UploadStats& getStats() const { return stats; }
+    void printStats() const;
+
+    // Interleaves count Cb and Cr samples into CbCr pairs.
+    static void interleaveChroma(const uint8_t* cb, const uint8_t* cr, uint8_t* cbcr, size_t count);
+    // The same for 10-bit samples in the low bits, moving them to the high bits (P010).
+    static void interleaveChroma10(const uint16_t* cb, const uint16_t* cr, uint16_t* cbcr, size_t count);
+    // Moves count 10-bit samples from the low to the high bits.
+    static void shiftToMsb(const uint16_t* src, uint16_t* dst, size_t count);
+
+private:
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* pHost = nullptr;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // The slot may be refilled once the timeline reaches uploadValue.
+        uint64_t uploadValue = 0;
+        // What the cached command buffer copies into.
+        VkImage recordedImage = VK_NULL_HANDLE;
+    };
+
+    VulkanBase* vulkanBase = nullptr;
+    ImageStateTracker& imageStates;
+    RawPixelFormat format;
+    uint32_t width;
+    uint32_t height;
+    VkExtent2D codedExtent;
+    uint32_t queueFamily;
+    uint32_t encodeFamily;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    std::unique_ptr<TimelineSemaphore> timeline;
+    std::vector<Slot> slots;
+    uint32_t currentSlot = 0;
+    size_t frameSize;
+    // Bytes per staging row of either plane, and the offset of the CbCr plane.
+    size_t stagingPitch;
+    size_t chromaOffset;
+    UploadStats stats;
+
+    // Writes a frame in the reader's layout to staging memory in the picture's layout,
+    // repeating the last column and row into the padding up to the coded extent.
+    void fillStaging(const uint8_t* frame, uint8_t* staging) const;
+    void recordCommands(Slot& slot, VkImage image);
+};
@@ -1,19 +1,40 @@
 #include "H264Demuxer.hpp"
-#include <iostream>
+#include "Log.hpp"
+#include <algorithm>
 
 // The FFmpeg headers must be wrapped in extern "C" because they are C libraries.
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
 }
 
+// Probe limits used when the container header already describes the video stream.
+// FFmpeg's defaults (5 MB, 5 s) are sized for raw streams without a header.
+constexpr int64_t HEADER_PROBE_SIZE = 512 * 1024;
+constexpr int64_t HEADER_ANALYZE_DURATION_US = 500000;
+
 // Constructor: Opens the input file and initializes the demuxer.
-H264Demuxer::H264Demuxer(const std::string& filepath) {
+H264Demuxer::H264Demuxer(const std::string& filepath) : filepath(filepath) {
     // Open the input file and read its header to fill the format context.
     if (avformat_open_input(&formatContext, filepath.c_str(), nullptr, nullptr) != 0) {
         throw std::runtime_error("FFmpeg: Could not open input file: " + filepath);
     }
 
+    // With SPS/PPS extradata and a size from the header (MP4, MKV), stream info only
+    // has to fill in details such as the pixel format, which the first frames give.
+    bool headerDescribesVideo = false;
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+        const AVCodecParameters* parameters = formatContext->streams[i]->codecpar;
+        if (parameters->codec_id == AV_CODEC_ID_H264 && parameters->extradata_size > 0 && parameters->width > 0) {
+            headerDescribesVideo = true;
+        }
+    }
+    if (headerDescribesVideo) {
+        formatContext->probesize = std::min<int64_t>(formatContext->probesize, HEADER_PROBE_SIZE);
+        formatContext->max_analyze_duration = HEADER_ANALYZE_DURATION_US;
+    }
+
     // Read packets from the media file to get stream information.
     if (avformat_find_stream_info(formatContext, nullptr) < 0) {
         avformat_close_input(&formatContext); // Clean up on failure
@@ -42,15 +63,65 @@ H264Demuxer::H264Demuxer(const std::string& filepath) {
     // as it's needed to initialize the Vulkan video session.
     if (codecParameters->extradata_size > 0) {
         sps_pps_data.assign(codecParameters->extradata, codecParameters->extradata + codecParameters->extradata_size);
-        std::cout << "Demuxer: Found " << sps_pps_data.size() << " bytes of SPS/PPS extradata." << std::endl;
+    }
+
+    parseFormatInfo();
+}
+
+// Printed separately from the constructor so a demuxer opened on another thread does
+// not interleave its output with the device set-up.
+void H264Demuxer::printSummary() const {
+    if (!sps_pps_data.empty()) {
+        VT_LOG_INFO("Demuxer: Found " << sps_pps_data.size() << " bytes of SPS/PPS extradata.");
     } else {
         // While not ideal, some streams might have SPS/PPS in-band. This implementation
         // relies on it being in the container header (extradata).
-        std::cout << "Warning: No SPS/PPS extradata found in container header." << std::endl;
+        VT_LOG_WARNING("Warning: No SPS/PPS extradata found in container header.");
+    }
+    if (!spsParsed) {
+        VT_LOG_WARNING("Warning: Could not parse SPS, using container pixel format.");
     }
 
-    std::cout << "Demuxer initialized for file: " << filepath << std::endl;
-    std::cout << "Video Resolution: " << getWidth() << "x" << getHeight() << std::endl;
+    VT_LOG_INFO("Demuxer initialized for file: " << filepath);
+    VT_LOG_INFO("Video Resolution: " << getWidth() << "x" << getHeight());
+    Timebase frameRate = getFrameRate();
+    VT_LOG_INFO("Video Timing: time base " << getTimebase().num << "/" << getTimebase().den << ", "
+                << static_cast<double>(frameRate.num) / frameRate.den << " fps, reorder delay "
+                << getReorderDelay());
+    VT_LOG_INFO("Video Format: " << spsInfo.bitDepthLuma << "-bit, chroma_format_idc "
+                << spsInfo.chromaFormatIdc);
+}
+
+// Parses the SPS from the avcC extradata to find the coded bit depth and chroma format.
+void H264Demuxer::parseFormatInfo() {
+    std::vector<std::vector<uint8_t>> spsList;
+    std::vector<std::vector<uint8_t>> ppsList;
+    bool avcC = H264Parser::parseAvcC(sps_pps_data, spsList, ppsList, nalLengthSize);
+    if (!avcC) {
+        nalLengthSize = 0;
+    }
+    if (avcC && !spsList.empty() && H264Parser::parseSps(spsList[0].data(), spsList[0].size(), spsInfo)) {
+        spsParsed = true;
+        return;
+    }
+
+    // No usable SPS in the header: derive the format from the pixel format FFmpeg probed.
+    spsInfo = H264SpsInfo{};
+    spsInfo.profileIdc = codecParameters->profile > 0 ? codecParameters->profile & 0xff : 100;
+    spsInfo.width = codecParameters->width;
+    spsInfo.height = codecParameters->height;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(codecParameters->format));
+    if (desc) {
+        spsInfo.bitDepthLuma = desc->comp[0].depth;
+        spsInfo.bitDepthChroma = desc->nb_components > 1 ? desc->comp[1].depth : desc->comp[0].depth;
+        if (desc->nb_components == 1) {
+            spsInfo.chromaFormatIdc = 0;
+        } else if (desc->log2_chroma_w == 0) {
+            spsInfo.chromaFormatIdc = 3;
+        } else if (desc->log2_chroma_h == 0) {
+            spsInfo.chromaFormatIdc = 2;
+        }
+    }
 }
 
 // Destructor: Ensures the format context is properly closed to free resources.
@@ -75,6 +146,42 @@ bool H264Demuxer::getNextPacket(AVPacket* packet) {
     return false;
 }
 
+// Reads one packet of any stream.
+bool H264Demuxer::readPacket(AVPacket* packet) {
+    return av_read_frame(formatContext, packet) >= 0;
+}
+
+// Seeks by the video stream's index; the container moves the other streams along.
+void H264Demuxer::seekVideo(int64_t dts) {
+    if (av_seek_frame(formatContext, videoStreamIndex, dts, AVSEEK_FLAG_BACKWARD) < 0) {
+        throw std::runtime_error("FFmpeg: Could not seek in " + filepath);
+    }
+}
+
+// Without a lower bound below pts, av_seek_frame() is asked for the keyframe after it.
+bool H264Demuxer::seekToKeyframe(int64_t pts) {
+    return avformat_seek_file(formatContext, videoStreamIndex, pts, pts, INT64_MAX, 0) >= 0;
+}
+
+void H264Demuxer::setKeyframesOnly() {
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+        formatContext->streams[i]->discard = static_cast<int>(i) == videoStreamIndex ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+    }
+}
+
+// Accessor for the stream count.
+int H264Demuxer::getStreamCount() const {
+    return static_cast<int>(formatContext->nb_streams);
+}
+
+// Accessor for a stream by index.
+const AVStream* H264Demuxer::getStream(int index) const {
+    if (index < 0 || index >= getStreamCount()) {
+        throw std::out_of_range("Demuxer: Stream index out of range");
+    }
+    return formatContext->streams[index];
+}
+
 // Accessor for video width.
 int H264Demuxer::getWidth() const {
     return codecParameters ? codecParameters->width : 0;
@@ -85,3 +192,42 @@ int H264Demuxer::getHeight() const {
     return codecParameters ? codecParameters->height : 0;
 }
 
+
+// Accessor for the packet time base.
+Timebase H264Demuxer::getTimebase() const {
+    AVRational timebase = formatContext->streams[videoStreamIndex]->time_base;
+    return {timebase.num, timebase.den};
+}
+
+// Accessor for the frame rate.
+Timebase H264Demuxer::getFrameRate() const {
+    const AVStream* stream = formatContext->streams[videoStreamIndex];
+    for (AVRational rate : {stream->avg_frame_rate, stream->r_frame_rate}) {
+        if (rate.num > 0 && rate.den > 0) {
+            return {rate.num, rate.den};
+        }
+    }
+    return {30, 1};
+}
+
+// Frame count from the stream header, else from the duration.
+uint64_t H264Demuxer::getFrameCountEstimate() const {
+    const AVStream* stream = formatContext->streams[videoStreamIndex];
+    if (stream->nb_frames > 0) {
+        return static_cast<uint64_t>(stream->nb_frames);
+    }
+    Timebase frameRate = getFrameRate();
+    AVRational frameTime = av_make_q(frameRate.den, frameRate.num);
+    if (stream->duration > 0) {
+        return static_cast<uint64_t>(av_rescale_q(stream->duration, stream->time_base, frameTime));
+    }
+    if (formatContext->duration > 0) {
+        return static_cast<uint64_t>(av_rescale_q(formatContext->duration, AV_TIME_BASE_Q, frameTime));
+    }
+    return 0;
+}
+
+// Accessor for the B-frame reordering delay.
+uint32_t H264Demuxer::getReorderDelay() const {
+    return codecParameters && codecParameters->video_delay > 0 ? static_cast<uint32_t>(codecParameters->video_delay) : 0;
+}
@@ -5,12 +5,16 @@
 #include <stdexcept>
 #include <cstdint> // <--- FIX: Added this include for uint8_t
 
+#include "H264Parser.hpp"
+#include "TimestampTracker.hpp"
+
 // Forward declarations for FFmpeg types to avoid including FFmpeg headers
 // in a public C++ header file. This is good practice to reduce compile times
 // and hide implementation details.
 struct AVFormatContext;
 struct AVPacket;
 struct AVCodecParameters;
+struct AVStream;
 
 // The H264Demuxer class encapsulates all interactions with the FFmpeg libraries
 // for the purpose of reading an H.264 video file.
@@ -23,15 +27,41 @@ public:
     // Destructor: Cleans up all allocated FFmpeg resources.
     ~H264Demuxer();
 
+    // Prints the stream format and any header warnings to the console.
+    void printSummary() const;
+
     // Reads the next compressed video frame from the file into the provided AVPacket.
     // Returns true if a packet was successfully read, false if the end of the file is reached.
     bool getNextPacket(AVPacket* packet);
 
+    // Reads the next packet of any stream, in container order, for callers that pass
+    // the other streams through. Returns false at the end of the file.
+    bool readPacket(AVPacket* packet);
+
+    // Seeks every stream to the video keyframe at or before dts, in the video stream's
+    // time base. Throws a std::runtime_error if the container cannot seek.
+    void seekVideo(int64_t dts);
+
+    // Seeks to the first video keyframe at or after pts, in the video stream's time
+    // base. Returns false if the container cannot seek there; reading continues from
+    // where it was.
+    bool seekToKeyframe(int64_t pts);
+
+    // Makes getNextPacket() return only video keyframes; containers with an index
+    // skip the other packets without reading them.
+    void setKeyframesOnly();
+
+    const std::string& getFilePath() const { return filepath; }
+
     // --- Accessors for Video Stream Information ---
 
     // Returns the index of the video stream within the container file.
     int getVideoStreamIndex() const { return videoStreamIndex; }
 
+    // Returns the number of streams in the container and one of them by index.
+    int getStreamCount() const;
+    const AVStream* getStream(int index) const;
+
     // Returns a vector containing the raw SPS (Sequence Parameter Set) and
     // PPS (Picture Parameter Set) data, which is required by the Vulkan decoder.
     const std::vector<uint8_t>& getSpsPpsData() const { return sps_pps_data; }
@@ -46,7 +76,36 @@ public:
     // Returns the height of the video.
     int getHeight() const;
 
+    // Returns the time base of the video stream's packet timestamps.
+    Timebase getTimebase() const;
+
+    // Returns the average frame rate of the video stream, falling back to the
+    // container's base rate and finally to 30 fps when neither is known.
+    Timebase getFrameRate() const;
+
+    // Returns the number of frames the decoder holds back to reorder B-frames.
+    uint32_t getReorderDelay() const;
+
+    // Returns the number of video frames from the container, or estimated from the
+    // duration and frame rate; 0 if neither is known.
+    uint64_t getFrameCountEstimate() const;
+
+    // Returns the parsed SPS. Falls back to the container's pixel format
+    // when the SPS is not available in the extradata.
+    const H264SpsInfo& getSpsInfo() const { return spsInfo; }
+
+    // Returns the luma bit depth of the coded video (8, 10, ...).
+    uint32_t getBitDepth() const { return spsInfo.bitDepthLuma; }
+
+    // Returns the chroma_format_idc of the coded video (1 = 4:2:0, 2 = 4:2:2, 3 = 4:4:4).
+    uint32_t getChromaFormatIdc() const { return spsInfo.chromaFormatIdc; }
+
+    // Returns the size of the NAL length prefixes in packets (1-4), or 0 for Annex B start codes.
+    uint32_t getNalLengthSize() const { return nalLengthSize; }
+
 private:
+    std::string filepath;
+
     // --- Private FFmpeg Handles ---
     AVFormatContext* formatContext = nullptr;
     int videoStreamIndex = -1;
@@ -55,5 +114,15 @@ private:
     // --- Private Data Storage ---
     // Stores the H.264 extradata, which typically contains the SPS and PPS NAL units.
     std::vector<uint8_t> sps_pps_data;
+
+    // Format information taken from the first SPS in the extradata.
+    H264SpsInfo spsInfo;
+    // False when spsInfo was derived from the container's pixel format instead.
+    bool spsParsed = false;
+    // From the avcC record; packets without one use Annex B start codes.
+    uint32_t nalLengthSize = 0;
+
+    // Fills spsInfo from the extradata, or from the codec parameters if no SPS is present.
+    void parseFormatInfo();
 };
 
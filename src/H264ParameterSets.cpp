@@ -0,0 +1,589 @@
+#include "H264ParameterSets.hpp"
+#include "H264Parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    // Parsed sets kept per kind before the cache is cleared; streams rarely use more than a few.
+    constexpr size_t MAX_CACHED_SETS = 64;
+
+    // FNV-1a over the NAL unit, header included.
+    uint64_t hashNal(const uint8_t* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool sameNal(const std::vector<uint8_t>& cached, const uint8_t* data, size_t size) {
+        return cached.size() == size && memcmp(cached.data(), data, size) == 0;
+    }
+
+    uint32_t ppsKey(const StdVideoH264PictureParameterSet& pps) {
+        return (static_cast<uint32_t>(pps.seq_parameter_set_id) << 8) | pps.pic_parameter_set_id;
+    }
+
+    // level_idc is ten times the level number; level 1b (9) is decoded as level 1.1.
+    StdVideoH264LevelIdc toStdLevel(uint32_t levelIdc) {
+        switch (levelIdc) {
+        case 10: return STD_VIDEO_H264_LEVEL_IDC_1_0;
+        case 9:
+        case 11: return STD_VIDEO_H264_LEVEL_IDC_1_1;
+        case 12: return STD_VIDEO_H264_LEVEL_IDC_1_2;
+        case 13: return STD_VIDEO_H264_LEVEL_IDC_1_3;
+        case 20: return STD_VIDEO_H264_LEVEL_IDC_2_0;
+        case 21: return STD_VIDEO_H264_LEVEL_IDC_2_1;
+        case 22: return STD_VIDEO_H264_LEVEL_IDC_2_2;
+        case 30: return STD_VIDEO_H264_LEVEL_IDC_3_0;
+        case 31: return STD_VIDEO_H264_LEVEL_IDC_3_1;
+        case 32: return STD_VIDEO_H264_LEVEL_IDC_3_2;
+        case 40: return STD_VIDEO_H264_LEVEL_IDC_4_0;
+        case 41: return STD_VIDEO_H264_LEVEL_IDC_4_1;
+        case 42: return STD_VIDEO_H264_LEVEL_IDC_4_2;
+        case 50: return STD_VIDEO_H264_LEVEL_IDC_5_0;
+        case 51: return STD_VIDEO_H264_LEVEL_IDC_5_1;
+        case 52: return STD_VIDEO_H264_LEVEL_IDC_5_2;
+        case 60: return STD_VIDEO_H264_LEVEL_IDC_6_0;
+        case 61: return STD_VIDEO_H264_LEVEL_IDC_6_1;
+        case 62: return STD_VIDEO_H264_LEVEL_IDC_6_2;
+        default: return STD_VIDEO_H264_LEVEL_IDC_INVALID;
+        }
+    }
+
+    // Reads scaling_list() in bitstream (zig-zag) order, which is the order Vulkan takes.
+    // Returns true when the list signals the default matrix.
+    bool readScalingList(BitReader& reader, uint8_t* list, uint32_t listSize) {
+        int32_t lastScale = 8;
+        int32_t nextScale = 8;
+        bool useDefault = false;
+        for (uint32_t j = 0; j < listSize; ++j) {
+            if (nextScale != 0) {
+                int32_t deltaScale = reader.readSE();
+                nextScale = (lastScale + deltaScale + 256) % 256;
+                useDefault = j == 0 && nextScale == 0;
+            }
+            list[j] = static_cast<uint8_t>(nextScale == 0 ? lastScale : nextScale);
+            lastScale = list[j];
+        }
+        return useDefault;
+    }
+
+    // Lists 0-5 are 4x4 and the rest 8x8, numbered as the mask bits.
+    void readScalingLists(BitReader& reader, uint32_t listCount, StdVideoH264ScalingLists& lists) {
+        for (uint32_t i = 0; i < listCount; ++i) {
+            if (!reader.readFlag()) {
+                continue;
+            }
+            lists.scaling_list_present_mask |= 1u << i;
+            bool useDefault = i < 6 ? readScalingList(reader, lists.ScalingList4x4[i], 16)
+                                    : readScalingList(reader, lists.ScalingList8x8[i - 6], 64);
+            if (useDefault) {
+                lists.use_default_scaling_matrix_mask |= 1u << i;
+            }
+        }
+    }
+
+    uint32_t readBits32(BitReader& reader) {
+        uint32_t high = reader.readBits(16);
+        return (high << 16) | reader.readBits(16);
+    }
+
+    void readHrdParameters(BitReader& reader, StdVideoH264HrdParameters& hrd) {
+        uint32_t cpbCount = reader.readUE() + 1;
+        if (cpbCount > STD_VIDEO_H264_CPB_CNT_LIST_SIZE) {
+            cpbCount = STD_VIDEO_H264_CPB_CNT_LIST_SIZE;
+        }
+        hrd.cpb_cnt_minus1 = static_cast<uint8_t>(cpbCount - 1);
+        hrd.bit_rate_scale = static_cast<uint8_t>(reader.readBits(4));
+        hrd.cpb_size_scale = static_cast<uint8_t>(reader.readBits(4));
+        for (uint32_t i = 0; i < cpbCount; ++i) {
+            hrd.bit_rate_value_minus1[i] = reader.readUE();
+            hrd.cpb_size_value_minus1[i] = reader.readUE();
+            hrd.cbr_flag[i] = reader.readFlag();
+        }
+        hrd.initial_cpb_removal_delay_length_minus1 = reader.readBits(5);
+        hrd.cpb_removal_delay_length_minus1 = reader.readBits(5);
+        hrd.dpb_output_delay_length_minus1 = reader.readBits(5);
+        hrd.time_offset_length = reader.readBits(5);
+    }
+
+    void readVui(BitReader& reader, H264SequenceParameterSet& sps) {
+        StdVideoH264SequenceParameterSetVui& vui = sps.vui;
+        vui.flags.aspect_ratio_info_present_flag = reader.readFlag();
+        if (vui.flags.aspect_ratio_info_present_flag) {
+            vui.aspect_ratio_idc = static_cast<StdVideoH264AspectRatioIdc>(reader.readBits(8));
+            if (vui.aspect_ratio_idc == STD_VIDEO_H264_ASPECT_RATIO_IDC_EXTENDED_SAR) {
+                vui.sar_width = static_cast<uint16_t>(reader.readBits(16));
+                vui.sar_height = static_cast<uint16_t>(reader.readBits(16));
+            }
+        }
+        vui.flags.overscan_info_present_flag = reader.readFlag();
+        if (vui.flags.overscan_info_present_flag) {
+            vui.flags.overscan_appropriate_flag = reader.readFlag();
+        }
+        vui.flags.video_signal_type_present_flag = reader.readFlag();
+        if (vui.flags.video_signal_type_present_flag) {
+            vui.video_format = static_cast<uint8_t>(reader.readBits(3));
+            vui.flags.video_full_range_flag = reader.readFlag();
+            vui.flags.color_description_present_flag = reader.readFlag();
+            if (vui.flags.color_description_present_flag) {
+                vui.colour_primaries = static_cast<uint8_t>(reader.readBits(8));
+                vui.transfer_characteristics = static_cast<uint8_t>(reader.readBits(8));
+                vui.matrix_coefficients = static_cast<uint8_t>(reader.readBits(8));
+            }
+        }
+        vui.flags.chroma_loc_info_present_flag = reader.readFlag();
+        if (vui.flags.chroma_loc_info_present_flag) {
+            vui.chroma_sample_loc_type_top_field = static_cast<uint8_t>(reader.readUE());
+            vui.chroma_sample_loc_type_bottom_field = static_cast<uint8_t>(reader.readUE());
+        }
+        vui.flags.timing_info_present_flag = reader.readFlag();
+        if (vui.flags.timing_info_present_flag) {
+            vui.num_units_in_tick = readBits32(reader);
+            vui.time_scale = readBits32(reader);
+            vui.flags.fixed_frame_rate_flag = reader.readFlag();
+        }
+        // Vulkan takes one set of HRD parameters: the NAL ones when both are present.
+        vui.flags.nal_hrd_parameters_present_flag = reader.readFlag();
+        if (vui.flags.nal_hrd_parameters_present_flag) {
+            readHrdParameters(reader, sps.hrd);
+        }
+        vui.flags.vcl_hrd_parameters_present_flag = reader.readFlag();
+        if (vui.flags.vcl_hrd_parameters_present_flag) {
+            StdVideoH264HrdParameters vclHrd{};
+            readHrdParameters(reader, vui.flags.nal_hrd_parameters_present_flag ? vclHrd : sps.hrd);
+        }
+        if (vui.flags.nal_hrd_parameters_present_flag || vui.flags.vcl_hrd_parameters_present_flag) {
+            reader.readFlag(); // low_delay_hrd_flag
+            vui.pHrdParameters = &sps.hrd;
+        }
+        reader.readFlag(); // pic_struct_present_flag
+        vui.flags.bitstream_restriction_flag = reader.readFlag();
+        if (vui.flags.bitstream_restriction_flag) {
+            reader.readFlag(); // motion_vectors_over_pic_boundaries_flag
+            reader.readUE();   // max_bytes_per_pic_denom
+            reader.readUE();   // max_bits_per_mb_denom
+            reader.readUE();   // log2_max_mv_length_horizontal
+            reader.readUE();   // log2_max_mv_length_vertical
+            vui.max_num_reorder_frames = static_cast<uint8_t>(reader.readUE());
+            vui.max_dec_frame_buffering = static_cast<uint8_t>(reader.readUE());
+        }
+    }
+}
+
+// Vulkan Video only names Baseline, Main, High and High 4:4:4 Predictive. The High 10
+// and High 4:2:2 profiles, and their intra variants, are subsets of High 4:4:4
+// Predictive, and of High when the stream only uses 8-bit 4:2:0. Extended and the
+// scalable and multiview profiles have no Vulkan equivalent.
+StdVideoH264ProfileIdc H264ParameterSets::toStdProfile(uint32_t profileIdc, uint32_t chromaFormatIdc,
+                                                       uint32_t bitDepth) {
+    switch (profileIdc) {
+    case 66: return STD_VIDEO_H264_PROFILE_IDC_BASELINE;
+    case 77: return STD_VIDEO_H264_PROFILE_IDC_MAIN;
+    case 100: return STD_VIDEO_H264_PROFILE_IDC_HIGH;
+    case 110:
+    case 122:
+        if (chromaFormatIdc == 1 && bitDepth == 8) {
+            return STD_VIDEO_H264_PROFILE_IDC_HIGH;
+        }
+        return STD_VIDEO_H264_PROFILE_IDC_HIGH_444_PREDICTIVE;
+    case 44:
+    case 244: return STD_VIDEO_H264_PROFILE_IDC_HIGH_444_PREDICTIVE;
+    default: return STD_VIDEO_H264_PROFILE_IDC_INVALID;
+    }
+}
+
+const char* H264ParameterSets::parseSps(const uint8_t* nal, size_t size, H264SequenceParameterSet& out) {
+    if (size < 4 || (nal[0] & 0x1f) != H264Parser::NAL_SPS) {
+        return "not an SPS";
+    }
+    std::vector<uint8_t> rbsp = H264Parser::unescapeRbsp(nal + 1, size - 1);
+    BitReader reader(rbsp.data(), rbsp.size());
+    StdVideoH264SequenceParameterSet& sps = out.std;
+
+    uint32_t profileIdc = reader.readBits(8);
+    sps.flags.constraint_set0_flag = reader.readFlag();
+    sps.flags.constraint_set1_flag = reader.readFlag();
+    sps.flags.constraint_set2_flag = reader.readFlag();
+    sps.flags.constraint_set3_flag = reader.readFlag();
+    sps.flags.constraint_set4_flag = reader.readFlag();
+    sps.flags.constraint_set5_flag = reader.readFlag();
+    reader.readBits(2); // reserved_zero_2bits
+    sps.level_idc = toStdLevel(reader.readBits(8));
+    uint32_t spsId = reader.readUE();
+    if (spsId >= MAX_SPS_COUNT) {
+        return "seq_parameter_set_id out of range";
+    }
+    sps.seq_parameter_set_id = static_cast<uint8_t>(spsId);
+
+    uint32_t chromaFormatIdc = 1;
+    switch (profileIdc) {
+        case 100: case 110: case 122: case 244: case 44:
+        case 83: case 86: case 118: case 128: case 138:
+        case 139: case 134: case 135: {
+            chromaFormatIdc = reader.readUE();
+            if (chromaFormatIdc == 3) {
+                sps.flags.separate_colour_plane_flag = reader.readFlag();
+            }
+            sps.bit_depth_luma_minus8 = static_cast<uint8_t>(reader.readUE());
+            sps.bit_depth_chroma_minus8 = static_cast<uint8_t>(reader.readUE());
+            sps.flags.qpprime_y_zero_transform_bypass_flag = reader.readFlag();
+            sps.flags.seq_scaling_matrix_present_flag = reader.readFlag();
+            if (sps.flags.seq_scaling_matrix_present_flag) {
+                readScalingLists(reader, chromaFormatIdc != 3 ? 8 : 12, out.scalingLists);
+                sps.pScalingLists = &out.scalingLists;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (chromaFormatIdc > 3) {
+        return "invalid chroma_format_idc";
+    }
+    sps.chroma_format_idc = static_cast<StdVideoH264ChromaFormatIdc>(chromaFormatIdc);
+
+    sps.log2_max_frame_num_minus4 = static_cast<uint8_t>(reader.readUE());
+    uint32_t pocType = reader.readUE();
+    if (pocType > 2) {
+        return "invalid pic_order_cnt_type";
+    }
+    sps.pic_order_cnt_type = static_cast<StdVideoH264PocType>(pocType);
+    if (pocType == 0) {
+        sps.log2_max_pic_order_cnt_lsb_minus4 = static_cast<uint8_t>(reader.readUE());
+    } else if (pocType == 1) {
+        sps.flags.delta_pic_order_always_zero_flag = reader.readFlag();
+        sps.offset_for_non_ref_pic = reader.readSE();
+        sps.offset_for_top_to_bottom_field = reader.readSE();
+        uint32_t cycleLength = reader.readUE();
+        if (cycleLength > 255) {
+            return "num_ref_frames_in_pic_order_cnt_cycle out of range";
+        }
+        sps.num_ref_frames_in_pic_order_cnt_cycle = static_cast<uint8_t>(cycleLength);
+        for (uint32_t i = 0; i < cycleLength; ++i) {
+            out.offsetForRefFrame[i] = reader.readSE();
+        }
+        sps.pOffsetForRefFrame = out.offsetForRefFrame;
+    }
+    sps.max_num_ref_frames = static_cast<uint8_t>(reader.readUE());
+    sps.flags.gaps_in_frame_num_value_allowed_flag = reader.readFlag();
+    sps.pic_width_in_mbs_minus1 = reader.readUE();
+    sps.pic_height_in_map_units_minus1 = reader.readUE();
+    sps.flags.frame_mbs_only_flag = reader.readFlag();
+    if (!sps.flags.frame_mbs_only_flag) {
+        sps.flags.mb_adaptive_frame_field_flag = reader.readFlag();
+    }
+    sps.flags.direct_8x8_inference_flag = reader.readFlag();
+    sps.flags.frame_cropping_flag = reader.readFlag();
+    if (sps.flags.frame_cropping_flag) {
+        sps.frame_crop_left_offset = reader.readUE();
+        sps.frame_crop_right_offset = reader.readUE();
+        sps.frame_crop_top_offset = reader.readUE();
+        sps.frame_crop_bottom_offset = reader.readUE();
+    }
+    sps.flags.vui_parameters_present_flag = reader.readFlag();
+    if (sps.flags.vui_parameters_present_flag) {
+        readVui(reader, out);
+        sps.pSequenceParameterSetVui = &out.vui;
+    }
+
+    if (reader.overrun()) {
+        return "truncated SPS";
+    }
+    if (sps.bit_depth_luma_minus8 > 6 || sps.bit_depth_chroma_minus8 > 6) {
+        return "unsupported bit depth";
+    }
+    sps.profile_idc = toStdProfile(profileIdc, chromaFormatIdc,
+                                   8 + std::max(sps.bit_depth_luma_minus8, sps.bit_depth_chroma_minus8));
+    if (sps.profile_idc == STD_VIDEO_H264_PROFILE_IDC_INVALID) {
+        return "unsupported profile_idc";
+    }
+    out.codedWidth = (sps.pic_width_in_mbs_minus1 + 1) * 16;
+    out.codedHeight = (sps.pic_height_in_map_units_minus1 + 1) * 16 * (sps.flags.frame_mbs_only_flag ? 1 : 2);
+    // Crop offsets count chroma samples, and field pairs in frames with field macroblocks.
+    uint32_t cropUnitX = (chromaFormatIdc == 1 || chromaFormatIdc == 2) ? 2 : 1;
+    uint32_t cropUnitY = (chromaFormatIdc == 1 ? 2 : 1) * (sps.flags.frame_mbs_only_flag ? 1 : 2);
+    uint64_t cropX = static_cast<uint64_t>(cropUnitX) * (static_cast<uint64_t>(sps.frame_crop_left_offset) + sps.frame_crop_right_offset);
+    uint64_t cropY = static_cast<uint64_t>(cropUnitY) * (static_cast<uint64_t>(sps.frame_crop_top_offset) + sps.frame_crop_bottom_offset);
+    if (cropX >= out.codedWidth || cropY >= out.codedHeight) {
+        return "cropping window out of range";
+    }
+    out.displayWidth = out.codedWidth - static_cast<uint32_t>(cropX);
+    out.displayHeight = out.codedHeight - static_cast<uint32_t>(cropY);
+    return nullptr;
+}
+
+const char* H264ParameterSets::parsePps(const uint8_t* nal, size_t size, uint32_t chromaFormatIdc,
+                                        H264PictureParameterSet& out) {
+    if (size < 2 || (nal[0] & 0x1f) != H264Parser::NAL_PPS) {
+        return "not a PPS";
+    }
+    std::vector<uint8_t> rbsp = H264Parser::unescapeRbsp(nal + 1, size - 1);
+    BitReader reader(rbsp.data(), rbsp.size());
+    StdVideoH264PictureParameterSet& pps = out.std;
+
+    uint32_t ppsId = reader.readUE();
+    uint32_t spsId = reader.readUE();
+    if (ppsId >= MAX_PPS_COUNT || spsId >= MAX_SPS_COUNT) {
+        return "parameter set ID out of range";
+    }
+    pps.pic_parameter_set_id = static_cast<uint8_t>(ppsId);
+    pps.seq_parameter_set_id = static_cast<uint8_t>(spsId);
+    pps.flags.entropy_coding_mode_flag = reader.readFlag();
+    pps.flags.bottom_field_pic_order_in_frame_present_flag = reader.readFlag();
+    // Slice groups (FMO) are a Baseline extension Vulkan Video does not decode.
+    if (reader.readUE() != 0) {
+        return "slice groups are not supported";
+    }
+    uint32_t refIdxL0 = reader.readUE();
+    uint32_t refIdxL1 = reader.readUE();
+    if (refIdxL0 > 31 || refIdxL1 > 31) {
+        return "num_ref_idx_default_active out of range";
+    }
+    pps.num_ref_idx_l0_default_active_minus1 = static_cast<uint8_t>(refIdxL0);
+    pps.num_ref_idx_l1_default_active_minus1 = static_cast<uint8_t>(refIdxL1);
+    pps.flags.weighted_pred_flag = reader.readFlag();
+    pps.weighted_bipred_idc = static_cast<StdVideoH264WeightedBipredIdc>(reader.readBits(2));
+    pps.pic_init_qp_minus26 = static_cast<int8_t>(reader.readSE());
+    pps.pic_init_qs_minus26 = static_cast<int8_t>(reader.readSE());
+    pps.chroma_qp_index_offset = static_cast<int8_t>(reader.readSE());
+    pps.flags.deblocking_filter_control_present_flag = reader.readFlag();
+    pps.flags.constrained_intra_pred_flag = reader.readFlag();
+    pps.flags.redundant_pic_cnt_present_flag = reader.readFlag();
+
+    pps.second_chroma_qp_index_offset = pps.chroma_qp_index_offset;
+    if (reader.moreRbspData()) {
+        pps.flags.transform_8x8_mode_flag = reader.readFlag();
+        pps.flags.pic_scaling_matrix_present_flag = reader.readFlag();
+        if (pps.flags.pic_scaling_matrix_present_flag) {
+            uint32_t listCount = 6 + (pps.flags.transform_8x8_mode_flag ? (chromaFormatIdc != 3 ? 2 : 6) : 0);
+            readScalingLists(reader, listCount, out.scalingLists);
+            pps.pScalingLists = &out.scalingLists;
+        }
+        pps.second_chroma_qp_index_offset = static_cast<int8_t>(reader.readSE());
+    }
+
+    if (reader.overrun()) {
+        return "truncated PPS";
+    }
+    return nullptr;
+}
+
+void H264ParameterSets::addExtradata(const std::vector<uint8_t>& extradata) {
+    std::vector<std::vector<uint8_t>> spsList;
+    std::vector<std::vector<uint8_t>> ppsList;
+    uint32_t nalLengthSize = 0;
+    if (H264Parser::parseAvcC(extradata, spsList, ppsList, nalLengthSize)) {
+        for (const auto& sps : spsList) {
+            add(sps.data(), sps.size());
+        }
+        for (const auto& pps : ppsList) {
+            add(pps.data(), pps.size());
+        }
+        return;
+    }
+    std::vector<H264NalUnit> nals;
+    if (extradata.empty() || H264Parser::splitNalUnits(extradata.data(), extradata.size(), 0, nals)) {
+        return;
+    }
+    for (const H264NalUnit& nal : nals) {
+        add(nal.data, nal.size);
+    }
+}
+
+bool H264ParameterSets::add(const uint8_t* nal, size_t size) {
+    uint8_t type = size > 0 ? nal[0] & 0x1f : 0;
+    if (type != H264Parser::NAL_SPS && type != H264Parser::NAL_PPS) {
+        return false;
+    }
+    ++stats.received;
+    uint64_t hash = hashNal(nal, size);
+    bool changed = type == H264Parser::NAL_SPS ? addSps(nal, size, hash) : addPps(nal, size, hash);
+    if (changed) {
+        pending = true;
+    } else {
+        ++stats.repeated;
+    }
+    return changed;
+}
+
+bool H264ParameterSets::addSps(const uint8_t* nal, size_t size, uint64_t hash) {
+    auto cached = spsCache.find(hash);
+    std::shared_ptr<const SpsEntry> entry;
+    bool fromCache = cached != spsCache.end() && sameNal(cached->second->nal, nal, size);
+    if (fromCache) {
+        entry = cached->second;
+    } else {
+        auto parsed = std::make_shared<SpsEntry>();
+        if (const char* error = parseSps(nal, size, parsed->set)) {
+            throw std::runtime_error(std::string("H264ParameterSets: Invalid or unsupported SPS: ") + error);
+        }
+        parsed->nal.assign(nal, nal + size);
+        ++stats.parsed;
+        if (spsCache.size() >= MAX_CACHED_SETS) {
+            spsCache.clear();
+        }
+        spsCache[hash] = parsed;
+        entry = std::move(parsed);
+    }
+
+    std::shared_ptr<const SpsEntry>& active = activeSps[entry->set.std.seq_parameter_set_id];
+    if (active == entry) {
+        return false;
+    }
+    if (fromCache) {
+        ++stats.cacheHits;
+    }
+    active = entry;
+    return true;
+}
+
+bool H264ParameterSets::addPps(const uint8_t* nal, size_t size, uint64_t hash) {
+    // The SPS must be known before the PPS can be parsed.
+    uint32_t spsId = 0;
+    {
+        uint8_t rbsp[16];
+        BitReader reader(rbsp, H264Parser::unescapeRbsp(nal + 1, std::min<size_t>(size - 1, sizeof(rbsp)), rbsp));
+        reader.readUE(); // pic_parameter_set_id
+        spsId = reader.readUE();
+        if (reader.overrun() || spsId >= MAX_SPS_COUNT) {
+            throw std::runtime_error("H264ParameterSets: Damaged PPS.");
+        }
+    }
+    const SpsEntry* sps = activeSps[spsId].get();
+    if (!sps) {
+        throw std::runtime_error("H264ParameterSets: PPS refers to SPS " + std::to_string(spsId) + ", which has not been seen.");
+    }
+    uint32_t chromaFormatIdc = sps->set.std.chroma_format_idc;
+
+    auto cached = ppsCache.find(hash);
+    std::shared_ptr<const PpsEntry> entry;
+    bool fromCache = cached != ppsCache.end() && sameNal(cached->second->nal, nal, size) &&
+                     cached->second->chromaFormatIdc == chromaFormatIdc;
+    if (fromCache) {
+        entry = cached->second;
+    } else {
+        auto parsed = std::make_shared<PpsEntry>();
+        if (const char* error = parsePps(nal, size, chromaFormatIdc, parsed->set)) {
+            throw std::runtime_error(std::string("H264ParameterSets: Invalid or unsupported PPS: ") + error);
+        }
+        parsed->nal.assign(nal, nal + size);
+        parsed->chromaFormatIdc = chromaFormatIdc;
+        ++stats.parsed;
+        if (ppsCache.size() >= MAX_CACHED_SETS) {
+            ppsCache.clear();
+        }
+        ppsCache[hash] = parsed;
+        entry = std::move(parsed);
+    }
+
+    std::shared_ptr<const PpsEntry>& active = activePps[entry->set.std.pic_parameter_set_id];
+    if (active == entry) {
+        return false;
+    }
+    if (fromCache) {
+        ++stats.cacheHits;
+    }
+    active = entry;
+    return true;
+}
+
+bool H264ParameterSets::needsRecreate() const {
+    if (!pending) {
+        return false;
+    }
+    for (uint32_t id = 0; id < MAX_SPS_COUNT; ++id) {
+        if (committedSps[id] && activeSps[id] != committedSps[id]) {
+            return true;
+        }
+    }
+    size_t newKeys = 0;
+    for (const auto& pps : activePps) {
+        if (!pps) {
+            continue;
+        }
+        auto committed = committedPps.find(ppsKey(pps->set.std));
+        if (committed == committedPps.end()) {
+            ++newKeys;
+        } else if (committed->second != pps) {
+            return true;
+        }
+    }
+    return committedPps.size() + newKeys > MAX_PPS_COUNT;
+}
+
+void H264ParameterSets::collect(bool all, std::vector<StdVideoH264SequenceParameterSet>& spsList,
+                                std::vector<StdVideoH264PictureParameterSet>& ppsList) const {
+    for (uint32_t id = 0; id < MAX_SPS_COUNT; ++id) {
+        if (activeSps[id] && (all || activeSps[id] != committedSps[id])) {
+            spsList.push_back(activeSps[id]->set.std);
+        }
+    }
+    for (const auto& pps : activePps) {
+        if (!pps) {
+            continue;
+        }
+        auto committed = committedPps.find(ppsKey(pps->set.std));
+        if (all || committed == committedPps.end() || committed->second != pps) {
+            ppsList.push_back(pps->set.std);
+        }
+    }
+}
+
+void H264ParameterSets::commit(bool recreated) {
+    if (recreated) {
+        for (uint32_t id = 0; id < MAX_SPS_COUNT; ++id) {
+            if (activeSps[id] && committedSps[id] && activeSps[id] != committedSps[id]) {
+                ++stats.replaced;
+            } else if (activeSps[id] && !committedSps[id]) {
+                ++stats.added;
+            }
+        }
+        std::unordered_map<uint32_t, std::shared_ptr<const PpsEntry>> recreatedPps;
+        for (const auto& pps : activePps) {
+            if (!pps) {
+                continue;
+            }
+            uint32_t key = ppsKey(pps->set.std);
+            auto committed = committedPps.find(key);
+            if (committed == committedPps.end()) {
+                ++stats.added;
+            } else if (committed->second != pps) {
+                ++stats.replaced;
+            }
+            recreatedPps[key] = pps;
+        }
+        committedSps = activeSps;
+        committedPps = std::move(recreatedPps);
+    } else {
+        for (uint32_t id = 0; id < MAX_SPS_COUNT; ++id) {
+            if (activeSps[id] && activeSps[id] != committedSps[id]) {
+                committedSps[id] = activeSps[id];
+                ++stats.added;
+            }
+        }
+        for (const auto& pps : activePps) {
+            if (!pps) {
+                continue;
+            }
+            std::shared_ptr<const PpsEntry>& committed = committedPps[ppsKey(pps->set.std)];
+            if (committed != pps) {
+                committed = pps;
+                ++stats.added;
+            }
+        }
+    }
+    pending = false;
+}
+
+const H264SequenceParameterSet* H264ParameterSets::getSps(uint32_t id) const {
+    return id < MAX_SPS_COUNT && activeSps[id] ? &activeSps[id]->set : nullptr;
+}
+
+const H264PictureParameterSet* H264ParameterSets::getPps(uint32_t id) const {
+    return id < MAX_PPS_COUNT && activePps[id] ? &activePps[id]->set : nullptr;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vk_video/vulkan_video_codec_h264std.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// An SPS in the layout Vulkan Video takes, with the storage its pointers refer to.
+// Not copyable, since std points into the object itself.
+struct H264SequenceParameterSet {
+    StdVideoH264SequenceParameterSet std{};
+    StdVideoH264ScalingLists scalingLists{};
+    StdVideoH264SequenceParameterSetVui vui{};
+    StdVideoH264HrdParameters hrd{};
+    int32_t offsetForRefFrame[255]{};
+    // Size in whole macroblocks, before cropping.
+    uint32_t codedWidth = 0;
+    uint32_t codedHeight = 0;
+    // Size after the cropping window, as shown.
+    uint32_t displayWidth = 0;
+    uint32_t displayHeight = 0;
+
+    H264SequenceParameterSet() = default;
+    H264SequenceParameterSet(const H264SequenceParameterSet&) = delete;
+    H264SequenceParameterSet& operator=(const H264SequenceParameterSet&) = delete;
+};
+
+// A PPS in the layout Vulkan Video takes.
+struct H264PictureParameterSet {
+    StdVideoH264PictureParameterSet std{};
+    StdVideoH264ScalingLists scalingLists{};
+
+    H264PictureParameterSet() = default;
+    H264PictureParameterSet(const H264PictureParameterSet&) = delete;
+    H264PictureParameterSet& operator=(const H264PictureParameterSet&) = delete;
+};
+
+// Totals over the parameter sets seen so far.
+struct ParameterSetStats {
+    // SPS and PPS NAL units, from the container header and in band.
+    uint64_t received = 0;
+    // Identical to the active set with the same ID, so nothing changed.
+    uint64_t repeated = 0;
+    // Parsed earlier and found in the cache, e.g. when a stream switches back to a PPS.
+    uint64_t cacheHits = 0;
+    uint64_t parsed = 0;
+    // Sets the session parameters did not hold yet, and sets that replace one they hold.
+    uint64_t added = 0;
+    uint64_t replaced = 0;
+};
+
+// The H264ParameterSets class tracks a stream's SPS and PPS by ID and tells the decoder
+// which of them its session parameters object still lacks. Sets are parsed into the
+// Vulkan Video structures once and cached by content hash, so the parameter sets that
+// broadcast streams resend before every IDR cost a hash and a compare.
+//
+// A session parameters object can take new sets with an update but never replace one
+// it holds, so a set whose ID is taken by different content, or a PPS that would exceed
+// the object's capacity, means creating a new object from the active sets.
+class H264ParameterSets {
+public:
+    // Session parameters objects are created for the whole SPS and PPS ID space.
+    static constexpr uint32_t MAX_SPS_COUNT = 32;
+    static constexpr uint32_t MAX_PPS_COUNT = 256;
+
+    // Takes the SPS and PPS in a container header: an avcC record or Annex B NAL units.
+    // Throws a std::runtime_error if one of them is damaged.
+    void addExtradata(const std::vector<uint8_t>& extradata);
+
+    // Takes an SPS or PPS NAL unit, including its header; other NAL units are ignored.
+    // Returns true if it changes the active sets. Throws a std::runtime_error for a
+    // damaged or unsupported set, or a PPS whose SPS has not been seen.
+    bool add(const uint8_t* nal, size_t size);
+
+    // True when active sets are missing from the session parameters object.
+    bool hasPending() const { return pending; }
+
+    // True when the pending sets cannot be added to the current parameters object, which
+    // must be recreated from all active sets instead.
+    bool needsRecreate() const;
+
+    // Appends the pending sets, or all active ones, in the layout of
+    // VkVideoDecodeH264SessionParametersAddInfoKHR. Valid until the next add.
+    void collect(bool all, std::vector<StdVideoH264SequenceParameterSet>& spsList,
+                 std::vector<StdVideoH264PictureParameterSet>& ppsList) const;
+
+    // Records that the parameters object now holds the pending sets, or that it was
+    // recreated with exactly the active ones.
+    void commit(bool recreated);
+
+    // The active SPS with the given ID, or nullptr.
+    const H264SequenceParameterSet* getSps(uint32_t id) const;
+    // The active PPS with the given ID, or nullptr.
+    const H264PictureParameterSet* getPps(uint32_t id) const;
+
+    const ParameterSetStats& getStats() const { return stats; }
+
+    // The Vulkan Video profile that decodes a stream with this profile_idc, chroma format
+    // and bit depth, or STD_VIDEO_H264_PROFILE_IDC_INVALID if none of them can.
+    static StdVideoH264ProfileIdc toStdProfile(uint32_t profileIdc, uint32_t chromaFormatIdc, uint32_t bitDepth);
+
+    // Parse an SPS or PPS NAL unit. Return nullptr, or why the set was rejected.
+    static const char* parseSps(const uint8_t* nal, size_t size, H264SequenceParameterSet& sps);
+    // The PPS syntax depends on its SPS's chroma format.
+    static const char* parsePps(const uint8_t* nal, size_t size, uint32_t chromaFormatIdc,
+                                H264PictureParameterSet& pps);
+
+private:
+    struct SpsEntry {
+        std::vector<uint8_t> nal;
+        H264SequenceParameterSet set;
+    };
+    struct PpsEntry {
+        std::vector<uint8_t> nal;
+        uint32_t chromaFormatIdc = 0;
+        H264PictureParameterSet set;
+    };
+
+    // Parsed sets by hash of their NAL unit. Active and committed sets are shared with
+    // the tables below, so clearing the cache never frees a set in use.
+    std::unordered_map<uint64_t, std::shared_ptr<const SpsEntry>> spsCache;
+    std::unordered_map<uint64_t, std::shared_ptr<const PpsEntry>> ppsCache;
+    // The sets each ID refers to now.
+    std::array<std::shared_ptr<const SpsEntry>, MAX_SPS_COUNT> activeSps;
+    std::array<std::shared_ptr<const PpsEntry>, MAX_PPS_COUNT> activePps;
+    // What the session parameters object holds. Vulkan keys PPS by SPS and PPS ID.
+    std::array<std::shared_ptr<const SpsEntry>, MAX_SPS_COUNT> committedSps;
+    std::unordered_map<uint32_t, std::shared_ptr<const PpsEntry>> committedPps;
+    bool pending = false;
+    ParameterSetStats stats;
+
+    bool addSps(const uint8_t* nal, size_t size, uint64_t hash);
+    bool addPps(const uint8_t* nal, size_t size, uint64_t hash);
+};
@@ -0,0 +1,344 @@
+#include "H264Parser.hpp"
+
+#include <algorithm>
+#include <functional>
+
+uint32_t BitReader::readBits(uint32_t count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (bitPos >= size * 8) {
+            overrunFlag = true;
+            return value << (count - i);
+        }
+        uint32_t bit = (data[bitPos >> 3] >> (7 - (bitPos & 7))) & 1;
+        value = (value << 1) | bit;
+        ++bitPos;
+    }
+    return value;
+}
+
+uint32_t BitReader::readUE() {
+    uint32_t leadingZeros = 0;
+    while (readBits(1) == 0) {
+        if (overrunFlag || ++leadingZeros > 31) {
+            overrunFlag = true;
+            return 0;
+        }
+    }
+    if (leadingZeros == 0) {
+        return 0;
+    }
+    return (1u << leadingZeros) - 1 + readBits(leadingZeros);
+}
+
+int32_t BitReader::readSE() {
+    uint32_t codeNum = readUE();
+    int32_t magnitude = static_cast<int32_t>((codeNum + 1) / 2);
+    return (codeNum & 1) ? magnitude : -magnitude;
+}
+
+bool BitReader::moreRbspData() const {
+    // The stop bit is the last set bit of the payload; trailing zero bytes may follow it.
+    size_t last = size;
+    while (last > 0 && data[last - 1] == 0) {
+        --last;
+    }
+    if (last == 0) {
+        return false;
+    }
+    uint8_t byte = data[last - 1];
+    uint32_t trailingZeros = 0;
+    while (((byte >> trailingZeros) & 1) == 0) {
+        ++trailingZeros;
+    }
+    size_t stopBitPos = (last - 1) * 8 + (7 - trailingZeros);
+    return bitPos < stopBitPos;
+}
+
+namespace H264Parser {
+
+    std::vector<uint8_t> unescapeRbsp(const uint8_t* data, size_t size) {
+        std::vector<uint8_t> rbsp(size);
+        rbsp.resize(unescapeRbsp(data, size, rbsp.data()));
+        return rbsp;
+    }
+
+    size_t unescapeRbsp(const uint8_t* data, size_t size, uint8_t* rbsp) {
+        size_t written = 0;
+        uint32_t zeroCount = 0;
+        for (size_t i = 0; i < size; ++i) {
+            if (zeroCount == 2 && data[i] == 0x03) {
+                zeroCount = 0;
+                continue;
+            }
+            zeroCount = (data[i] == 0) ? zeroCount + 1 : 0;
+            rbsp[written++] = data[i];
+        }
+        return written;
+    }
+
+    bool parseAvcC(const std::vector<uint8_t>& extradata,
+                   std::vector<std::vector<uint8_t>>& spsList,
+                   std::vector<std::vector<uint8_t>>& ppsList,
+                   uint32_t& nalLengthSize) {
+        // configurationVersion must be 1; Annex B extradata is not an avcC record.
+        if (extradata.size() < 7 || extradata[0] != 1) {
+            return false;
+        }
+        nalLengthSize = (extradata[4] & 0x03) + 1;
+
+        size_t pos = 5;
+        auto readNalList = [&](uint32_t count, std::vector<std::vector<uint8_t>>& out) {
+            for (uint32_t i = 0; i < count; ++i) {
+                if (pos + 2 > extradata.size()) return false;
+                size_t nalSize = (extradata[pos] << 8) | extradata[pos + 1];
+                pos += 2;
+                if (pos + nalSize > extradata.size()) return false;
+                out.emplace_back(extradata.begin() + pos, extradata.begin() + pos + nalSize);
+                pos += nalSize;
+            }
+            return true;
+        };
+
+        uint32_t numSps = extradata[pos++] & 0x1f;
+        if (!readNalList(numSps, spsList)) return false;
+        if (pos >= extradata.size()) return false;
+        uint32_t numPps = extradata[pos++];
+        return readNalList(numPps, ppsList);
+    }
+
+    // Skips a scaling_list() syntax structure; the values are not needed for format selection.
+    static void skipScalingList(BitReader& reader, uint32_t listSize) {
+        int32_t lastScale = 8;
+        int32_t nextScale = 8;
+        for (uint32_t j = 0; j < listSize; ++j) {
+            if (nextScale != 0) {
+                int32_t deltaScale = reader.readSE();
+                nextScale = (lastScale + deltaScale + 256) % 256;
+            }
+            lastScale = (nextScale == 0) ? lastScale : nextScale;
+        }
+    }
+
+    bool parseSps(const uint8_t* nal, size_t size, H264SpsInfo& sps) {
+        if (size < 4 || (nal[0] & 0x1f) != NAL_SPS) {
+            return false;
+        }
+        std::vector<uint8_t> rbsp = unescapeRbsp(nal + 1, size - 1);
+        BitReader reader(rbsp.data(), rbsp.size());
+
+        sps.profileIdc = reader.readBits(8);
+        reader.readBits(8); // constraint_set flags + reserved_zero_2bits
+        sps.levelIdc = reader.readBits(8);
+        sps.spsId = reader.readUE();
+
+        sps.chromaFormatIdc = 1;
+        sps.bitDepthLuma = 8;
+        sps.bitDepthChroma = 8;
+        switch (sps.profileIdc) {
+            case 100: case 110: case 122: case 244: case 44:
+            case 83: case 86: case 118: case 128: case 138:
+            case 139: case 134: case 135: {
+                sps.chromaFormatIdc = reader.readUE();
+                if (sps.chromaFormatIdc == 3) {
+                    reader.readFlag(); // separate_colour_plane_flag
+                }
+                sps.bitDepthLuma = reader.readUE() + 8;
+                sps.bitDepthChroma = reader.readUE() + 8;
+                reader.readFlag(); // qpprime_y_zero_transform_bypass_flag
+                if (reader.readFlag()) { // seq_scaling_matrix_present_flag
+                    uint32_t listCount = (sps.chromaFormatIdc != 3) ? 8 : 12;
+                    for (uint32_t i = 0; i < listCount; ++i) {
+                        if (reader.readFlag()) {
+                            skipScalingList(reader, i < 6 ? 16 : 64);
+                        }
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        sps.log2MaxFrameNumMinus4 = reader.readUE();
+        sps.picOrderCntType = reader.readUE();
+        if (sps.picOrderCntType == 0) {
+            sps.log2MaxPicOrderCntLsbMinus4 = reader.readUE();
+        } else if (sps.picOrderCntType == 1) {
+            reader.readFlag(); // delta_pic_order_always_zero_flag
+            reader.readSE();   // offset_for_non_ref_pic
+            reader.readSE();   // offset_for_top_to_bottom_field
+            uint32_t cycleLength = reader.readUE();
+            for (uint32_t i = 0; i < cycleLength && !reader.overrun(); ++i) {
+                reader.readSE();
+            }
+        }
+        sps.maxNumRefFrames = reader.readUE();
+        reader.readFlag(); // gaps_in_frame_num_value_allowed_flag
+        uint32_t widthInMbs = reader.readUE() + 1;
+        uint32_t heightInMapUnits = reader.readUE() + 1;
+        sps.frameMbsOnly = reader.readFlag();
+        if (!sps.frameMbsOnly) {
+            reader.readFlag(); // mb_adaptive_frame_field_flag
+        }
+        reader.readFlag(); // direct_8x8_inference_flag
+
+        uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+        if (reader.readFlag()) { // frame_cropping_flag
+            cropLeft = reader.readUE();
+            cropRight = reader.readUE();
+            cropTop = reader.readUE();
+            cropBottom = reader.readUE();
+        }
+
+        if (reader.overrun() || sps.bitDepthLuma > 14 || sps.chromaFormatIdc > 3) {
+            return false;
+        }
+
+        uint32_t frameHeightFactor = sps.frameMbsOnly ? 1 : 2;
+        uint32_t cropUnitX = (sps.chromaFormatIdc == 0 || sps.chromaFormatIdc == 3) ? 1 : 2;
+        uint32_t cropUnitY = ((sps.chromaFormatIdc == 1) ? 2 : 1) * frameHeightFactor;
+        sps.width = widthInMbs * 16 - cropUnitX * (cropLeft + cropRight);
+        sps.height = heightInMapUnits * 16 * frameHeightFactor - cropUnitY * (cropTop + cropBottom);
+        return true;
+    }
+
+    // Slice header fields up to pic_parameter_set_id; the rest depends on the SPS and PPS.
+    bool parseSlicePpsId(const uint8_t* nal, size_t size, uint32_t& ppsId) {
+        if (size < 2) {
+            return false;
+        }
+        // Enough RBSP bytes for three maximal Exp-Golomb codes.
+        uint8_t rbsp[24];
+        BitReader reader(rbsp, unescapeRbsp(nal + 1, std::min<size_t>(size - 1, sizeof(rbsp)), rbsp));
+        reader.readUE(); // first_mb_in_slice
+        uint32_t sliceType = reader.readUE();
+        ppsId = reader.readUE();
+        return !reader.overrun() && sliceType <= 9 && ppsId <= 255;
+    }
+
+    // Checks one NAL unit and adds it to the packet summary.
+    static bool inspectNal(const uint8_t* nal, size_t size, H264PacketInfo& info) {
+        if (size == 0) {
+            info.error = "empty NAL unit";
+            return false;
+        }
+        if (nal[0] & 0x80) {
+            info.error = "forbidden_zero_bit set";
+            return false;
+        }
+        uint8_t type = nal[0] & 0x1f;
+        if (type == NAL_SLICE || type == NAL_IDR_SLICE) {
+            bool idrSlice = type == NAL_IDR_SLICE;
+            if (idrSlice && (nal[0] & 0x60) == 0) {
+                info.error = "IDR slice with nal_ref_idc 0";
+                return false;
+            }
+            if (info.hasSlice && info.idr != idrSlice) {
+                info.error = "IDR and non-IDR slices in one picture";
+                return false;
+            }
+            if (info.hasSlice && isFirstSlice(nal, size)) {
+                info.error = "more than one picture in the packet";
+                return false;
+            }
+            uint32_t ppsId;
+            if (!parseSlicePpsId(nal, size, ppsId)) {
+                info.error = "truncated slice header";
+                return false;
+            }
+            info.hasSlice = true;
+            info.idr = idrSlice;
+            ++info.sliceCount;
+        }
+        ++info.nalCount;
+        return true;
+    }
+
+    // Calls visit for each NAL unit until it returns false. Returns nullptr, or why the
+    // packet cannot be split.
+    static const char* walkNalUnits(const uint8_t* data, size_t size, uint32_t nalLengthSize,
+                                    const std::function<bool(const uint8_t*, size_t)>& visit) {
+        if (nalLengthSize > 4) {
+            return "invalid NAL length size";
+        }
+        size_t pos = 0;
+        if (nalLengthSize > 0) {
+            while (pos < size) {
+                if (size - pos < nalLengthSize) {
+                    return "truncated NAL length";
+                }
+                size_t nalSize = 0;
+                for (uint32_t i = 0; i < nalLengthSize; ++i) {
+                    nalSize = (nalSize << 8) | data[pos++];
+                }
+                if (nalSize > size - pos) {
+                    return "NAL unit runs past the end of the packet";
+                }
+                if (!visit(data + pos, nalSize)) {
+                    return nullptr;
+                }
+                pos += nalSize;
+            }
+            return nullptr;
+        }
+
+        // Annex B: NAL units follow 00 00 01 start codes; trailing zeros belong to the next one.
+        auto findStartCode = [&](size_t from) {
+            for (size_t i = from; i + 3 <= size; ++i) {
+                if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+                    return i;
+                }
+            }
+            return size;
+        };
+        pos = findStartCode(0);
+        if (pos == size || (pos > 0 && std::any_of(data, data + pos, [](uint8_t byte) { return byte != 0; }))) {
+            return "packet does not start with a start code";
+        }
+        while (pos < size) {
+            size_t begin = pos + 3;
+            size_t next = findStartCode(begin);
+            size_t end = next;
+            while (end > begin && data[end - 1] == 0) {
+                --end;
+            }
+            if (!visit(data + begin, end - begin)) {
+                return nullptr;
+            }
+            pos = next;
+        }
+        return nullptr;
+    }
+
+    const char* splitNalUnits(const uint8_t* data, size_t size, uint32_t nalLengthSize,
+                              std::vector<H264NalUnit>& nals) {
+        nals.clear();
+        return walkNalUnits(data, size, nalLengthSize, [&](const uint8_t* nal, size_t nalSize) {
+            nals.push_back({ nal, nalSize });
+            return true;
+        });
+    }
+
+    bool inspectPacket(const uint8_t* data, size_t size, uint32_t nalLengthSize, H264PacketInfo& info) {
+        info = H264PacketInfo{};
+        bool nalsValid = true;
+        const char* error = walkNalUnits(data, size, nalLengthSize, [&](const uint8_t* nal, size_t nalSize) {
+            nalsValid = inspectNal(nal, nalSize, info);
+            return nalsValid;
+        });
+        if (error) {
+            info.error = error;
+            return false;
+        }
+        if (!nalsValid) {
+            return false;
+        }
+        if (!info.hasSlice) {
+            info.error = "no slice data";
+            return false;
+        }
+        return true;
+    }
+
+} // namespace H264Parser
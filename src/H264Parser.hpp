@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A minimal MSB-first bit reader over an RBSP (emulation prevention bytes removed).
+// Reads past the end return zeros and set the overrun flag instead of throwing,
+// so callers can parse first and validate once at the end.
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    uint32_t readBits(uint32_t count);
+    bool readFlag() { return readBits(1) != 0; }
+
+    // Reads an unsigned Exp-Golomb code (ue(v)).
+    uint32_t readUE();
+
+    // Reads a signed Exp-Golomb code (se(v)).
+    int32_t readSE();
+
+    bool overrun() const { return overrunFlag; }
+
+    // True while bits remain before the RBSP stop bit (more_rbsp_data()).
+    bool moreRbspData() const;
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t bitPos = 0;
+    bool overrunFlag = false;
+};
+
+// The subset of an H.264 Sequence Parameter Set needed to configure
+// the video session and picture formats.
+struct H264SpsInfo {
+    uint32_t profileIdc = 0;
+    uint32_t levelIdc = 0;
+    uint32_t spsId = 0;
+    uint32_t chromaFormatIdc = 1;
+    uint32_t bitDepthLuma = 8;
+    uint32_t bitDepthChroma = 8;
+    uint32_t log2MaxFrameNumMinus4 = 0;
+    uint32_t picOrderCntType = 0;
+    uint32_t log2MaxPicOrderCntLsbMinus4 = 0;
+    uint32_t maxNumRefFrames = 0;
+    bool frameMbsOnly = true;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// A NAL unit inside a packet, without its length prefix or start code.
+struct H264NalUnit {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// What the NAL unit headers of one packet say about its access unit.
+struct H264PacketInfo {
+    uint32_t nalCount = 0;
+    uint32_t sliceCount = 0;
+    bool hasSlice = false;
+    // Every slice is an IDR slice; decoding can restart here.
+    bool idr = false;
+    // Why inspectPacket rejected the packet, or nullptr.
+    const char* error = nullptr;
+};
+
+// Helpers for parsing H.264 NAL units and parameter sets.
+namespace H264Parser {
+
+    // NAL unit types used by the transcoder.
+    constexpr uint8_t NAL_SLICE = 1;
+    constexpr uint8_t NAL_IDR_SLICE = 5;
+    constexpr uint8_t NAL_SPS = 7;
+    constexpr uint8_t NAL_PPS = 8;
+
+    // Returns a copy of the NAL payload with emulation prevention bytes (0x000003) removed.
+    std::vector<uint8_t> unescapeRbsp(const uint8_t* data, size_t size);
+    // The same into rbsp, which holds at least size bytes; returns the bytes written. For
+    // the headers read on every frame, whose first bytes fit on the stack.
+    size_t unescapeRbsp(const uint8_t* data, size_t size, uint8_t* rbsp);
+
+    // Splits the 'avcC' decoder configuration record found in MP4 extradata
+    // into its SPS and PPS NAL units. Returns false if the record is malformed.
+    bool parseAvcC(const std::vector<uint8_t>& extradata,
+                   std::vector<std::vector<uint8_t>>& spsList,
+                   std::vector<std::vector<uint8_t>>& ppsList,
+                   uint32_t& nalLengthSize);
+
+    // Parses an SPS NAL unit (including its one-byte NAL header).
+    // Returns false if the NAL is not an SPS or is truncated.
+    bool parseSps(const uint8_t* nal, size_t size, H264SpsInfo& sps);
+
+    // Splits a packet into its NAL units, length-prefixed when nalLengthSize is 1-4 and
+    // Annex B when it is 0. Returns nullptr, or why the packet cannot be split.
+    const char* splitNalUnits(const uint8_t* data, size_t size, uint32_t nalLengthSize,
+                              std::vector<H264NalUnit>& nals);
+
+    // True for a slice NAL unit with first_mb_in_slice 0, which starts a new picture.
+    inline bool isFirstSlice(const uint8_t* nal, size_t size) {
+        // ue(v) is 0 exactly when its first bit is set.
+        return size >= 2 && (nal[1] & 0x80) != 0;
+    }
+
+    // Reads the pic_parameter_set_id of a slice NAL unit (including its header).
+    // Returns false if the slice header is truncated or out of range.
+    bool parseSlicePpsId(const uint8_t* nal, size_t size, uint32_t& ppsId);
+
+    // Walks the NAL units of a packet checking what can be checked without decoding:
+    // NAL sizes, the forbidden bit, the start of each slice header and that the slices
+    // belong to one picture. Returns false and sets info.error if the packet is damaged.
+    bool inspectPacket(const uint8_t* data, size_t size, uint32_t nalLengthSize, H264PacketInfo& info);
+
+} // namespace H264Parser
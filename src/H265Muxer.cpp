@@ -1,5 +1,14 @@
 #include "H265Muxer.hpp"
-#include <iostream>
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 // The FFmpeg headers must be wrapped in extern "C" because they are C libraries.
 extern "C" {
@@ -7,12 +16,40 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// Decode times are passed to the passthrough queue as they are.
+static_assert(PassthroughQueue::UNKNOWN_DTS == AV_NOPTS_VALUE, "PassthroughQueue::UNKNOWN_DTS must be AV_NOPTS_VALUE");
+
+namespace {
+    // The video packet and a few queued passthrough packets; the ring grows past that
+    // while a passthrough stream runs far ahead of the video.
+    constexpr size_t INITIAL_PACKETS = 64;
+
+    MetricCounter& videoBytesCounter() {
+        static MetricCounter& counter = MetricsRegistry::global().counter(
+            "transcoder_bitstream_out_bytes_total", "Encoded video bytes written to the output.");
+        return counter;
+    }
+
+    MetricCounter& passthroughBytesCounter() {
+        static MetricCounter& counter = MetricsRegistry::global().counter(
+            "transcoder_passthrough_bytes_total", "Audio, subtitle and data bytes copied to the output.");
+        return counter;
+    }
+}
+
 // Constructor: Initializes the output format context and video stream.
-H265Muxer::H265Muxer(const std::string& filepath, int width, int height, int fps) {
+H265Muxer::H265Muxer(const std::string& filepath, int width, int height, Timebase timebase, Timebase frameRate,
+                     const FragmentedOutput& fragmented)
+    : packetTimebase(timebase), filepath(filepath), trackSize(width, height), packets(INITIAL_PACKETS),
+      fragmented(fragmented), fragmentCount(fragmented.resumeFragments) {
     // Allocate the output media context.
     if (avformat_alloc_output_context2(&formatContext, nullptr, nullptr, filepath.c_str()) < 0) {
         throw std::runtime_error("Muxer: Could not create output context for " + filepath);
     }
+    if (fragmented.enabled && !std::strstr(formatContext->oformat->name, "mp4") &&
+        !std::strstr(formatContext->oformat->name, "mov")) {
+        throw std::runtime_error("Muxer: Fragmented output needs an MP4 or MOV file, not " + filepath);
+    }
 
     // Add a new video stream to the output media file.
     videoStream = avformat_new_stream(formatContext, nullptr);
@@ -27,19 +64,48 @@ H265Muxer::H265Muxer(const std::string& filepath, int width, int height, int fps
     videoStream->codecpar->width = width;
     videoStream->codecpar->height = height;
     // Set the timebase, which defines the units of the presentation timestamp (PTS).
-    videoStream->time_base = {1, fps};
+    // The container may replace it when the header is written.
+    videoStream->time_base = av_make_q(timebase.num, timebase.den);
+    videoStream->avg_frame_rate = av_make_q(frameRate.num, frameRate.den);
 
     // Open the output file for writing if needed by the container format.
     if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&formatContext->pb, filepath.c_str(), AVIO_FLAG_WRITE) < 0) {
+        AVDictionary* ioOptions = nullptr;
+        if (fragmented.resumeBytes > 0) {
+            // Keep the complete fragments and drop whatever the previous run left after them.
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(filepath, ec);
+            if (ec || size < fragmented.resumeBytes) {
+                throw std::runtime_error("Muxer: " + filepath + " is shorter than its checkpoint");
+            }
+            std::filesystem::resize_file(filepath, fragmented.resumeBytes, ec);
+            if (ec) {
+                throw std::runtime_error("Muxer: Could not truncate " + filepath + ": " + ec.message());
+            }
+            av_dict_set(&ioOptions, "truncate", "0", 0);
+        }
+        int result = avio_open2(&formatContext->pb, filepath.c_str(), AVIO_FLAG_WRITE, nullptr, &ioOptions);
+        av_dict_free(&ioOptions);
+        if (result < 0) {
             throw std::runtime_error("Muxer: Could not open output file: " + filepath);
         }
+        if (fragmented.resumeBytes > 0 &&
+            avio_seek(formatContext->pb, static_cast<int64_t>(fragmented.resumeBytes), SEEK_SET) < 0) {
+            throw std::runtime_error("Muxer: Could not seek to the end of " + filepath);
+        }
     }
-    std::cout << "Muxer initialized for file: " << filepath << std::endl;
+    passthroughTimebases.resize(1);
+    lastPassthroughDts.resize(1, INT64_MIN);
+    VT_LOG_INFO("Muxer initialized for file: " << filepath);
 }
 
 // Destructor: Finalizes the output file and frees all resources.
 H265Muxer::~H265Muxer() {
+    // Packets still queued here belong to a transcode that failed before finish().
+    PassthroughQueue::Entry queued;
+    while (passthroughQueue.pop(queued)) {
+        packets.release(queued.packet);
+    }
     if (formatContext) {
         // Write the stream trailer to the output media file.
         av_write_trailer(formatContext);
@@ -72,44 +138,231 @@ void H265Muxer::setCodecParameters(const std::vector<uint8_t>& vps, const std::v
     videoStream->codecpar->extradata_size = extradata.size();
 }
 
+// hev1 sample entries may carry parameter sets in the samples, and a size change
+// brings new ones with its IDR; the hvcC only describes the first.
+void H265Muxer::allowSizeChanges(int maxWidth, int maxHeight) {
+    if (headerWritten) {
+        throw std::logic_error("Muxer: Size changes must be allowed before the first packet");
+    }
+    trackSize.allowChanges(maxWidth, maxHeight);
+    videoStream->codecpar->width = trackSize.getWidth();
+    videoStream->codecpar->height = trackSize.getHeight();
+    videoStream->codecpar->codec_tag = MKTAG('h', 'e', 'v', '1');
+    VT_LOG_INFO("Muxer: Video track declared for up to " << trackSize.getWidth() << "x" << trackSize.getHeight()
+                << " with in-band parameter sets.");
+}
+
+void H265Muxer::changeVideoSize(int width, int height) {
+    trackSize.change(width, height);
+    VT_LOG_DEBUG("Muxer: Video pictures are " << width << "x" << height << " from the next IDR.");
+}
+
+// Adds a stream copied from the input.
+int H265Muxer::addPassthroughStream(const AVStream* inputStream) {
+    if (headerWritten) {
+        throw std::logic_error("Muxer: Passthrough streams must be added before the first packet");
+    }
+    const AVCodecParameters* inputParameters = inputStream->codecpar;
+    // 0 means the container definitely cannot store the codec; a negative value means
+    // FFmpeg does not know, and the header write reports it if it really cannot.
+    if (avformat_query_codec(formatContext->oformat, inputParameters->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+        VT_LOG_INFO("Muxer: Dropping stream " << inputStream->index << " ("
+                    << avcodec_get_name(inputParameters->codec_id) << "), not supported by the container.");
+        return -1;
+    }
+
+    AVStream* stream = avformat_new_stream(formatContext, nullptr);
+    if (!stream) {
+        throw std::runtime_error("Muxer: Could not allocate passthrough stream");
+    }
+    if (avcodec_parameters_copy(stream->codecpar, inputParameters) < 0) {
+        throw std::runtime_error("Muxer: Could not copy passthrough stream parameters");
+    }
+    // The source container's codec tag may not be valid in the output container.
+    stream->codecpar->codec_tag = 0;
+    stream->time_base = inputStream->time_base;
+    stream->disposition = inputStream->disposition;
+    av_dict_copy(&stream->metadata, inputStream->metadata, 0);
+
+    passthroughTimebases.resize(stream->index + 1);
+    lastPassthroughDts.resize(stream->index + 1, INT64_MIN);
+    passthroughTimebases[stream->index] = Timebase{ inputStream->time_base.num, inputStream->time_base.den };
+    ++passthroughStreamCount;
+    VT_LOG_INFO("Muxer: Copying stream " << inputStream->index << " ("
+                << av_get_media_type_string(inputParameters->codec_type) << ", "
+                << avcodec_get_name(inputParameters->codec_id) << ") to output stream " << stream->index);
+    return stream->index;
+}
+
+// Queues a passthrough packet until the video reaches its decode time.
+void H265Muxer::writePassthroughPacket(AVPacket* packet, int outputStreamIndex) {
+    if (outputStreamIndex <= 0 || outputStreamIndex >= static_cast<int>(passthroughTimebases.size()) ||
+        !passthroughTimebases[outputStreamIndex].isValid()) {
+        throw std::invalid_argument("Muxer: Not a passthrough stream index");
+    }
+    const Timebase& timebase = passthroughTimebases[outputStreamIndex];
+    int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    int64_t dtsMicroseconds = dts == AV_NOPTS_VALUE
+        ? AV_NOPTS_VALUE
+        : av_rescale_q(dts, av_make_q(timebase.num, timebase.den), AV_TIME_BASE_Q);
+    if (dtsMicroseconds != AV_NOPTS_VALUE && outputStreamIndex < static_cast<int>(resumePassthroughDts.size()) &&
+        dtsMicroseconds <= resumePassthroughDts[outputStreamIndex]) {
+        av_packet_unref(packet);
+        return;
+    }
+
+    AVPacket* queued = packets.acquire();
+    av_packet_move_ref(queued, packet);
+    queued->stream_index = outputStreamIndex;
+    passthroughQueue.push(queued, dtsMicroseconds);
+    ++passthroughPacketCount;
+
+    // Only the bound is enforced here; ordering against the video happens in writePacket().
+    if (headerWritten) {
+        flushPassthrough(AV_NOPTS_VALUE);
+    }
+}
+
+// Writes everything left in the passthrough queue.
+void H265Muxer::finish() {
+    if (!headerWritten) {
+        writeHeader();
+    }
+    PassthroughQueue::Entry queued;
+    while (passthroughQueue.pop(queued)) {
+        writeQueuedPacket(queued);
+    }
+}
+
+// Flushes the fragment (movflags frag_custom).
+uint64_t H265Muxer::cutFragment(int64_t nextVideoDts) {
+    if (!fragmented.enabled) {
+        throw std::logic_error("Muxer: Fragments can only be cut in fragmented output");
+    }
+    if (!headerWritten) {
+        writeHeader();
+    }
+    flushPassthrough(av_rescale_q(nextVideoDts, av_make_q(packetTimebase.num, packetTimebase.den), AV_TIME_BASE_Q));
+    if (av_write_frame(formatContext, nullptr) < 0) {
+        throw std::runtime_error("Muxer: Could not write a fragment");
+    }
+    avio_flush(formatContext->pb);
+    // The checkpoint saved next refers to the fragment, so it must be on disk first. An
+    // fsync through any descriptor of the file writes all of its data.
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || ::fsync(fd) != 0) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("Muxer: Could not sync " + filepath + ": " + std::strerror(errno));
+    }
+    ::close(fd);
+    ++fragmentCount;
+    return static_cast<uint64_t>(avio_tell(formatContext->pb));
+}
+
+int H265Muxer::getOutputStreamCount() const {
+    return static_cast<int>(formatContext->nb_streams);
+}
+
+void H265Muxer::skipPassthroughUntil(const std::vector<int64_t>& dtsMicroseconds) {
+    resumePassthroughDts = dtsMicroseconds;
+}
+
+// Writes the queued packets that are due, in arrival order, which is DTS order per stream.
+void H265Muxer::flushPassthrough(int64_t dtsMicroseconds) {
+    PassthroughQueue::Entry queued;
+    while (passthroughQueue.popDue(dtsMicroseconds, queued)) {
+        writeQueuedPacket(queued);
+    }
+}
+
+// Rescales a queued packet to its output stream's time base and writes it.
+void H265Muxer::writeQueuedPacket(PassthroughQueue::Entry& queued) {
+    AVStream* stream = formatContext->streams[queued.packet->stream_index];
+    const Timebase& timebase = passthroughTimebases[queued.packet->stream_index];
+    av_packet_rescale_ts(queued.packet, av_make_q(timebase.num, timebase.den), stream->time_base);
+    queued.packet->pos = -1;
+    if (queued.dtsMicroseconds != AV_NOPTS_VALUE) {
+        lastPassthroughDts[queued.packet->stream_index] = queued.dtsMicroseconds;
+    }
+    passthroughBytesCounter().add(static_cast<uint64_t>(queued.packet->size));
+    // Packets are interleaved here already, so FFmpeg's queue is skipped. av_write_frame()
+    // references the payload for as long as it needs it; the ring drops ours.
+    if (av_write_frame(formatContext, queued.packet) < 0) {
+        VT_LOG_WARNING("Muxer: Warning, failed to write passthrough packet.");
+    }
+    packets.release(queued.packet);
+}
+
 // Writes the container header to the file.
 void H265Muxer::writeHeader() {
-    if (avformat_write_header(formatContext, nullptr) < 0) {
+    AVDictionary* muxerOptions = nullptr;
+    bool resuming = fragmented.resumeBytes > 0;
+    if (fragmented.enabled) {
+        // Fragments are cut by cutFragment() only, and the moov lists no samples.
+        std::string movflags = "frag_custom+empty_moov+default_base_moof";
+        if (resuming) {
+            // Fragment decode times follow the packet timestamps instead of restarting at 0.
+            movflags += "+frag_discont";
+            av_dict_set_int(&muxerOptions, "fragment_index", fragmented.resumeFragments + 1, 0);
+        }
+        av_dict_set(&muxerOptions, "movflags", movflags.c_str(), 0);
+    }
+    // A resumed file already starts with the header; the new one goes to memory and is dropped.
+    AVIOContext* filePb = formatContext->pb;
+    if (resuming && avio_open_dyn_buf(&formatContext->pb) < 0) {
+        av_dict_free(&muxerOptions);
+        throw std::runtime_error("Muxer: Could not allocate the header buffer");
+    }
+    int result = avformat_write_header(formatContext, &muxerOptions);
+    av_dict_free(&muxerOptions);
+    if (resuming) {
+        uint8_t* header = nullptr;
+        avio_close_dyn_buf(formatContext->pb, &header);
+        av_free(header);
+        formatContext->pb = filePb;
+    }
+    if (result < 0) {
         throw std::runtime_error("Muxer: Error occurred when writing header");
     }
     headerWritten = true;
-    std::cout << "Muxer: Wrote container header." << std::endl;
+    VT_LOG_DEBUG("Muxer: Wrote container header.");
 }
 
 // Writes a single compressed frame to the output file.
-void H265Muxer::writePacket(const std::vector<uint8_t>& data, int64_t pts) {
+void H265Muxer::writePacket(const uint8_t* data, int size, const FrameTimestamp& timestamp, bool keyframe) {
     // The header must be written before the first packet.
     if (!headerWritten) {
         writeHeader();
     }
 
-    AVPacket packet{};
-    av_init_packet(&packet);
+    AVPacket* packet = packets.acquire();
+    packet->size = size;
+    packet->stream_index = videoStream->index;
 
-    packet.data = const_cast<uint8_t*>(data.data());
-    packet.size = data.size();
-    packet.stream_index = videoStream->index;
+    // Rescale the timestamps from the pipeline's timebase to the stream's timebase,
+    // which the container may have changed in avformat_write_header().
+    AVRational srcTimebase = av_make_q(packetTimebase.num, packetTimebase.den);
+    packet->pts = av_rescale_q(timestamp.pts, srcTimebase, videoStream->time_base);
+    packet->dts = av_rescale_q(timestamp.dts, srcTimebase, videoStream->time_base);
+    packet->duration = av_rescale_q(timestamp.duration, srcTimebase, videoStream->time_base);
 
-    // Rescale the timestamp from the application's timebase to the stream's timebase.
-    // For this project, we can assume they are the same (based on FPS).
-    packet.pts = pts;
-    packet.dts = pts; // For simple cases, DTS can be the same as PTS.
+    if (keyframe) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
 
-    // A simple check for keyframes (IDR frames in H.265).
-    // A proper implementation would parse the NAL unit type from the bitstream.
-    // For now, we assume all packets passed could be keyframes for simplicity.
-    packet.flags |= AV_PKT_FLAG_KEY;
+    // Passthrough packets that decode before this frame go first.
+    flushPassthrough(av_rescale_q(timestamp.dts, srcTimebase, AV_TIME_BASE_Q));
 
-    // Write the compressed frame to the media file.
-    if (av_interleaved_write_frame(formatContext, &packet) < 0) {
-        std::cerr << "Muxer: Warning, failed to write packet." << std::endl;
+    // Write the compressed frame to the media file. The packet has no buffer reference,
+    // so av_write_frame() neither copies the data nor references it: the container
+    // takes what it needs before returning.
+    videoBytesCounter().add(size);
+    packet->data = const_cast<uint8_t*>(data);
+    if (av_write_frame(formatContext, packet) < 0) {
+        VT_LOG_WARNING("Muxer: Warning, failed to write packet.");
     }
-
-    av_packet_unref(&packet);
+    packets.release(packet);
 }
 
@@ -5,45 +5,134 @@
 #include <stdexcept>
 #include <cstdint> // <--- FIX: Added this include for uint8_t
 
+#include "TimestampTracker.hpp"
+#include "PacketRing.hpp"
+#include "PassthroughQueue.hpp"
+#include "VideoTrackSize.hpp"
+
 // Forward declarations for FFmpeg types to avoid including the C headers
 // in a C++ header file.
 struct AVFormatContext;
 struct AVPacket;
 struct AVStream;
 
+// Fragmented MP4 output: the file is a header followed by self-contained fragments, so
+// it stays playable up to the last complete fragment if the process dies, and a later
+// process can truncate it there and append.
+struct FragmentedOutput {
+    bool enabled = false;
+    // When resuming: the bytes of the existing file to keep and the fragments they hold.
+    uint64_t resumeBytes = 0;
+    uint32_t resumeFragments = 0;
+};
+
 // The H265Muxer class encapsulates the logic for writing a raw H.265
 // bitstream into an MP4 container file using the FFmpeg libraries.
+// Audio, subtitle and data streams of the source can be copied alongside the video.
+// Their packets arrive ahead of the encoded video, so they are held back and written
+// in DTS order with it; the queue is bounded, and packets beyond the bound are
+// written early rather than buffered without limit.
 class H265Muxer {
 public:
     // Constructor: Creates the output file and initializes the muxer.
-    // It sets up the video stream with the specified parameters.
+    // It sets up the video stream with the specified parameters. Packet timestamps
+    // are given in timebase and rescaled to whatever the container chooses.
     // Throws a std::runtime_error on failure.
-    H265Muxer(const std::string& filepath, int width, int height, int fps);
+    H265Muxer(const std::string& filepath, int width, int height, Timebase timebase, Timebase frameRate,
+              const FragmentedOutput& fragmented = FragmentedOutput{});
 
     // Destructor: Finalizes the MP4 file by writing the trailer and
     // closes all FFmpeg resources.
     ~H265Muxer();
 
     // Writes a single compressed video packet to the output file.
-    // The data vector contains the raw H.265 NAL units for one frame.
-    // The pts (Presentation Timestamp) is crucial for correct playback timing.
-    void writePacket(const std::vector<uint8_t>& data, int64_t pts);
+    // data holds the raw H.265 NAL units for one frame in its first size bytes, followed
+    // by zeroed padding. The packet is written before this returns, so data can be
+    // reused right after. The timestamps are in the time base given to the constructor.
+    void writePacket(const uint8_t* data, int size, const FrameTimestamp& timestamp, bool keyframe);
 
     // Writes the initial H.265 parameter sets (VPS, SPS, PPS) to the
     // stream's configuration. This is typically done once before writing any frames.
     void setCodecParameters(const std::vector<uint8_t>& vps, const std::vector<uint8_t>& sps, const std::vector<uint8_t>& pps);
 
+    // Adds an output stream that copies inputStream without re-encoding. Must be called
+    // before the first packet is written. Returns the output stream index, or -1 if the
+    // container cannot store the stream's codec.
+    int addPassthroughStream(const AVStream* inputStream);
+
+    // Queues a packet of a passthrough stream, in the input stream's time base, to be
+    // interleaved with the video. The queue takes over the packet's reference and
+    // leaves it blank.
+    void writePassthroughPacket(AVPacket* packet, int outputStreamIndex);
+
+    // Declares the video track for pictures up to maxWidth x maxHeight with in-band
+    // parameter sets, so the stream may change size at an IDR. Must be called before
+    // the first packet is written.
+    void allowSizeChanges(int maxWidth, int maxHeight);
+
+    // Video packets from the next IDR on hold pictures of width x height. Throws a
+    // std::runtime_error if the track header cannot describe them.
+    void changeVideoSize(int width, int height);
+    const VideoTrackSize& getTrackSize() const { return trackSize; }
+
+    // Writes every queued passthrough packet. Call once after the last video packet.
+    void finish();
+
+    // Fragmented output only: closes the current fragment with everything written so
+    // far, after the passthrough packets that decode no later than nextVideoDts, the
+    // DTS of the video packet after the cut. A resumed transcode seeks to that packet,
+    // so packets queued before it would otherwise be lost. Returns the file size, up
+    // to which the file is complete.
+    uint64_t cutFragment(int64_t nextVideoDts);
+    uint32_t getFragmentCount() const { return fragmentCount; }
+    int getOutputStreamCount() const;
+
+    // Decode time in microseconds of the last passthrough packet written to each output
+    // stream, INT64_MIN for none.
+    const std::vector<int64_t>& getLastPassthroughDts() const { return lastPassthroughDts; }
+    // Drops passthrough packets that decode no later than these times, per output
+    // stream, because a resumed output already holds them.
+    void skipPassthroughUntil(const std::vector<int64_t>& dtsMicroseconds);
+
+    int getPassthroughStreamCount() const { return passthroughStreamCount; }
+    uint64_t getPassthroughPacketCount() const { return passthroughPacketCount; }
+    // Passthrough packets written ahead of the video because the queue was full.
+    uint64_t getForcedPassthroughCount() const { return passthroughQueue.getForcedCount(); }
+
 
 private:
     // --- Private FFmpeg Handles ---
     AVFormatContext* formatContext = nullptr;
     AVStream* videoStream = nullptr;
+    // Time base of the timestamps passed to writePacket().
+    Timebase packetTimebase;
+    std::string filepath;
+    VideoTrackSize trackSize;
+
+    // The packets handed to FFmpeg, the video packet and the queued passthrough ones.
+    PacketRing packets;
+    // Passthrough packets waiting for the video to catch up.
+    PassthroughQueue passthroughQueue;
+    // Source time base of each output stream, indexed by stream index; unused for video.
+    std::vector<Timebase> passthroughTimebases;
+    int passthroughStreamCount = 0;
+    uint64_t passthroughPacketCount = 0;
+    std::vector<int64_t> lastPassthroughDts;
+    std::vector<int64_t> resumePassthroughDts;
+
+    FragmentedOutput fragmented;
+    uint32_t fragmentCount = 0;
 
     // --- Private Helper Methods ---
     // Writes the MP4 container header to the file. Must be called after
     // setting codec parameters and before writing any packets.
     void writeHeader();
 
+    // Writes queued passthrough packets that decode no later than dtsMicroseconds,
+    // then any beyond the queue bound.
+    void flushPassthrough(int64_t dtsMicroseconds);
+    void writeQueuedPacket(PassthroughQueue::Entry& queued);
+
     // Flag to ensure the header is only written once.
     bool headerWritten = false;
 };
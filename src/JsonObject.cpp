@@ -0,0 +1,340 @@
+#include "JsonObject.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+    // Recursive-descent reader over the input text.
+    class Reader {
+    public:
+        explicit Reader(const std::string& text) : text(text) {}
+
+        void skipWhitespace() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+                ++pos;
+            }
+        }
+
+        bool atEnd() { skipWhitespace(); return pos >= text.size(); }
+
+        char peek() {
+            skipWhitespace();
+            if (pos >= text.size()) {
+                fail("unexpected end of input");
+            }
+            return text[pos];
+        }
+
+        void expect(char c) {
+            if (peek() != c) {
+                fail(std::string("expected '") + c + "'");
+            }
+            ++pos;
+        }
+
+        std::string readString() {
+            expect('"');
+            std::string out;
+            while (true) {
+                if (pos >= text.size()) {
+                    fail("unterminated string");
+                }
+                char c = text[pos++];
+                if (c == '"') {
+                    return out;
+                }
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    fail("control character in string");
+                }
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= text.size()) {
+                    fail("unterminated escape");
+                }
+                switch (text[pos++]) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': appendUtf8(out, readCodePoint()); break;
+                    default: fail("invalid escape");
+                }
+            }
+        }
+
+        JsonObject::Value readValue() {
+            char c = peek();
+            if (c == '"') {
+                return readString();
+            }
+            if (c == '{' || c == '[') {
+                fail("nested objects and arrays are not supported");
+            }
+            if (matchWord("true")) return true;
+            if (matchWord("false")) return false;
+            if (matchWord("null")) return nullptr;
+            // strtod accepts more than JSON numbers (hex, inf); those are rejected below.
+            const char* begin = text.c_str() + pos;
+            char* end = nullptr;
+            double number = std::strtod(begin, &end);
+            if (end == begin || !std::isfinite(number) || (c != '-' && (c < '0' || c > '9'))) {
+                fail("invalid value");
+            }
+            for (const char* p = begin; p != end; ++p) {
+                if (std::char_traits<char>::find("0123456789+-.eE", 15, *p) == nullptr) {
+                    fail("invalid number");
+                }
+            }
+            pos += static_cast<size_t>(end - begin);
+            return number;
+        }
+
+        [[noreturn]] void fail(const std::string& message) {
+            throw std::invalid_argument("JSON: " + message + " at offset " + std::to_string(pos));
+        }
+
+    private:
+        const std::string& text;
+        size_t pos = 0;
+
+        bool matchWord(const char* word) {
+            size_t length = std::char_traits<char>::length(word);
+            if (text.compare(pos, length, word) == 0) {
+                pos += length;
+                return true;
+            }
+            return false;
+        }
+
+        uint32_t readHex4() {
+            if (pos + 4 > text.size()) {
+                fail("truncated \\u escape");
+            }
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = text[pos++];
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= c - '0';
+                else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+                else fail("invalid \\u escape");
+            }
+            return value;
+        }
+
+        uint32_t readCodePoint() {
+            uint32_t high = readHex4();
+            if (high < 0xD800 || high > 0xDBFF) {
+                return high;
+            }
+            // A high surrogate must be followed by an escaped low surrogate.
+            if (text.compare(pos, 2, "\\u") != 0) {
+                fail("unpaired surrogate");
+            }
+            pos += 2;
+            uint32_t low = readHex4();
+            if (low < 0xDC00 || low > 0xDFFF) {
+                fail("unpaired surrogate");
+            }
+            return 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        static void appendUtf8(std::string& out, uint32_t cp) {
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+    };
+
+    void appendEscaped(std::string& out, const std::string& value) {
+        out += '"';
+        for (char c : value) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escape[8];
+                        std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+                        out += escape;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        out += '"';
+    }
+
+    void appendNumber(std::string& out, double value) {
+        char buffer[32];
+        // Integers are written without a fraction so counters and ids read naturally.
+        if (std::isfinite(value) && value == std::floor(value) && std::fabs(value) < 9007199254740992.0) {
+            std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+        } else if (std::isfinite(value)) {
+            // The shortest form that reads back as the same double.
+            for (int precision = 6; precision <= 17; ++precision) {
+                std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+                if (std::strtod(buffer, nullptr) == value) {
+                    break;
+                }
+            }
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "null");
+        }
+        out += buffer;
+    }
+
+    const char* typeName(const JsonObject::Value& value) {
+        static const char* names[] = { "null", "boolean", "number", "string" };
+        return names[value.index()];
+    }
+}
+
+JsonObject JsonObject::parse(const std::string& text) {
+    Reader reader(text);
+    JsonObject object;
+    reader.expect('{');
+    if (reader.peek() == '}') {
+        reader.expect('}');
+    } else {
+        while (true) {
+            std::string key = reader.readString();
+            reader.expect(':');
+            object.setValue(key, reader.readValue());
+            if (reader.peek() == ',') {
+                reader.expect(',');
+                continue;
+            }
+            reader.expect('}');
+            break;
+        }
+    }
+    if (!reader.atEnd()) {
+        reader.fail("trailing characters");
+    }
+    return object;
+}
+
+JsonObject& JsonObject::setValue(const std::string& key, Value value) {
+    for (auto& entry : values) {
+        if (entry.first == key) {
+            entry.second = std::move(value);
+            return *this;
+        }
+    }
+    values.emplace_back(key, std::move(value));
+    return *this;
+}
+
+const JsonObject::Value* JsonObject::find(const std::string& key) const {
+    for (const auto& entry : values) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+const std::string& JsonObject::getString(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value) {
+        throw std::invalid_argument("Missing field \"" + key + "\"");
+    }
+    if (!std::holds_alternative<std::string>(*value)) {
+        throw std::invalid_argument("Field \"" + key + "\" must be a string, not " + typeName(*value));
+    }
+    return std::get<std::string>(*value);
+}
+
+std::string JsonObject::getString(const std::string& key, const std::string& fallback) const {
+    return has(key) ? getString(key) : fallback;
+}
+
+bool JsonObject::getBool(const std::string& key, bool fallback) const {
+    const Value* value = find(key);
+    if (!value) {
+        return fallback;
+    }
+    if (!std::holds_alternative<bool>(*value)) {
+        throw std::invalid_argument("Field \"" + key + "\" must be a boolean, not " + typeName(*value));
+    }
+    return std::get<bool>(*value);
+}
+
+uint64_t JsonObject::getUint64(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value) {
+        throw std::invalid_argument("Missing field \"" + key + "\"");
+    }
+    const double* number = std::get_if<double>(value);
+    if (!number || *number < 0 || *number != std::floor(*number) || *number >= 18446744073709551616.0) {
+        throw std::invalid_argument("Field \"" + key + "\" must be a non-negative integer");
+    }
+    return static_cast<uint64_t>(*number);
+}
+
+int64_t JsonObject::getInt64(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value) {
+        throw std::invalid_argument("Missing field \"" + key + "\"");
+    }
+    const double* number = std::get_if<double>(value);
+    if (!number || *number != std::floor(*number) || std::fabs(*number) >= 9223372036854775808.0) {
+        throw std::invalid_argument("Field \"" + key + "\" must be an integer");
+    }
+    return static_cast<int64_t>(*number);
+}
+
+uint32_t JsonObject::getUint32(const std::string& key, uint32_t fallback) const {
+    if (!has(key)) {
+        return fallback;
+    }
+    uint64_t value = getUint64(key);
+    if (value > UINT32_MAX) {
+        throw std::invalid_argument("Field \"" + key + "\" is out of range");
+    }
+    return static_cast<uint32_t>(value);
+}
+
+std::string JsonObject::dump() const {
+    std::string out = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        appendEscaped(out, values[i].first);
+        out += ':';
+        const Value& value = values[i].second;
+        switch (value.index()) {
+            case 0: out += "null"; break;
+            case 1: out += std::get<bool>(value) ? "true" : "false"; break;
+            case 2: appendNumber(out, std::get<double>(value)); break;
+            case 3: appendEscaped(out, std::get<std::string>(value)); break;
+        }
+    }
+    out += '}';
+    return out;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// A flat JSON object: string keys with string, number, boolean or null values, kept
+// in insertion order. This is all the daemon protocol needs; nested objects and
+// arrays are rejected when parsing.
+class JsonObject {
+public:
+    using Value = std::variant<std::nullptr_t, bool, double, std::string>;
+
+    // Parses one JSON object. Throws a std::invalid_argument on malformed or nested input.
+    static JsonObject parse(const std::string& text);
+
+    // Adds or replaces a value. Returns *this so calls can be chained.
+    JsonObject& set(const std::string& key, const std::string& value) { return setValue(key, value); }
+    JsonObject& set(const std::string& key, const char* value) { return setValue(key, std::string(value)); }
+    JsonObject& set(const std::string& key, bool value) { return setValue(key, value); }
+    JsonObject& set(const std::string& key, std::nullptr_t) { return setValue(key, nullptr); }
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>>
+    JsonObject& set(const std::string& key, T value) { return setValue(key, static_cast<double>(value)); }
+
+    bool has(const std::string& key) const { return find(key) != nullptr; }
+
+    // Typed accessors. The single-argument forms throw a std::invalid_argument if the key
+    // is missing; all forms throw if the value has a different type.
+    const std::string& getString(const std::string& key) const;
+    std::string getString(const std::string& key, const std::string& fallback) const;
+    bool getBool(const std::string& key, bool fallback) const;
+    // A non-negative integer that fits in 32 bits.
+    uint32_t getUint32(const std::string& key, uint32_t fallback) const;
+    uint64_t getUint64(const std::string& key) const;
+    int64_t getInt64(const std::string& key) const;
+
+    // Serialises the object on a single line.
+    std::string dump() const;
+
+private:
+    std::vector<std::pair<std::string, Value>> values;
+
+    JsonObject& setValue(const std::string& key, Value value);
+    const Value* find(const std::string& key) const;
+};
@@ -0,0 +1,240 @@
+#include "Log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Lines buffered between the producers and the writer thread; a power of two.
+constexpr size_t LOG_RING_CAPACITY = 4096;
+// Upper bound on how long a line can sit in the ring when a wakeup is missed.
+constexpr std::chrono::milliseconds LOG_IDLE_POLL(50);
+
+namespace {
+    struct LogRecord {
+        LogLevel level = LogLevel::Info;
+        bool status = false;
+        std::string text;
+    };
+
+    // Bounded multi-producer queue (Vyukov): each slot's sequence number says whether
+    // it is free for the producer at that position or holds a record for the consumer.
+    // Only the writer thread pops.
+    class LogRing {
+    public:
+        LogRing() : slots(new Slot[LOG_RING_CAPACITY]) {
+            for (size_t i = 0; i < LOG_RING_CAPACITY; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool tryPush(LogRecord&& record) {
+            size_t position = enqueuePosition.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[position & (LOG_RING_CAPACITY - 1)];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0) {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+            slot->record = std::move(record);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(LogRecord& record) {
+            size_t position = dequeuePosition.load(std::memory_order_relaxed);
+            Slot& slot = slots[position & (LOG_RING_CAPACITY - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                return false;
+            }
+            record = std::move(slot.record);
+            slot.sequence.store(position + LOG_RING_CAPACITY, std::memory_order_release);
+            dequeuePosition.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t getEnqueuePosition() const { return enqueuePosition.load(std::memory_order_acquire); }
+        size_t getDequeuePosition() const { return dequeuePosition.load(std::memory_order_acquire); }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> sequence;
+            LogRecord record;
+        };
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<size_t> enqueuePosition{0};
+        alignas(64) std::atomic<size_t> dequeuePosition{0};
+    };
+
+    class Logger {
+    public:
+        std::atomic<int> level{static_cast<int>(LogLevel::Info)};
+        std::atomic<uint64_t> dropped{0};
+
+        Logger() : thread(&Logger::run, this) {
+            // The logger lives until the process ends, so lines logged during static
+            // destruction are still safe; exit only waits for what is queued.
+            std::atexit([] { Log::flush(); });
+        }
+
+        void push(LogRecord&& record) {
+            // Status updates are superseded by the next one, so they are skipped
+            // rather than counted, and never take the last half of the ring from lines.
+            if (record.status) {
+                if (ring.getEnqueuePosition() - ring.getDequeuePosition() >= LOG_RING_CAPACITY / 2 ||
+                    !ring.tryPush(std::move(record))) {
+                    return;
+                }
+            } else if (!ring.tryPush(std::move(record))) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (sleeping.load()) {
+                wakeup.notify_one();
+            }
+        }
+
+        void flush() {
+            if (std::this_thread::get_id() == thread.get_id()) {
+                return;
+            }
+            size_t target = ring.getEnqueuePosition();
+            wakeup.notify_one();
+            std::unique_lock<std::mutex> lock(flushMutex);
+            flushed.wait(lock, [this, target] { return written.load() >= target; });
+        }
+
+    private:
+        LogRing ring;
+        std::mutex wakeMutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> sleeping{false};
+        std::mutex flushMutex;
+        std::condition_variable flushed;
+        // Ring position up to which every record has been written out, not just popped.
+        std::atomic<size_t> written{0};
+        uint64_t reportedDrops = 0;
+        bool statusLineOpen = false;
+        std::thread thread;
+
+        void run() {
+            while (true) {
+                drain();
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                // Producers only notify while the writer sleeps. A push that races with
+                // falling asleep waits at most LOG_IDLE_POLL.
+                sleeping.store(true);
+                if (ring.getEnqueuePosition() == ring.getDequeuePosition()) {
+                    wakeup.wait_for(lock, LOG_IDLE_POLL);
+                }
+                sleeping.store(false);
+            }
+        }
+
+        void drain() {
+            LogRecord record;
+            std::string pendingStatus;
+            bool wrote = false;
+            while (ring.tryPop(record)) {
+                if (record.status) {
+                    pendingStatus = std::move(record.text);
+                    continue;
+                }
+                wrote |= writeStatus(pendingStatus);
+                writeLine(record);
+                wrote = true;
+            }
+            wrote |= writeStatus(pendingStatus);
+            uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                writeLine({ LogLevel::Warning, false, "Log: " + std::to_string(drops - reportedDrops) + " lines dropped" });
+                reportedDrops = drops;
+            }
+            if (wrote) {
+                std::cout.flush();
+            }
+            {
+                std::lock_guard<std::mutex> lock(flushMutex);
+                written.store(ring.getDequeuePosition());
+            }
+            flushed.notify_all();
+        }
+
+        bool writeStatus(std::string& text) {
+            if (text.empty()) {
+                return false;
+            }
+            std::cout << '\r' << text;
+            statusLineOpen = true;
+            text.clear();
+            return true;
+        }
+
+        void writeLine(const LogRecord& record) {
+            // Regular lines start below the status line rather than overwriting it.
+            if (statusLineOpen) {
+                std::cout << '\n';
+                statusLineOpen = false;
+            }
+            std::ostream& stream = record.level >= LogLevel::Warning ? std::cerr : std::cout;
+            if (&stream == &std::cerr) {
+                std::cout.flush();
+            }
+            stream << record.text << '\n';
+        }
+    };
+
+    Logger& logger() {
+        // Never destroyed; see the constructor.
+        static Logger* instance = new Logger();
+        return *instance;
+    }
+}
+
+void Log::setLevel(LogLevel level) {
+    logger().level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool Log::isEnabled(LogLevel level) {
+    return static_cast<int>(level) >= logger().level.load(std::memory_order_relaxed);
+}
+
+bool Log::parseLevel(const std::string& name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warning") level = LogLevel::Warning;
+    else if (name == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+void Log::write(LogLevel level, std::string text) {
+    logger().push({ level, false, std::move(text) });
+}
+
+void Log::status(std::string text) {
+    if (isEnabled(LogLevel::Info)) {
+        logger().push({ LogLevel::Info, true, std::move(text) });
+    }
+}
+
+void Log::flush() {
+    logger().flush();
+}
+
+uint64_t Log::getDroppedCount() {
+    return logger().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+enum class LogLevel { Debug = 0, Info = 1, Warning = 2, Error = 3 };
+
+// The lowest level compiled in. Log calls below it are discarded at compile time,
+// arguments included. Set by CMake: info for release builds, debug otherwise.
+#ifndef VT_LOG_MIN_LEVEL
+#define VT_LOG_MIN_LEVEL 0
+#endif
+
+// The Log class is the process-wide logger. A call formats its line on the calling
+// thread and pushes it into a lock-free ring buffer; a background thread writes the
+// lines out, so transcoding threads never wait on the console. Warnings and errors go
+// to stderr, everything else to stdout. When the ring is full, lines are dropped and
+// counted instead of blocking the caller.
+class Log {
+public:
+    // Lines below this level are skipped at run time (default Info).
+    static void setLevel(LogLevel level);
+    static bool isEnabled(LogLevel level);
+    // Parses "debug", "info", "warning" or "error". Returns false for anything else.
+    static bool parseLevel(const std::string& name, LogLevel& level);
+
+    static void write(LogLevel level, std::string text);
+
+    // Replaces the transient status line, e.g. progress. Status updates that are still
+    // queued when a newer one arrives are never printed.
+    static void status(std::string text);
+
+    // Blocks until every line logged so far has been written.
+    static void flush();
+
+    static uint64_t getDroppedCount();
+};
+
+#define VT_LOG(level, expr)                                              \
+    do {                                                                 \
+        if constexpr (static_cast<int>(level) >= VT_LOG_MIN_LEVEL) {     \
+            if (Log::isEnabled(level)) {                                 \
+                std::ostringstream vtLogStream;                          \
+                vtLogStream << expr;                                     \
+                Log::write(level, vtLogStream.str());                    \
+            }                                                            \
+        }                                                                \
+    } while (0)
+
+#define VT_LOG_DEBUG(expr) VT_LOG(LogLevel::Debug, expr)
+#define VT_LOG_INFO(expr) VT_LOG(LogLevel::Info, expr)
+#define VT_LOG_WARNING(expr) VT_LOG(LogLevel::Warning, expr)
+#define VT_LOG_ERROR(expr) VT_LOG(LogLevel::Error, expr)
@@ -0,0 +1,474 @@
+#include "LookaheadAnalyzer.hpp"
+#include "LookaheadKernels.hpp"
+#include "VulkanUtils.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef VT_HAVE_COMPUTE_SHADERS
+// SPIR-V generated at build time from shaders/lookahead_downscale.comp.
+static const uint32_t kLookaheadShaderCode[] =
+#include "lookahead_downscale.comp.spv.h"
+;
+#endif
+
+namespace {
+    using LookaheadKernels::BLOCK_SIZE;
+    using LookaheadKernels::sumAbsDiff;
+    constexpr uint32_t WORKGROUP_SIZE = 8;
+    constexpr uint32_t HISTOGRAM_BINS = 32;
+
+    // A cut must also be this many times the running average SAD, so that sustained
+    // motion or noise does not trigger cuts.
+    constexpr double CUT_SAD_RATIO = 3.0;
+    constexpr double MIN_CUT_SAD = 8.0;
+    // A frame after a cut that is this much closer to the frame before the cut than the
+    // cut itself marks the cut as a flash.
+    constexpr double FLASH_RATIO = 0.5;
+    constexpr int32_t MAX_QP_DELTA = 2;
+
+    struct PushConstants {
+        uint32_t thumbnailWidth;
+        uint32_t thumbnailHeight;
+        uint32_t sampleShift;
+    };
+
+    // Makes device writes to a host-visible buffer visible to the CPU once the
+    // submission's semaphore has been waited on.
+    void recordHostReadBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess) {
+        VkMemoryBarrier2 barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+        VkDependencyInfo dependency{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        dependency.memoryBarrierCount = 1;
+        dependency.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(commandBuffer, &dependency);
+    }
+}
+
+LookaheadAnalyzer::LookaheadAnalyzer(VulkanBase* vulkanBase, ImageStateTracker& imageStates, VkExtent2D extent,
+                                     uint32_t bitDepth, uint32_t slotCount, const LookaheadOptions& options)
+    : vulkanBase(vulkanBase), imageStates(imageStates), extent(extent), options(options) {
+    if (!vulkanBase->getQueueFamilyIndices().computeFamily.has_value()) {
+        throw std::runtime_error("Lookahead analysis requires a compute queue!");
+    }
+    if (options.minIdrInterval > options.maxIdrInterval) {
+        throw std::invalid_argument("Lookahead minimum IDR interval exceeds the maximum.");
+    }
+
+    bytesPerSample = bitDepth > 8 ? 2 : 1;
+    thumbnailWidth = LookaheadKernels::getThumbnailWidth(extent.width);
+    thumbnailHeight = LookaheadKernels::getThumbnailHeight(extent.height);
+    gpuPath = isGpuPathSupported();
+
+    VkDevice device = vulkanBase->getDevice();
+    VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = vulkanBase->getQueueFamilyIndices().computeFamily.value();
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead command pool!");
+    }
+
+    slots.resize(slotCount);
+    window.reserve(slotCount);
+    spareThumbnails.reserve(slotCount + 1);
+    if (gpuPath) {
+        createGpuPipeline(slotCount);
+    } else {
+        VkDeviceSize lumaSize = static_cast<VkDeviceSize>(extent.width) * extent.height * bytesPerSample;
+        VulkanUtils::createBuffer(vulkanBase->getPhysicalDevice(), device, lumaSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+        vkMapMemory(device, readbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &pReadbackHost);
+        stagingTimeline = std::make_unique<TimelineSemaphore>(device);
+    }
+    VT_LOG_INFO("Lookahead: " << options.depth << " frames, " << thumbnailWidth << "x" << thumbnailHeight
+                << " thumbnails on " << (gpuPath ? "GPU (compute shader)" : "CPU (SIMD)"));
+}
+
+LookaheadAnalyzer::~LookaheadAnalyzer() {
+    VkDevice device = vulkanBase->getDevice();
+    for (auto& slot : slots) {
+        if (slot.view) vkDestroyImageView(device, slot.view, nullptr);
+        if (slot.buffer) {
+            vkUnmapMemory(device, slot.bufferMemory);
+            vkDestroyBuffer(device, slot.buffer, nullptr);
+            vkFreeMemory(device, slot.bufferMemory, nullptr);
+        }
+    }
+    if (pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+    if (pipelineLayout) vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    if (descriptorPool) vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    if (descriptorSetLayout) vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    if (sampler) vkDestroySampler(device, sampler, nullptr);
+    if (readbackBuffer) {
+        vkUnmapMemory(device, readbackBufferMemory);
+        vkDestroyBuffer(device, readbackBuffer, nullptr);
+        vkFreeMemory(device, readbackBufferMemory, nullptr);
+    }
+    stagingTimeline.reset();
+    if (commandPool) vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+bool LookaheadAnalyzer::isGpuPathSupported() const {
+#ifdef VT_HAVE_COMPUTE_SHADERS
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(vulkanBase->getPhysicalDevice(),
+        bytesPerSample == 2 ? VK_FORMAT_R16_UINT : VK_FORMAT_R8_UINT, &props);
+    return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+#else
+    return false;
+#endif
+}
+
+VkImageUsageFlags LookaheadAnalyzer::getPictureUsage() const {
+    return gpuPath ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+}
+
+VkImageCreateFlags LookaheadAnalyzer::getImageCreateFlags() const {
+    // A single-plane view with a different format and usage than the video picture itself.
+    return gpuPath ? (VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) : 0;
+}
+
+void LookaheadAnalyzer::createGpuPipeline(uint32_t slotCount) {
+#ifdef VT_HAVE_COMPUTE_SHADERS
+    VkDevice device = vulkanBase->getDevice();
+
+    // Integer formats are only fetched, so the sampler never filters.
+    VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead sampler!");
+    }
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = &sampler;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSizes[2] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slotCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, slotCount}
+    };
+    VkDescriptorPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    poolInfo.maxSets = slotCount;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead descriptor pool!");
+    }
+
+    VkPushConstantRange pushConstantRange{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants)};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    moduleInfo.codeSize = sizeof(kLookaheadShaderCode);
+    moduleInfo.pCode = kLookaheadShaderCode;
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    VkResult result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create lookahead compute pipeline!");
+    }
+#else
+    (void)slotCount;
+#endif
+}
+
+void LookaheadAnalyzer::bindSlot(uint32_t slotIndex, VkImage image, QueueAccess from, QueueAccess to) {
+    VkDevice device = vulkanBase->getDevice();
+    Slot& slot = slots.at(slotIndex);
+    slot.image = image;
+
+    VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate lookahead command buffer!");
+    }
+
+    if (gpuPath) {
+        slot.view = VulkanUtils::createPlaneImageView(device, image,
+            bytesPerSample == 2 ? VK_FORMAT_R16_UINT : VK_FORMAT_R8_UINT, VK_IMAGE_ASPECT_PLANE_0_BIT, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+        VkDeviceSize thumbnailSize = static_cast<VkDeviceSize>(thumbnailWidth) * thumbnailHeight;
+        VulkanUtils::createBuffer(vulkanBase->getPhysicalDevice(), device, thumbnailSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot.buffer, slot.bufferMemory);
+        vkMapMemory(device, slot.bufferMemory, 0, VK_WHOLE_SIZE, 0, &slot.pHost);
+
+        VkDescriptorSetAllocateInfo setInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        setInfo.descriptorPool = descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &descriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &setInfo, &slot.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate lookahead descriptor set!");
+        }
+
+        VkDescriptorImageInfo imageInfo{sampler, slot.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkDescriptorBufferInfo bufferInfo{slot.buffer, 0, VK_WHOLE_SIZE};
+        VkWriteDescriptorSet writes[2]{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = slot.descriptorSet;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &imageInfo;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = slot.descriptorSet;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[1].pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+        recordGpuCommands(slot, from, to);
+    } else {
+        slot.thumbnail.resize(static_cast<size_t>(thumbnailWidth) * thumbnailHeight);
+        recordCpuCommands(slot, from, to);
+    }
+}
+
+// The slot's picture never changes, so its command buffer is recorded once and resubmitted.
+void LookaheadAnalyzer::recordGpuCommands(Slot& slot, QueueAccess from, QueueAccess to) {
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+    BarrierBuilder barriers(imageStates);
+    barriers.acquireFrom(slot.image, from, {ImageAccess::ComputeSampled, vulkanBase->getQueueFamilyIndices().computeFamily.value()})
+            .record(slot.commandBuffer);
+
+    PushConstants params{thumbnailWidth, thumbnailHeight, bytesPerSample == 2 ? 8u : 0u};
+    vkCmdBindPipeline(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &slot.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(slot.commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(slot.commandBuffer,
+        (thumbnailWidth / 4 + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+        (thumbnailHeight + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+    barriers.release(slot.image, to.access, to.queueFamily).record(slot.commandBuffer);
+    recordHostReadBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    vkEndCommandBuffer(slot.commandBuffer);
+}
+
+void LookaheadAnalyzer::recordCpuCommands(Slot& slot, QueueAccess from, QueueAccess to) {
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_PLANE_0_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+    BarrierBuilder barriers(imageStates);
+    barriers.acquireFrom(slot.image, from, {ImageAccess::TransferSrc, vulkanBase->getQueueFamilyIndices().computeFamily.value()})
+            .record(slot.commandBuffer);
+    vkCmdCopyImageToBuffer(slot.commandBuffer, slot.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+    barriers.release(slot.image, to.access, to.queueFamily).record(slot.commandBuffer);
+    recordHostReadBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    vkEndCommandBuffer(slot.commandBuffer);
+}
+
+void LookaheadAnalyzer::submit(uint32_t slotIndex, const VkSemaphoreSubmitInfo& wait, const VkSemaphoreSubmitInfo& signal) {
+    VkQueue queue = vulkanBase->getComputeQueue();
+    Slot& slot = slots.at(slotIndex);
+
+    VkCommandBufferSubmitInfo commandBufferInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+    commandBufferInfo.commandBuffer = slot.commandBuffer;
+
+    VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+    submitInfo.waitSemaphoreInfoCount = 1;
+    submitInfo.pWaitSemaphoreInfos = &wait;
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+
+    if (gpuPath) {
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signal;
+        if (vulkanBase->queueSubmit(queue, 1, &submitInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit lookahead analysis!");
+        }
+        return;
+    }
+
+    // The readback buffer is shared by all slots, so the luma plane is downscaled into
+    // the slot's thumbnail before the next readback can overwrite it.
+    uint64_t readbackValue = stagingTimeline->nextValue();
+    VkSemaphoreSubmitInfo signals[2] = {
+        signal,
+        stagingTimeline->submitInfo(readbackValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT)
+    };
+    submitInfo.signalSemaphoreInfoCount = 2;
+    submitInfo.pSignalSemaphoreInfos = signals;
+    if (vulkanBase->queueSubmit(queue, 1, &submitInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit lookahead readback!");
+    }
+    stagingTimeline->wait(readbackValue);
+
+    auto start = std::chrono::steady_clock::now();
+    LookaheadKernels::downscaleLuma(pReadbackHost, static_cast<size_t>(extent.width) * bytesPerSample, bytesPerSample,
+                                    extent.width, extent.height, slot.thumbnail.data());
+    stats.cpuMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void LookaheadAnalyzer::collect(uint32_t slotIndex) {
+    auto start = std::chrono::steady_clock::now();
+    const Slot& slot = slots.at(slotIndex);
+    size_t size = static_cast<size_t>(thumbnailWidth) * thumbnailHeight;
+
+    WindowFrame frame;
+    if (!spareThumbnails.empty()) {
+        frame.thumbnail = std::move(spareThumbnails.back());
+        spareThumbnails.pop_back();
+    }
+    if (gpuPath) {
+        const uint8_t* src = static_cast<const uint8_t*>(slot.pHost);
+        frame.thumbnail.assign(src, src + size);
+    } else {
+        frame.thumbnail = slot.thumbnail;
+    }
+
+    // Histogram change and SAD against the previously collected frame.
+    uint32_t histogram[HISTOGRAM_BINS] = {};
+    for (uint8_t value : frame.thumbnail) {
+        ++histogram[value >> 3];
+    }
+    if (haveLastCollected) {
+        frame.sad = static_cast<double>(sumAbsDiff(frame.thumbnail.data(), lastCollected.data(), size)) / size;
+        uint64_t histogramDistance = 0;
+        for (uint32_t i = 0; i < HISTOGRAM_BINS; ++i) {
+            histogramDistance += static_cast<uint64_t>(std::abs(static_cast<int64_t>(histogram[i]) - lastHistogram[i]));
+        }
+        frame.histogramDelta = static_cast<double>(histogramDistance) / (2.0 * size);
+    } else {
+        frame.first = true;
+    }
+
+    // Horizontal gradient over the blocks inside the picture.
+    uint32_t validWidth = (extent.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (validWidth > 1) {
+        uint64_t gradient = 0;
+        for (uint32_t y = 0; y < thumbnailHeight; ++y) {
+            const uint8_t* row = frame.thumbnail.data() + static_cast<size_t>(y) * thumbnailWidth;
+            gradient += sumAbsDiff(row, row + 1, validWidth - 1);
+        }
+        frame.activity = static_cast<double>(gradient) / (static_cast<double>(validWidth - 1) * thumbnailHeight);
+    }
+
+    lastCollected = frame.thumbnail;
+    std::copy(histogram, histogram + HISTOGRAM_BINS, lastHistogram);
+    haveLastCollected = true;
+    window.push_back(std::move(frame));
+    ++stats.framesAnalysed;
+    stats.cpuMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool LookaheadAnalyzer::isSceneCut(const WindowFrame& frame) const {
+    return !frame.first && frame.histogramDelta > options.sceneCutThreshold &&
+           frame.sad > std::max(MIN_CUT_SAD, CUT_SAD_RATIO * averageSad);
+}
+
+FrameHint LookaheadAnalyzer::nextHint(bool forceIdr) {
+    if (window.empty()) {
+        throw std::logic_error("Lookahead window is empty.");
+    }
+    auto start = std::chrono::steady_clock::now();
+    WindowFrame frame = std::move(window.front());
+    window.pop_front();
+    size_t size = frame.thumbnail.size();
+
+    FrameHint hint;
+    if (firstDecision) {
+        hint.idr = true;
+        firstDecision = false;
+    } else {
+        bool cut = isSceneCut(frame);
+        bool flash = false;
+        if (suppressNextCut) {
+            // The return from a flash: the change undoes the previous frame's.
+            flash = true;
+            suppressNextCut = false;
+        } else if (cut && !window.empty()) {
+            double sadBack = static_cast<double>(sumAbsDiff(window.front().thumbnail.data(), lastDecided.data(), size)) / size;
+            if (sadBack < FLASH_RATIO * frame.sad) {
+                flash = true;
+                suppressNextCut = true;
+                ++stats.flashesRejected;
+            }
+        }
+        cut = cut && !flash;
+        if (cut) {
+            ++stats.sceneCuts;
+        } else if (!flash) {
+            sadFrames = std::min<uint32_t>(sadFrames + 1, 16);
+            averageSad += (frame.sad - averageSad) / sadFrames;
+        }
+        hint.sceneCut = cut;
+        ++framesSinceIdr;
+        hint.idr = forceIdr || (cut && framesSinceIdr >= options.minIdrInterval) ||
+                   framesSinceIdr >= options.maxIdrInterval;
+    }
+
+    if (hint.idr) {
+        framesSinceIdr = 0;
+        ++stats.idrFrames;
+        hint.qpDelta = -MAX_QP_DELTA;
+    } else if (!window.empty() && isSceneCut(window.front())) {
+        // Little of the last frame before a cut is referenced, so it can be coded coarser.
+        hint.qpDelta = MAX_QP_DELTA;
+    } else {
+        // Busy frames mask quantisation noise; flat frames show it.
+        double meanActivity = frame.activity;
+        for (size_t i = 0; i < window.size(); ++i) {
+            meanActivity += window[i].activity;
+        }
+        meanActivity /= static_cast<double>(window.size() + 1);
+        double ratio = (frame.activity + 1.0) / (meanActivity + 1.0);
+        hint.qpDelta = std::clamp(static_cast<int32_t>(std::lround(1.5 * std::log2(ratio))), -MAX_QP_DELTA, MAX_QP_DELTA);
+    }
+
+    spareThumbnails.push_back(std::move(lastDecided));
+    lastDecided = std::move(frame.thumbnail);
+    stats.cpuMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return hint;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "VulkanBase.hpp"
+#include "BarrierBuilder.hpp"
+#include "TimelineSemaphore.hpp"
+#include "RingQueue.hpp"
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Tuning for the lookahead stage.
+struct LookaheadOptions {
+    // Frames analysed ahead of the encoder; 0 disables the lookahead.
+    uint32_t depth = 0;
+    // Scene cuts closer than this to the previous IDR are coded as P frames.
+    uint32_t minIdrInterval = 12;
+    // An IDR is forced after this many frames without one.
+    uint32_t maxIdrInterval = 250;
+    // Minimum luma histogram change (0-1) for a scene cut.
+    double sceneCutThreshold = 0.35;
+};
+
+// Frame type and QP decisions handed to the encoder.
+struct FrameHint {
+    bool idr = false;
+    bool sceneCut = false;
+    int32_t qpDelta = 0;
+};
+
+struct LookaheadStats {
+    uint64_t framesAnalysed = 0;
+    uint64_t sceneCuts = 0;
+    uint64_t flashesRejected = 0;
+    uint64_t idrFrames = 0;
+    double cpuMicroseconds = 0.0;
+};
+
+// The LookaheadAnalyzer class measures each decoded picture on the compute queue and
+// decides frame types and QP offsets from a window of upcoming frames. The luma plane
+// is box-downscaled 8x8 into an 8-bit thumbnail, by a compute shader or, without one,
+// by SIMD code on a readback. Scene cuts are detected from the thumbnail SAD and
+// histogram change against the previous frame; a cut that reverts on the next frame is
+// treated as a flash and does not get an IDR.
+class LookaheadAnalyzer {
+public:
+    // Creates the analysis pipeline for slotCount pictures with the given extent and
+    // luma bit depth. Throws a std::runtime_error if no compute queue is available.
+    LookaheadAnalyzer(VulkanBase* vulkanBase, ImageStateTracker& imageStates, VkExtent2D extent,
+                      uint32_t bitDepth, uint32_t slotCount, const LookaheadOptions& options);
+    ~LookaheadAnalyzer();
+
+    bool usesGpu() const { return gpuPath; }
+
+    // Extra usage and create flags the decoded pictures need for the selected path.
+    VkImageUsageFlags getPictureUsage() const;
+    VkImageCreateFlags getImageCreateFlags() const;
+
+    // How the analysis reads the picture; the decoder releases it for this access.
+    ImageAccess getSourceAccess() const { return gpuPath ? ImageAccess::ComputeSampled : ImageAccess::TransferSrc; }
+
+    // Associates a slot with a picture and records its command buffer once. The picture
+    // is handed over from `from` and passed on to `to` after the analysis.
+    void bindSlot(uint32_t slot, VkImage image, QueueAccess from, QueueAccess to);
+
+    // Analyses the picture in a slot on the compute queue after the wait point.
+    void submit(uint32_t slot, const VkSemaphoreSubmitInfo& wait, const VkSemaphoreSubmitInfo& signal);
+
+    // Adds the analysed slot to the lookahead window. Frames must be collected in
+    // display order, and only after the slot's signal point has been reached.
+    void collect(uint32_t slot);
+
+    size_t getWindowSize() const { return window.size(); }
+
+    // Returns the decision for the oldest frame in the window and removes it. forceIdr
+    // makes it an IDR regardless, e.g. at a checkpoint; the IDR interval restarts there.
+    FrameHint nextHint(bool forceIdr = false);
+
+    const LookaheadStats& getStats() const { return stats; }
+
+private:
+    struct Slot {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        // GPU path: the thumbnail written by the shader.
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
+        void* pHost = nullptr;
+        // CPU path: the thumbnail downscaled from the readback.
+        std::vector<uint8_t> thumbnail;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+
+    // One analysed frame in the lookahead window.
+    struct WindowFrame {
+        std::vector<uint8_t> thumbnail;
+        double sad = 0.0;            // Mean absolute difference to the previous frame (0-255).
+        double histogramDelta = 0.0; // Half the L1 distance of the luma histograms (0-1).
+        double activity = 0.0;       // Mean absolute horizontal gradient, a proxy for intra cost.
+        bool first = false;
+    };
+
+    VulkanBase* vulkanBase = nullptr;
+    ImageStateTracker& imageStates;
+    VkExtent2D extent{};
+    uint32_t bytesPerSample = 1;
+    uint32_t thumbnailWidth = 0;
+    uint32_t thumbnailHeight = 0;
+    LookaheadOptions options;
+    bool gpuPath = false;
+    std::vector<Slot> slots;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    // CPU path: luma readback shared by all slots.
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackBufferMemory = VK_NULL_HANDLE;
+    void* pReadbackHost = nullptr;
+    std::unique_ptr<TimelineSemaphore> stagingTimeline;
+
+    RingQueue<WindowFrame> window;
+    // Thumbnail buffers of decided frames, reused by the next collected ones.
+    std::vector<std::vector<uint8_t>> spareThumbnails;
+    std::vector<uint8_t> lastCollected;   // Thumbnail of the newest frame in the window.
+    uint32_t lastHistogram[32] = {};      // Its luma histogram.
+    bool haveLastCollected = false;
+    std::vector<uint8_t> lastDecided;     // Thumbnail of the frame before the window.
+    uint32_t framesSinceIdr = 0;
+    bool firstDecision = true;
+    bool suppressNextCut = false;         // The next frame returns from a flash.
+    double averageSad = 0.0;              // Running mean SAD of frames that are not cuts.
+    uint32_t sadFrames = 0;
+    LookaheadStats stats;
+
+    bool isGpuPathSupported() const;
+    void createGpuPipeline(uint32_t slotCount);
+    void recordGpuCommands(Slot& slot, QueueAccess from, QueueAccess to);
+    void recordCpuCommands(Slot& slot, QueueAccess from, QueueAccess to);
+    // True if a window frame looks like a scene cut against the running SAD average.
+    bool isSceneCut(const WindowFrame& frame) const;
+};
@@ -0,0 +1,151 @@
+#include "LookaheadKernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VT_LOOKAHEAD_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VT_LOOKAHEAD_NEON 1
+#endif
+
+namespace {
+
+    // Averages 8x8 blocks of (sample >> shift) with round-half-up, like the shader. Blocks
+    // past the picture edge average only the samples inside it; padding columns are zero.
+    void downscale(const void* luma, size_t rowPitch, uint32_t bytesPerSample, uint32_t width, uint32_t height,
+                   uint8_t* thumbnail, bool simd) {
+        using LookaheadKernels::BLOCK_SIZE;
+        uint32_t outWidth = LookaheadKernels::getThumbnailWidth(width);
+        uint32_t outHeight = LookaheadKernels::getThumbnailHeight(height);
+        uint32_t blocksX = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        // One 8-bit row, zero padded to whole 16-byte vectors so partial blocks sum correctly.
+        std::vector<uint8_t> row((static_cast<size_t>(blocksX) * BLOCK_SIZE + 15) & ~size_t(15), 0);
+        std::vector<uint32_t> sums(blocksX);
+
+        for (uint32_t by = 0; by < outHeight; ++by) {
+            std::fill(sums.begin(), sums.end(), 0);
+            uint32_t rows = std::min(BLOCK_SIZE, height - by * BLOCK_SIZE);
+            for (uint32_t r = 0; r < rows; ++r) {
+                const uint8_t* srcRow = static_cast<const uint8_t*>(luma) + (static_cast<size_t>(by) * BLOCK_SIZE + r) * rowPitch;
+                uint32_t x = 0;
+                if (bytesPerSample == 2) {
+                    const uint16_t* src16 = reinterpret_cast<const uint16_t*>(srcRow);
+#if defined(VT_LOOKAHEAD_SSE2)
+                    for (; simd && x + 16 <= width; x += 16) {
+                        __m128i lo = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src16 + x)), 8);
+                        __m128i hi = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src16 + x + 8)), 8);
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(row.data() + x), _mm_packus_epi16(lo, hi));
+                    }
+#elif defined(VT_LOOKAHEAD_NEON)
+                    for (; simd && x + 16 <= width; x += 16) {
+                        uint8x8_t lo = vshrn_n_u16(vld1q_u16(src16 + x), 8);
+                        uint8x8_t hi = vshrn_n_u16(vld1q_u16(src16 + x + 8), 8);
+                        vst1q_u8(row.data() + x, vcombine_u8(lo, hi));
+                    }
+#endif
+                    for (; x < width; ++x) {
+                        row[x] = static_cast<uint8_t>(src16[x] >> 8);
+                    }
+                } else {
+                    std::memcpy(row.data(), srcRow, width);
+                }
+
+                // Horizontal sums of eight samples, two blocks per vector.
+                uint32_t bx = 0;
+#if defined(VT_LOOKAHEAD_SSE2)
+                const __m128i zero = _mm_setzero_si128();
+                for (; simd && bx + 2 <= blocksX; bx += 2) {
+                    __m128i sad = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.data() + bx * BLOCK_SIZE)), zero);
+                    sums[bx] += static_cast<uint32_t>(_mm_cvtsi128_si32(sad));
+                    sums[bx + 1] += static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+                }
+#elif defined(VT_LOOKAHEAD_NEON)
+                for (; simd && bx + 2 <= blocksX; bx += 2) {
+                    uint64x2_t blockSums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vld1q_u8(row.data() + bx * BLOCK_SIZE))));
+                    sums[bx] += static_cast<uint32_t>(vgetq_lane_u64(blockSums, 0));
+                    sums[bx + 1] += static_cast<uint32_t>(vgetq_lane_u64(blockSums, 1));
+                }
+#endif
+                for (; bx < blocksX; ++bx) {
+                    for (uint32_t i = 0; i < BLOCK_SIZE; ++i) {
+                        sums[bx] += row[bx * BLOCK_SIZE + i];
+                    }
+                }
+            }
+
+            uint8_t* out = thumbnail + static_cast<size_t>(by) * outWidth;
+            for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                uint32_t count = std::min(BLOCK_SIZE, width - bx * BLOCK_SIZE) * rows;
+                out[bx] = static_cast<uint8_t>((sums[bx] + count / 2) / count);
+            }
+            std::fill(out + blocksX, out + outWidth, 0);
+        }
+    }
+
+} // namespace
+
+namespace LookaheadKernels {
+
+    bool hasSimd() {
+#if defined(VT_LOOKAHEAD_SSE2) || defined(VT_LOOKAHEAD_NEON)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint32_t getThumbnailWidth(uint32_t width) {
+        uint32_t blocks = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        return (blocks + 3) & ~3u;
+    }
+
+    uint32_t getThumbnailHeight(uint32_t height) {
+        return (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    void downscaleLuma(const void* luma, size_t rowPitch, uint32_t bytesPerSample,
+                       uint32_t width, uint32_t height, uint8_t* thumbnail) {
+        downscale(luma, rowPitch, bytesPerSample, width, height, thumbnail, true);
+    }
+
+    void downscaleLumaScalar(const void* luma, size_t rowPitch, uint32_t bytesPerSample,
+                             uint32_t width, uint32_t height, uint8_t* thumbnail) {
+        downscale(luma, rowPitch, bytesPerSample, width, height, thumbnail, false);
+    }
+
+    uint64_t sumAbsDiff(const uint8_t* a, const uint8_t* b, size_t count) {
+        uint64_t total = 0;
+        size_t i = 0;
+#if defined(VT_LOOKAHEAD_SSE2)
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+        total = static_cast<uint32_t>(_mm_cvtsi128_si32(acc)) + static_cast<uint64_t>(static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8))));
+#elif defined(VT_LOOKAHEAD_NEON)
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; i + 16 <= count; i += 16) {
+            acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+        }
+        uint64x2_t acc64 = vpaddlq_u32(acc);
+        total = vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+#endif
+        return total + sumAbsDiffScalar(a + i, b + i, count - i);
+    }
+
+    uint64_t sumAbsDiffScalar(const uint8_t* a, const uint8_t* b, size_t count) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += static_cast<uint64_t>(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+        }
+        return total;
+    }
+
+} // namespace LookaheadKernels
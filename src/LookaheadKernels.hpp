@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The CPU kernels of the lookahead analysis. Each has a SIMD version (SSE2 or NEON,
+// whichever the target has) and a scalar one that gives the same results, so the two
+// can be checked against each other.
+namespace LookaheadKernels {
+
+    // Thumbnails have one sample per BLOCK_SIZE x BLOCK_SIZE block of luma.
+    constexpr uint32_t BLOCK_SIZE = 8;
+
+    // True when the SIMD versions use vector instructions on this target.
+    bool hasSimd();
+
+    // Thumbnail geometry: one sample per block, rows padded to a multiple of 4.
+    uint32_t getThumbnailWidth(uint32_t width);
+    uint32_t getThumbnailHeight(uint32_t height);
+
+    // Box-downscales an 8-bit or MSB-aligned 16-bit luma plane into a thumbnail.
+    // Bit-exact with the compute shader.
+    void downscaleLuma(const void* luma, size_t rowPitch, uint32_t bytesPerSample,
+                       uint32_t width, uint32_t height, uint8_t* thumbnail);
+    void downscaleLumaScalar(const void* luma, size_t rowPitch, uint32_t bytesPerSample,
+                             uint32_t width, uint32_t height, uint8_t* thumbnail);
+
+    // Sum of absolute differences of two byte arrays.
+    uint64_t sumAbsDiff(const uint8_t* a, const uint8_t* b, size_t count);
+    uint64_t sumAbsDiffScalar(const uint8_t* a, const uint8_t* b, size_t count);
+
+} // namespace LookaheadKernels
@@ -0,0 +1,177 @@
+#include "MemoryPlanner.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    // Totals over every transcoder in the process.
+    struct BudgetMetrics {
+        MetricGauge& reserved;
+        MetricCounter& waits;
+    };
+
+    BudgetMetrics& budgetMetrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static BudgetMetrics metrics{
+            registry.gauge("transcoder_memory_reserved_bytes", "Device memory reserved by the planned pipelines."),
+            registry.counter("transcoder_memory_admission_waits_total", "Transcodes that waited for memory before starting."),
+        };
+        return metrics;
+    }
+
+    constexpr uint64_t KIB = 1024;
+    constexpr uint64_t MIB = 1024 * KIB;
+}
+
+namespace MemoryPlanner {
+
+    std::string formatSize(uint64_t bytes) {
+        char buffer[32];
+        if (bytes < MIB) {
+            std::snprintf(buffer, sizeof(buffer), "%llu KiB", static_cast<unsigned long long>((bytes + KIB - 1) / KIB));
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "%.1f MiB", static_cast<double>(bytes) / MIB);
+        }
+        return buffer;
+    }
+
+    uint64_t pictureBytes(uint32_t width, uint32_t height, uint32_t chromaFormatIdc, uint32_t bitDepth) {
+        uint64_t lumaSamples = static_cast<uint64_t>(width) * height;
+        // Chroma samples per four luma samples: none, 4:2:0, 4:2:2 and 4:4:4.
+        static constexpr uint64_t CHROMA_QUARTERS[] = { 0, 2, 4, 8 };
+        uint64_t chromaSamples = lumaSamples * CHROMA_QUARTERS[std::min(chromaFormatIdc, 3u)] / 4;
+        return (lumaSamples + chromaSamples) * (bitDepth > 8 ? 2 : 1);
+    }
+
+    uint32_t minimumPoolSize(uint32_t framesInFlight, uint32_t lookahead) {
+        return framesInFlight + lookahead + (lookahead > 0 ? 1 : 0);
+    }
+
+    uint64_t requiredBytes(const MemoryCosts& costs, const PipelineDepth& depth) {
+        return costs.fixedBytes + costs.perFrameBytes * depth.framesInFlight +
+               costs.perPictureBytes * depth.picturePoolMaxSize;
+    }
+
+    MemoryPlan plan(const MemoryCosts& costs, const PipelineDepth& requested, uint64_t available,
+                    uint32_t minFramesInFlight) {
+        MemoryPlan result;
+        PipelineDepth& depth = result.depth;
+        depth = requested;
+        minFramesInFlight = std::min(std::max(minFramesInFlight, 1u), requested.framesInFlight);
+        uint32_t minLookahead = std::min(requested.lookahead, 1u);
+        // One step at a time, so the plan keeps as much depth as fits.
+        while (requiredBytes(costs, depth) > available) {
+            if (depth.picturePoolMaxSize > minimumPoolSize(depth.framesInFlight, depth.lookahead)) {
+                --depth.picturePoolMaxSize;
+            } else if (depth.lookahead > minLookahead) {
+                --depth.lookahead;
+            } else if (depth.framesInFlight > minFramesInFlight) {
+                --depth.framesInFlight;
+            } else {
+                break;
+            }
+        }
+        if (depth.picturePoolSize > depth.picturePoolMaxSize) {
+            depth.picturePoolSize = depth.picturePoolMaxSize;
+        }
+        result.bytes = requiredBytes(costs, depth);
+        result.fits = result.bytes <= available;
+        result.reduced = depth.framesInFlight != requested.framesInFlight || depth.lookahead != requested.lookahead ||
+                         depth.picturePoolMaxSize != requested.picturePoolMaxSize;
+        return result;
+    }
+
+} // namespace MemoryPlanner
+
+MemoryReservation::~MemoryReservation() {
+    release();
+}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept
+    : budget(other.budget), bytes(other.bytes) {
+    other.budget = nullptr;
+    other.bytes = 0;
+}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this != &other) {
+        release();
+        budget = other.budget;
+        bytes = other.bytes;
+        other.budget = nullptr;
+        other.bytes = 0;
+    }
+    return *this;
+}
+
+void MemoryReservation::release() {
+    if (budget) {
+        budget->release(bytes);
+        budget = nullptr;
+        bytes = 0;
+    }
+}
+
+MemoryBudget& MemoryBudget::global() {
+    static MemoryBudget budget;
+    return budget;
+}
+
+void MemoryBudget::setLimit(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+}
+
+uint64_t MemoryBudget::getLimit() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return limit;
+}
+
+uint64_t MemoryBudget::getReserved() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return reserved;
+}
+
+MemoryReservation MemoryBudget::reserve(uint64_t deviceBudget, const MemoryCosts& costs, const PipelineDepth& requested,
+                                        uint32_t minFramesInFlight, MemoryPlan& plan) {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t capacity = limit > 0 ? std::min(limit, deviceBudget) : deviceBudget;
+    bool waited = false;
+    for (;;) {
+        uint64_t available = capacity > reserved ? capacity - reserved : 0;
+        plan = MemoryPlanner::plan(costs, requested, available, minFramesInFlight);
+        if (plan.fits || reserved == 0) {
+            break;
+        }
+        if (!waited) {
+            waited = true;
+            budgetMetrics().waits.add();
+            VT_LOG_INFO("Memory: Waiting for " << MemoryPlanner::formatSize(plan.bytes) << "; "
+                        << MemoryPlanner::formatSize(reserved) << " of " << MemoryPlanner::formatSize(capacity)
+                        << " are reserved by other transcodes");
+        }
+        released.wait(lock);
+    }
+    if (!plan.fits) {
+        VT_LOG_WARNING("Memory: Even the smallest pipeline needs " << MemoryPlanner::formatSize(plan.bytes) << ", more than the "
+                       << MemoryPlanner::formatSize(capacity) << " budget; allocations may fail");
+    }
+    reserved += plan.bytes;
+    budgetMetrics().reserved.add(static_cast<int64_t>(plan.bytes));
+
+    MemoryReservation reservation;
+    reservation.budget = this;
+    reservation.bytes = plan.bytes;
+    return reservation;
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reserved -= bytes;
+    }
+    budgetMetrics().reserved.add(-static_cast<int64_t>(bytes));
+    released.notify_all();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Device memory a transcode needs, split by what the pipeline depth scales.
+struct MemoryCosts {
+    // DPB images, whatever the depth.
+    uint64_t fixedBytes = 0;
+    // One frame in flight: its decode and encode bitstream buffers.
+    uint64_t perFrameBytes = 0;
+    // One pool picture, with its converted copy when downconverting.
+    uint64_t perPictureBytes = 0;
+};
+
+// How many frames the pipeline holds at once.
+struct PipelineDepth {
+    uint32_t framesInFlight = 0;
+    uint32_t lookahead = 0;
+    // Pictures allocated up front (0 = one per frame in flight and lookahead frame), and
+    // the limit the pool may grow to.
+    uint32_t picturePoolSize = 0;
+    uint32_t picturePoolMaxSize = 0;
+};
+
+// A depth and what it costs at most.
+struct MemoryPlan {
+    PipelineDepth depth;
+    uint64_t bytes = 0;
+    // False when even the smallest depth needs more than was available.
+    bool fits = false;
+    // The depth is smaller than requested.
+    bool reduced = false;
+};
+
+// Sizes a transcode's pipeline to the memory available to it.
+namespace MemoryPlanner {
+
+    // Bytes for the log: MiB with one decimal, or whole KiB below 1 MiB.
+    std::string formatSize(uint64_t bytes);
+
+    // Approximate size of one picture; drivers may pad it.
+    uint64_t pictureBytes(uint32_t width, uint32_t height, uint32_t chromaFormatIdc, uint32_t bitDepth);
+
+    // The fewest pictures the pool may be limited to: one per frame in flight and per
+    // lookahead frame, plus one for the decoder to run ahead of a full lookahead.
+    uint32_t minimumPoolSize(uint32_t framesInFlight, uint32_t lookahead);
+
+    // Bytes the depth needs with the pool grown to its limit.
+    uint64_t requiredBytes(const MemoryCosts& costs, const PipelineDepth& depth);
+
+    // The requested depth if it fits in available bytes, otherwise the largest smaller
+    // one that does. The pool's room to grow goes first, then lookahead frames down to
+    // one, then frames in flight down to minFramesInFlight. If nothing fits, the
+    // smallest depth is returned with fits set to false.
+    MemoryPlan plan(const MemoryCosts& costs, const PipelineDepth& requested, uint64_t available,
+                    uint32_t minFramesInFlight);
+
+} // namespace MemoryPlanner
+
+class MemoryBudget;
+
+// Bytes reserved from a MemoryBudget, given back when the reservation is destroyed.
+class MemoryReservation {
+public:
+    MemoryReservation() = default;
+    ~MemoryReservation();
+    MemoryReservation(MemoryReservation&& other) noexcept;
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+
+    uint64_t getBytes() const { return bytes; }
+
+private:
+    friend class MemoryBudget;
+    MemoryBudget* budget = nullptr;
+    uint64_t bytes = 0;
+
+    void release();
+};
+
+// The MemoryBudget class shares device memory between the transcodes of a process.
+// Each transcode plans its pipeline depth against what the others have not reserved
+// and reserves the plan's bytes until it finishes. When even its smallest depth does
+// not fit, it waits for the others to finish instead of failing; with nothing else
+// reserved it goes ahead with the smallest depth.
+class MemoryBudget {
+public:
+    // The budget shared by every transcoder in the process.
+    static MemoryBudget& global();
+
+    // Caps the memory the transcodes may plan to use (0 = only the device's budget).
+    void setLimit(uint64_t bytes);
+    uint64_t getLimit() const;
+
+    // Plans the requested depth against the device budget or the limit, whichever is
+    // smaller, minus what is reserved, and reserves the plan's bytes. Blocks while the
+    // plan does not fit and other reservations exist.
+    MemoryReservation reserve(uint64_t deviceBudget, const MemoryCosts& costs, const PipelineDepth& requested,
+                              uint32_t minFramesInFlight, MemoryPlan& plan);
+
+    uint64_t getReserved() const;
+
+private:
+    friend class MemoryReservation;
+    mutable std::mutex mutex;
+    std::condition_variable released;
+    uint64_t limit = 0;
+    uint64_t reserved = 0;
+
+    void release(uint64_t bytes);
+};
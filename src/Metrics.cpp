@@ -0,0 +1,257 @@
+#include "Metrics.hpp"
+#include "JsonObject.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+    int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Prometheus sample values.
+    std::string formatValue(double value) {
+        if (std::isinf(value)) {
+            return value > 0 ? "+Inf" : "-Inf";
+        }
+        // The shortest form that reads back as the same double.
+        char buffer[32];
+        for (int precision = 6; precision <= 17; ++precision) {
+            std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+            if (std::strtod(buffer, nullptr) == value) {
+                break;
+            }
+        }
+        return buffer;
+    }
+
+    std::string escapeHelp(const std::string& help) {
+        std::string out;
+        for (char c : help) {
+            if (c == '\\') out += "\\\\";
+            else if (c == '\n') out += "\\n";
+            else out += c;
+        }
+        return out;
+    }
+}
+
+MetricHistogram::MetricHistogram(std::vector<double> bounds)
+    : upperBounds(std::move(bounds)), counts(new std::atomic<uint64_t>[upperBounds.size() + 1]) {
+    if (!std::is_sorted(upperBounds.begin(), upperBounds.end()) ||
+        std::adjacent_find(upperBounds.begin(), upperBounds.end()) != upperBounds.end()) {
+        throw std::invalid_argument("Histogram bounds must be strictly increasing.");
+    }
+    for (size_t i = 0; i <= upperBounds.size(); ++i) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricHistogram::observe(double value) {
+    // Buckets are inclusive upper bounds ("le" in Prometheus).
+    size_t bucket = std::lower_bound(upperBounds.begin(), upperBounds.end(), value) - upperBounds.begin();
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    double expected = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed)) {
+    }
+}
+
+std::vector<uint64_t> MetricHistogram::getBucketCounts() const {
+    std::vector<uint64_t> result(upperBounds.size() + 1);
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+double MetricHistogram::getQuantile(double quantile) const {
+    std::vector<uint64_t> bucketCounts = getBucketCounts();
+    uint64_t total = 0;
+    for (uint64_t count : bucketCounts) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    double rank = std::clamp(quantile, 0.0, 1.0) * static_cast<double>(total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCounts.size(); ++i) {
+        if (bucketCounts[i] == 0 || static_cast<double>(seen + bucketCounts[i]) < rank) {
+            seen += bucketCounts[i];
+            continue;
+        }
+        // The overflow bucket has no upper bound; report its lower one.
+        if (i == upperBounds.size()) {
+            return upperBounds.empty() ? 0.0 : upperBounds.back();
+        }
+        double lower = i == 0 ? 0.0 : upperBounds[i - 1];
+        double fraction = (rank - static_cast<double>(seen)) / static_cast<double>(bucketCounts[i]);
+        return lower + (upperBounds[i] - lower) * fraction;
+    }
+    return upperBounds.empty() ? 0.0 : upperBounds.back();
+}
+
+std::vector<double> MetricHistogram::latencyBuckets() {
+    std::vector<double> bounds;
+    for (double bound = 0.0001; bound < 15.0; bound *= 2.0) {
+        bounds.push_back(bound);
+    }
+    return bounds;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::findOrCreate(const std::string& name, Kind kind, const std::string& help) {
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+        if (it->second.kind != kind) {
+            throw std::logic_error("Metric " + name + " is already registered with a different type.");
+        }
+        return it->second;
+    }
+    Entry& entry = entries[name];
+    entry.kind = kind;
+    entry.help = help;
+    return entry;
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = findOrCreate(name, Kind::Counter, help);
+    if (!entry.counter) {
+        entry.counter = std::make_unique<MetricCounter>();
+    }
+    return *entry.counter;
+}
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = findOrCreate(name, Kind::Gauge, help);
+    if (!entry.gauge) {
+        entry.gauge = std::make_unique<MetricGauge>();
+    }
+    return *entry.gauge;
+}
+
+MetricHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                            const std::vector<double>& upperBounds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = findOrCreate(name, Kind::Histogram, help);
+    if (!entry.histogram) {
+        entry.histogram = std::make_unique<MetricHistogram>(upperBounds);
+    }
+    return *entry.histogram;
+}
+
+uint64_t MetricsRegistry::addCollector(std::function<void()> collector) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t id = nextCollectorId++;
+    collectors[id] = std::move(collector);
+    return id;
+}
+
+void MetricsRegistry::removeCollector(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    collectors.erase(id);
+}
+
+// Collectors run under the lock so one cannot be removed, and its owner destroyed,
+// while it runs. They must only update metrics they already hold.
+void MetricsRegistry::runCollectors() {
+    for (auto& entry : collectors) {
+        entry.second();
+    }
+}
+
+std::string MetricsRegistry::renderPrometheus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    runCollectors();
+    std::string out;
+    for (const auto& item : entries) {
+        const std::string& name = item.first;
+        const Entry& entry = item.second;
+        static const char* typeNames[] = { "counter", "gauge", "histogram" };
+        out += "# HELP " + name + " " + escapeHelp(entry.help) + "\n";
+        out += "# TYPE " + name + " " + typeNames[static_cast<int>(entry.kind)] + "\n";
+        switch (entry.kind) {
+            case Kind::Counter:
+                out += name + " " + std::to_string(entry.counter->get()) + "\n";
+                break;
+            case Kind::Gauge:
+                out += name + " " + std::to_string(entry.gauge->get()) + "\n";
+                break;
+            case Kind::Histogram: {
+                const MetricHistogram& histogram = *entry.histogram;
+                std::vector<uint64_t> bucketCounts = histogram.getBucketCounts();
+                // The count is derived from the same snapshot so buckets and count agree.
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < bucketCounts.size(); ++i) {
+                    cumulative += bucketCounts[i];
+                    std::string bound = i < histogram.getUpperBounds().size()
+                        ? formatValue(histogram.getUpperBounds()[i]) : "+Inf";
+                    out += name + "_bucket{le=\"" + bound + "\"} " + std::to_string(cumulative) + "\n";
+                }
+                out += name + "_sum " + formatValue(histogram.getSum()) + "\n";
+                out += name + "_count " + std::to_string(cumulative) + "\n";
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+void MetricsRegistry::renderJson(JsonObject& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    runCollectors();
+    for (const auto& item : entries) {
+        const std::string& name = item.first;
+        const Entry& entry = item.second;
+        switch (entry.kind) {
+            case Kind::Counter:
+                out.set(name, entry.counter->get());
+                break;
+            case Kind::Gauge:
+                out.set(name, entry.gauge->get());
+                break;
+            case Kind::Histogram: {
+                const MetricHistogram& histogram = *entry.histogram;
+                uint64_t count = 0;
+                for (uint64_t bucketCount : histogram.getBucketCounts()) {
+                    count += bucketCount;
+                }
+                out.set(name + "_count", count);
+                out.set(name + "_sum", histogram.getSum());
+                out.set(name + "_p50", histogram.getQuantile(0.50));
+                out.set(name + "_p95", histogram.getQuantile(0.95));
+                out.set(name + "_p99", histogram.getQuantile(0.99));
+                break;
+            }
+        }
+    }
+}
+
+std::vector<std::pair<std::string, uint64_t>> MetricsRegistry::getCounterValues() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<std::string, uint64_t>> values;
+    for (const auto& item : entries) {
+        if (item.second.kind == Kind::Counter) {
+            values.emplace_back(item.first, item.second.counter->get());
+        }
+    }
+    return values;
+}
+
+ScopedMetricTimer::ScopedMetricTimer(MetricHistogram& histogram)
+    : histogram(histogram), startNs(nowNs()) {}
+
+ScopedMetricTimer::~ScopedMetricTimer() {
+    histogram.observe(static_cast<double>(nowNs() - startNs) * 1e-9);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class JsonObject;
+
+// A monotonically increasing count. Updates are single relaxed atomic adds.
+class MetricCounter {
+public:
+    void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// A value that goes up and down, such as a queue depth or a memory size.
+class MetricGauge {
+public:
+    void set(int64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+    void add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+// A distribution over fixed buckets. observe() is lock-free: one relaxed add on the
+// bucket and a compare-exchange loop on the sum.
+class MetricHistogram {
+public:
+    // upperBounds must be increasing; values above the last bound land in an overflow bucket.
+    explicit MetricHistogram(std::vector<double> upperBounds);
+
+    void observe(double value);
+
+    const std::vector<double>& getUpperBounds() const { return upperBounds; }
+    // Per-bucket (not cumulative) counts, the overflow bucket last.
+    std::vector<uint64_t> getBucketCounts() const;
+    double getSum() const { return sum.load(std::memory_order_relaxed); }
+    // Estimates a quantile (0-1) by interpolating within its bucket; 0 if empty.
+    double getQuantile(double quantile) const;
+
+    // Exponential bounds from 100 us to about 13 s, for latencies in seconds.
+    static std::vector<double> latencyBuckets();
+
+private:
+    std::vector<double> upperBounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<double> sum{0.0};
+};
+
+// The MetricsRegistry class owns the process's named metrics. Components look their
+// metrics up once and update them directly; exporters render every metric in the
+// Prometheus text format or as a flat JSON object. Metrics are process-wide, so with
+// several jobs in one daemon they report totals across jobs.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& global();
+
+    // Returns the metric with this name, creating it on first use. The reference stays
+    // valid for the registry's lifetime. Throws a std::logic_error if the name is
+    // registered as a different kind of metric.
+    MetricCounter& counter(const std::string& name, const std::string& help);
+    MetricGauge& gauge(const std::string& name, const std::string& help);
+    MetricHistogram& histogram(const std::string& name, const std::string& help,
+                               const std::vector<double>& upperBounds = MetricHistogram::latencyBuckets());
+
+    // Collectors update sampled gauges (e.g. device memory) right before an export.
+    // Returns an id for removeCollector().
+    uint64_t addCollector(std::function<void()> collector);
+    void removeCollector(uint64_t id);
+
+    // Prometheus text exposition format, version 0.0.4.
+    std::string renderPrometheus();
+
+    // Adds every metric to a flat JSON object. Histograms become <name>_count, _sum,
+    // _p50, _p95 and _p99.
+    void renderJson(JsonObject& out);
+
+    // Current value of every counter, for computing rates between exports.
+    std::vector<std::pair<std::string, uint64_t>> getCounterValues() const;
+
+private:
+    enum class Kind { Counter, Gauge, Histogram };
+    struct Entry {
+        Kind kind;
+        std::string help;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    mutable std::mutex mutex;
+    // Sorted by name so exports are stable.
+    std::map<std::string, Entry> entries;
+    std::map<uint64_t, std::function<void()>> collectors;
+    uint64_t nextCollectorId = 1;
+
+    Entry& findOrCreate(const std::string& name, Kind kind, const std::string& help);
+    void runCollectors();
+};
+
+// Records the time from construction to destruction into a histogram, in seconds.
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(MetricHistogram& histogram);
+    ~ScopedMetricTimer();
+
+    ScopedMetricTimer(const ScopedMetricTimer&) = delete;
+    ScopedMetricTimer& operator=(const ScopedMetricTimer&) = delete;
+
+private:
+    MetricHistogram& histogram;
+    int64_t startNs;
+};
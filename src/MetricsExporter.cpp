@@ -0,0 +1,209 @@
+#include "MetricsExporter.hpp"
+#include "JsonObject.hpp"
+#include "Log.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A scraper that has not sent its request line within this time is dropped.
+constexpr int REQUEST_TIMEOUT_MS = 2000;
+constexpr size_t MAX_REQUEST_HEAD = 8192;
+
+namespace {
+    void sendAll(int fd, const std::string& data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t sent = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+    }
+}
+
+MetricsHttpServer::MetricsHttpServer(MetricsRegistry& registry, uint16_t port) : registry(registry) {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error(std::string("Metrics: Could not create socket: ") + std::strerror(errno));
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Loopback only: the endpoint has no authentication.
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listenFd, 16) < 0 || pipe2(stopPipe, O_CLOEXEC) < 0) {
+        int error = errno;
+        close(listenFd);
+        throw std::runtime_error("Metrics: Could not listen on 127.0.0.1:" + std::to_string(port) + ": " + std::strerror(error));
+    }
+    thread = std::thread(&MetricsHttpServer::serve, this);
+    VT_LOG_INFO("Metrics: Serving Prometheus metrics on http://127.0.0.1:" << port << "/metrics");
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    char byte = 0;
+    ssize_t written = write(stopPipe[1], &byte, 1);
+    (void)written;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(listenFd);
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+}
+
+void MetricsHttpServer::serve() {
+    while (true) {
+        pollfd fds[2] = { { listenFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VT_LOG_ERROR("Metrics: poll failed: " << std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            // Scrapes are rare and small; one at a time keeps this simple.
+            handleConnection(fd);
+            close(fd);
+        }
+    }
+}
+
+void MetricsHttpServer::handleConnection(int fd) {
+    std::string head;
+    char buffer[1024];
+    while (head.find("\r\n\r\n") == std::string::npos && head.find("\n\n") == std::string::npos) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) <= 0) {
+            return;
+        }
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+        head.append(buffer, static_cast<size_t>(received));
+        if (head.size() > MAX_REQUEST_HEAD) {
+            return;
+        }
+    }
+
+    // Only the request line matters: "GET /metrics HTTP/1.1".
+    std::string requestLine = head.substr(0, head.find_first_of("\r\n"));
+    bool isGet = requestLine.rfind("GET ", 0) == 0;
+    std::string target = isGet ? requestLine.substr(4, requestLine.find(' ', 4) - 4) : std::string();
+    std::string path = target.substr(0, target.find('?'));
+
+    std::string body;
+    std::string status;
+    std::string contentType = "text/plain; charset=utf-8";
+    if (!isGet) {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported.\n";
+    } else if (path == "/metrics") {
+        status = "200 OK";
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+        body = registry.renderPrometheus();
+    } else {
+        status = "404 Not Found";
+        body = "See /metrics.\n";
+    }
+    sendAll(fd, "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+}
+
+MetricsFileWriter::MetricsFileWriter(MetricsRegistry& registry, const std::string& path, std::chrono::milliseconds interval)
+    : registry(registry), path(path), interval(interval) {
+    if (interval.count() <= 0) {
+        throw std::invalid_argument("Metrics: The file interval must be positive.");
+    }
+    previousCounters = registry.getCounterValues();
+    previousTime = std::chrono::steady_clock::now();
+    thread = std::thread(&MetricsFileWriter::run, this);
+}
+
+MetricsFileWriter::~MetricsFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    // The final totals are written even for runs shorter than one interval.
+    writeSnapshot();
+}
+
+void MetricsFileWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+        lock.unlock();
+        writeSnapshot();
+        lock.lock();
+    }
+}
+
+void MetricsFileWriter::writeSnapshot() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - previousTime).count();
+
+    JsonObject snapshot;
+    snapshot.set("timestamp", static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()) / 1000.0);
+    registry.renderJson(snapshot);
+
+    std::vector<std::pair<std::string, uint64_t>> counters = registry.getCounterValues();
+    for (const auto& counter : counters) {
+        uint64_t previous = 0;
+        for (const auto& old : previousCounters) {
+            if (old.first == counter.first) {
+                previous = old.second;
+                break;
+            }
+        }
+        // frames_total becomes frames_per_second.
+        std::string rateName = counter.first;
+        if (rateName.size() > 6 && rateName.compare(rateName.size() - 6, 6, "_total") == 0) {
+            rateName.resize(rateName.size() - 6);
+        }
+        snapshot.set(rateName + "_per_second", seconds > 0.0 ? (counter.second - previous) / seconds : 0.0);
+    }
+    previousCounters = std::move(counters);
+    previousTime = now;
+
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        file << snapshot.dump() << "\n";
+        if (!file) {
+            VT_LOG_WARNING("Metrics: Could not write " << temporaryPath);
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        VT_LOG_WARNING("Metrics: Could not replace " << path << ": " << std::strerror(errno));
+    }
+}
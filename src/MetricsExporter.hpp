@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Metrics.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Serves GET /metrics in the Prometheus text format on a loopback TCP port, from a
+// background thread. Other paths answer 404.
+class MetricsHttpServer {
+public:
+    // Binds 127.0.0.1:port. Throws a std::runtime_error if the port is unavailable.
+    MetricsHttpServer(MetricsRegistry& registry, uint16_t port);
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+private:
+    MetricsRegistry& registry;
+    int listenFd = -1;
+    int stopPipe[2] = { -1, -1 };
+    std::thread thread;
+
+    void serve();
+    void handleConnection(int fd);
+};
+
+// Writes all metrics as a JSON object to a file at a fixed interval, and once more
+// when destroyed. Each counter also gets a rate over the last interval, named with
+// _per_second in place of _total. The file is replaced atomically, so readers never
+// see a partial write.
+class MetricsFileWriter {
+public:
+    MetricsFileWriter(MetricsRegistry& registry, const std::string& path, std::chrono::milliseconds interval);
+    ~MetricsFileWriter();
+
+    MetricsFileWriter(const MetricsFileWriter&) = delete;
+    MetricsFileWriter& operator=(const MetricsFileWriter&) = delete;
+
+private:
+    MetricsRegistry& registry;
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::thread thread;
+
+    std::vector<std::pair<std::string, uint64_t>> previousCounters;
+    std::chrono::steady_clock::time_point previousTime;
+
+    void run();
+    void writeSnapshot();
+};
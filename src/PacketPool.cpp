@@ -0,0 +1,127 @@
+#include "PacketPool.hpp"
+#include "Metrics.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+namespace {
+    MetricCounter& allocationsCounter() {
+        static MetricCounter& counter = MetricsRegistry::global().counter(
+            "transcoder_packet_buffers_allocated_total", "Packet buffers allocated because every pooled one was in use.");
+        return counter;
+    }
+}
+
+PacketBuffer::PacketBuffer(PacketBuffer&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)), buffer(std::exchange(other.buffer, nullptr)) {
+}
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool = std::exchange(other.pool, nullptr);
+        buffer = std::exchange(other.buffer, nullptr);
+    }
+    return *this;
+}
+
+uint8_t* PacketBuffer::data() const {
+    return buffer->data;
+}
+
+void PacketBuffer::reset() {
+    if (buffer) {
+        pool->release(buffer);
+        pool = nullptr;
+        buffer = nullptr;
+    }
+}
+
+PacketPool::PacketPool(size_t bufferSize) : bufferSize(bufferSize) {
+    createPool();
+}
+
+PacketPool::~PacketPool() {
+    for (AVBufferRef* buffer : freeBuffers) {
+        av_buffer_unref(&buffer);
+    }
+    av_buffer_pool_uninit(&pool);
+}
+
+PacketBuffer PacketPool::getBuffer() {
+    std::lock_guard<std::mutex> lock(mutex);
+    AVBufferRef* buffer = nullptr;
+    if (!freeBuffers.empty()) {
+        buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    } else {
+        buffer = av_buffer_pool_get(pool);
+        if (!buffer) {
+            throw std::runtime_error("FFmpeg: Could not allocate a packet buffer");
+        }
+        // Grows with the buffers, so a buffer coming back always has room.
+        freeBuffers.reserve(allocated.load());
+    }
+    ++handedOut;
+    return PacketBuffer(this, buffer);
+}
+
+void PacketPool::resize(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == bufferSize) {
+        return;
+    }
+    for (AVBufferRef* buffer : freeBuffers) {
+        av_buffer_unref(&buffer);
+    }
+    freeBuffers.clear();
+    // The old pool is freed once its last buffer handed out comes back.
+    av_buffer_pool_uninit(&pool);
+    bufferSize = size;
+    createPool();
+}
+
+size_t PacketPool::getBufferSize() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bufferSize;
+}
+
+PacketPoolStats PacketPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    PacketPoolStats stats;
+    stats.buffersHandedOut = handedOut;
+    stats.buffersAllocated = allocated.load();
+    return stats;
+}
+
+void PacketPool::createPool() {
+    pool = av_buffer_pool_init2(bufferSize + AV_INPUT_BUFFER_PADDING_SIZE, this, &PacketPool::allocate, nullptr);
+    if (!pool) {
+        throw std::runtime_error("FFmpeg: Could not create a packet buffer pool");
+    }
+}
+
+void PacketPool::release(AVBufferRef* buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (static_cast<size_t>(buffer->size) != bufferSize + AV_INPUT_BUFFER_PADDING_SIZE) {
+        av_buffer_unref(&buffer);
+        return;
+    }
+    freeBuffers.push_back(buffer);
+}
+
+// Only called when no pooled buffer is free.
+AVBufferRef* PacketPool::allocate(void* opaque, size_t size) {
+    auto* self = static_cast<PacketPool*>(opaque);
+    AVBufferRef* buffer = av_buffer_allocz(size);
+    if (buffer) {
+        ++self->allocated;
+        allocationsCounter().add();
+    }
+    return buffer;
+}
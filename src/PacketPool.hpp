@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct AVBufferPool;
+struct AVBufferRef;
+
+class PacketPool;
+
+// A payload buffer handed out by a PacketPool, which gets it back when the handle is
+// reset or destroyed. Handles must not outlive their pool.
+class PacketBuffer {
+public:
+    PacketBuffer() = default;
+    PacketBuffer(PacketBuffer&& other) noexcept;
+    PacketBuffer& operator=(PacketBuffer&& other) noexcept;
+    ~PacketBuffer() { reset(); }
+
+    PacketBuffer(const PacketBuffer&) = delete;
+    PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+    uint8_t* data() const;
+    explicit operator bool() const { return buffer != nullptr; }
+    void reset();
+
+private:
+    friend class PacketPool;
+
+    PacketPool* pool = nullptr;
+    AVBufferRef* buffer = nullptr;
+
+    PacketBuffer(PacketPool* pool, AVBufferRef* buffer) : pool(pool), buffer(buffer) {}
+};
+
+// An encoded frame waiting for its timestamp.
+struct EncodedPacket {
+    PacketBuffer buffer;
+    int size = 0;
+    bool idr = false;
+};
+
+struct PacketPoolStats {
+    uint64_t buffersHandedOut = 0;
+    // Buffers the pool had to allocate because none was free. It stops growing once the
+    // pool covers the packets the pipeline and the muxer hold at once.
+    uint64_t buffersAllocated = 0;
+};
+
+// The PacketPool class hands out payload buffers for a transcode's packets: encoded ones
+// until the muxer has written them, and demuxed ones until they are parsed. Buffers come
+// from an AVBufferPool when every one handed out before is in use, and are kept on a
+// free list once returned, so in steady state a packet costs neither a buffer nor the
+// AVBufferRef that av_buffer_pool_get() wraps each one in. Buffers may be taken and
+// returned on any thread.
+class PacketPool {
+public:
+    // Buffers hold bufferSize bytes plus the padding FFmpeg expects after packet data.
+    explicit PacketPool(size_t bufferSize);
+    ~PacketPool();
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    // Throws a std::runtime_error if the pool is empty and a buffer cannot be allocated.
+    PacketBuffer getBuffer();
+
+    // Buffers handed out from now on hold bufferSize bytes; those of the old size are
+    // freed as they come back.
+    void resize(size_t bufferSize);
+
+    size_t getBufferSize() const;
+    PacketPoolStats getStats() const;
+
+private:
+    friend class PacketBuffer;
+
+    mutable std::mutex mutex;
+    size_t bufferSize;
+    AVBufferPool* pool = nullptr;
+    std::vector<AVBufferRef*> freeBuffers;
+    uint64_t handedOut = 0;
+    // Written by FFmpeg's allocation callback.
+    std::atomic<uint64_t> allocated{0};
+
+    void createPool();
+    void release(AVBufferRef* buffer);
+    static AVBufferRef* allocate(void* opaque, size_t size);
+};
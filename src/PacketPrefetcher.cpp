@@ -0,0 +1,106 @@
+#include "PacketPrefetcher.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+PacketPrefetcher::PacketPrefetcher(PacketSource source, TaskPool& pool, size_t depth)
+    : source(std::move(source)), depth(depth), strand(pool) {
+    for (size_t i = 0; i < depth; ++i) {
+        AVPacket* packet = av_packet_alloc();
+        if (!packet) {
+            for (AVPacket* allocated : blank) {
+                av_packet_free(&allocated);
+            }
+            throw std::runtime_error("Failed to allocate AVPacket");
+        }
+        blank.push_back(packet);
+    }
+    ready.reserve(depth);
+}
+
+PacketPrefetcher::~PacketPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    try {
+        strand.wait();
+    } catch (...) {
+        // readAhead() keeps what the demuxer throws for readPacket().
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+        av_packet_free(&ready[i]);
+    }
+    for (AVPacket* packet : blank) {
+        av_packet_free(&packet);
+    }
+}
+
+bool PacketPrefetcher::readPacket(AVPacket* packet) {
+    std::unique_lock<std::mutex> lock(mutex);
+    startReading();
+    available.wait(lock, [this] { return !ready.empty() || endOfInput || error; });
+    if (ready.empty()) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    AVPacket* next = ready.front();
+    ready.pop_front();
+    av_packet_move_ref(packet, next);
+    blank.push_back(next);
+    startReading();
+    return true;
+}
+
+void PacketPrefetcher::startReading() {
+    bool worthReading = ready.empty() ? !blank.empty() : blank.size() * 2 >= depth;
+    if (!reading && !endOfInput && !error && !stopping && worthReading) {
+        reading = true;
+        strand.post([this] { readAhead(); });
+    }
+}
+
+// Reads until every blank packet is filled, then stops until readPacket() frees enough of them.
+void PacketPrefetcher::readAhead() {
+    for (;;) {
+        AVPacket* packet;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || blank.empty()) {
+                reading = false;
+                return;
+            }
+            packet = blank.back();
+            blank.pop_back();
+        }
+        bool read = false;
+        std::exception_ptr failure;
+        try {
+            read = source(packet);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (read) {
+                ready.push_back(packet);
+            } else {
+                av_packet_unref(packet);
+                blank.push_back(packet);
+                endOfInput = !failure;
+                error = failure;
+                reading = false;
+            }
+        }
+        available.notify_one();
+        if (!read) {
+            return;
+        }
+    }
+}
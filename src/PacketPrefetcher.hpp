@@ -0,0 +1,56 @@
+#pragma once
+
+#include "H264Demuxer.hpp"
+#include "RingQueue.hpp"
+#include "TaskPool.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct AVPacket;
+
+// The PacketPrefetcher class demuxes a few packets ahead of a transcode on the task
+// pool, so reading and parsing the container overlaps recording and submitting the
+// previous frames. Packets come out in the order the demuxer returned them.
+class PacketPrefetcher {
+public:
+    // Fills a blank packet and returns true, or returns false at the end of the input.
+    using PacketSource = std::function<bool(AVPacket*)>;
+
+    // The demuxer must not be used elsewhere until the prefetcher is destroyed.
+    PacketPrefetcher(H264Demuxer& demuxer, TaskPool& pool, size_t depth)
+        : PacketPrefetcher([&demuxer](AVPacket* packet) { return demuxer.readPacket(packet); }, pool, depth) {}
+    PacketPrefetcher(PacketSource source, TaskPool& pool, size_t depth);
+    // Stops reading ahead and waits for a read in progress.
+    ~PacketPrefetcher();
+
+    PacketPrefetcher(const PacketPrefetcher&) = delete;
+    PacketPrefetcher& operator=(const PacketPrefetcher&) = delete;
+
+    // Moves the next packet into packet, which must be blank. Returns false at the end
+    // of the input, like H264Demuxer::readPacket(). Once the packets read before a
+    // failed read are used up, rethrows what the demuxer threw.
+    bool readPacket(AVPacket* packet);
+
+private:
+    PacketSource source;
+    size_t depth;
+    TaskStrand strand;
+    std::mutex mutex;
+    std::condition_variable available;
+    RingQueue<AVPacket*> ready;
+    std::vector<AVPacket*> blank;
+    bool reading = false;
+    bool endOfInput = false;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    // Called with the mutex held: posts a read task unless one is queued or running.
+    // Reading resumes once half the packets are free, so one task reads several.
+    void startReading();
+    void readAhead();
+};
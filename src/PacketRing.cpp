@@ -0,0 +1,58 @@
+#include "PacketRing.hpp"
+
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+PacketRing::PacketRing(size_t initialCount) {
+    free.reserve(initialCount);
+    allocated.reserve(initialCount);
+    try {
+        for (size_t i = 0; i < initialCount; ++i) {
+            free.push_back(allocate());
+        }
+    } catch (...) {
+        for (AVPacket* packet : allocated) {
+            av_packet_free(&packet);
+        }
+        throw;
+    }
+}
+
+PacketRing::~PacketRing() {
+    for (AVPacket* packet : allocated) {
+        av_packet_free(&packet);
+    }
+}
+
+AVPacket* PacketRing::acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free.empty()) {
+        return allocate();
+    }
+    AVPacket* packet = free.front();
+    free.pop_front();
+    return packet;
+}
+
+void PacketRing::release(AVPacket* packet) {
+    av_packet_unref(packet);
+    std::lock_guard<std::mutex> lock(mutex);
+    free.push_back(packet);
+}
+
+uint64_t PacketRing::getAllocatedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocated.size();
+}
+
+AVPacket* PacketRing::allocate() {
+    AVPacket* packet = av_packet_alloc();
+    if (!packet) {
+        throw std::runtime_error("Failed to allocate AVPacket");
+    }
+    allocated.push_back(packet);
+    return packet;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "RingQueue.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct AVPacket;
+
+// The PacketRing class recycles AVPacket structs, so code that holds packets for a
+// while, queued or handed to a task, takes them from a ring instead of allocating and
+// freeing one per packet. Packets go back blank and are reused oldest first. It is
+// thread-safe: a packet may be released on another thread than it was taken on.
+class PacketRing {
+public:
+    // Allocates initialCount packets up front. Throws a std::runtime_error on failure.
+    explicit PacketRing(size_t initialCount);
+    // Frees every packet the ring allocated, including those not released.
+    ~PacketRing();
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    // Returns a blank packet, allocating one only if every packet is in use. Throws a
+    // std::runtime_error if that allocation fails.
+    AVPacket* acquire();
+    // Drops the packet's reference, if any, and returns it to the ring.
+    void release(AVPacket* packet);
+
+    // Packets allocated, including the initial ones. It stops growing once the ring
+    // covers the packets held at once.
+    uint64_t getAllocatedCount() const;
+
+private:
+    mutable std::mutex mutex;
+    RingQueue<AVPacket*> free;
+    std::vector<AVPacket*> allocated;
+
+    // Called with the mutex held.
+    AVPacket* allocate();
+};
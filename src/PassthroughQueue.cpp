@@ -0,0 +1,39 @@
+#include "PassthroughQueue.hpp"
+
+PassthroughQueue::PassthroughQueue(int64_t maxMicroseconds, size_t maxPackets)
+    : maxMicroseconds(maxMicroseconds), maxPackets(maxPackets) {
+    queue.reserve(64);
+}
+
+void PassthroughQueue::push(AVPacket* packet, int64_t dtsMicroseconds) {
+    queue.push_back({ packet, dtsMicroseconds });
+}
+
+bool PassthroughQueue::popDue(int64_t dtsMicroseconds, Entry& entry) {
+    if (queue.empty()) {
+        return false;
+    }
+    const Entry& front = queue.front();
+    bool due = dtsMicroseconds != UNKNOWN_DTS &&
+               (front.dtsMicroseconds == UNKNOWN_DTS || front.dtsMicroseconds <= dtsMicroseconds);
+    if (!due) {
+        const Entry& back = queue.back();
+        bool overfull = queue.size() > maxPackets ||
+                        (front.dtsMicroseconds != UNKNOWN_DTS && back.dtsMicroseconds != UNKNOWN_DTS &&
+                         back.dtsMicroseconds - front.dtsMicroseconds > maxMicroseconds);
+        if (!overfull) {
+            return false;
+        }
+        ++forcedCount;
+    }
+    return pop(entry);
+}
+
+bool PassthroughQueue::pop(Entry& entry) {
+    if (queue.empty()) {
+        return false;
+    }
+    entry = queue.front();
+    queue.pop_front();
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "RingQueue.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+struct AVPacket;
+
+// The PassthroughQueue class decides when copied audio, subtitle and data packets are
+// written between the video packets. The demuxer hands them over well ahead of the
+// encoded video, so they wait here, in arrival order (DTS order per stream), until a
+// video packet decodes no earlier than they do. The queue is bounded by the decode time
+// it spans and its packet count; packets beyond the bound are released early rather
+// than buffered without limit. Packets are referenced, not owned.
+class PassthroughQueue {
+public:
+    // Decode time of a packet without timestamps (AV_NOPTS_VALUE).
+    static constexpr int64_t UNKNOWN_DTS = INT64_MIN;
+    // The video is never that far behind in practice, so the bound only matters for
+    // streams with broken timestamps.
+    static constexpr int64_t MAX_QUEUE_MICROSECONDS = 10 * 1000000;
+    static constexpr size_t MAX_QUEUE_PACKETS = 4096;
+
+    struct Entry {
+        AVPacket* packet = nullptr;
+        int64_t dtsMicroseconds = UNKNOWN_DTS;
+    };
+
+    explicit PassthroughQueue(int64_t maxMicroseconds = MAX_QUEUE_MICROSECONDS, size_t maxPackets = MAX_QUEUE_PACKETS);
+
+    void push(AVPacket* packet, int64_t dtsMicroseconds);
+
+    // Takes the next packet to write before a video packet decoding at dtsMicroseconds:
+    // one that decodes no later, has no decode time, or is beyond the bound. With
+    // UNKNOWN_DTS only the bound applies. Returns false when the rest must wait.
+    bool popDue(int64_t dtsMicroseconds, Entry& entry);
+
+    // Takes the next packet regardless of its decode time, at the end of the stream.
+    bool pop(Entry& entry);
+
+    size_t size() const { return queue.size(); }
+    bool empty() const { return queue.empty(); }
+    // Packets released ahead of the video because the queue was full.
+    uint64_t getForcedCount() const { return forcedCount; }
+
+private:
+    RingQueue<Entry> queue;
+    int64_t maxMicroseconds;
+    size_t maxPackets;
+    uint64_t forcedCount = 0;
+};
@@ -0,0 +1,61 @@
+#include "PictureAssembler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+constexpr uint8_t START_CODE[] = { 0, 0, 1 };
+
+PictureAssembler::PictureAssembler(uint32_t nalLengthSize) : nalLengthSize(nalLengthSize) {
+    if (nalLengthSize > 4) {
+        throw std::invalid_argument("PictureAssembler: NAL length size must be 0-4.");
+    }
+}
+
+size_t PictureAssembler::packedSizeBound(size_t packetSize, uint32_t nalCount) {
+    return packetSize + static_cast<size_t>(nalCount) * sizeof(START_CODE);
+}
+
+size_t PictureAssembler::assemble(const uint8_t* data, size_t size, uint8_t* dst, size_t capacity) {
+    if (const char* error = H264Parser::splitNalUnits(data, size, nalLengthSize, nalUnits)) {
+        throw std::runtime_error(std::string("PictureAssembler: Damaged packet: ") + error);
+    }
+
+    sliceOffsets.clear();
+    parameterSets.clear();
+    size_t written = 0;
+    for (const H264NalUnit& nal : nalUnits) {
+        uint8_t type = nal.size > 0 ? nal.data[0] & 0x1f : 0;
+        if (type != H264Parser::NAL_SLICE && type != H264Parser::NAL_IDR_SLICE) {
+            if (type == H264Parser::NAL_SPS || type == H264Parser::NAL_PPS) {
+                parameterSets.push_back(nal);
+            }
+            ++stats.skippedNalUnits;
+            continue;
+        }
+        // Slices of the next picture would be decoded into this one.
+        if (!sliceOffsets.empty() && H264Parser::isFirstSlice(nal.data, nal.size)) {
+            throw std::runtime_error("PictureAssembler: More than one picture in a packet.");
+        }
+        if (capacity - written < sizeof(START_CODE) + nal.size) {
+            throw std::runtime_error("PictureAssembler: Picture of " + std::to_string(size) +
+                                     " bytes exceeds the decode bitstream buffer!");
+        }
+        if (sliceOffsets.empty()) {
+            firstSlice = nal;
+        }
+        sliceOffsets.push_back(static_cast<uint32_t>(written));
+        memcpy(dst + written, START_CODE, sizeof(START_CODE));
+        memcpy(dst + written + sizeof(START_CODE), nal.data, nal.size);
+        written += sizeof(START_CODE) + nal.size;
+    }
+    if (sliceOffsets.empty()) {
+        throw std::runtime_error("PictureAssembler: Packet holds no slice.");
+    }
+
+    ++stats.pictures;
+    stats.slices += sliceOffsets.size();
+    stats.maxSlicesPerPicture = std::max(stats.maxSlicesPerPicture, static_cast<uint32_t>(sliceOffsets.size()));
+    return written;
+}
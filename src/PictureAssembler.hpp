@@ -0,0 +1,61 @@
+#pragma once
+
+#include "H264Parser.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Totals over the pictures assembled so far.
+struct PictureAssemblerStats {
+    uint64_t pictures = 0;
+    uint64_t slices = 0;
+    uint32_t maxSlicesPerPicture = 0;
+    // Parameter sets, SEI and other non-slice NAL units left out of the decode buffer.
+    uint64_t skippedNalUnits = 0;
+};
+
+// The PictureAssembler class packs the slices of one access unit (a demuxed packet)
+// into a decode bitstream buffer for a single decode call. Each slice NAL unit is
+// written once, behind a 00 00 01 start code, straight from the packet, and its
+// offset from the start of the picture goes into the slice offset table that the
+// H.264 picture info points at. Other NAL units are left out: the parameter sets
+// reach the decoder through the session parameters, so in-band ones are listed by
+// getParameterSets() for the caller to apply before the decode.
+class PictureAssembler {
+public:
+    // nalLengthSize is the size of the packets' NAL length prefixes (1-4), or 0 for
+    // Annex B start codes.
+    explicit PictureAssembler(uint32_t nalLengthSize);
+
+    // The most bytes a packet of packetSize bytes with nalCount NAL units packs to:
+    // start codes can be longer than short length prefixes.
+    static size_t packedSizeBound(size_t packetSize, uint32_t nalCount);
+
+    // Packs the packet's slices to dst, which holds capacity bytes and should sit at
+    // the device's bitstream offset alignment. Returns the bytes written. Throws a
+    // std::runtime_error if the packet is damaged, holds no slice or more than one
+    // picture, or does not fit.
+    size_t assemble(const uint8_t* data, size_t size, uint8_t* dst, size_t capacity);
+
+    // Offsets of the last assembled picture's slices from dst, in stream order.
+    const std::vector<uint32_t>& getSliceOffsets() const { return sliceOffsets; }
+
+    // The first slice of the last assembled picture, pointing into the packet; its
+    // header names the PPS, and through it the SPS, the picture is decoded with.
+    const H264NalUnit& getFirstSlice() const { return firstSlice; }
+
+    // SPS and PPS NAL units of the last assembled packet, pointing into the packet.
+    const std::vector<H264NalUnit>& getParameterSets() const { return parameterSets; }
+
+    const PictureAssemblerStats& getStats() const { return stats; }
+
+private:
+    uint32_t nalLengthSize;
+    // Reused across pictures so assembling does not allocate.
+    std::vector<H264NalUnit> nalUnits;
+    std::vector<uint32_t> sliceOffsets;
+    std::vector<H264NalUnit> parameterSets;
+    H264NalUnit firstSlice;
+    PictureAssemblerStats stats;
+};
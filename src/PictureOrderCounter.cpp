@@ -0,0 +1,132 @@
+#include "PictureOrderCounter.hpp"
+#include "H264Parser.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool PictureOrderCounter::parseSlice(const uint8_t* nal, size_t size, const StdVideoH264SequenceParameterSet& sps,
+                                     const StdVideoH264PictureParameterSet& pps, H264SliceOrderFields& fields) {
+    if (size < 2) {
+        return false;
+    }
+    fields = H264SliceOrderFields();
+    fields.idr = (nal[0] & 0x1f) == H264Parser::NAL_IDR_SLICE;
+    fields.reference = (nal[0] & 0x60) != 0;
+
+    // The fields sit within the first 40 or so RBSP bytes of any slice header.
+    uint8_t rbsp[64];
+    BitReader reader(rbsp, H264Parser::unescapeRbsp(nal + 1, std::min<size_t>(size - 1, sizeof(rbsp)), rbsp));
+    reader.readUE(); // first_mb_in_slice
+    reader.readUE(); // slice_type
+    reader.readUE(); // pic_parameter_set_id
+    if (sps.flags.separate_colour_plane_flag) {
+        reader.readBits(2); // colour_plane_id
+    }
+    fields.frameNum = reader.readBits(sps.log2_max_frame_num_minus4 + 4u);
+    if (!sps.flags.frame_mbs_only_flag) {
+        fields.fieldPic = reader.readFlag();
+        if (fields.fieldPic) {
+            fields.bottomField = reader.readFlag();
+        }
+    }
+    if (fields.idr) {
+        reader.readUE(); // idr_pic_id
+    }
+    bool bottomDelta = pps.flags.bottom_field_pic_order_in_frame_present_flag && !fields.fieldPic;
+    if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_0) {
+        fields.picOrderCntLsb = reader.readBits(sps.log2_max_pic_order_cnt_lsb_minus4 + 4u);
+        if (bottomDelta) {
+            fields.deltaPicOrderCntBottom = reader.readSE();
+        }
+    } else if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_1 && !sps.flags.delta_pic_order_always_zero_flag) {
+        fields.deltaPicOrderCnt[0] = reader.readSE();
+        if (bottomDelta) {
+            fields.deltaPicOrderCnt[1] = reader.readSE();
+        }
+    }
+    return !reader.overrun();
+}
+
+int32_t PictureOrderCounter::next(const uint8_t* nal, size_t size, const StdVideoH264SequenceParameterSet& sps,
+                                  const StdVideoH264PictureParameterSet& pps) {
+    H264SliceOrderFields fields;
+    if (!parseSlice(nal, size, sps, pps, fields)) {
+        throw std::runtime_error("Decode: Truncated slice header.");
+    }
+    return next(fields, sps);
+}
+
+int32_t PictureOrderCounter::next(const H264SliceOrderFields& fields, const StdVideoH264SequenceParameterSet& sps) {
+    int32_t top = 0;
+    int32_t bottom = 0;
+    if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_0) {
+        // 8.2.1.1: the LSBs are sent, the MSBs follow them across wrap-arounds.
+        if (fields.idr) {
+            prevPicOrderCntMsb = 0;
+            prevPicOrderCntLsb = 0;
+        }
+        int32_t maxLsb = 1 << (sps.log2_max_pic_order_cnt_lsb_minus4 + 4);
+        int32_t lsb = static_cast<int32_t>(fields.picOrderCntLsb);
+        int32_t prevLsb = static_cast<int32_t>(prevPicOrderCntLsb);
+        int32_t msb = prevPicOrderCntMsb;
+        if (lsb < prevLsb && prevLsb - lsb >= maxLsb / 2) {
+            msb += maxLsb;
+        } else if (lsb > prevLsb && lsb - prevLsb > maxLsb / 2) {
+            msb -= maxLsb;
+        }
+        top = msb + lsb;
+        bottom = fields.fieldPic ? top : top + fields.deltaPicOrderCntBottom;
+        if (fields.reference) {
+            prevPicOrderCntMsb = msb;
+            prevPicOrderCntLsb = fields.picOrderCntLsb;
+        }
+    } else {
+        // 8.2.1.2 and 8.2.1.3: the count follows frame_num, continued across wrap-arounds.
+        uint32_t maxFrameNum = 1u << (sps.log2_max_frame_num_minus4 + 4);
+        uint32_t frameNumOffset = 0;
+        if (!fields.idr) {
+            frameNumOffset = prevFrameNumOffset + (prevFrameNum > fields.frameNum ? maxFrameNum : 0);
+        }
+        prevFrameNumOffset = frameNumOffset;
+        prevFrameNum = fields.frameNum;
+
+        if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_1) {
+            uint32_t cycleLength = sps.num_ref_frames_in_pic_order_cnt_cycle;
+            uint32_t absFrameNum = cycleLength ? frameNumOffset + fields.frameNum : 0;
+            if (!fields.reference && absFrameNum > 0) {
+                --absFrameNum;
+            }
+            int32_t expected = 0;
+            if (absFrameNum > 0) {
+                int32_t deltaPerCycle = 0;
+                for (uint32_t i = 0; i < cycleLength; ++i) {
+                    deltaPerCycle += sps.pOffsetForRefFrame[i];
+                }
+                uint32_t cycles = (absFrameNum - 1) / cycleLength;
+                uint32_t inCycle = (absFrameNum - 1) % cycleLength;
+                expected = static_cast<int32_t>(cycles) * deltaPerCycle;
+                for (uint32_t i = 0; i <= inCycle; ++i) {
+                    expected += sps.pOffsetForRefFrame[i];
+                }
+            }
+            if (!fields.reference) {
+                expected += sps.offset_for_non_ref_pic;
+            }
+            top = expected + fields.deltaPicOrderCnt[0];
+            bottom = fields.fieldPic ? expected + sps.offset_for_top_to_bottom_field + fields.deltaPicOrderCnt[0]
+                                     : top + sps.offset_for_top_to_bottom_field + fields.deltaPicOrderCnt[1];
+        } else {
+            // Display order is decode order, with non-reference pictures before the next reference one.
+            int32_t count = 0;
+            if (!fields.idr) {
+                count = 2 * static_cast<int32_t>(frameNumOffset + fields.frameNum) - (fields.reference ? 0 : 1);
+            }
+            top = count;
+            bottom = count;
+        }
+    }
+    if (fields.fieldPic) {
+        return fields.bottomField ? bottom : top;
+    }
+    return std::min(top, bottom);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vk_video/vulkan_video_codec_h264std.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// The slice header fields that give a picture its order count.
+struct H264SliceOrderFields {
+    bool idr = false;
+    bool reference = false;
+    uint32_t frameNum = 0;
+    bool fieldPic = false;
+    bool bottomField = false;
+    uint32_t picOrderCntLsb = 0;
+    int32_t deltaPicOrderCntBottom = 0;
+    int32_t deltaPicOrderCnt[2] = {};
+};
+
+// The PictureOrderCounter class derives each picture's PicOrderCnt, its place in
+// display order, from the first slice header of the pictures in decode order, as in
+// H.264 clause 8.2.1 for all three pic_order_cnt_types. The count restarts at every
+// IDR. memory_management_control_operation 5, which also restarts it, sits past the
+// reference list syntax and is not looked for.
+class PictureOrderCounter {
+public:
+    // Reads the order fields from a slice NAL unit (including its header).
+    // Returns false if the slice header is truncated.
+    static bool parseSlice(const uint8_t* nal, size_t size, const StdVideoH264SequenceParameterSet& sps,
+                           const StdVideoH264PictureParameterSet& pps, H264SliceOrderFields& fields);
+
+    // The PicOrderCnt of the next picture in decode order, given its first slice.
+    // Throws a std::runtime_error if the slice header is truncated.
+    int32_t next(const uint8_t* nal, size_t size, const StdVideoH264SequenceParameterSet& sps,
+                 const StdVideoH264PictureParameterSet& pps);
+
+    // The PicOrderCnt of a picture with these fields; updates the state the next
+    // picture's count depends on.
+    int32_t next(const H264SliceOrderFields& fields, const StdVideoH264SequenceParameterSet& sps);
+
+private:
+    // Type 0: the count of the previous reference picture.
+    int32_t prevPicOrderCntMsb = 0;
+    uint32_t prevPicOrderCntLsb = 0;
+    // Types 1 and 2: frame_num wrap-arounds of the previous picture.
+    uint32_t prevFrameNumOffset = 0;
+    uint32_t prevFrameNum = 0;
+};
@@ -0,0 +1,201 @@
+#include "QualityKernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VT_VERIFY_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VT_VERIFY_NEON 1
+#endif
+
+namespace {
+
+    // The scalar tails of the kernels, from sample or block `from` on.
+    void widenTail(const uint8_t* row, bool wide, int shift, size_t from, size_t width, uint16_t* out) {
+        if (wide) {
+            const uint16_t* row16 = reinterpret_cast<const uint16_t*>(row);
+            for (size_t x = from; x < width; ++x) {
+                out[x] = static_cast<uint16_t>(row16[x] << shift);
+            }
+        } else {
+            for (size_t x = from; x < width; ++x) {
+                out[x] = static_cast<uint16_t>(row[x] << shift);
+            }
+        }
+    }
+
+    uint64_t squaredErrorTail(const uint16_t* a, const uint16_t* b, size_t from, size_t count) {
+        uint64_t total = 0;
+        for (size_t i = from; i < count; ++i) {
+            int64_t diff = static_cast<int64_t>(a[i]) - b[i];
+            total += static_cast<uint64_t>(diff * diff);
+        }
+        return total;
+    }
+
+    void blockTail(const uint16_t* a, const uint16_t* b, size_t from, size_t blocksX, QualityKernels::BlockSums* sums) {
+        for (size_t bx = from; bx < blocksX; ++bx) {
+            QualityKernels::BlockSums& block = sums[bx];
+            for (size_t i = bx * 4; i < bx * 4 + 4; ++i) {
+                block.sumA += a[i];
+                block.sumB += b[i];
+                block.sumSquares += static_cast<uint64_t>(a[i]) * a[i] + static_cast<uint64_t>(b[i]) * b[i];
+                block.sumProducts += static_cast<uint64_t>(a[i]) * b[i];
+            }
+        }
+    }
+
+}
+
+namespace QualityKernels {
+
+    bool hasSimd() {
+#if defined(VT_VERIFY_SSE2) || defined(VT_VERIFY_NEON)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void widenRow(const uint8_t* row, bool wide, int shift, size_t width, uint16_t* out) {
+        size_t x = 0;
+        if (wide) {
+            const uint16_t* row16 = reinterpret_cast<const uint16_t*>(row);
+#if defined(VT_VERIFY_SSE2)
+            __m128i count = _mm_cvtsi32_si128(shift);
+            for (; x + 8 <= width; x += 8) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row16 + x));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_sll_epi16(v, count));
+            }
+#elif defined(VT_VERIFY_NEON)
+            int16x8_t count = vdupq_n_s16(static_cast<int16_t>(shift));
+            for (; x + 8 <= width; x += 8) {
+                vst1q_u16(out + x, vshlq_u16(vld1q_u16(row16 + x), count));
+            }
+#endif
+        } else {
+#if defined(VT_VERIFY_SSE2)
+            __m128i count = _mm_cvtsi32_si128(shift);
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 16 <= width; x += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_sll_epi16(_mm_unpacklo_epi8(v, zero), count));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 8), _mm_sll_epi16(_mm_unpackhi_epi8(v, zero), count));
+            }
+#elif defined(VT_VERIFY_NEON)
+            int16x8_t count = vdupq_n_s16(static_cast<int16_t>(shift));
+            for (; x + 16 <= width; x += 16) {
+                uint8x16_t v = vld1q_u8(row + x);
+                vst1q_u16(out + x, vshlq_u16(vmovl_u8(vget_low_u8(v)), count));
+                vst1q_u16(out + x + 8, vshlq_u16(vmovl_u8(vget_high_u8(v)), count));
+            }
+#endif
+        }
+        widenTail(row, wide, shift, x, width, out);
+    }
+
+    void widenRowScalar(const uint8_t* row, bool wide, int shift, size_t width, uint16_t* out) {
+        widenTail(row, wide, shift, 0, width, out);
+    }
+
+    uint64_t sumSquaredError(const uint16_t* a, const uint16_t* b, size_t count) {
+        uint64_t total = 0;
+        size_t i = 0;
+#if defined(VT_VERIFY_SSE2)
+        // Differences fit in 16 bits; each multiply-add lane holds two squares.
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8) {
+            __m128i diff = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            __m128i squares = _mm_madd_epi16(diff, diff);
+            acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero), _mm_unpackhi_epi32(squares, zero)));
+        }
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        total = lanes[0] + lanes[1];
+#elif defined(VT_VERIFY_NEON)
+        uint64x2_t acc = vdupq_n_u64(0);
+        for (; i + 8 <= count; i += 8) {
+            uint16x8_t diff = vabdq_u16(vld1q_u16(a + i), vld1q_u16(b + i));
+            acc = vpadalq_u32(acc, vmull_u16(vget_low_u16(diff), vget_low_u16(diff)));
+            acc = vpadalq_u32(acc, vmull_u16(vget_high_u16(diff), vget_high_u16(diff)));
+        }
+        total = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+        return total + squaredErrorTail(a, b, i, count);
+    }
+
+    uint64_t sumSquaredErrorScalar(const uint16_t* a, const uint16_t* b, size_t count) {
+        return squaredErrorTail(a, b, 0, count);
+    }
+
+    void accumulateBlockRow(const uint16_t* const* rowsA, const uint16_t* const* rowsB, size_t blocksX, BlockSums* sums) {
+        for (size_t bx = 0; bx < blocksX; ++bx) {
+            sums[bx] = BlockSums{};
+        }
+        for (int r = 0; r < 4; ++r) {
+            const uint16_t* a = rowsA[r];
+            const uint16_t* b = rowsB[r];
+            size_t bx = 0;
+#if defined(VT_VERIFY_SSE2)
+            // Two blocks per vector: multiply-add leaves pairs of columns in each lane.
+            const __m128i ones = _mm_set1_epi16(1);
+            for (; bx + 2 <= blocksX; bx += 2) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + bx * 4));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + bx * 4));
+                alignas(16) uint32_t sa[4], sb[4], ss[4], sp[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(sa), _mm_madd_epi16(va, ones));
+                _mm_store_si128(reinterpret_cast<__m128i*>(sb), _mm_madd_epi16(vb, ones));
+                _mm_store_si128(reinterpret_cast<__m128i*>(ss), _mm_add_epi32(_mm_madd_epi16(va, va), _mm_madd_epi16(vb, vb)));
+                _mm_store_si128(reinterpret_cast<__m128i*>(sp), _mm_madd_epi16(va, vb));
+                for (int half = 0; half < 2; ++half) {
+                    BlockSums& block = sums[bx + half];
+                    block.sumA += sa[half * 2] + sa[half * 2 + 1];
+                    block.sumB += sb[half * 2] + sb[half * 2 + 1];
+                    block.sumSquares += static_cast<uint64_t>(ss[half * 2]) + ss[half * 2 + 1];
+                    block.sumProducts += static_cast<uint64_t>(sp[half * 2]) + sp[half * 2 + 1];
+                }
+            }
+#elif defined(VT_VERIFY_NEON)
+            for (; bx + 2 <= blocksX; bx += 2) {
+                uint16x8_t va = vld1q_u16(a + bx * 4);
+                uint16x8_t vb = vld1q_u16(b + bx * 4);
+                // Low half is the first block, high half the second.
+                uint64x2_t sumsA = vpaddlq_u32(vpaddlq_u16(va));
+                uint64x2_t sumsB = vpaddlq_u32(vpaddlq_u16(vb));
+                uint32x4_t squares[2] = {
+                    vaddq_u32(vmull_u16(vget_low_u16(va), vget_low_u16(va)), vmull_u16(vget_low_u16(vb), vget_low_u16(vb))),
+                    vaddq_u32(vmull_u16(vget_high_u16(va), vget_high_u16(va)), vmull_u16(vget_high_u16(vb), vget_high_u16(vb)))
+                };
+                uint32x4_t products[2] = {
+                    vmull_u16(vget_low_u16(va), vget_low_u16(vb)),
+                    vmull_u16(vget_high_u16(va), vget_high_u16(vb))
+                };
+                sums[bx].sumA += vgetq_lane_u64(sumsA, 0);
+                sums[bx + 1].sumA += vgetq_lane_u64(sumsA, 1);
+                sums[bx].sumB += vgetq_lane_u64(sumsB, 0);
+                sums[bx + 1].sumB += vgetq_lane_u64(sumsB, 1);
+                for (int half = 0; half < 2; ++half) {
+                    uint64x2_t sq = vpaddlq_u32(squares[half]);
+                    uint64x2_t pr = vpaddlq_u32(products[half]);
+                    sums[bx + half].sumSquares += vgetq_lane_u64(sq, 0) + vgetq_lane_u64(sq, 1);
+                    sums[bx + half].sumProducts += vgetq_lane_u64(pr, 0) + vgetq_lane_u64(pr, 1);
+                }
+            }
+#endif
+            blockTail(a, b, bx, blocksX, sums);
+        }
+    }
+
+    void accumulateBlockRowScalar(const uint16_t* const* rowsA, const uint16_t* const* rowsB, size_t blocksX,
+                                  BlockSums* sums) {
+        for (size_t bx = 0; bx < blocksX; ++bx) {
+            sums[bx] = BlockSums{};
+        }
+        for (int r = 0; r < 4; ++r) {
+            blockTail(rowsA[r], rowsB[r], 0, blocksX, sums);
+        }
+    }
+
+} // namespace QualityKernels
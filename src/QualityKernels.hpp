@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The CPU kernels of the quality verifier. Each has a SIMD version (SSE2 or NEON,
+// whichever the target has) and a scalar one that gives the same results, so the two
+// can be checked against each other. Samples are 16-bit and scaled to a common depth.
+namespace QualityKernels {
+
+    // The 16-bit multiply-add kernels need samples below 2^15, and two squared
+    // differences per 32-bit lane below 2^31.
+    constexpr int MAX_BIT_DEPTH = 14;
+
+    // True when the SIMD versions use vector instructions on this target.
+    bool hasSimd();
+
+    // Reads width samples of 8-bit (wide false) or 16-bit little-endian (wide true)
+    // samples into out, shifted left by shift.
+    void widenRow(const uint8_t* row, bool wide, int shift, size_t width, uint16_t* out);
+    void widenRowScalar(const uint8_t* row, bool wide, int shift, size_t width, uint16_t* out);
+
+    // Sum of squared differences of two rows.
+    uint64_t sumSquaredError(const uint16_t* a, const uint16_t* b, size_t count);
+    uint64_t sumSquaredErrorScalar(const uint16_t* a, const uint16_t* b, size_t count);
+
+    // Sums over one 4x4 block of both images, the SSIM building block.
+    struct BlockSums {
+        uint64_t sumA = 0;
+        uint64_t sumB = 0;
+        uint64_t sumSquares = 0; // a^2 + b^2
+        uint64_t sumProducts = 0;
+
+        BlockSums& operator+=(const BlockSums& other) {
+            sumA += other.sumA;
+            sumB += other.sumB;
+            sumSquares += other.sumSquares;
+            sumProducts += other.sumProducts;
+            return *this;
+        }
+    };
+
+    // Sums four rows into blocksX horizontally adjacent 4x4 blocks, overwriting sums.
+    void accumulateBlockRow(const uint16_t* const* rowsA, const uint16_t* const* rowsB, size_t blocksX, BlockSums* sums);
+    void accumulateBlockRowScalar(const uint16_t* const* rowsA, const uint16_t* const* rowsB, size_t blocksX,
+                                  BlockSums* sums);
+
+} // namespace QualityKernels
@@ -0,0 +1,435 @@
+#include "QualityVerifier.hpp"
+#include "QualityKernels.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+}
+
+// Reported for planes without any error, where PSNR is infinite.
+constexpr double MAX_PSNR = 100.0;
+// Frame pairs waiting for a worker, per worker; bounds the decoded frames held in memory.
+constexpr size_t PAIRS_PER_WORKER = 2;
+
+namespace {
+    // Decodes the best video stream of a file in display order.
+    class VideoFileDecoder {
+    public:
+        explicit VideoFileDecoder(const std::string& path) {
+            if (avformat_open_input(&formatContext, path.c_str(), nullptr, nullptr) != 0) {
+                throw std::runtime_error("Verify: Could not open " + path);
+            }
+            const AVCodec* codec = nullptr;
+            if (avformat_find_stream_info(formatContext, nullptr) < 0 ||
+                (streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0)) < 0) {
+                avformat_close_input(&formatContext);
+                throw std::runtime_error("Verify: No decodable video stream in " + path);
+            }
+            codecContext = avcodec_alloc_context3(codec);
+            packet = av_packet_alloc();
+            if (!codecContext || !packet ||
+                avcodec_parameters_to_context(codecContext, formatContext->streams[streamIndex]->codecpar) < 0) {
+                release();
+                throw std::runtime_error("Verify: Could not set up a decoder for " + path);
+            }
+            // Frame threads let the two decoders keep up with the scoring workers.
+            codecContext->thread_count = 0;
+            if (avcodec_open2(codecContext, codec, nullptr) < 0) {
+                release();
+                throw std::runtime_error("Verify: Could not open the " + std::string(codec->name) + " decoder for " + path);
+            }
+        }
+
+        ~VideoFileDecoder() { release(); }
+
+        VideoFileDecoder(const VideoFileDecoder&) = delete;
+        VideoFileDecoder& operator=(const VideoFileDecoder&) = delete;
+
+        // Returns the next frame, owned by the caller, or nullptr at the end.
+        AVFrame* nextFrame() {
+            AVFrame* frame = av_frame_alloc();
+            if (!frame) {
+                throw std::runtime_error("Verify: Failed to allocate a frame");
+            }
+            while (true) {
+                int result = avcodec_receive_frame(codecContext, frame);
+                if (result == 0) {
+                    return frame;
+                }
+                if (result == AVERROR_EOF) {
+                    av_frame_free(&frame);
+                    return nullptr;
+                }
+                if (result != AVERROR(EAGAIN)) {
+                    // A broken picture; skip it, unless nothing is left to feed the decoder.
+                    ++decodeErrors;
+                    if (draining) {
+                        av_frame_free(&frame);
+                        return nullptr;
+                    }
+                }
+                sendNextPacket();
+            }
+        }
+
+        uint64_t getDecodeErrors() const { return decodeErrors; }
+        double getBitrate() const { return static_cast<double>(formatContext->bit_rate); }
+
+    private:
+        AVFormatContext* formatContext = nullptr;
+        AVCodecContext* codecContext = nullptr;
+        AVPacket* packet = nullptr;
+        int streamIndex = -1;
+        bool draining = false;
+        uint64_t decodeErrors = 0;
+
+        void sendNextPacket() {
+            while (av_read_frame(formatContext, packet) >= 0) {
+                if (packet->stream_index != streamIndex) {
+                    av_packet_unref(packet);
+                    continue;
+                }
+                if (avcodec_send_packet(codecContext, packet) < 0) {
+                    ++decodeErrors;
+                }
+                av_packet_unref(packet);
+                return;
+            }
+            avcodec_send_packet(codecContext, nullptr);
+            draining = true;
+        }
+
+        void release() {
+            av_packet_free(&packet);
+            avcodec_free_context(&codecContext);
+            avformat_close_input(&formatContext);
+        }
+    };
+
+    // One plane of a frame, read as 16-bit samples scaled to a common bit depth.
+    struct PlaneReader {
+        const uint8_t* data = nullptr;
+        int linesize = 0;
+        bool wide = false;
+        int shift = 0;
+
+        void readRow(int y, int width, uint16_t* out) const {
+            QualityKernels::widenRow(data + static_cast<ptrdiff_t>(y) * linesize, wide, shift, static_cast<size_t>(width), out);
+        }
+    };
+
+    // SSIM of one 8x8 window from its sums; the constants are scaled to match.
+    double windowSsim(const QualityKernels::BlockSums& sums, double c1, double c2) {
+        double s1 = static_cast<double>(sums.sumA);
+        double s2 = static_cast<double>(sums.sumB);
+        double variances = static_cast<double>(sums.sumSquares) * 64.0 - s1 * s1 - s2 * s2;
+        double covariance = static_cast<double>(sums.sumProducts) * 64.0 - s1 * s2;
+        return (2.0 * s1 * s2 + c1) * (2.0 * covariance + c2) / ((s1 * s1 + s2 * s2 + c1) * (variances + c2));
+    }
+
+    double toPsnr(uint64_t squaredError, uint64_t samples, double peak) {
+        if (squaredError == 0 || samples == 0) {
+            return MAX_PSNR;
+        }
+        double mse = static_cast<double>(squaredError) / static_cast<double>(samples);
+        return std::min(MAX_PSNR, 10.0 * std::log10(peak * peak / mse));
+    }
+
+    const AVPixFmtDescriptor* planarDescriptor(const AVFrame* frame) {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL)) ||
+            !(desc->nb_components == 1 || (desc->nb_components == 3 && (desc->flags & AV_PIX_FMT_FLAG_PLANAR))) ||
+            desc->comp[0].shift != 0 ||
+            desc->comp[0].depth > QualityKernels::MAX_BIT_DEPTH) {
+            throw std::runtime_error(std::string("Verify: Unsupported pixel format ") +
+                                     (desc ? desc->name : "unknown") + "; only planar YUV is compared.");
+        }
+        return desc;
+    }
+
+    FrameQuality compareFrames(const AVFrame* reference, const AVFrame* distorted) {
+        const AVPixFmtDescriptor* refDesc = planarDescriptor(reference);
+        const AVPixFmtDescriptor* distDesc = planarDescriptor(distorted);
+        if (refDesc->nb_components != distDesc->nb_components || refDesc->log2_chroma_w != distDesc->log2_chroma_w ||
+            refDesc->log2_chroma_h != distDesc->log2_chroma_h) {
+            throw std::runtime_error(std::string("Verify: Chroma formats differ (") + refDesc->name + " vs " +
+                                     distDesc->name + ")");
+        }
+        int depth = std::max(refDesc->comp[0].depth, distDesc->comp[0].depth);
+        double peak = static_cast<double>((1 << depth) - 1);
+        int width = std::min(reference->width, distorted->width);
+        int height = std::min(reference->height, distorted->height);
+
+        FrameQuality quality;
+        quality.peak = peak;
+        double* planePsnr[3] = { &quality.psnrY, &quality.psnrU, &quality.psnrV };
+        std::vector<uint16_t> rowA(static_cast<size_t>(width) + 8);
+        std::vector<uint16_t> rowB(static_cast<size_t>(width) + 8);
+        for (int plane = 0; plane < refDesc->nb_components; ++plane) {
+            int planeWidth = plane == 0 ? width : AV_CEIL_RSHIFT(width, refDesc->log2_chroma_w);
+            int planeHeight = plane == 0 ? height : AV_CEIL_RSHIFT(height, refDesc->log2_chroma_h);
+            PlaneReader a{ reference->data[refDesc->comp[plane].plane], reference->linesize[refDesc->comp[plane].plane],
+                           refDesc->comp[plane].step > 1, depth - refDesc->comp[0].depth };
+            PlaneReader b{ distorted->data[distDesc->comp[plane].plane], distorted->linesize[distDesc->comp[plane].plane],
+                           distDesc->comp[plane].step > 1, depth - distDesc->comp[0].depth };
+            uint64_t squaredError = 0;
+            for (int y = 0; y < planeHeight; ++y) {
+                a.readRow(y, planeWidth, rowA.data());
+                b.readRow(y, planeWidth, rowB.data());
+                squaredError += QualityKernels::sumSquaredError(rowA.data(), rowB.data(), static_cast<size_t>(planeWidth));
+            }
+            uint64_t samples = static_cast<uint64_t>(planeWidth) * planeHeight;
+            *planePsnr[plane] = toPsnr(squaredError, samples, peak);
+            quality.squaredError += squaredError;
+            quality.samples += samples;
+        }
+        if (refDesc->nb_components == 1) {
+            quality.psnrU = quality.psnrV = MAX_PSNR;
+        }
+        quality.psnr = toPsnr(quality.squaredError, quality.samples, peak);
+
+        // Luma SSIM: 4x4 block sums, combined 2x2 into overlapping 8x8 windows.
+        size_t blocksX = static_cast<size_t>(width) / 4;
+        size_t blocksY = static_cast<size_t>(height) / 4;
+        if (blocksX < 2 || blocksY < 2) {
+            quality.ssim = quality.psnrY >= MAX_PSNR ? 1.0 : 0.0;
+            return quality;
+        }
+        double c1 = 0.01 * 0.01 * peak * peak * 64.0 * 64.0;
+        double c2 = 0.03 * 0.03 * peak * peak * 64.0 * 63.0;
+        PlaneReader lumaA{ reference->data[refDesc->comp[0].plane], reference->linesize[refDesc->comp[0].plane],
+                           refDesc->comp[0].step > 1, depth - refDesc->comp[0].depth };
+        PlaneReader lumaB{ distorted->data[distDesc->comp[0].plane], distorted->linesize[distDesc->comp[0].plane],
+                           distDesc->comp[0].step > 1, depth - distDesc->comp[0].depth };
+        size_t stride = blocksX * 4 + 8;
+        std::vector<uint16_t> rowsA(stride * 4);
+        std::vector<uint16_t> rowsB(stride * 4);
+        const uint16_t* rowPointersA[4];
+        const uint16_t* rowPointersB[4];
+        for (int r = 0; r < 4; ++r) {
+            rowPointersA[r] = rowsA.data() + stride * r;
+            rowPointersB[r] = rowsB.data() + stride * r;
+        }
+        std::vector<QualityKernels::BlockSums> previous(blocksX);
+        std::vector<QualityKernels::BlockSums> current(blocksX);
+        double total = 0.0;
+        for (size_t by = 0; by < blocksY; ++by) {
+            for (int r = 0; r < 4; ++r) {
+                lumaA.readRow(static_cast<int>(by * 4 + r), static_cast<int>(blocksX * 4), rowsA.data() + stride * r);
+                lumaB.readRow(static_cast<int>(by * 4 + r), static_cast<int>(blocksX * 4), rowsB.data() + stride * r);
+            }
+            QualityKernels::accumulateBlockRow(rowPointersA, rowPointersB, blocksX, current.data());
+            if (by > 0) {
+                for (size_t bx = 0; bx + 1 < blocksX; ++bx) {
+                    QualityKernels::BlockSums window = previous[bx];
+                    window += previous[bx + 1];
+                    window += current[bx];
+                    window += current[bx + 1];
+                    total += windowSsim(window, c1, c2);
+                }
+            }
+            std::swap(previous, current);
+        }
+        quality.ssim = total / static_cast<double>((blocksX - 1) * (blocksY - 1));
+        return quality;
+    }
+
+    struct FramePair {
+        uint64_t index;
+        AVFrame* reference;
+        AVFrame* distorted;
+    };
+}
+
+bool QualityReport::isComplete() const {
+    return decodeErrors == 0 && referenceFrames == distortedFrames && comparedFrames == referenceFrames;
+}
+
+QualityVerifier::QualityVerifier(const std::string& referencePath, const std::string& distortedPath,
+                                 const VerifyOptions& options)
+    : referencePath(referencePath), distortedPath(distortedPath), options(options) {}
+
+QualityReport QualityVerifier::run() {
+    VideoFileDecoder referenceDecoder(referencePath);
+    VideoFileDecoder distortedDecoder(distortedPath);
+    uint32_t threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    VT_LOG_INFO("Verify: Comparing " << distortedPath << " against " << referencePath << " on " << threadCount << " threads");
+
+    std::mutex mutex;
+    std::condition_variable pairAvailable;
+    std::condition_variable spaceAvailable;
+    std::deque<FramePair> pending;
+    bool producerDone = false;
+    std::exception_ptr failure;
+    std::vector<FrameQuality> results;
+
+    auto worker = [&] {
+        while (true) {
+            FramePair pair;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                pairAvailable.wait(lock, [&] { return producerDone || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                pair = pending.front();
+                pending.pop_front();
+            }
+            spaceAvailable.notify_one();
+            FrameQuality quality;
+            std::exception_ptr error;
+            try {
+                quality = compareFrames(pair.reference, pair.distorted);
+                quality.frameIndex = pair.index;
+            } catch (...) {
+                error = std::current_exception();
+            }
+            av_frame_free(&pair.reference);
+            av_frame_free(&pair.distorted);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error) {
+                if (!failure) {
+                    failure = error;
+                }
+                spaceAvailable.notify_one();
+            } else {
+                results.push_back(quality);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    QualityReport report;
+    auto finishWorkers = [&] {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            producerDone = true;
+        }
+        pairAvailable.notify_all();
+        for (std::thread& thread : workers) {
+            thread.join();
+        }
+    };
+    try {
+        // Decoding stays on this thread; libavcodec's frame threads parallelise it.
+        while (true) {
+            AVFrame* reference = referenceDecoder.nextFrame();
+            AVFrame* distorted = distortedDecoder.nextFrame();
+            report.referenceFrames += reference ? 1 : 0;
+            report.distortedFrames += distorted ? 1 : 0;
+            if (report.referenceFrames == 1 && reference) {
+                report.referenceWidth = reference->width;
+                report.referenceHeight = reference->height;
+            }
+            if (report.distortedFrames == 1 && distorted) {
+                report.distortedWidth = distorted->width;
+                report.distortedHeight = distorted->height;
+            }
+            if (!reference || !distorted) {
+                av_frame_free(&reference);
+                av_frame_free(&distorted);
+                // Count what is left of the longer file.
+                while (AVFrame* frame = referenceDecoder.nextFrame()) {
+                    av_frame_free(&frame);
+                    ++report.referenceFrames;
+                }
+                while (AVFrame* frame = distortedDecoder.nextFrame()) {
+                    av_frame_free(&frame);
+                    ++report.distortedFrames;
+                }
+                break;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceAvailable.wait(lock, [&] { return pending.size() < threadCount * PAIRS_PER_WORKER || failure; });
+            if (failure) {
+                av_frame_free(&reference);
+                av_frame_free(&distorted);
+                break;
+            }
+            pending.push_back({ report.referenceFrames - 1, reference, distorted });
+            lock.unlock();
+            pairAvailable.notify_one();
+        }
+    } catch (...) {
+        finishWorkers();
+        throw;
+    }
+    finishWorkers();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    report.decodeErrors = referenceDecoder.getDecodeErrors() + distortedDecoder.getDecodeErrors();
+    report.referenceBitrate = referenceDecoder.getBitrate();
+    report.distortedBitrate = distortedDecoder.getBitrate();
+    report.comparedFrames = results.size();
+    if (results.empty()) {
+        return report;
+    }
+
+    uint64_t squaredError = 0;
+    uint64_t samples = 0;
+    report.minSsim = 1.0;
+    for (const FrameQuality& quality : results) {
+        report.meanPsnrY += quality.psnrY;
+        report.meanPsnrU += quality.psnrU;
+        report.meanPsnrV += quality.psnrV;
+        report.meanPsnr += quality.psnr;
+        report.meanSsim += quality.ssim;
+        report.minSsim = std::min(report.minSsim, quality.ssim);
+        squaredError += quality.squaredError;
+        samples += quality.samples;
+    }
+    double count = static_cast<double>(results.size());
+    report.meanPsnrY /= count;
+    report.meanPsnrU /= count;
+    report.meanPsnrV /= count;
+    report.meanPsnr /= count;
+    report.meanSsim /= count;
+    report.globalPsnr = toPsnr(squaredError, samples, results[0].peak);
+
+    size_t worst = std::min<size_t>(options.worstFrameCount, results.size());
+    std::partial_sort(results.begin(), results.begin() + worst, results.end(),
+                      [](const FrameQuality& a, const FrameQuality& b) { return a.psnr < b.psnr; });
+    report.worstFrames.assign(results.begin(), results.begin() + worst);
+    return report;
+}
+
+void QualityVerifier::printReport(const QualityReport& report) {
+    VT_LOG_INFO("Verify: " << report.comparedFrames << " frames compared (source " << report.referenceFrames
+                << ", output " << report.distortedFrames << "), " << report.decodeErrors << " decode errors");
+    if (report.referenceWidth != report.distortedWidth || report.referenceHeight != report.distortedHeight) {
+        VT_LOG_WARNING("Verify: Frame sizes differ (" << report.referenceWidth << "x" << report.referenceHeight << " vs "
+                       << report.distortedWidth << "x" << report.distortedHeight << "), comparing the common area");
+    }
+    if (report.comparedFrames > 0) {
+        VT_LOG_INFO("Verify: PSNR Y " << report.meanPsnrY << " U " << report.meanPsnrU << " V " << report.meanPsnrV
+                    << " avg " << report.meanPsnr << " global " << report.globalPsnr << " dB, SSIM mean "
+                    << report.meanSsim << " min " << report.minSsim);
+    }
+    if (report.referenceBitrate > 0.0 && report.distortedBitrate > 0.0) {
+        VT_LOG_INFO("Verify: Bitrate " << report.referenceBitrate / 1000.0 << " kbps -> "
+                    << report.distortedBitrate / 1000.0 << " kbps");
+    }
+    for (const FrameQuality& frame : report.worstFrames) {
+        VT_LOG_INFO("Verify: Worst frame " << frame.frameIndex << ": PSNR " << frame.psnr << " dB (Y " << frame.psnrY
+                    << "), SSIM " << frame.ssim);
+    }
+    if (!report.isComplete()) {
+        VT_LOG_WARNING("Verify: Output is incomplete or did not decode cleanly.");
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Quality of one output frame against the source frame at the same display position.
+struct FrameQuality {
+    uint64_t frameIndex = 0;
+    // Per plane and over all samples of the frame, in dB; identical planes give 100.
+    double psnrY = 0.0;
+    double psnrU = 0.0;
+    double psnrV = 0.0;
+    double psnr = 0.0;
+    // Luma SSIM over overlapping 8x8 windows, 0-1.
+    double ssim = 0.0;
+    // Totals behind psnr, for the sequence-wide figure.
+    uint64_t squaredError = 0;
+    uint64_t samples = 0;
+    // Largest sample value at the bit depth compared.
+    double peak = 0.0;
+};
+
+struct QualityReport {
+    uint64_t referenceFrames = 0;
+    uint64_t distortedFrames = 0;
+    uint64_t comparedFrames = 0;
+    // Packets either decoder rejected.
+    uint64_t decodeErrors = 0;
+    int referenceWidth = 0;
+    int referenceHeight = 0;
+    int distortedWidth = 0;
+    int distortedHeight = 0;
+    // Means of the per-frame values, and PSNR from the squared error of every frame.
+    double meanPsnrY = 0.0;
+    double meanPsnrU = 0.0;
+    double meanPsnrV = 0.0;
+    double meanPsnr = 0.0;
+    double globalPsnr = 0.0;
+    double meanSsim = 0.0;
+    double minSsim = 0.0;
+    // Container bitrates in bits per second; 0 when unknown.
+    double referenceBitrate = 0.0;
+    double distortedBitrate = 0.0;
+    // The lowest-PSNR frames, worst first.
+    std::vector<FrameQuality> worstFrames;
+
+    // True when every frame decoded and the frame counts match.
+    bool isComplete() const;
+};
+
+struct VerifyOptions {
+    // Frames compared in parallel; 0 uses one thread per hardware thread.
+    uint32_t threads = 0;
+    uint32_t worstFrameCount = 5;
+};
+
+// The QualityVerifier class decodes a source and its transcode on the CPU with
+// libavcodec and compares them frame by frame in display order, without a GPU. Frame
+// pairs are scored by a pool of worker threads with SIMD kernels: PSNR per plane and
+// luma SSIM. Planar YUV of any bit depth is supported; when the depths differ, e.g.
+// after a 10-bit to 8-bit downconvert, the shallower frame is scaled up. If the
+// frame sizes differ, the common top-left area is compared.
+class QualityVerifier {
+public:
+    QualityVerifier(const std::string& referencePath, const std::string& distortedPath,
+                    const VerifyOptions& options = VerifyOptions{});
+
+    // Decodes both files to the end and scores every frame pair. Throws a
+    // std::runtime_error if a file has no decodable video or an unsupported pixel format.
+    QualityReport run();
+
+    static void printReport(const QualityReport& report);
+
+private:
+    std::string referencePath;
+    std::string distortedPath;
+    VerifyOptions options;
+};
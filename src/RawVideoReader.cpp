@@ -0,0 +1,219 @@
+#include "RawVideoReader.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr char Y4M_SIGNATURE[] = "YUV4MPEG2";
+    constexpr char Y4M_FRAME_MARKER[] = "FRAME";
+    // Longest stream or frame header line accepted before the data is considered damaged.
+    constexpr size_t MAX_Y4M_HEADER_SIZE = 4096;
+
+    bool hasY4mExtension(const std::string& path) {
+        if (path.size() < 4) {
+            return false;
+        }
+        std::string extension = path.substr(path.size() - 4);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".y4m";
+    }
+
+    // Parses "num:den" (Y4M) into a rational; false if either part is not a positive integer.
+    bool parseRatio(const std::string& value, Timebase& ratio) {
+        size_t colon = value.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        try {
+            ratio.num = std::stoi(value.substr(0, colon));
+            ratio.den = std::stoi(value.substr(colon + 1));
+        } catch (const std::exception&) {
+            return false;
+        }
+        return ratio.isValid();
+    }
+}
+
+RawVideoReader::RawVideoReader(const std::string& path, const RawVideoOptions& options)
+    : path(path), format(options.format), width(options.width), height(options.height),
+      frameRate(options.frameRate) {
+    y4m = !options.enabled();
+    if (!y4m && (width == 0 || height == 0 || !frameRate.isValid())) {
+        throw std::invalid_argument("Raw input needs a frame size and frame rate.");
+    }
+
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open input file: " + path + " (" + strerror(errno) + ")");
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Input file is empty or unreadable: " + path);
+    }
+    fileSize = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Could not map input file: " + path + " (" + strerror(errno) + ")");
+    }
+    data = static_cast<const uint8_t*>(mapping);
+    // Frames are read front to back once; let the kernel read ahead aggressively.
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    try {
+        if (y4m) {
+            parseY4mHeader();
+        }
+    } catch (...) {
+        munmap(mapping, fileSize);
+        close(fd);
+        throw;
+    }
+    firstFrameOffset = position;
+
+    size_t bytesPerSample = getBitDepth() > 8 ? 2 : 1;
+    size_t lumaSize = static_cast<size_t>(width) * height * bytesPerSample;
+    size_t chromaSize = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2) * bytesPerSample;
+    frameSize = lumaSize + 2 * chromaSize;
+}
+
+RawVideoReader::~RawVideoReader() {
+    munmap(const_cast<uint8_t*>(data), fileSize);
+    close(fd);
+}
+
+bool RawVideoReader::isRawInput(const std::string& path, const RawVideoOptions& options) {
+    return options.enabled() || hasY4mExtension(path);
+}
+
+RawPixelFormat RawVideoReader::parsePixelFormat(const std::string& name) {
+    if (name == "i420") return RawPixelFormat::I420;
+    if (name == "nv12") return RawPixelFormat::Nv12;
+    if (name == "yuv420p10") return RawPixelFormat::I420P10;
+    if (name == "p010") return RawPixelFormat::P010;
+    throw std::invalid_argument("Unknown raw pixel format: " + name + " (expected i420, nv12, yuv420p10 or p010)");
+}
+
+const char* RawVideoReader::getPixelFormatName(RawPixelFormat format) {
+    switch (format) {
+    case RawPixelFormat::I420: return "i420";
+    case RawPixelFormat::Nv12: return "nv12";
+    case RawPixelFormat::I420P10: return "yuv420p10";
+    case RawPixelFormat::P010: return "p010";
+    default: return "none";
+    }
+}
+
+// "YUV4MPEG2 W1920 H1080 F30000:1001 Ip A1:1 C420jpeg\n". Only progressive 4:2:0 is
+// supported; the aspect ratio and X (application) parameters are ignored.
+void RawVideoReader::parseY4mHeader() {
+    const uint8_t* end = static_cast<const uint8_t*>(memchr(data, '\n', std::min(fileSize, MAX_Y4M_HEADER_SIZE)));
+    if (fileSize < sizeof(Y4M_SIGNATURE) || memcmp(data, Y4M_SIGNATURE, sizeof(Y4M_SIGNATURE) - 1) != 0 || !end) {
+        throw std::runtime_error("Y4M: " + path + " has no YUV4MPEG2 header.");
+    }
+    std::string header(reinterpret_cast<const char*>(data) + sizeof(Y4M_SIGNATURE) - 1,
+                       reinterpret_cast<const char*>(end));
+    position = static_cast<size_t>(end - data) + 1;
+
+    std::string colorspace = "420jpeg";
+    frameRate = {};
+    size_t start = 0;
+    while (start < header.size()) {
+        size_t stop = header.find(' ', start);
+        if (stop == std::string::npos) {
+            stop = header.size();
+        }
+        std::string token = header.substr(start, stop - start);
+        start = stop + 1;
+        if (token.empty()) {
+            continue;
+        }
+        std::string value = token.substr(1);
+        try {
+            switch (token[0]) {
+            case 'W': width = static_cast<uint32_t>(std::stoul(value)); break;
+            case 'H': height = static_cast<uint32_t>(std::stoul(value)); break;
+            case 'F':
+                if (!parseRatio(value, frameRate)) {
+                    throw std::runtime_error("Y4M: Invalid frame rate " + value + ".");
+                }
+                break;
+            case 'I':
+                if (value != "p" && value != "?") {
+                    throw std::runtime_error("Y4M: Interlaced input (I" + value + ") is not supported.");
+                }
+                break;
+            case 'C': colorspace = value; break;
+            default: break;
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Y4M: Invalid header parameter " + token + ".");
+        }
+    }
+    if (width == 0 || height == 0 || !frameRate.isValid()) {
+        throw std::runtime_error("Y4M: The header of " + path + " lacks the frame size or rate.");
+    }
+
+    if (colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420") {
+        format = RawPixelFormat::I420;
+    } else if (colorspace == "420p10") {
+        format = RawPixelFormat::I420P10;
+    } else {
+        throw std::runtime_error("Y4M: Colourspace C" + colorspace + " is not supported; only 8- and 10-bit 4:2:0 are.");
+    }
+}
+
+const uint8_t* RawVideoReader::nextFrame() {
+    if (position >= fileSize) {
+        return nullptr;
+    }
+    if (y4m) {
+        size_t remaining = fileSize - position;
+        const uint8_t* end = static_cast<const uint8_t*>(memchr(data + position, '\n', std::min(remaining, MAX_Y4M_HEADER_SIZE)));
+        if (remaining < sizeof(Y4M_FRAME_MARKER) - 1 || memcmp(data + position, Y4M_FRAME_MARKER, sizeof(Y4M_FRAME_MARKER) - 1) != 0 || !end) {
+            throw std::runtime_error("Y4M: No FRAME marker at byte " + std::to_string(position) + " of " + path + ".");
+        }
+        position = static_cast<size_t>(end - data) + 1;
+    }
+    if (fileSize - position < frameSize) {
+        VT_LOG_WARNING("Warning: Dropping a truncated last frame of " << (fileSize - position) << " bytes, "
+                       << frameSize << " expected.");
+        position = fileSize;
+        return nullptr;
+    }
+
+    const uint8_t* frame = data + position;
+    position += frameSize;
+    // Start reading the next frame from disk while this one is uploaded.
+    if (position < fileSize) {
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t pageStart = position & ~(pageSize - 1);
+        madvise(const_cast<uint8_t*>(data) + pageStart, std::min(frameSize, fileSize - pageStart), MADV_WILLNEED);
+    }
+    return frame;
+}
+
+uint64_t RawVideoReader::getFrameCountEstimate() const {
+    // Y4M frame headers are usually just "FRAME\n".
+    size_t frameStride = frameSize + (y4m ? sizeof(Y4M_FRAME_MARKER) : 0);
+    return (fileSize - firstFrameOffset) / frameStride;
+}
+
+void RawVideoReader::printSummary() const {
+    VT_LOG_INFO("Raw input: " << path << (y4m ? " (Y4M)" : " (headerless)"));
+    VT_LOG_INFO("Video Resolution: " << width << "x" << height);
+    VT_LOG_INFO("Video Timing: " << static_cast<double>(frameRate.num) / frameRate.den << " fps, about "
+                << getFrameCountEstimate() << " frames");
+    VT_LOG_INFO("Video Format: " << getPixelFormatName(format) << ", " << getBitDepth() << "-bit 4:2:0");
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "TimestampTracker.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Sample layouts of uncompressed 4:2:0 input.
+enum class RawPixelFormat {
+    None,
+    I420,    // 8-bit, three planes (Y4M 420jpeg, 420paldv, 420mpeg2).
+    Nv12,    // 8-bit, luma plane and interleaved CbCr plane.
+    I420P10, // 10-bit in the low bits of 16-bit little-endian samples, three planes (Y4M 420p10).
+    P010     // 10-bit in the high bits of 16-bit little-endian samples, NV12 arrangement.
+};
+
+// How to read a headerless raw file. Y4M inputs describe themselves.
+struct RawVideoOptions {
+    RawPixelFormat format = RawPixelFormat::None;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    Timebase frameRate{25, 1};
+
+    bool enabled() const { return format != RawPixelFormat::None; }
+};
+
+// The RawVideoReader class reads uncompressed frames from a Y4M or headerless raw YUV
+// file. The file is memory-mapped and frames are returned as pointers into the
+// mapping, so the only copy of a frame is the one into the GPU's staging memory.
+class RawVideoReader {
+public:
+    // Throws a std::runtime_error if the file cannot be mapped or its Y4M header is
+    // damaged or describes an unsupported layout, and a std::invalid_argument if a
+    // headerless file is opened without a format and size.
+    RawVideoReader(const std::string& path, const RawVideoOptions& options);
+    ~RawVideoReader();
+
+    RawVideoReader(const RawVideoReader&) = delete;
+    RawVideoReader& operator=(const RawVideoReader&) = delete;
+
+    // True for a .y4m path, or for any path when a headerless format is given.
+    static bool isRawInput(const std::string& path, const RawVideoOptions& options);
+
+    // Parses i420, nv12, yuv420p10 or p010. Throws a std::invalid_argument otherwise.
+    static RawPixelFormat parsePixelFormat(const std::string& name);
+    static const char* getPixelFormatName(RawPixelFormat format);
+
+    // Returns the next frame, or nullptr at the end of the file. A truncated last frame
+    // is dropped with a warning; a missing Y4M frame marker throws a std::runtime_error.
+    const uint8_t* nextFrame();
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    Timebase getFrameRate() const { return frameRate; }
+    RawPixelFormat getPixelFormat() const { return format; }
+    uint32_t getBitDepth() const { return format == RawPixelFormat::I420P10 || format == RawPixelFormat::P010 ? 10 : 8; }
+    size_t getFrameSize() const { return frameSize; }
+    uint64_t getFrameCountEstimate() const;
+
+    void printSummary() const;
+
+private:
+    std::string path;
+    int fd = -1;
+    const uint8_t* data = nullptr;
+    size_t fileSize = 0;
+    size_t position = 0;
+    size_t firstFrameOffset = 0;
+    bool y4m = false;
+
+    RawPixelFormat format = RawPixelFormat::None;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    Timebase frameRate;
+    size_t frameSize = 0;
+
+    // Parses the stream header and leaves position at the first FRAME marker.
+    void parseY4mHeader();
+};
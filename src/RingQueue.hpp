@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// A FIFO queue on a circular buffer. Unlike std::deque, which allocates and frees
+// blocks as a queue moves through them, it only allocates when it grows past its
+// capacity, so per-frame queues reserved for the pipeline depth never allocate.
+// Popped slots are reset to T(), so they let go of what they held right away.
+template <typename T>
+class RingQueue {
+public:
+    void reserve(size_t capacity) {
+        if (capacity > slots.size()) {
+            grow(capacity);
+        }
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& front() { return slots[head]; }
+    const T& front() const { return slots[head]; }
+    T& back() { return (*this)[count - 1]; }
+
+    // Element i counted from the front.
+    T& operator[](size_t i) { return slots[(head + i) % slots.size()]; }
+    const T& operator[](size_t i) const { return slots[(head + i) % slots.size()]; }
+
+    void push_back(T value) {
+        if (count == slots.size()) {
+            grow(slots.empty() ? 4 : slots.size() * 2);
+        }
+        slots[(head + count) % slots.size()] = std::move(value);
+        ++count;
+    }
+
+    void pop_front() {
+        slots[head] = T();
+        head = (head + 1) % slots.size();
+        --count;
+    }
+
+    void pop_back() {
+        --count;
+        slots[(head + count) % slots.size()] = T();
+    }
+
+    void clear() {
+        while (count > 0) {
+            pop_front();
+        }
+    }
+
+private:
+    std::vector<T> slots;
+    size_t head = 0;
+    size_t count = 0;
+
+    void grow(size_t capacity) {
+        std::vector<T> larger(capacity);
+        for (size_t i = 0; i < count; ++i) {
+            larger[i] = std::move((*this)[i]);
+        }
+        slots = std::move(larger);
+        head = 0;
+    }
+};
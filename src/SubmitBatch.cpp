@@ -0,0 +1,44 @@
+#include "SubmitBatch.hpp"
+#include <stdexcept>
+
+SubmitBatch::SubmitBatch(size_t capacity) {
+    entries.reserve(capacity);
+    submitInfos.reserve(capacity);
+}
+
+void SubmitBatch::add(VkCommandBuffer commandBuffer, const VkSemaphoreSubmitInfo* wait, const VkSemaphoreSubmitInfo& signal) {
+    Entry entry{};
+    entry.commandBuffer.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    entry.commandBuffer.commandBuffer = commandBuffer;
+    entry.hasWait = wait != nullptr;
+    if (wait) {
+        entry.wait = *wait;
+    }
+    entry.signal = signal;
+    entries.push_back(entry);
+}
+
+void SubmitBatch::submit(VulkanBase* vulkanBase, VkQueue queue) {
+    if (entries.empty()) {
+        return;
+    }
+
+    // Pointers into entries are only taken here, after the vector has stopped growing.
+    submitInfos.clear();
+    for (const Entry& entry : entries) {
+        VkSubmitInfo2 info{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+        info.waitSemaphoreInfoCount = entry.hasWait ? 1 : 0;
+        info.pWaitSemaphoreInfos = entry.hasWait ? &entry.wait : nullptr;
+        info.commandBufferInfoCount = 1;
+        info.pCommandBufferInfos = &entry.commandBuffer;
+        info.signalSemaphoreInfoCount = 1;
+        info.pSignalSemaphoreInfos = &entry.signal;
+        submitInfos.push_back(info);
+    }
+
+    VkResult result = vulkanBase->queueSubmit(queue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data());
+    entries.clear();
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit batched video work!");
+    }
+}
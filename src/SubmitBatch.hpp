@@ -0,0 +1,37 @@
+#pragma once
+
+#include "VulkanBase.hpp"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// The SubmitBatch class collects per-frame command buffers for one queue, together
+// with their timeline waits and signals, and hands them to the driver in a single
+// vkQueueSubmit2 call. Each frame keeps its own VkSubmitInfo2 so per-frame timeline
+// values are preserved.
+class SubmitBatch {
+public:
+    explicit SubmitBatch(size_t capacity = 1);
+
+    // Queues a command buffer. wait may be null; signal is required.
+    void add(VkCommandBuffer commandBuffer, const VkSemaphoreSubmitInfo* wait, const VkSemaphoreSubmitInfo& signal);
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    // Submits every queued command buffer in order and clears the batch.
+    // Throws a std::runtime_error if the submission fails.
+    void submit(VulkanBase* vulkanBase, VkQueue queue);
+
+private:
+    struct Entry {
+        VkCommandBufferSubmitInfo commandBuffer;
+        VkSemaphoreSubmitInfo wait;
+        VkSemaphoreSubmitInfo signal;
+        bool hasWait;
+    };
+
+    // Reused between submissions so the steady state does not allocate.
+    std::vector<Entry> entries;
+    std::vector<VkSubmitInfo2> submitInfos;
+};
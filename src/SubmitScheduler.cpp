@@ -0,0 +1,244 @@
+#include "SubmitScheduler.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+
+namespace {
+    // Totals over every transcoder in the process.
+    struct SchedulerMetrics {
+        MetricCounter& deadlineMisses;
+        MetricCounter& deferrals;
+    };
+
+    SchedulerMetrics& schedulerMetrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static SchedulerMetrics metrics{
+            registry.counter("transcoder_deadline_misses_total", "Live frames encoded after their deadline."),
+            registry.counter("transcoder_scheduler_deferrals_total", "Frames held back for another transcode."),
+        };
+        return metrics;
+    }
+
+    // Virtual time, in megapixels over weight, a batch job may run ahead of another
+    // active one: a few frames, so jobs do not take turns frame by frame.
+    constexpr double FAIR_SHARE_LEAD = 8.0;
+    // A batch job that has not asked for a frame for this long no longer holds others
+    // back, and rejoins at their virtual time instead of catching up.
+    constexpr auto BATCH_IDLE_TIMEOUT = std::chrono::milliseconds(250);
+    constexpr uint32_t BATCH_FRAMES_IN_FLIGHT_WITH_LIVE = 1;
+    // Arrivals and idle timeouts change the policy's answer without a notification.
+    constexpr auto POLL_INTERVAL = std::chrono::milliseconds(5);
+
+    double secondsBetween(SubmitScheduler::Clock::time_point from, SubmitScheduler::Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    }
+}
+
+ScheduledJob::~ScheduledJob() {
+    release();
+}
+
+ScheduledJob::ScheduledJob(ScheduledJob&& other) noexcept
+    : scheduler(other.scheduler), id(other.id), live(other.live) {
+    other.scheduler = nullptr;
+    other.id = 0;
+}
+
+ScheduledJob& ScheduledJob::operator=(ScheduledJob&& other) noexcept {
+    if (this != &other) {
+        release();
+        scheduler = other.scheduler;
+        id = other.id;
+        live = other.live;
+        other.scheduler = nullptr;
+        other.id = 0;
+    }
+    return *this;
+}
+
+void ScheduledJob::release() {
+    if (scheduler) {
+        scheduler->remove(id);
+        scheduler = nullptr;
+        id = 0;
+    }
+}
+
+void ScheduledJob::admitFrame(uint64_t frameNumber, double cost) {
+    if (scheduler) {
+        scheduler->admit(id, frameNumber, cost);
+    }
+}
+
+bool ScheduledJob::completeFrame(uint64_t frameNumber) {
+    return scheduler && scheduler->complete(id, frameNumber);
+}
+
+void ScheduledJob::endOfInput() {
+    if (scheduler) {
+        scheduler->endOfInput(id);
+    }
+}
+
+uint32_t ScheduledJob::getFramesInFlight(uint32_t planned) const {
+    if (!scheduler || live || !scheduler->hasLiveJobs()) {
+        return planned;
+    }
+    return std::min(planned, BATCH_FRAMES_IN_FLIGHT_WITH_LIVE);
+}
+
+SchedulingStats ScheduledJob::getStats() const {
+    return scheduler ? scheduler->getStats(id) : SchedulingStats{};
+}
+
+SubmitScheduler& SubmitScheduler::global() {
+    static SubmitScheduler scheduler;
+    return scheduler;
+}
+
+ScheduledJob SubmitScheduler::addJob(const SchedulingOptions& options, double frameIntervalSeconds) {
+    JobState state;
+    state.live = options.deadlineMs > 0;
+    state.weight = std::max(options.weight, 1u);
+    state.frameInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frameIntervalSeconds));
+    state.budget = std::chrono::milliseconds(options.deadlineMs);
+
+    ScheduledJob job;
+    std::lock_guard<std::mutex> lock(mutex);
+    job.scheduler = this;
+    job.id = nextJobId++;
+    job.live = state.live;
+    jobs.emplace(job.id, state);
+    return job;
+}
+
+SubmitScheduler::Clock::time_point SubmitScheduler::arrival(const JobState& job, uint64_t frameNumber) const {
+    return job.origin + job.frameInterval * static_cast<int64_t>(frameNumber - job.firstFrame);
+}
+
+bool SubmitScheduler::isDue(const JobState& job, Clock::time_point now) const {
+    return job.live && job.started && !job.inputEnded && arrival(job, job.nextFrame) - job.budget / 2 <= now;
+}
+
+bool SubmitScheduler::isActiveBatch(const JobState& job, Clock::time_point now) const {
+    return !job.live && job.started && !job.inputEnded && (job.waiting || now - job.lastAdmitted < BATCH_IDLE_TIMEOUT);
+}
+
+bool SubmitScheduler::minActiveVirtualTime(uint64_t except, Clock::time_point now, double& minimum) const {
+    bool found = false;
+    for (const auto& [otherId, other] : jobs) {
+        if (otherId != except && isActiveBatch(other, now) && (!found || other.virtualTime < minimum)) {
+            minimum = other.virtualTime;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool SubmitScheduler::mustWait(uint64_t id, const JobState& job, Clock::time_point now) const {
+    if (job.live) {
+        Clock::time_point deadline = arrival(job, job.nextFrame) + job.budget;
+        for (const auto& [otherId, other] : jobs) {
+            if (otherId != id && isDue(other, now) && arrival(other, other.nextFrame) + other.budget < deadline) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (const auto& [otherId, other] : jobs) {
+        if (isDue(other, now)) {
+            return true;
+        }
+    }
+    double minimum = 0.0;
+    return minActiveVirtualTime(id, now, minimum) && job.virtualTime - minimum > FAIR_SHARE_LEAD;
+}
+
+void SubmitScheduler::admit(uint64_t id, uint64_t frameNumber, double cost) {
+    std::unique_lock<std::mutex> lock(mutex);
+    JobState& job = jobs.at(id);
+    Clock::time_point now = Clock::now();
+    if (!job.started) {
+        job.started = true;
+        job.firstFrame = frameNumber;
+        job.origin = now;
+    }
+    if (!job.live && !isActiveBatch(job, now)) {
+        // Time spent idle is not credit to spend at the others' expense.
+        double minimum = 0.0;
+        if (minActiveVirtualTime(id, now, minimum)) {
+            job.virtualTime = std::max(job.virtualTime, minimum);
+        }
+    }
+    job.nextFrame = frameNumber;
+    job.waiting = true;
+
+    Clock::time_point waitStart = now;
+    Clock::time_point giveUp = now + MAX_DEFERRAL;
+    while (now < giveUp && mustWait(id, job, now)) {
+        changed.wait_until(lock, std::min(giveUp, now + POLL_INTERVAL));
+        now = Clock::now();
+    }
+    if (now > waitStart) {
+        ++job.stats.deferrals;
+        job.stats.deferredSeconds += secondsBetween(waitStart, now);
+        schedulerMetrics().deferrals.add();
+    }
+
+    job.waiting = false;
+    job.nextFrame = frameNumber + 1;
+    job.lastAdmitted = now;
+    if (!job.live) {
+        job.virtualTime += cost / job.weight;
+    }
+    lock.unlock();
+    changed.notify_all();
+}
+
+bool SubmitScheduler::complete(uint64_t id, uint64_t frameNumber) {
+    std::lock_guard<std::mutex> lock(mutex);
+    JobState& job = jobs.at(id);
+    ++job.stats.framesCompleted;
+    if (!job.live) {
+        return false;
+    }
+    double lateness = secondsBetween(arrival(job, frameNumber) + job.budget, Clock::now());
+    if (lateness <= 0.0) {
+        return false;
+    }
+    ++job.stats.deadlineMisses;
+    job.stats.worstLatenessSeconds = std::max(job.stats.worstLatenessSeconds, lateness);
+    schedulerMetrics().deadlineMisses.add();
+    return true;
+}
+
+void SubmitScheduler::endOfInput(uint64_t id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.at(id).inputEnded = true;
+    }
+    changed.notify_all();
+}
+
+bool SubmitScheduler::hasLiveJobs() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [id, job] : jobs) {
+        if (job.live && !job.inputEnded) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SchedulingStats SubmitScheduler::getStats(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs.at(id).stats;
+}
+
+void SubmitScheduler::remove(uint64_t id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.erase(id);
+    }
+    changed.notify_all();
+}
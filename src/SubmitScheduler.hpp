@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+// How a transcode's frames compete with other transcodes for the device.
+struct SchedulingOptions {
+    // Makes the job live: frames arrive in real time at the source frame rate from the
+    // first one, and each is due this many milliseconds after it arrives. 0 = batch.
+    uint32_t deadlineMs = 0;
+    // A batch job's share of the capacity live jobs leave, relative to other batch jobs.
+    uint32_t weight = 1;
+};
+
+struct SchedulingStats {
+    uint64_t framesCompleted = 0;
+    // Live frames completed after their deadline, and by how much the latest was.
+    uint64_t deadlineMisses = 0;
+    double worstLatenessSeconds = 0.0;
+    // Frames held back for other jobs, and how long in total.
+    uint64_t deferrals = 0;
+    double deferredSeconds = 0.0;
+};
+
+class SubmitScheduler;
+
+// A job registered with a SubmitScheduler, removed when destroyed.
+class ScheduledJob {
+public:
+    ScheduledJob() = default;
+    ~ScheduledJob();
+    ScheduledJob(ScheduledJob&& other) noexcept;
+    ScheduledJob& operator=(ScheduledJob&& other) noexcept;
+
+    bool isLive() const { return live; }
+
+    // Blocks until the job may submit the frame. cost is the frame's share of device
+    // work, e.g. its megapixels; batch jobs are charged it against their weight.
+    void admitFrame(uint64_t frameNumber, double cost);
+    // Records that the frame's encode finished. Returns true if it missed its deadline.
+    bool completeFrame(uint64_t frameNumber);
+    // No more frames will be admitted, so the job stops holding others back.
+    void endOfInput();
+    // The frames the job should keep in flight when it planned for the given number:
+    // fewer for a batch job while live jobs run.
+    uint32_t getFramesInFlight(uint32_t planned) const;
+
+    SchedulingStats getStats() const;
+
+private:
+    friend class SubmitScheduler;
+    SubmitScheduler* scheduler = nullptr;
+    uint64_t id = 0;
+    bool live = false;
+
+    void release();
+};
+
+// The SubmitScheduler class decides which transcode submits its next frame when several
+// share the device. Work already on the GPU runs to completion, so jobs are ordered
+// one frame at a time, before each frame is decoded or uploaded:
+//
+// - A live job is due from half its deadline before its next frame arrives, so batch
+//   work queued on the GPU has time to drain. Due live jobs go in earliest-deadline-
+//   first order; one holds back live jobs with later deadlines.
+// - Batch jobs hold back their next frame while any live job is due, and otherwise
+//   share what is left by weight: each frame advances a job's virtual time by cost
+//   over weight, and a job that gets ahead of another active batch job waits for it.
+// - While live jobs run, batch jobs keep a single frame in flight, so a live frame
+//   queues behind at most one frame of each batch job.
+//
+// No frame is held back for longer than MAX_DEFERRAL, so an overloaded live job or a
+// batch job stalled on its input slows the others down without stopping them.
+class SubmitScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr Clock::duration MAX_DEFERRAL = std::chrono::milliseconds(100);
+
+    // The scheduler shared by every transcoder in the process.
+    static SubmitScheduler& global();
+
+    // frameIntervalSeconds paces a live job's frame arrivals.
+    ScheduledJob addJob(const SchedulingOptions& options, double frameIntervalSeconds);
+
+private:
+    friend class ScheduledJob;
+
+    struct JobState {
+        bool live = false;
+        uint32_t weight = 1;
+        Clock::duration frameInterval{};
+        Clock::duration budget{};
+        // Arrivals count from the first frame admitted.
+        bool started = false;
+        bool inputEnded = false;
+        uint64_t firstFrame = 0;
+        Clock::time_point origin;
+        // The frame waiting to be admitted, or the next one.
+        uint64_t nextFrame = 0;
+        bool waiting = false;
+        Clock::time_point lastAdmitted;
+        double virtualTime = 0.0;
+        SchedulingStats stats;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<uint64_t, JobState> jobs;
+    uint64_t nextJobId = 1;
+
+    void admit(uint64_t id, uint64_t frameNumber, double cost);
+    bool complete(uint64_t id, uint64_t frameNumber);
+    void endOfInput(uint64_t id);
+    bool hasLiveJobs() const;
+    SchedulingStats getStats(uint64_t id) const;
+    void remove(uint64_t id);
+
+    Clock::time_point arrival(const JobState& job, uint64_t frameNumber) const;
+    bool isDue(const JobState& job, Clock::time_point now) const;
+    bool isActiveBatch(const JobState& job, Clock::time_point now) const;
+    // The lowest virtual time among active batch jobs other than the given one; false
+    // if there are none.
+    bool minActiveVirtualTime(uint64_t except, Clock::time_point now, double& minimum) const;
+    bool mustWait(uint64_t id, const JobState& job, Clock::time_point now) const;
+};
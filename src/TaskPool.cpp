@@ -0,0 +1,301 @@
+#include "TaskPool.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+
+struct TaskHandle::Node {
+    TaskPool* pool = nullptr;
+    TaskFunction task;
+    // A strand's first exception, kept there so the strand's later tasks still run.
+    std::exception_ptr* errorSink = nullptr;
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    // What the task, or a task it depends on, threw.
+    std::exception_ptr error;
+    // Dependencies still to finish, plus one until submit() has registered them all.
+    std::atomic<uint32_t> pending{1};
+    // Handles, plus one the pool holds from submit() until the task has run.
+    std::atomic<uint32_t> references{0};
+    // Not referenced: the pool's reference keeps a dependent until it has run. Cleared
+    // for reuse, so the capacity stays.
+    std::vector<Node*> dependents;
+    Node* nextFree = nullptr;
+};
+
+namespace {
+    // Totals over every pool in the process.
+    struct PoolMetrics {
+        MetricCounter& tasks;
+        MetricCounter& steals;
+    };
+
+    PoolMetrics& poolMetrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static PoolMetrics metrics{
+            registry.counter("transcoder_cpu_tasks_total", "CPU pipeline tasks run by the task pool."),
+            registry.counter("transcoder_cpu_task_steals_total", "Tasks a pool worker took from another worker's deque."),
+        };
+        return metrics;
+    }
+
+    std::atomic<uint32_t> globalThreadCount{0};
+
+    // A strand's task has one dependent; a fan-in of more grows the node's list once.
+    constexpr size_t INITIAL_DEPENDENTS = 4;
+    // Nodes and deque slots set up per worker at start, enough for a few sessions'
+    // frames in flight; the pool grows past them only under deeper queues.
+    constexpr size_t INITIAL_TASKS_PER_WORKER = 32;
+
+    // The pool and worker the current thread belongs to, so tasks a worker submits go to
+    // the back of its own deque.
+    thread_local TaskPool* currentPool = nullptr;
+    thread_local uint32_t currentWorker = 0;
+}
+
+TaskHandle::TaskHandle(const TaskHandle& other) : node(other.node) {
+    if (node) {
+        ++node->references;
+    }
+}
+
+TaskHandle::~TaskHandle() {
+    if (node) {
+        node->pool->release(node);
+    }
+}
+
+void TaskHandle::wait() const {
+    if (!node) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(node->mutex);
+    node->finished.wait(lock, [this] { return node->done; });
+    if (node->error) {
+        std::rethrow_exception(node->error);
+    }
+}
+
+TaskHandle TaskStrand::post(TaskFunction task) {
+    last = pool->start(std::move(task), { last }, &error);
+    return last;
+}
+
+void TaskStrand::wait() const {
+    last.wait();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+TaskPool::TaskPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->tasks.reserve(INITIAL_TASKS_PER_WORKER);
+    }
+    nodes.reserve(threadCount * INITIAL_TASKS_PER_WORKER);
+    for (size_t i = 0; i < threadCount * INITIAL_TASKS_PER_WORKER; ++i) {
+        TaskHandle::Node* node = allocateNode();
+        node->nextFree = freeNodes;
+        freeNodes = node;
+    }
+    // Started once every deque exists, since workers steal from all of them.
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers[i]->thread = std::thread(&TaskPool::workerLoop, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+TaskPool& TaskPool::global() {
+    static TaskPool pool(globalThreadCount.load());
+    return pool;
+}
+
+void TaskPool::setGlobalThreadCount(uint32_t threadCount) {
+    globalThreadCount = threadCount;
+}
+
+TaskHandle TaskPool::submit(TaskFunction task, std::initializer_list<TaskHandle> dependencies) {
+    return start(std::move(task), dependencies, nullptr);
+}
+
+TaskHandle TaskPool::start(TaskFunction task, std::initializer_list<TaskHandle> dependencies, std::exception_ptr* errorSink) {
+    TaskHandle::Node* node = acquireNode();
+    node->task = std::move(task);
+    node->errorSink = errorSink;
+    // One for the handle returned and one for the pool until the task has run.
+    node->references = 2;
+    TaskHandle handle(node);
+    for (const TaskHandle& dependency : dependencies) {
+        if (!dependency.node) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(dependency.node->mutex);
+        if (!dependency.node->done) {
+            ++node->pending;
+            dependency.node->dependents.push_back(node);
+        } else if (dependency.node->error) {
+            // Dependencies that finish meanwhile write it too.
+            std::lock_guard<std::mutex> nodeLock(node->mutex);
+            if (!node->error) {
+                node->error = dependency.node->error;
+            }
+        }
+    }
+
+    if (--node->pending == 0) {
+        enqueue(node);
+    }
+    return handle;
+}
+
+TaskPoolStats TaskPool::getStats() const {
+    TaskPoolStats stats;
+    stats.tasksRun = tasksRun.load();
+    stats.steals = steals.load();
+    stats.nodesAllocated = nodesAllocated.load();
+    return stats;
+}
+
+TaskHandle::Node* TaskPool::acquireNode() {
+    std::lock_guard<std::mutex> lock(nodeMutex);
+    if (freeNodes) {
+        TaskHandle::Node* node = freeNodes;
+        freeNodes = node->nextFree;
+        node->nextFree = nullptr;
+        return node;
+    }
+    ++nodesAllocated;
+    return allocateNode();
+}
+
+TaskHandle::Node* TaskPool::allocateNode() {
+    nodes.push_back(std::make_unique<TaskHandle::Node>());
+    nodes.back()->pool = this;
+    // Any node may be reused as a dependency, so each gets room for a few dependents.
+    nodes.back()->dependents.reserve(INITIAL_DEPENDENTS);
+    return nodes.back().get();
+}
+
+// Called for every reference dropped; the last one returns the node to the free list.
+void TaskPool::release(TaskHandle::Node* node) {
+    if (--node->references > 0) {
+        return;
+    }
+    node->done = false;
+    node->error = nullptr;
+    node->errorSink = nullptr;
+    node->pending = 1;
+    node->dependents.clear();
+    std::lock_guard<std::mutex> lock(nodeMutex);
+    node->nextFree = freeNodes;
+    freeNodes = node;
+}
+
+void TaskPool::enqueue(TaskHandle::Node* node) {
+    uint32_t index = currentPool == this ? currentWorker : nextWorker++ % workers.size();
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(node);
+    }
+    ++queued;
+    {
+        // Taken so a worker cannot miss the wake-up between checking queued and sleeping.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_one();
+}
+
+bool TaskPool::takeTask(uint32_t index, TaskHandle::Node*& node) {
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            node = own.tasks.back();
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            node = victim.tasks.front();
+            victim.tasks.pop_front();
+            --queued;
+            ++steals;
+            poolMetrics().steals.add();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::run(TaskHandle::Node* node) {
+    // Every dependency has finished, so nothing else writes error any more.
+    if (!node->error) {
+        try {
+            node->task();
+        } catch (...) {
+            if (!node->errorSink) {
+                node->error = std::current_exception();
+            } else if (!*node->errorSink) {
+                *node->errorSink = std::current_exception();
+            }
+        }
+    }
+    // The captures go now, not when the node is reused.
+    node->task.reset();
+    ++tasksRun;
+    poolMetrics().tasks.add();
+
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->done = true;
+    }
+    node->finished.notify_all();
+    // Once done is set, submit() adds no more dependents.
+    for (TaskHandle::Node* dependent : node->dependents) {
+        if (node->error) {
+            std::lock_guard<std::mutex> lock(dependent->mutex);
+            if (!dependent->error) {
+                dependent->error = node->error;
+            }
+        }
+        if (--dependent->pending == 0) {
+            enqueue(dependent);
+        }
+    }
+    release(node);
+}
+
+void TaskPool::workerLoop(uint32_t index) {
+    currentPool = this;
+    currentWorker = index;
+    for (;;) {
+        TaskHandle::Node* node = nullptr;
+        if (takeTask(index, node)) {
+            run(node);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return queued > 0 || stopping; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
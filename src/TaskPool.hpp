@@ -0,0 +1,208 @@
+#pragma once
+
+#include "RingQueue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class TaskPool;
+
+// A task's callable, stored inline so that posting a task never allocates. The
+// captures must fit in INLINE_BYTES; a task with more state captures a pointer to it.
+class TaskFunction {
+public:
+    static constexpr size_t INLINE_BYTES = 64;
+
+    TaskFunction() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskFunction>>>
+    TaskFunction(F&& function) {
+        using Callable = std::decay_t<F>;
+        static_assert(sizeof(Callable) <= INLINE_BYTES, "Task captures do not fit inline; capture a pointer instead.");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "Task captures are over-aligned.");
+        static_assert(std::is_nothrow_move_constructible_v<Callable>, "Task captures must be nothrow movable.");
+        new (storage) Callable(std::forward<F>(function));
+        invoke = [](void* callable) { (*static_cast<Callable*>(callable))(); };
+        manage = [](void* callable, void* movedTo) {
+            if (movedTo) {
+                new (movedTo) Callable(std::move(*static_cast<Callable*>(callable)));
+            }
+            static_cast<Callable*>(callable)->~Callable();
+        };
+    }
+
+    TaskFunction(TaskFunction&& other) noexcept { moveFrom(other); }
+    TaskFunction& operator=(TaskFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    ~TaskFunction() { reset(); }
+
+    explicit operator bool() const { return invoke != nullptr; }
+    void operator()() { invoke(storage); }
+
+    // Destroys the captures.
+    void reset() {
+        if (manage) {
+            manage(storage, nullptr);
+            invoke = nullptr;
+            manage = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char storage[INLINE_BYTES];
+    void (*invoke)(void*) = nullptr;
+    // Moves the callable to movedTo, unless it is null, and destroys it.
+    void (*manage)(void*, void*) = nullptr;
+
+    void moveFrom(TaskFunction& other) noexcept {
+        if (other.manage) {
+            other.manage(other.storage, storage);
+            invoke = other.invoke;
+            manage = other.manage;
+            other.invoke = nullptr;
+            other.manage = nullptr;
+        }
+    }
+};
+
+// A task submitted to a TaskPool, for waiting on it or making other tasks depend on it.
+// Handles must not outlive their pool.
+class TaskHandle {
+public:
+    TaskHandle() = default;
+    TaskHandle(const TaskHandle& other);
+    TaskHandle(TaskHandle&& other) noexcept : node(other.node) { other.node = nullptr; }
+    TaskHandle& operator=(TaskHandle other) noexcept {
+        std::swap(node, other.node);
+        return *this;
+    }
+    ~TaskHandle();
+
+    bool valid() const { return node != nullptr; }
+    // Blocks until the task has run, and rethrows what it threw. Never call it from a
+    // task: the worker would sit idle instead of running the task waited for.
+    void wait() const;
+
+private:
+    friend class TaskPool;
+    struct Node;
+    Node* node = nullptr;
+
+    // Takes over a reference to node.
+    explicit TaskHandle(Node* node) : node(node) {}
+};
+
+// Runs tasks one at a time in the order they are posted, on whichever worker is free:
+// the stages of one transcode keep their order without a thread of their own. A task
+// that throws does not stop the tasks posted after it; wait() rethrows the first
+// exception. The strand must outlive its tasks.
+class TaskStrand {
+public:
+    explicit TaskStrand(TaskPool& pool) : pool(&pool) {}
+
+    // Returns the task's handle, e.g. to wait for it before reusing what it works on.
+    TaskHandle post(TaskFunction task);
+    // Blocks until every posted task has run; same restrictions as TaskHandle::wait().
+    void wait() const;
+
+private:
+    TaskPool* pool;
+    TaskHandle last;
+    // Written only by the strand's tasks, which never run at the same time.
+    std::exception_ptr error;
+};
+
+struct TaskPoolStats {
+    uint64_t tasksRun = 0;
+    // Tasks a worker took from another worker's deque.
+    uint64_t steals = 0;
+    // Task nodes allocated beyond those set up at start because every pooled one was in
+    // use. It stops growing once the pool covers the tasks queued and referenced at once.
+    uint64_t nodesAllocated = 0;
+};
+
+// The TaskPool class runs the CPU stages of every transcode in the process on one set
+// of workers, one per hardware thread by default, so sessions share the cores instead
+// of each bringing threads of their own. Each worker has its own deque: it takes its
+// newest task from the back, and when that runs dry it steals the oldest from the front
+// of another's. Tasks from outside the pool are dealt to the workers in turn.
+//
+// A task may depend on other tasks and runs once they all have. If one of them threw,
+// it does not run and the exception is passed on to its own dependents and waiters.
+//
+// Task nodes are reference counted and go back to a free list once the task has run
+// and its last handle is gone. The pool starts with nodes and deque room for a few
+// dozen tasks per worker, so in steady state submitting a task does not allocate.
+class TaskPool {
+public:
+    // 0 starts one worker per hardware thread.
+    explicit TaskPool(uint32_t threadCount);
+    // Runs the tasks still queued, then joins the workers.
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // The pool shared by every transcoder in the process, started on first use.
+    static TaskPool& global();
+    // Sizes the global pool; has no effect once it has started.
+    static void setGlobalThreadCount(uint32_t threadCount);
+
+    TaskHandle submit(TaskFunction task, std::initializer_list<TaskHandle> dependencies = {});
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+    TaskPoolStats getStats() const;
+
+private:
+    friend class TaskHandle;
+    friend class TaskStrand;
+
+    struct Worker {
+        std::mutex mutex;
+        RingQueue<TaskHandle::Node*> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<uint32_t> nextWorker{0};
+    // Tasks in the deques; workers sleep while it is 0.
+    std::atomic<uint64_t> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+    std::atomic<uint64_t> tasksRun{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> nodesAllocated{0};
+
+    // Every node the pool allocated, and the unreferenced ones linked through Node::nextFree.
+    std::mutex nodeMutex;
+    std::vector<std::unique_ptr<TaskHandle::Node>> nodes;
+    TaskHandle::Node* freeNodes = nullptr;
+
+    // errorSink, when not null, takes the task's exception in place of its dependents.
+    TaskHandle start(TaskFunction task, std::initializer_list<TaskHandle> dependencies, std::exception_ptr* errorSink);
+    TaskHandle::Node* acquireNode();
+    // Called with nodeMutex held, or before the workers start.
+    TaskHandle::Node* allocateNode();
+    void release(TaskHandle::Node* node);
+    void enqueue(TaskHandle::Node* node);
+    bool takeTask(uint32_t index, TaskHandle::Node*& node);
+    void run(TaskHandle::Node* node);
+    void workerLoop(uint32_t index);
+};
@@ -0,0 +1,508 @@
+#include "ThumbnailExtractor.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+}
+
+// MJPEG quantiser scale, 2 (best) to 31; previews do not need more.
+constexpr int JPEG_QSCALE = 3;
+// Largest thumbnail or sheet side, within what JPEG can store.
+constexpr uint32_t MAX_IMAGE_SIZE = 16384;
+
+namespace {
+    // Splits a file pattern around its one %d conversion, for formatPath().
+    struct FilePattern {
+        std::string prefix;
+        std::string suffix;
+        int width = 0;
+        bool zeroPad = false;
+    };
+
+    std::string unescapePercent(const std::string& text) {
+        std::string out;
+        for (size_t i = 0; i < text.size(); ++i) {
+            out += text[i];
+            if (text[i] == '%') {
+                ++i;
+            }
+        }
+        return out;
+    }
+
+    // Parses by hand rather than handing the user's pattern to snprintf.
+    FilePattern parsePattern(const std::string& pattern) {
+        FilePattern parsed;
+        size_t conversion = std::string::npos;
+        size_t conversionEnd = 0;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != '%') {
+                continue;
+            }
+            if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+                ++i;
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') {
+                ++end;
+            }
+            if (end == pattern.size() || pattern[end] != 'd' || conversion != std::string::npos || end - i > 4) {
+                throw std::invalid_argument("Thumbnails: The file pattern needs exactly one %d conversion: " + pattern);
+            }
+            parsed.zeroPad = pattern[i + 1] == '0';
+            parsed.width = end > i + 1 ? std::stoi(pattern.substr(i + 1, end - i - 1)) : 0;
+            conversion = i;
+            conversionEnd = end + 1;
+            i = end;
+        }
+        if (conversion == std::string::npos) {
+            throw std::invalid_argument("Thumbnails: The file pattern needs exactly one %d conversion: " + pattern);
+        }
+        parsed.prefix = unescapePercent(pattern.substr(0, conversion));
+        parsed.suffix = unescapePercent(pattern.substr(conversionEnd));
+        return parsed;
+    }
+
+    std::string formatPath(const FilePattern& pattern, uint64_t number) {
+        std::string digits = std::to_string(number);
+        if (static_cast<int>(digits.size()) < pattern.width) {
+            digits.insert(0, pattern.width - digits.size(), pattern.zeroPad ? '0' : ' ');
+        }
+        return pattern.prefix + digits + pattern.suffix;
+    }
+
+    bool isPngPath(const std::string& pattern) {
+        std::string extension = pattern.substr(std::min(pattern.rfind('.'), pattern.size()));
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (extension == ".png") {
+            return true;
+        }
+        if (extension == ".jpg" || extension == ".jpeg") {
+            return false;
+        }
+        throw std::invalid_argument("Thumbnails: The file pattern must end in .jpg, .jpeg or .png: " + pattern);
+    }
+
+    // Averages the source samples each output sample covers (a box filter) and
+    // reduces them to 8 bits. Every source sample is read once.
+    template <typename Sample>
+    void downscalePlane(const uint8_t* src, int srcStride, int srcWidth, int srcHeight, int shift,
+                        uint8_t* dst, int dstStride, int dstWidth, int dstHeight) {
+        std::vector<int> columnOf(srcWidth);
+        std::vector<uint32_t> columnCount(dstWidth, 0);
+        for (int x = 0; x < srcWidth; ++x) {
+            columnOf[x] = std::min(static_cast<int>(static_cast<int64_t>(x) * dstWidth / srcWidth), dstWidth - 1);
+            ++columnCount[columnOf[x]];
+        }
+        std::vector<uint64_t> sums(dstWidth);
+        for (int dy = 0; dy < dstHeight; ++dy) {
+            int y0 = static_cast<int>(static_cast<int64_t>(dy) * srcHeight / dstHeight);
+            int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(dy + 1) * srcHeight / dstHeight));
+            std::fill(sums.begin(), sums.end(), 0);
+            for (int y = y0; y < y1; ++y) {
+                const Sample* row = reinterpret_cast<const Sample*>(src + static_cast<ptrdiff_t>(y) * srcStride);
+                for (int x = 0; x < srcWidth; ++x) {
+                    sums[columnOf[x]] += row[x];
+                }
+            }
+            uint8_t* out = dst + static_cast<ptrdiff_t>(dy) * dstStride;
+            for (int dx = 0; dx < dstWidth; ++dx) {
+                uint64_t count = static_cast<uint64_t>(columnCount[dx]) * static_cast<uint64_t>(y1 - y0);
+                uint64_t value = ((sums[dx] + count / 2) / count) >> shift;
+                out[dx] = static_cast<uint8_t>(std::min<uint64_t>(value, 255));
+            }
+        }
+    }
+}
+
+// An 8-bit 4:2:0 picture: a thumbnail or a sprite sheet.
+struct ThumbnailExtractor::Picture {
+    int width = 0;
+    int height = 0;
+    std::array<std::vector<uint8_t>, 3> planes;
+    bool fullRange = false;
+    bool bt709 = false;
+
+    Picture(int width, int height) : width(width), height(height) {
+        planes[0].assign(static_cast<size_t>(width) * height, 16);
+        planes[1].assign(static_cast<size_t>(width / 2) * (height / 2), 128);
+        planes[2].assign(static_cast<size_t>(width / 2) * (height / 2), 128);
+    }
+
+    int stride(int plane) const { return plane == 0 ? width : width / 2; }
+};
+
+// Encodes pictures as JPEG or PNG files, keeping one encoder while the size stays the same.
+class ThumbnailExtractor::ImageWriter {
+public:
+    explicit ImageWriter(bool png) : png(png) {
+        codec = avcodec_find_encoder(png ? AV_CODEC_ID_PNG : AV_CODEC_ID_MJPEG);
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        if (!codec || !frame || !packet) {
+            release();
+            throw std::runtime_error(std::string("Thumbnails: No ") + (png ? "PNG" : "JPEG") + " encoder available");
+        }
+    }
+
+    ~ImageWriter() { release(); }
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    void write(const Picture& picture, const std::string& path) {
+        openEncoder(picture.width, picture.height);
+        if (av_frame_make_writable(frame) < 0) {
+            throw std::runtime_error("Thumbnails: Failed to allocate an image frame");
+        }
+        if (png) {
+            convertToRgb(picture);
+        } else {
+            convertToFullRange(picture);
+            frame->quality = context->global_quality;
+        }
+        if (avcodec_send_frame(context, frame) < 0 || avcodec_receive_packet(context, packet) < 0) {
+            throw std::runtime_error("Thumbnails: Could not encode " + path);
+        }
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(packet->data), packet->size);
+        av_packet_unref(packet);
+        if (!file.flush()) {
+            throw std::runtime_error("Thumbnails: Could not write " + path);
+        }
+    }
+
+private:
+    bool png;
+    const AVCodec* codec = nullptr;
+    AVCodecContext* context = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+
+    void openEncoder(int width, int height) {
+        if (context && context->width == width && context->height == height) {
+            return;
+        }
+        avcodec_free_context(&context);
+        av_frame_unref(frame);
+        context = avcodec_alloc_context3(codec);
+        if (!context) {
+            throw std::runtime_error("Thumbnails: Failed to allocate an image encoder");
+        }
+        context->width = width;
+        context->height = height;
+        context->time_base = AVRational{ 1, 25 };
+        // JPEG stores full-range YCbCr; the J format says so to every FFmpeg version.
+        context->pix_fmt = png ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_YUVJ420P;
+        if (!png) {
+            context->flags |= AV_CODEC_FLAG_QSCALE;
+            context->global_quality = FF_QP2LAMBDA * JPEG_QSCALE;
+        }
+        if (avcodec_open2(context, codec, nullptr) < 0) {
+            throw std::runtime_error(std::string("Thumbnails: Could not open the ") + codec->name + " encoder");
+        }
+        frame->format = context->pix_fmt;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            throw std::runtime_error("Thumbnails: Failed to allocate an image frame");
+        }
+    }
+
+    void convertToFullRange(const Picture& picture) {
+        std::array<uint8_t, 256> lumaTable;
+        std::array<uint8_t, 256> chromaTable;
+        for (int v = 0; v < 256; ++v) {
+            if (picture.fullRange) {
+                lumaTable[v] = chromaTable[v] = static_cast<uint8_t>(v);
+            } else {
+                lumaTable[v] = static_cast<uint8_t>(std::clamp(std::lround((v - 16) * 255.0 / 219.0), 0L, 255L));
+                chromaTable[v] = static_cast<uint8_t>(std::clamp(std::lround((v - 128) * 255.0 / 224.0 + 128.0), 0L, 255L));
+            }
+        }
+        for (int plane = 0; plane < 3; ++plane) {
+            const std::array<uint8_t, 256>& table = plane == 0 ? lumaTable : chromaTable;
+            int width = plane == 0 ? picture.width : picture.width / 2;
+            int height = plane == 0 ? picture.height : picture.height / 2;
+            for (int y = 0; y < height; ++y) {
+                const uint8_t* in = picture.planes[plane].data() + static_cast<size_t>(y) * picture.stride(plane);
+                uint8_t* out = frame->data[plane] + static_cast<ptrdiff_t>(y) * frame->linesize[plane];
+                for (int x = 0; x < width; ++x) {
+                    out[x] = table[in[x]];
+                }
+            }
+        }
+    }
+
+    void convertToRgb(const Picture& picture) {
+        double kr = picture.bt709 ? 0.2126 : 0.299;
+        double kb = picture.bt709 ? 0.0722 : 0.114;
+        double lumaOffset = picture.fullRange ? 0.0 : 16.0;
+        double lumaScale = picture.fullRange ? 1.0 : 255.0 / 219.0;
+        double chromaScale = picture.fullRange ? 1.0 : 255.0 / 224.0;
+        auto clampByte = [](double v) { return static_cast<uint8_t>(std::clamp(std::lround(v), 0L, 255L)); };
+        for (int y = 0; y < picture.height; ++y) {
+            const uint8_t* luma = picture.planes[0].data() + static_cast<size_t>(y) * picture.stride(0);
+            const uint8_t* cb = picture.planes[1].data() + static_cast<size_t>(y / 2) * picture.stride(1);
+            const uint8_t* cr = picture.planes[2].data() + static_cast<size_t>(y / 2) * picture.stride(2);
+            uint8_t* out = frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0];
+            for (int x = 0; x < picture.width; ++x) {
+                double yValue = (luma[x] - lumaOffset) * lumaScale;
+                double cbValue = (cb[x / 2] - 128.0) * chromaScale;
+                double crValue = (cr[x / 2] - 128.0) * chromaScale;
+                double r = yValue + 2.0 * (1.0 - kr) * crValue;
+                double b = yValue + 2.0 * (1.0 - kb) * cbValue;
+                double g = (yValue - kr * r - kb * b) / (1.0 - kr - kb);
+                out[3 * x] = clampByte(r);
+                out[3 * x + 1] = clampByte(g);
+                out[3 * x + 2] = clampByte(b);
+            }
+        }
+    }
+
+    void release() {
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        avcodec_free_context(&context);
+    }
+};
+
+ThumbnailExtractor::ThumbnailExtractor(const H264Demuxer& demuxer, const ThumbnailOptions& options)
+    : options(options), timebase(demuxer.getTimebase()), nalLengthSize(demuxer.getNalLengthSize()) {
+    parsePattern(options.outputPattern);
+    if (options.width < 2 || options.width > MAX_IMAGE_SIZE || options.height > MAX_IMAGE_SIZE ||
+        (options.height != 0 && options.height < 2)) {
+        throw std::invalid_argument("Thumbnails: The size must be 2-" + std::to_string(MAX_IMAGE_SIZE) + " pixels");
+    }
+    if ((options.spriteColumns == 0) != (options.spriteRows == 0)) {
+        throw std::invalid_argument("Thumbnails: A sprite sheet needs both columns and rows");
+    }
+    intervalTicks = av_rescale(options.intervalSeconds, timebase.den, timebase.num);
+    writer = std::make_unique<ImageWriter>(isPngPath(options.outputPattern));
+
+    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+    frame = av_frame_alloc();
+    if (!decoder || !frame || avcodec_parameters_to_context(decoder, demuxer.getCodecParameters()) < 0) {
+        release();
+        throw std::runtime_error("Thumbnails: Could not set up an H.264 decoder");
+    }
+    decoder->pkt_timebase = av_make_q(timebase.num, timebase.den);
+    // Frame threads decode consecutive IDRs in parallel; none waits for another.
+    decoder->thread_count = 0;
+    if (avcodec_open2(decoder, codec, nullptr) < 0) {
+        release();
+        throw std::runtime_error("Thumbnails: Could not open the H.264 decoder");
+    }
+}
+
+ThumbnailExtractor::~ThumbnailExtractor() {
+    release();
+}
+
+void ThumbnailExtractor::release() {
+    av_frame_free(&frame);
+    avcodec_free_context(&decoder);
+}
+
+void ThumbnailExtractor::run(H264Demuxer& demuxer) {
+    auto start = std::chrono::steady_clock::now();
+    demuxer.setKeyframesOnly();
+    AVPacket* packet = av_packet_alloc();
+    if (!packet) throw std::runtime_error("Failed to allocate AVPacket");
+    try {
+        while (demuxer.getNextPacket(packet)) {
+            bool due = isDue(packet);
+            if (due) {
+                decode(packet);
+            }
+            av_packet_unref(packet);
+            // Containers with an index land on the first keyframe at or after the mark;
+            // for the others the keyframes in between are read and skipped.
+            if (due && intervalTicks > 0) {
+                demuxer.seekToKeyframe(nextDuePts);
+            }
+        }
+    } catch (...) {
+        av_packet_free(&packet);
+        throw;
+    }
+    av_packet_free(&packet);
+    finish();
+    // The time in run() covers reading and seeking as well.
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ThumbnailExtractor::addPacket(const AVPacket* packet) {
+    auto start = std::chrono::steady_clock::now();
+    if (isDue(packet)) {
+        decode(packet);
+    }
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ThumbnailExtractor::finish() {
+    auto start = std::chrono::steady_clock::now();
+    avcodec_send_packet(decoder, nullptr);
+    receiveFrames();
+    avcodec_flush_buffers(decoder);
+    if (sheetTiles > 0) {
+        writeSheet();
+    }
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ThumbnailExtractor::printStats() const {
+    VT_LOG_INFO("Thumbnails: " << stats.thumbnails << " from " << stats.keyframesDecoded << " IDRs ("
+                << stats.keyframesRead << " keyframes read) in " << stats.filesWritten << " files, "
+                << stats.keyframesPerSecond() << " keyframes/s"
+                << (stats.decodeErrors ? ", " + std::to_string(stats.decodeErrors) + " decode errors" : ""));
+}
+
+bool ThumbnailExtractor::isDue(const AVPacket* packet) {
+    if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+        return false;
+    }
+    ++stats.keyframesRead;
+    int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (intervalTicks > 0) {
+        if (pts == AV_NOPTS_VALUE || (haveFirstPts && pts < nextDuePts)) {
+            return false;
+        }
+    }
+    // Recovery-point keyframes may need pictures before them; IDRs never do.
+    H264PacketInfo info;
+    if (!H264Parser::inspectPacket(packet->data, packet->size, nalLengthSize, info) || !info.idr) {
+        return false;
+    }
+    if (intervalTicks > 0) {
+        if (!haveFirstPts) {
+            haveFirstPts = true;
+            firstPts = pts;
+        }
+        nextDuePts = firstPts + ((pts - firstPts) / intervalTicks + 1) * intervalTicks;
+    }
+    return true;
+}
+
+void ThumbnailExtractor::decode(const AVPacket* packet) {
+    ++stats.keyframesDecoded;
+    int result;
+    while ((result = avcodec_send_packet(decoder, packet)) == AVERROR(EAGAIN)) {
+        receiveFrames();
+    }
+    if (result < 0) {
+        ++stats.decodeErrors;
+    }
+    receiveFrames();
+}
+
+void ThumbnailExtractor::receiveFrames() {
+    while (true) {
+        int result = avcodec_receive_frame(decoder, frame);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            return;
+        }
+        if (result < 0) {
+            ++stats.decodeErrors;
+            continue;
+        }
+        addThumbnail(frame);
+        av_frame_unref(frame);
+    }
+}
+
+void ThumbnailExtractor::addThumbnail(const AVFrame* decoded) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(decoded->format));
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BE)) ||
+        (desc->nb_components != 1 && desc->nb_components != 3) || desc->comp[0].depth > 16) {
+        throw std::runtime_error("Thumbnails: Unsupported pixel format " +
+                                 std::string(desc ? desc->name : "unknown"));
+    }
+    for (int i = 0; i < desc->nb_components; ++i) {
+        if (desc->comp[i].plane != i) {
+            throw std::runtime_error("Thumbnails: Unsupported pixel format " + std::string(desc->name));
+        }
+    }
+
+    if (thumbnailWidth == 0) {
+        // Sized from the first frame's display aspect ratio, in even dimensions for 4:2:0.
+        AVRational sar = decoded->sample_aspect_ratio;
+        double pixelAspect = sar.num > 0 && sar.den > 0 ? av_q2d(sar) : 1.0;
+        displayAspect = decoded->width * pixelAspect / decoded->height;
+        thumbnailWidth = static_cast<int>(options.width) & ~1;
+        thumbnailHeight = options.height ? static_cast<int>(options.height) & ~1
+                                         : std::max(2, static_cast<int>(std::lround(thumbnailWidth / displayAspect / 2.0)) * 2);
+        if (thumbnailHeight > static_cast<int>(MAX_IMAGE_SIZE) ||
+            static_cast<uint64_t>(thumbnailWidth) * std::max(options.spriteColumns, 1u) > MAX_IMAGE_SIZE ||
+            static_cast<uint64_t>(thumbnailHeight) * std::max(options.spriteRows, 1u) > MAX_IMAGE_SIZE) {
+            throw std::invalid_argument("Thumbnails: Images would be larger than " + std::to_string(MAX_IMAGE_SIZE) +
+                                        " pixels on a side");
+        }
+        VT_LOG_INFO("Thumbnails: " << thumbnailWidth << "x" << thumbnailHeight << " from " << decoded->width << "x"
+                    << decoded->height);
+    }
+
+    bool sprite = options.spriteColumns > 0;
+    if (!sheet) {
+        sheet = std::make_unique<Picture>(thumbnailWidth * static_cast<int>(std::max(options.spriteColumns, 1u)),
+                                          thumbnailHeight * static_cast<int>(std::max(options.spriteRows, 1u)));
+    }
+    sheet->fullRange = decoded->color_range == AVCOL_RANGE_JPEG;
+    sheet->bt709 = decoded->colorspace == AVCOL_SPC_BT709 ||
+                   (decoded->colorspace == AVCOL_SPC_UNSPECIFIED && decoded->height >= 720);
+    int tileX = sprite ? static_cast<int>(sheetTiles % options.spriteColumns) * thumbnailWidth : 0;
+    int tileY = sprite ? static_cast<int>(sheetTiles / options.spriteColumns) * thumbnailHeight : 0;
+
+    int shift = std::max(desc->comp[0].depth - 8, 0);
+    bool wide = desc->comp[0].depth > 8;
+    for (int plane = 0; plane < desc->nb_components; ++plane) {
+        int srcWidth = plane == 0 ? decoded->width : AV_CEIL_RSHIFT(decoded->width, desc->log2_chroma_w);
+        int srcHeight = plane == 0 ? decoded->height : AV_CEIL_RSHIFT(decoded->height, desc->log2_chroma_h);
+        int dstWidth = plane == 0 ? thumbnailWidth : thumbnailWidth / 2;
+        int dstHeight = plane == 0 ? thumbnailHeight : thumbnailHeight / 2;
+        int dstX = plane == 0 ? tileX : tileX / 2;
+        int dstY = plane == 0 ? tileY : tileY / 2;
+        uint8_t* dst = sheet->planes[plane].data() + static_cast<size_t>(dstY) * sheet->stride(plane) + dstX;
+        if (wide) {
+            downscalePlane<uint16_t>(decoded->data[plane], decoded->linesize[plane], srcWidth, srcHeight, shift,
+                                     dst, sheet->stride(plane), dstWidth, dstHeight);
+        } else {
+            downscalePlane<uint8_t>(decoded->data[plane], decoded->linesize[plane], srcWidth, srcHeight, shift,
+                                    dst, sheet->stride(plane), dstWidth, dstHeight);
+        }
+    }
+    ++stats.thumbnails;
+    ++sheetTiles;
+    if (!sprite || sheetTiles == options.spriteColumns * options.spriteRows) {
+        writeSheet();
+    }
+}
+
+void ThumbnailExtractor::writeSheet() {
+    writer->write(*sheet, nextFilePath());
+    ++stats.filesWritten;
+    sheetTiles = 0;
+    // Tiles of the next sheet overwrite this one's; unused tiles of a last sheet stay black.
+    if (options.spriteColumns > 0) {
+        std::fill(sheet->planes[0].begin(), sheet->planes[0].end(), sheet->fullRange ? 0 : 16);
+        std::fill(sheet->planes[1].begin(), sheet->planes[1].end(), 128);
+        std::fill(sheet->planes[2].begin(), sheet->planes[2].end(), 128);
+    }
+}
+
+std::string ThumbnailExtractor::nextFilePath() {
+    return formatPath(parsePattern(options.outputPattern), stats.filesWritten + 1);
+}
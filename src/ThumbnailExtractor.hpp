@@ -0,0 +1,105 @@
+#pragma once
+
+#include "H264Demuxer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+struct ThumbnailOptions {
+    // Output files, with one printf integer conversion (%d, %04d, ...) numbering them
+    // from 1; the extension picks JPEG (.jpg, .jpeg) or PNG (.png). Empty = off.
+    std::string outputPattern;
+    // Seconds of video between thumbnails: the first IDR at or after each mark is
+    // taken. 0 takes every IDR.
+    uint32_t intervalSeconds = 0;
+    // Thumbnail width; the height follows the display aspect ratio unless given.
+    uint32_t width = 320;
+    uint32_t height = 0;
+    // Tiles thumbnails into sheets of columns x rows; 0 writes one file per thumbnail.
+    uint32_t spriteColumns = 0;
+    uint32_t spriteRows = 0;
+
+    bool enabled() const { return !outputPattern.empty(); }
+};
+
+struct ThumbnailStats {
+    // Keyframe packets the demuxer returned, and the IDRs among them decoded.
+    uint64_t keyframesRead = 0;
+    uint64_t keyframesDecoded = 0;
+    uint64_t thumbnails = 0;
+    uint64_t filesWritten = 0;
+    uint64_t decodeErrors = 0;
+    // Time spent reading, decoding, scaling and writing.
+    double seconds = 0.0;
+
+    double keyframesPerSecond() const { return seconds > 0.0 ? keyframesDecoded / seconds : 0.0; }
+};
+
+// The ThumbnailExtractor class writes preview images from the IDR frames of an H.264
+// stream. Only IDRs are decoded, on the CPU with libavcodec: they reference no other
+// picture, so no other frame has to be decoded. Each is box-filtered down to the
+// thumbnail size and written as JPEG or PNG, alone or as a tile of a sprite sheet.
+// It runs on its own, jumping from keyframe to keyframe with the demuxer, or takes
+// the packets of a transcode as they are read.
+class ThumbnailExtractor {
+public:
+    // Throws a std::invalid_argument for a bad pattern or size, and a
+    // std::runtime_error if no decoder or image encoder is available.
+    ThumbnailExtractor(const H264Demuxer& demuxer, const ThumbnailOptions& options);
+    ~ThumbnailExtractor();
+
+    ThumbnailExtractor(const ThumbnailExtractor&) = delete;
+    ThumbnailExtractor& operator=(const ThumbnailExtractor&) = delete;
+
+    // Reads only the keyframes of the demuxer's video, seeking to the next mark when an
+    // interval is set, and writes every thumbnail. The demuxer is not usable for a
+    // transcode afterwards.
+    void run(H264Demuxer& demuxer);
+
+    // Takes a video packet of a transcode, in decode order, and decodes it if it is an
+    // IDR due for a thumbnail. Call finish() after the last one.
+    void addPacket(const AVPacket* packet);
+
+    // Decodes what is still in the decoder and writes the last, partly filled sheet.
+    void finish();
+
+    const ThumbnailStats& getStats() const { return stats; }
+    void printStats() const;
+
+private:
+    struct Picture;
+    class ImageWriter;
+
+    ThumbnailOptions options;
+    Timebase timebase;
+    uint32_t nalLengthSize;
+    int64_t intervalTicks = 0;
+    bool haveFirstPts = false;
+    int64_t firstPts = 0;
+    int64_t nextDuePts = 0;
+
+    AVCodecContext* decoder = nullptr;
+    AVFrame* frame = nullptr;
+    // The thumbnail size is fixed by the first frame, so sheet tiles line up.
+    int thumbnailWidth = 0;
+    int thumbnailHeight = 0;
+    double displayAspect = 0.0;
+    std::unique_ptr<Picture> sheet;
+    uint32_t sheetTiles = 0;
+    std::unique_ptr<ImageWriter> writer;
+    ThumbnailStats stats;
+
+    // True for an IDR packet at or after the next mark; moves the mark past it.
+    bool isDue(const AVPacket* packet);
+    void decode(const AVPacket* packet);
+    void receiveFrames();
+    void addThumbnail(const AVFrame* decoded);
+    void writeSheet();
+    std::string nextFilePath();
+    void release();
+};
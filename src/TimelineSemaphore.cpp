@@ -0,0 +1,63 @@
+#include "TimelineSemaphore.hpp"
+#include "Metrics.hpp"
+#include <stdexcept>
+
+namespace {
+    MetricHistogram& waitHistogram() {
+        static MetricHistogram& histogram = MetricsRegistry::global().histogram(
+            "transcoder_timeline_wait_seconds", "Time the CPU blocked waiting for GPU work on a timeline semaphore.");
+        return histogram;
+    }
+}
+
+TimelineSemaphore::TimelineSemaphore(VkDevice device, uint64_t initialValue)
+    : device(device), lastSubmittedValue(initialValue) {
+    VkSemaphoreTypeCreateInfo typeInfo{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = initialValue;
+
+    VkSemaphoreCreateInfo createInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    createInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device, &createInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore!");
+    }
+}
+
+TimelineSemaphore::~TimelineSemaphore() {
+    if (semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+}
+
+uint64_t TimelineSemaphore::getCompletedValue() const {
+    uint64_t value = 0;
+    if (vkGetSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to read timeline semaphore value (device lost?)");
+    }
+    return value;
+}
+
+bool TimelineSemaphore::wait(uint64_t value, uint64_t timeoutNs) const {
+    VkSemaphoreWaitInfo waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+
+    ScopedMetricTimer timer(waitHistogram());
+    VkResult result = vkWaitSemaphores(device, &waitInfo, timeoutNs);
+    if (result == VK_TIMEOUT) {
+        return false;
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to wait on timeline semaphore (device lost?)");
+    }
+    return true;
+}
+
+VkSemaphoreSubmitInfo TimelineSemaphore::submitInfo(uint64_t value, VkPipelineStageFlags2 stageMask) const {
+    VkSemaphoreSubmitInfo info{VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+    info.semaphore = semaphore;
+    info.value = value;
+    info.stageMask = stageMask;
+    return info;
+}
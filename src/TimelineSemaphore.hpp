@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+// The TimelineSemaphore class wraps a Vulkan timeline semaphore whose value increases
+// monotonically with every submission on one queue. Each frame signals its own value,
+// so any number of frames can be in flight without per-frame fences, and CPU code can
+// poll or wait for an exact frame.
+class TimelineSemaphore {
+public:
+    TimelineSemaphore(VkDevice device, uint64_t initialValue = 0);
+    ~TimelineSemaphore();
+
+    TimelineSemaphore(const TimelineSemaphore&) = delete;
+    TimelineSemaphore& operator=(const TimelineSemaphore&) = delete;
+
+    VkSemaphore get() const { return semaphore; }
+
+    // Reserves the value the next submission on this queue will signal.
+    uint64_t nextValue() { return ++lastSubmittedValue; }
+
+    // The most recently reserved value; waiting for it waits for all submitted work.
+    uint64_t getLastSubmittedValue() const { return lastSubmittedValue; }
+
+    // Returns the value the device has reached. Never blocks.
+    uint64_t getCompletedValue() const;
+
+    // Returns true if the device has reached value. Never blocks.
+    bool isComplete(uint64_t value) const { return getCompletedValue() >= value; }
+
+    // Blocks for at most timeoutNs until the device reaches value.
+    // Returns false on timeout; throws on device loss.
+    bool wait(uint64_t value, uint64_t timeoutNs = UINT64_MAX) const;
+
+    // Fills a VkSemaphoreSubmitInfo for waiting on or signalling value at the given stages.
+    VkSemaphoreSubmitInfo submitInfo(uint64_t value, VkPipelineStageFlags2 stageMask) const;
+
+private:
+    VkDevice device;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t lastSubmittedValue;
+};
@@ -0,0 +1,88 @@
+#include "TimestampTracker.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace {
+    AVRational toAVRational(Timebase timebase) {
+        return av_make_q(timebase.num, timebase.den);
+    }
+}
+
+TimestampTracker::TimestampTracker(Timebase inputTimebase, Timebase outputTimebase, Timebase frameRate,
+                                   uint32_t inputReorderDelay, uint32_t outputReorderDelay)
+    : inputTimebase(inputTimebase), outputTimebase(outputTimebase),
+      inputReorderDelay(inputReorderDelay), outputReorderDelay(outputReorderDelay) {
+    if (!inputTimebase.isValid() || !outputTimebase.isValid() || !frameRate.isValid()) {
+        throw std::invalid_argument("Timestamp tracker needs valid time bases and frame rate.");
+    }
+    // One frame is 1 / frameRate seconds.
+    AVRational frameTime = av_inv_q(toAVRational(frameRate));
+    inputFrameDuration = std::max<int64_t>(av_rescale_q(1, frameTime, toAVRational(inputTimebase)), 1);
+    outputFrameDuration = std::max<int64_t>(av_rescale_q(1, frameTime, toAVRational(outputTimebase)), 1);
+}
+
+void TimestampTracker::pushPacket(int64_t pts, int64_t dts, int64_t duration) {
+    if (duration <= 0) {
+        duration = inputFrameDuration;
+    }
+    if (pts == AV_NOPTS_VALUE) {
+        // Without reordering, decode order is presentation order and the DTS is the PTS.
+        if (dts != AV_NOPTS_VALUE && inputReorderDelay == 0) {
+            pts = dts;
+        } else {
+            pts = havePushed ? lastPushedPts + lastPushedDuration : 0;
+        }
+        ++synthesizedCount;
+    }
+    pending.emplace(pts, duration);
+    // Synthesised timestamps continue after the latest presentation time seen.
+    if (!havePushed || pts >= lastPushedPts) {
+        lastPushedPts = pts;
+        lastPushedDuration = duration;
+    }
+    havePushed = true;
+}
+
+bool TimestampTracker::hasFrame(bool flush) const {
+    return !pending.empty() && (flush || pending.size() > inputReorderDelay);
+}
+
+FrameTimestamp TimestampTracker::popFrame() {
+    if (pending.empty()) {
+        throw std::logic_error("Timestamp tracker has no pending frame.");
+    }
+    PendingFrame frame = pending.top();
+    pending.pop();
+
+    FrameTimestamp out;
+    out.pts = av_rescale_q(frame.first, toAVRational(inputTimebase), toAVRational(outputTimebase));
+    out.duration = std::max<int64_t>(av_rescale_q(frame.second, toAVRational(inputTimebase), toAVRational(outputTimebase)), 1);
+
+    // A packet whose PTS arrives later than the reorder window allows, or a time base
+    // too coarse for the frame rate, would repeat a timestamp; the muxer rejects that.
+    if (havePopped && out.pts <= lastPts) {
+        out.pts = lastPts + 1;
+        ++correctedCount;
+    }
+    out.dts = out.pts - static_cast<int64_t>(outputReorderDelay) * outputFrameDuration;
+    if (havePopped && out.dts <= lastDts) {
+        out.dts = std::min(lastDts + 1, out.pts);
+    }
+
+    lastPts = out.pts;
+    lastDts = out.dts;
+    havePopped = true;
+    return out;
+}
+
+void TimestampTracker::resumeAfter(int64_t lastOutputPts, int64_t lastOutputDts) {
+    lastPts = lastOutputPts;
+    lastDts = lastOutputDts;
+    havePopped = true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// A time base or frame rate as a rational number. Mirrors AVRational so the FFmpeg
+// headers stay out of the public headers.
+struct Timebase {
+    int num = 0;
+    int den = 1;
+
+    bool isValid() const { return num > 0 && den > 0; }
+};
+
+// Timestamps of one output frame, in the tracker's output time base.
+struct FrameTimestamp {
+    int64_t pts = 0;
+    int64_t dts = 0;
+    int64_t duration = 0;
+};
+
+// The TimestampTracker class carries presentation timestamps from demuxed packets to
+// encoded frames. Packets are pushed in decode order; frames leave in presentation
+// order once the stream's reordering delay (B-frames) has been filled, rescaled from
+// the input to the output time base. Missing timestamps are synthesised from the
+// frame rate, and output DTS are kept strictly increasing and at most the PTS.
+class TimestampTracker {
+public:
+    // inputReorderDelay is the number of frames the source decoder holds back for
+    // reordering (has_b_frames). outputReorderDelay is the same for the encoder;
+    // the output DTS trails the PTS by that many frame durations.
+    TimestampTracker(Timebase inputTimebase, Timebase outputTimebase, Timebase frameRate,
+                     uint32_t inputReorderDelay, uint32_t outputReorderDelay = 0);
+
+    // Records a packet in decode order. pts and dts may be AV_NOPTS_VALUE; a
+    // duration of 0 means one frame at the nominal frame rate.
+    void pushPacket(int64_t pts, int64_t dts, int64_t duration);
+
+    // Returns true if the next frame's timestamp is known. At end of stream
+    // (flush = true) every pushed packet is available.
+    bool hasFrame(bool flush) const;
+
+    // Returns the timestamps of the next frame in presentation order.
+    // Throws a std::logic_error if no packet is pending.
+    FrameTimestamp popFrame();
+
+    // Continues an output that already ends with a frame at these output timestamps;
+    // later frames are kept after them.
+    void resumeAfter(int64_t lastOutputPts, int64_t lastOutputDts);
+
+    size_t getPendingCount() const { return pending.size(); }
+    // Packets whose PTS had to be synthesised or corrected.
+    uint64_t getSynthesizedCount() const { return synthesizedCount; }
+    uint64_t getCorrectedCount() const { return correctedCount; }
+
+private:
+    // (pts, duration) in the input time base, smallest pts first.
+    using PendingFrame = std::pair<int64_t, int64_t>;
+    std::priority_queue<PendingFrame, std::vector<PendingFrame>, std::greater<PendingFrame>> pending;
+
+    Timebase inputTimebase;
+    Timebase outputTimebase;
+    uint32_t inputReorderDelay;
+    uint32_t outputReorderDelay;
+    // Nominal frame duration in the input and output time bases.
+    int64_t inputFrameDuration;
+    int64_t outputFrameDuration;
+
+    bool havePushed = false;
+    int64_t lastPushedPts = 0;
+    int64_t lastPushedDuration = 0;
+    bool havePopped = false;
+    int64_t lastPts = 0;
+    int64_t lastDts = 0;
+    uint64_t synthesizedCount = 0;
+    uint64_t correctedCount = 0;
+};
@@ -0,0 +1,696 @@
+#include "TranscodeDaemon.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Progress events per job are sent at most this often; state changes always go out.
+constexpr std::chrono::milliseconds PROGRESS_EVENT_INTERVAL(500);
+// How often the poll loop checks for signals when nothing else happens.
+constexpr int POLL_TIMEOUT_MS = 250;
+// A request line longer than this closes the connection.
+constexpr size_t MAX_REQUEST_SIZE = 64 * 1024;
+// A client that stops reading is dropped once this much output is pending.
+constexpr size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+// Finished jobs kept for status queries.
+constexpr size_t MAX_FINISHED_JOBS = 256;
+
+namespace {
+    volatile std::sig_atomic_t signalReceived = 0;
+
+    struct DaemonMetrics {
+        MetricGauge& jobsQueued;
+        MetricGauge& jobsRunning;
+        MetricCounter& jobsDone;
+        MetricCounter& jobsFailed;
+    };
+
+    DaemonMetrics& metrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static DaemonMetrics metrics{
+            registry.gauge("transcoder_jobs_queued", "Daemon jobs waiting for a worker."),
+            registry.gauge("transcoder_jobs_running", "Daemon jobs being transcoded."),
+            registry.counter("transcoder_jobs_done_total", "Daemon jobs that finished successfully."),
+            registry.counter("transcoder_jobs_failed_total", "Daemon jobs that failed."),
+        };
+        return metrics;
+    }
+
+    void onTerminationSignal(int) {
+        signalReceived = 1;
+    }
+
+    sockaddr_un makeAddress(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Daemon: Socket path must be 1 to " + std::to_string(sizeof(address.sun_path) - 1) + " bytes");
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    void setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw std::runtime_error(std::string("Daemon: fcntl failed: ") + std::strerror(errno));
+        }
+    }
+
+    JsonObject errorResponse(const std::string& message) {
+        JsonObject response;
+        response.set("ok", false).set("error", message);
+        return response;
+    }
+}
+
+TranscodeDaemon::TranscodeDaemon(VulkanBase* vulkanBase, const DaemonOptions& options)
+    : vulkanBase(vulkanBase), options(options) {
+    if (!vulkanBase || !vulkanBase->getDevice()) {
+        throw std::invalid_argument("VulkanBase pointer or device cannot be null.");
+    }
+    if (options.maxConcurrentJobs == 0) {
+        throw std::invalid_argument("Daemon: At least one concurrent job is required.");
+    }
+    sockaddr_un address = makeAddress(options.socketPath);
+
+    // A socket file left by a daemon that died is removed; one that accepts connections is in use.
+    struct stat info{};
+    if (lstat(options.socketPath.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            throw std::runtime_error("Daemon: " + options.socketPath + " exists and is not a socket");
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool inUse = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (inUse) {
+            throw std::runtime_error("Daemon: Another daemon is listening on " + options.socketPath);
+        }
+        unlink(options.socketPath.c_str());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error(std::string("Daemon: Could not create socket: ") + std::strerror(errno));
+    }
+    if (bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        close(listenFd);
+        throw std::runtime_error("Daemon: Could not bind " + options.socketPath + ": " + std::strerror(error));
+    }
+    // Jobs read and write arbitrary paths as this user; only this user may submit them.
+    chmod(options.socketPath.c_str(), S_IRUSR | S_IWUSR);
+    if (listen(listenFd, SOMAXCONN) < 0 || pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        int error = errno;
+        close(listenFd);
+        unlink(options.socketPath.c_str());
+        throw std::runtime_error(std::string("Daemon: Could not listen: ") + std::strerror(error));
+    }
+    setNonBlocking(listenFd);
+    sessionCache = std::make_unique<VideoSessionCache>(options.cachedSessions,
+                                                       VideoSessionCache::deviceDestroyer(vulkanBase->getDevice()));
+    VT_LOG_INFO("Daemon listening on " << options.socketPath << " with " << options.maxConcurrentJobs
+                << " concurrent jobs, keeping up to " << options.cachedSessions << " idle video sessions");
+}
+
+TranscodeDaemon::~TranscodeDaemon() {
+    stopJobs();
+    for (Client& client : clients) {
+        close(client.fd);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(options.socketPath.c_str());
+    }
+    for (int fd : wakePipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void TranscodeDaemon::run() {
+    struct sigaction action{};
+    action.sa_handler = onTerminationSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    // Writes to a client that has gone away fail with EPIPE instead of killing the daemon.
+    signal(SIGPIPE, SIG_IGN);
+
+    for (uint32_t i = 0; i < options.maxConcurrentJobs; ++i) {
+        workers.emplace_back(&TranscodeDaemon::workerLoop, this);
+    }
+
+    std::vector<pollfd> pollFds;
+    while (!shutdownRequested && !signalReceived) {
+        pollFds.clear();
+        pollFds.push_back({ listenFd, POLLIN, 0 });
+        pollFds.push_back({ wakePipe[0], POLLIN, 0 });
+        for (const Client& client : clients) {
+            short wanted = client.closeAfterFlush || client.readClosed ? 0 : POLLIN;
+            if (!client.outBuffer.empty()) {
+                wanted |= POLLOUT;
+            }
+            pollFds.push_back({ client.fd, wanted, 0 });
+        }
+        if (poll(pollFds.data(), pollFds.size(), POLL_TIMEOUT_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Daemon: poll failed: ") + std::strerror(errno));
+        }
+
+        if (pollFds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        // Clients accepted below are polled from the next iteration on.
+        size_t polledClients = clients.size();
+        if (pollFds[0].revents & POLLIN) {
+            acceptClients();
+        }
+        for (size_t i = 0; i < polledClients; ++i) {
+            short revents = pollFds[i + 2].revents;
+            Client& client = clients[i];
+            bool keep = true;
+            if (revents & (POLLHUP | POLLERR) && client.readClosed) {
+                keep = false;
+            } else if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                keep = readClient(client);
+            }
+            if (keep && (revents & POLLOUT)) {
+                keep = flushClient(client);
+            }
+            if (!keep) {
+                close(client.fd);
+                client.fd = -1;
+            }
+        }
+        deliverEvents();
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd < 0; }), clients.end());
+    }
+
+    VT_LOG_INFO("Daemon shutting down.");
+    stopJobs();
+    // Last state events and the shutdown response go out on a best-effort basis.
+    deliverEvents();
+    for (Client& client : clients) {
+        flushClient(client);
+    }
+}
+
+void TranscodeDaemon::workerLoop() {
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = queue.front();
+            queue.pop_front();
+            metrics().jobsQueued.add(-1);
+            metrics().jobsRunning.add(1);
+            job->state = JobState::Running;
+            postStateEvent(*job);
+        }
+        runJob(job);
+    }
+}
+
+void TranscodeDaemon::runJob(const std::shared_ptr<Job>& job) {
+    std::string error;
+    bool cancelled = false;
+    try {
+        VideoTranscoder transcoder(vulkanBase, job->inputPath, job->outputPath, job->options, sessionCache.get());
+        transcoder.setProgressCallback([this, job](const TranscodeProgress& progress) {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->progress = progress;
+            auto now = std::chrono::steady_clock::now();
+            if (now - job->lastProgressEvent < PROGRESS_EVENT_INTERVAL) {
+                return;
+            }
+            job->lastProgressEvent = now;
+            JsonObject event;
+            event.set("event", "progress").set("id", job->id).set("frames", progress.framesEncoded)
+                 .set("total_frames", progress.totalFrames).set("dropped_frames", progress.framesDropped)
+                 .set("deadline_misses", progress.deadlineMisses).set("output_files", progress.outputFiles)
+                 .set("fps", progress.elapsedSeconds > 0.0 ? progress.framesEncoded / progress.elapsedSeconds : 0.0);
+            postEvent(*job, event);
+        });
+        {
+            // A cancel that arrived while the sessions were being created applies now.
+            std::lock_guard<std::mutex> lock(mutex);
+            job->transcoder = &transcoder;
+            if (job->cancelRequested) {
+                transcoder.cancel();
+            }
+        }
+        try {
+            transcoder.run();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->transcoder = nullptr;
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        job->transcoder = nullptr;
+        cancelled = transcoder.isCancelled();
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    metrics().jobsRunning.add(-1);
+    if (!error.empty()) {
+        metrics().jobsFailed.add();
+        job->state = JobState::Failed;
+        job->error = error;
+        VT_LOG_WARNING("Job " << job->id << " failed: " << error);
+    } else {
+        job->state = cancelled ? JobState::Cancelled : JobState::Done;
+        metrics().jobsDone.add(cancelled ? 0 : 1);
+        VT_LOG_INFO("Job " << job->id << " " << getStateName(job->state) << ": " << job->progress.framesEncoded
+                    << " frames in " << job->progress.elapsedSeconds << " s");
+    }
+    postStateEvent(*job);
+    pruneFinishedJobs();
+}
+
+void TranscodeDaemon::postEvent(const Job& job, JsonObject event, bool final) {
+    events.push_back({ job.id, event.dump(), final });
+    // The pipe is non-blocking; a full pipe already guarantees a wakeup.
+    char byte = 0;
+    ssize_t written = write(wakePipe[1], &byte, 1);
+    (void)written;
+}
+
+void TranscodeDaemon::postStateEvent(const Job& job) {
+    JsonObject event;
+    event.set("event", "state").set("id", job.id).set("state", getStateName(job.state));
+    if (!job.error.empty()) {
+        event.set("error", job.error);
+    }
+    postEvent(job, event, isFinished(job.state));
+}
+
+void TranscodeDaemon::pruneFinishedJobs() {
+    size_t finished = 0;
+    for (const auto& entry : jobs) {
+        finished += isFinished(entry.second->state) ? 1 : 0;
+    }
+    // Job ids increase, so the map is ordered oldest first.
+    for (auto it = jobs.begin(); it != jobs.end() && finished > MAX_FINISHED_JOBS;) {
+        if (isFinished(it->second->state)) {
+            it = jobs.erase(it);
+            --finished;
+        } else {
+            ++it;
+        }
+    }
+}
+
+JsonObject TranscodeDaemon::handleRequest(Client& client, const JsonObject& request) {
+    const std::string& command = request.getString("cmd");
+    if (command == "submit") {
+        return submitJob(request);
+    }
+    if (command == "status") {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (request.has("id")) {
+            auto it = jobs.find(request.getUint64("id"));
+            return it == jobs.end() ? errorResponse("Unknown job id") : describeJob(*it->second);
+        }
+        size_t counts[5] = {};
+        for (const auto& entry : jobs) {
+            ++counts[static_cast<size_t>(entry.second->state)];
+        }
+        JsonObject response;
+        response.set("ok", true).set("workers", options.maxConcurrentJobs);
+        for (JobState state : { JobState::Queued, JobState::Running, JobState::Done, JobState::Failed, JobState::Cancelled }) {
+            response.set(getStateName(state), counts[static_cast<size_t>(state)]);
+        }
+        VideoSessionCacheStats cacheStats = sessionCache->getStats();
+        response.set("session_cache_hits", cacheStats.hits).set("session_cache_misses", cacheStats.misses)
+                .set("idle_sessions", cacheStats.idle);
+        return response;
+    }
+    if (command == "cancel") {
+        return cancelJob(request.getUint64("id"));
+    }
+    if (command == "watch") {
+        JsonObject response;
+        response.set("ok", true);
+        client.watching = true;
+        client.watchedJob = 0;
+        if (request.has("id")) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = jobs.find(request.getUint64("id"));
+            if (it == jobs.end()) {
+                client.watching = false;
+                return errorResponse("Unknown job id");
+            }
+            client.watchedJob = it->first;
+            response.set("state", getStateName(it->second->state));
+            // There will be no more events for a finished job.
+            client.closeAfterFlush = isFinished(it->second->state);
+        }
+        return response;
+    }
+    if (command == "shutdown") {
+        shutdownRequested = true;
+        JsonObject response;
+        response.set("ok", true);
+        return response;
+    }
+    return errorResponse("Unknown command \"" + command + "\"");
+}
+
+JsonObject TranscodeDaemon::submitJob(const JsonObject& request) {
+    auto job = std::make_shared<Job>();
+    job->inputPath = request.getString("input");
+    job->outputPath = request.getString("output");
+    if (job->inputPath.empty() || job->outputPath.empty()) {
+        return errorResponse("Input and output paths must not be empty");
+    }
+
+    TranscodeOptions& jobOptions = job->options;
+    jobOptions = options.jobDefaults;
+    std::string downconvert = request.getString("downconvert", "");
+    if (downconvert == "none") jobOptions.downconvert = DownconvertMode::None;
+    else if (downconvert == "auto") jobOptions.downconvert = DownconvertMode::Auto;
+    else if (downconvert == "gpu") jobOptions.downconvert = DownconvertMode::Gpu;
+    else if (downconvert == "cpu") jobOptions.downconvert = DownconvertMode::Cpu;
+    else if (!downconvert.empty()) return errorResponse("downconvert must be none, auto, gpu or cpu");
+    jobOptions.submitBatchSize = request.getUint32("submit_batch", jobOptions.submitBatchSize);
+    jobOptions.reuseCommandBuffers = request.getBool("command_reuse", jobOptions.reuseCommandBuffers);
+    jobOptions.picturePoolSize = request.getUint32("picture_pool", jobOptions.picturePoolSize);
+    jobOptions.picturePoolMaxSize = request.getUint32("picture_pool_max", jobOptions.picturePoolMaxSize);
+    jobOptions.lookahead.depth = request.getUint32("lookahead", jobOptions.lookahead.depth);
+    jobOptions.constantQp = request.getUint32("cqp", jobOptions.constantQp);
+    jobOptions.passthrough = request.getBool("passthrough", jobOptions.passthrough);
+    jobOptions.resilientDecode = request.getBool("resilient", jobOptions.resilientDecode);
+    jobOptions.maxDecodeErrors = request.getUint32("max_decode_errors", jobOptions.maxDecodeErrors);
+    jobOptions.checkpointIntervalSeconds = request.getUint32("checkpoint_interval", jobOptions.checkpointIntervalSeconds);
+    jobOptions.resume = request.getBool("resume", jobOptions.resume);
+    jobOptions.thumbnails.outputPattern = request.getString("thumbnails", jobOptions.thumbnails.outputPattern);
+    jobOptions.thumbnails.intervalSeconds = request.getUint32("thumbnail_interval", jobOptions.thumbnails.intervalSeconds);
+    jobOptions.thumbnails.width = request.getUint32("thumbnail_width", jobOptions.thumbnails.width);
+    jobOptions.maxWidth = request.getUint32("max_width", jobOptions.maxWidth);
+    jobOptions.maxHeight = request.getUint32("max_height", jobOptions.maxHeight);
+    if ((jobOptions.maxWidth == 0) != (jobOptions.maxHeight == 0)) {
+        return errorResponse("max_width and max_height must be given together");
+    }
+    jobOptions.scheduling.deadlineMs = request.getUint32("deadline_ms", jobOptions.scheduling.deadlineMs);
+    jobOptions.scheduling.weight = request.getUint32("weight", jobOptions.scheduling.weight);
+    if (jobOptions.scheduling.weight == 0) {
+        return errorResponse("weight must be at least 1");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Two jobs writing one file would both produce garbage.
+    for (const auto& entry : jobs) {
+        if (!isFinished(entry.second->state) && entry.second->outputPath == job->outputPath) {
+            return errorResponse("Job " + std::to_string(entry.first) + " is already writing " + job->outputPath);
+        }
+    }
+    job->id = nextJobId++;
+    jobs[job->id] = job;
+    queue.push_back(job);
+    metrics().jobsQueued.add(1);
+    postStateEvent(*job);
+    jobAvailable.notify_one();
+    VT_LOG_INFO("Job " << job->id << " queued: " << job->inputPath << " -> " << job->outputPath);
+
+    JsonObject response;
+    response.set("ok", true).set("id", job->id);
+    return response;
+}
+
+JsonObject TranscodeDaemon::cancelJob(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it == jobs.end()) {
+        return errorResponse("Unknown job id");
+    }
+    Job& job = *it->second;
+    if (job.state == JobState::Queued) {
+        queue.erase(std::find(queue.begin(), queue.end(), it->second));
+        metrics().jobsQueued.add(-1);
+        job.state = JobState::Cancelled;
+        postStateEvent(job);
+    } else if (job.state == JobState::Running) {
+        // The worker reports the final state once the frames in flight are drained.
+        job.cancelRequested = true;
+        if (job.transcoder) {
+            job.transcoder->cancel();
+        }
+    }
+    JsonObject response;
+    response.set("ok", true).set("id", id).set("state", job.state == JobState::Running ? "cancelling" : getStateName(job.state));
+    return response;
+}
+
+JsonObject TranscodeDaemon::describeJob(const Job& job) const {
+    JsonObject response;
+    response.set("ok", true).set("id", job.id).set("state", getStateName(job.state))
+            .set("input", job.inputPath).set("output", job.outputPath)
+            .set("frames", job.progress.framesEncoded).set("total_frames", job.progress.totalFrames)
+            .set("dropped_frames", job.progress.framesDropped)
+            .set("deadline_misses", job.progress.deadlineMisses)
+            .set("output_files", job.progress.outputFiles)
+            .set("elapsed", job.progress.elapsedSeconds);
+    if (!job.error.empty()) {
+        response.set("error", job.error);
+    }
+    return response;
+}
+
+void TranscodeDaemon::acceptClients() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                VT_LOG_WARNING("Daemon: accept failed: " << std::strerror(errno));
+            }
+            return;
+        }
+        Client client;
+        client.fd = fd;
+        clients.push_back(std::move(client));
+    }
+}
+
+bool TranscodeDaemon::readClient(Client& client) {
+    char buffer[4096];
+    while (true) {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received == 0) {
+            client.readClosed = true;
+            break;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+        client.inBuffer.append(buffer, static_cast<size_t>(received));
+    }
+
+    size_t lineEnd;
+    while (!client.closeAfterFlush && (lineEnd = client.inBuffer.find('\n')) != std::string::npos) {
+        std::string line = client.inBuffer.substr(0, lineEnd);
+        client.inBuffer.erase(0, lineEnd + 1);
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        JsonObject response;
+        try {
+            response = handleRequest(client, JsonObject::parse(line));
+        } catch (const std::invalid_argument& e) {
+            response = errorResponse(e.what());
+        }
+        client.outBuffer += response.dump();
+        client.outBuffer += '\n';
+    }
+    if (client.inBuffer.size() > MAX_REQUEST_SIZE) {
+        return false;
+    }
+    // A client that will send nothing more and is not watching only waits for its responses.
+    if (client.readClosed && !client.watching) {
+        client.closeAfterFlush = true;
+    }
+    return flushClient(client);
+}
+
+bool TranscodeDaemon::flushClient(Client& client) {
+    while (!client.outBuffer.empty()) {
+        ssize_t sent = send(client.fd, client.outBuffer.data(), client.outBuffer.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return client.outBuffer.size() <= MAX_PENDING_OUTPUT;
+            }
+            return false;
+        }
+        client.outBuffer.erase(0, static_cast<size_t>(sent));
+    }
+    return !client.closeAfterFlush;
+}
+
+void TranscodeDaemon::deliverEvents() {
+    std::deque<Event> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.swap(events);
+    }
+    if (pending.empty()) {
+        return;
+    }
+    for (Client& client : clients) {
+        if (client.fd < 0 || !client.watching) {
+            continue;
+        }
+        for (const Event& event : pending) {
+            if (client.closeAfterFlush) {
+                break;
+            }
+            if (client.watchedJob != 0 && client.watchedJob != event.jobId) {
+                continue;
+            }
+            client.outBuffer += event.line;
+            client.outBuffer += '\n';
+            client.closeAfterFlush = client.watchedJob != 0 && event.final;
+        }
+        if (!flushClient(client)) {
+            close(client.fd);
+            client.fd = -1;
+        }
+    }
+}
+
+void TranscodeDaemon::stopJobs() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping && workers.empty()) {
+            return;
+        }
+        stopping = true;
+        for (const std::shared_ptr<Job>& job : queue) {
+            job->state = JobState::Cancelled;
+            postStateEvent(*job);
+        }
+        metrics().jobsQueued.add(-static_cast<int64_t>(queue.size()));
+        queue.clear();
+        for (auto& entry : jobs) {
+            entry.second->cancelRequested = true;
+            if (entry.second->transcoder) {
+                entry.second->transcoder->cancel();
+            }
+        }
+        jobAvailable.notify_all();
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+const char* TranscodeDaemon::getStateName(JobState state) {
+    switch (state) {
+        case JobState::Queued: return "queued";
+        case JobState::Running: return "running";
+        case JobState::Done: return "done";
+        case JobState::Failed: return "failed";
+        case JobState::Cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+bool TranscodeDaemon::isFinished(JobState state) {
+    return state == JobState::Done || state == JobState::Failed || state == JobState::Cancelled;
+}
+
+bool TranscodeDaemon::sendRequest(const std::string& socketPath, const std::string& request) {
+    // Parsed here as well, both to reject typos early and to know whether to keep reading.
+    JsonObject parsed = JsonObject::parse(request);
+    bool watch = parsed.getString("cmd", "") == "watch";
+
+    sockaddr_un address = makeAddress(socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Could not connect to daemon at " + socketPath + ": " + std::strerror(error));
+    }
+    std::string line = parsed.dump() + "\n";
+    for (size_t offset = 0; offset < line.size();) {
+        ssize_t sent = send(fd, line.data() + offset, line.size() - offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            throw std::runtime_error(std::string("Could not send request: ") + std::strerror(errno));
+        }
+        offset += static_cast<size_t>(sent);
+    }
+
+    bool ok = false;
+    bool haveResponse = false;
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+        size_t lineEnd;
+        while ((lineEnd = buffer.find('\n')) != std::string::npos) {
+            std::string responseLine = buffer.substr(0, lineEnd);
+            buffer.erase(0, lineEnd + 1);
+            std::cout << responseLine << std::endl;
+            if (!haveResponse) {
+                haveResponse = true;
+                ok = JsonObject::parse(responseLine).getBool("ok", false);
+            }
+        }
+        if (haveResponse && (!watch || !ok)) {
+            break;
+        }
+    }
+    close(fd);
+    if (!haveResponse) {
+        throw std::runtime_error("Daemon closed the connection without a response");
+    }
+    return ok;
+}
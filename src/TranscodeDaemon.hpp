@@ -0,0 +1,142 @@
+#pragma once
+
+#include "VulkanBase.hpp"
+#include "VideoTranscoder.hpp"
+#include "JsonObject.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DaemonOptions {
+    // Path of the Unix domain socket the daemon listens on.
+    std::string socketPath;
+    // Jobs transcoded at the same time, each with its own video sessions.
+    uint32_t maxConcurrentJobs = 1;
+    // Video sessions and DPBs of finished jobs kept for later jobs with the same
+    // profile and size limits (0 creates them for every job).
+    uint32_t cachedSessions = 1;
+    // Options for the fields a submitted job leaves out.
+    TranscodeOptions jobDefaults;
+};
+
+// The TranscodeDaemon class keeps one Vulkan device resident and runs transcode jobs
+// submitted over a Unix domain socket, so jobs do not pay for instance and device
+// creation, and keeps the video sessions of finished jobs for the next ones with the
+// same profile and size limits. Requests and responses are single-line JSON objects:
+//
+//   {"cmd":"submit","input":"in.mp4","output":"out.mp4"[,"lookahead":N,"cqp":N,
+//    "downconvert":"auto|gpu|cpu","passthrough":bool,"submit_batch":N,"resilient":bool,
+//    "max_decode_errors":N,"checkpoint_interval":S,"resume":bool,"thumbnails":"thumbs/%04d.jpg",
+//    "thumbnail_interval":S,"thumbnail_width":N]} -> {"ok":true,"id":N}
+//   {"cmd":"status"[,"id":N]}   job state and progress, or job and session cache counts
+//                               without an id
+//   {"cmd":"cancel","id":N}     removes a queued job or stops a running one
+//   {"cmd":"watch"[,"id":N]}    streams "progress" and "state" events; with an id the
+//                               connection is closed once that job has finished
+//   {"cmd":"shutdown"}          cancels all jobs and exits
+//
+// Failed requests answer {"ok":false,"error":"..."}. Jobs run on worker threads; the
+// socket is served from the thread that calls run().
+class TranscodeDaemon {
+public:
+    // Creates the listening socket. Throws a std::runtime_error if the path is in use
+    // by a running daemon or cannot be bound.
+    TranscodeDaemon(VulkanBase* vulkanBase, const DaemonOptions& options);
+    ~TranscodeDaemon();
+
+    // Serves requests until a shutdown command, SIGINT or SIGTERM. Running jobs are
+    // cancelled and drained before it returns.
+    void run();
+
+    // Client side: sends one request line to a daemon and prints the responses. Returns
+    // when the first response arrives, or for watch requests when the daemon closes
+    // the connection. Returns true if the response reported success.
+    static bool sendRequest(const std::string& socketPath, const std::string& request);
+
+private:
+    enum class JobState { Queued, Running, Done, Failed, Cancelled };
+
+    struct Job {
+        uint64_t id = 0;
+        std::string inputPath;
+        std::string outputPath;
+        TranscodeOptions options;
+        JobState state = JobState::Queued;
+        std::string error;
+        TranscodeProgress progress;
+        bool cancelRequested = false;
+        // Set while the job runs, so cancel() can reach it.
+        VideoTranscoder* transcoder = nullptr;
+        std::chrono::steady_clock::time_point lastProgressEvent;
+    };
+
+    struct Client {
+        int fd = -1;
+        std::string inBuffer;
+        std::string outBuffer;
+        bool watching = false;
+        uint64_t watchedJob = 0;   // 0 watches every job.
+        bool closeAfterFlush = false;
+        // The client shut down its sending side; a watcher still receives events.
+        bool readClosed = false;
+    };
+
+    // A line for watching clients; final marks the job's last event.
+    struct Event {
+        uint64_t jobId = 0;
+        std::string line;
+        bool final = false;
+    };
+
+    VulkanBase* vulkanBase = nullptr;
+    DaemonOptions options;
+    int listenFd = -1;
+    // Written by worker threads to wake the poll loop when events are queued.
+    int wakePipe[2] = { -1, -1 };
+    bool shutdownRequested = false;
+    // Only touched by the thread in run().
+    std::vector<Client> clients;
+    std::vector<std::thread> workers;
+    // Shared by the workers; destroyed after they have been joined.
+    std::unique_ptr<VideoSessionCache> sessionCache;
+
+    // Guards everything below.
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::map<uint64_t, std::shared_ptr<Job>> jobs;
+    std::deque<std::shared_ptr<Job>> queue;
+    std::deque<Event> events;
+    uint64_t nextJobId = 1;
+    bool stopping = false;
+
+    void workerLoop();
+    void runJob(const std::shared_ptr<Job>& job);
+    // Queues an event for watchers and wakes the poll loop. The caller holds the mutex.
+    void postEvent(const Job& job, JsonObject event, bool final = false);
+    void postStateEvent(const Job& job);
+    // Drops the oldest finished jobs once too many are kept. The caller holds the mutex.
+    void pruneFinishedJobs();
+
+    JsonObject handleRequest(Client& client, const JsonObject& request);
+    JsonObject submitJob(const JsonObject& request);
+    JsonObject cancelJob(uint64_t id);
+    JsonObject describeJob(const Job& job) const;
+
+    void acceptClients();
+    // Returns false once the client should be closed.
+    bool readClient(Client& client);
+    bool flushClient(Client& client);
+    void deliverEvents();
+    void stopJobs();
+
+    static const char* getStateName(JobState state);
+    static bool isFinished(JobState state);
+};
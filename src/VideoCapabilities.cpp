@@ -0,0 +1,283 @@
+#include "VideoCapabilities.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+// Bump when the on-disk layout changes; older files are ignored.
+constexpr uint32_t CACHE_FORMAT_VERSION = 1;
+
+VideoCapabilityCache::VideoCapabilityCache(VkInstance instance, VkPhysicalDevice physicalDevice)
+    : instance(instance), physicalDevice(physicalDevice) {
+    pfn_vkGetPhysicalDeviceVideoCapabilitiesKHR = (PFN_vkGetPhysicalDeviceVideoCapabilitiesKHR)
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceVideoCapabilitiesKHR");
+    pfn_vkGetPhysicalDeviceVideoFormatPropertiesKHR = (PFN_vkGetPhysicalDeviceVideoFormatPropertiesKHR)
+        vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceVideoFormatPropertiesKHR");
+    if (!pfn_vkGetPhysicalDeviceVideoCapabilitiesKHR || !pfn_vkGetPhysicalDeviceVideoFormatPropertiesKHR) {
+        throw std::runtime_error("Failed to load Vulkan video capability query functions!");
+    }
+
+    // A driver update can change any reported limit, so the driver version and the
+    // pipeline cache UUID are part of the key.
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+    std::ostringstream key;
+    key << std::hex << props.vendorID << ' ' << props.deviceID << ' ' << props.driverVersion << ' ';
+    for (uint8_t byte : props.pipelineCacheUUID) {
+        key << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(byte);
+    }
+    deviceKey = key.str();
+
+    load();
+}
+
+std::string VideoCapabilityCache::getCachePath() {
+    if (const char* path = std::getenv("VT_CAPS_CACHE")) {
+        return path;
+    }
+    std::string base;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        base = xdg;
+    } else if (const char* home = std::getenv("HOME")) {
+        base = std::string(home) + "/.cache";
+    } else {
+        return "";
+    }
+    return base + "/vulkan_transcoder/video_caps.txt";
+}
+
+std::string VideoCapabilityCache::profileKey(const VkVideoProfileInfoKHR& profile) {
+    uint32_t stdProfileIdc = 0;
+    uint32_t pictureLayout = 0;
+    for (auto* next = static_cast<const VkBaseInStructure*>(profile.pNext); next; next = next->pNext) {
+        if (next->sType == VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR) {
+            auto* h264 = reinterpret_cast<const VkVideoDecodeH264ProfileInfoKHR*>(next);
+            stdProfileIdc = h264->stdProfileIdc;
+            pictureLayout = h264->pictureLayout;
+        } else if (next->sType == VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_PROFILE_INFO_KHR) {
+            stdProfileIdc = reinterpret_cast<const VkVideoEncodeH265ProfileInfoKHR*>(next)->stdProfileIdc;
+        }
+    }
+    std::ostringstream key;
+    key << std::hex << profile.videoCodecOperation << '-' << profile.chromaSubsampling << '-'
+        << profile.lumaBitDepth << '-' << profile.chromaBitDepth << '-' << stdProfileIdc << '-' << pictureLayout;
+    return key.str();
+}
+
+const VideoProfileCapabilities& VideoCapabilityCache::get(const VkVideoProfileInfoKHR& profile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key = profileKey(profile);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        return it->second;
+    }
+    auto inserted = entries.emplace(key, query(profile));
+    save();
+    return inserted.first->second;
+}
+
+VideoProfileCapabilities VideoCapabilityCache::query(const VkVideoProfileInfoKHR& profile) {
+    VideoProfileCapabilities caps;
+
+    VkVideoCapabilitiesKHR videoCaps{VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR};
+    VkVideoDecodeCapabilitiesKHR decodeCaps{VK_STRUCTURE_TYPE_VIDEO_DECODE_CAPABILITIES_KHR};
+    VkVideoDecodeH264CapabilitiesKHR h264Caps{VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_CAPABILITIES_KHR};
+    VkVideoEncodeCapabilitiesKHR encodeCaps{VK_STRUCTURE_TYPE_VIDEO_ENCODE_CAPABILITIES_KHR};
+    VkVideoEncodeH265CapabilitiesKHR h265Caps{VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_CAPABILITIES_KHR};
+
+    VkImageUsageFlags pictureUsage = 0;
+    VkImageUsageFlags dpbUsage = 0;
+    switch (profile.videoCodecOperation) {
+        case VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR:
+            videoCaps.pNext = &decodeCaps;
+            decodeCaps.pNext = &h264Caps;
+            pictureUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR;
+            dpbUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR;
+            break;
+        case VK_VIDEO_CODEC_OPERATION_ENCODE_H265_BIT_KHR:
+            videoCaps.pNext = &encodeCaps;
+            encodeCaps.pNext = &h265Caps;
+            pictureUsage = VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR;
+            dpbUsage = VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR;
+            break;
+        default:
+            throw std::runtime_error("Capability query for an unsupported video codec operation!");
+    }
+
+    if (pfn_vkGetPhysicalDeviceVideoCapabilitiesKHR(physicalDevice, &profile, &videoCaps) != VK_SUCCESS) {
+        return caps;
+    }
+
+    caps.supported = true;
+    caps.flags = videoCaps.flags;
+    caps.minCodedExtent = videoCaps.minCodedExtent;
+    caps.maxCodedExtent = videoCaps.maxCodedExtent;
+    caps.pictureAccessGranularity = videoCaps.pictureAccessGranularity;
+    caps.maxDpbSlots = videoCaps.maxDpbSlots;
+    caps.maxActiveReferencePictures = videoCaps.maxActiveReferencePictures;
+    caps.minBitstreamBufferOffsetAlignment = videoCaps.minBitstreamBufferOffsetAlignment;
+    caps.minBitstreamBufferSizeAlignment = videoCaps.minBitstreamBufferSizeAlignment;
+    if (profile.videoCodecOperation == VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR) {
+        caps.maxLevelIdc = h264Caps.maxLevelIdc;
+        caps.codingFlags = decodeCaps.flags;
+    } else {
+        caps.maxLevelIdc = h265Caps.maxLevelIdc;
+        caps.codingFlags = encodeCaps.flags;
+        caps.rateControlModes = encodeCaps.rateControlModes;
+        caps.maxQualityLevels = encodeCaps.maxQualityLevels;
+        caps.maxBitrate = encodeCaps.maxBitrate;
+    }
+    caps.pictureFormats = queryFormats(profile, pictureUsage);
+    caps.dpbFormats = queryFormats(profile, dpbUsage);
+    return caps;
+}
+
+std::vector<VkFormat> VideoCapabilityCache::queryFormats(const VkVideoProfileInfoKHR& profile, VkImageUsageFlags usage) {
+    VkVideoProfileListInfoKHR profileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
+    profileList.profileCount = 1;
+    profileList.pProfiles = &profile;
+
+    VkPhysicalDeviceVideoFormatInfoKHR formatInfo{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VIDEO_FORMAT_INFO_KHR};
+    formatInfo.pNext = &profileList;
+    formatInfo.imageUsage = usage;
+
+    uint32_t formatCount = 0;
+    if (pfn_vkGetPhysicalDeviceVideoFormatPropertiesKHR(physicalDevice, &formatInfo, &formatCount, nullptr) != VK_SUCCESS) {
+        return {};
+    }
+    std::vector<VkVideoFormatPropertiesKHR> properties(formatCount, {VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR});
+    if (pfn_vkGetPhysicalDeviceVideoFormatPropertiesKHR(physicalDevice, &formatInfo, &formatCount, properties.data()) != VK_SUCCESS) {
+        return {};
+    }
+
+    std::vector<VkFormat> formats;
+    for (uint32_t i = 0; i < formatCount; ++i) {
+        formats.push_back(properties[i].format);
+    }
+    return formats;
+}
+
+// File layout: a header line "vtcaps <version> <device key>", then one line per profile:
+// <key> <supported> <flags> <min w h> <max w h> <granularity w h> <dpb slots> <active refs>
+// <offset align> <size align> <max level> <coding flags> <rc modes> <quality levels> <max bitrate>
+// <n> <picture formats...> <n> <dpb formats...>
+void VideoCapabilityCache::load() {
+    std::string path = getCachePath();
+    if (path.empty()) return;
+    std::ifstream file(path);
+    if (!file) return;
+
+    std::string line;
+    if (!std::getline(file, line)) return;
+    std::ostringstream expectedHeader;
+    expectedHeader << "vtcaps " << CACHE_FORMAT_VERSION << ' ' << deviceKey;
+    if (line != expectedHeader.str()) {
+        VT_LOG_INFO("Video capability cache is stale (driver or device changed), re-querying.");
+        return;
+    }
+
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string key;
+        VideoProfileCapabilities caps;
+        uint32_t formatCount = 0;
+        in >> key >> caps.supported >> caps.flags
+           >> caps.minCodedExtent.width >> caps.minCodedExtent.height
+           >> caps.maxCodedExtent.width >> caps.maxCodedExtent.height
+           >> caps.pictureAccessGranularity.width >> caps.pictureAccessGranularity.height
+           >> caps.maxDpbSlots >> caps.maxActiveReferencePictures
+           >> caps.minBitstreamBufferOffsetAlignment >> caps.minBitstreamBufferSizeAlignment
+           >> caps.maxLevelIdc >> caps.codingFlags >> caps.rateControlModes
+           >> caps.maxQualityLevels >> caps.maxBitrate;
+        for (auto* formats : {&caps.pictureFormats, &caps.dpbFormats}) {
+            in >> formatCount;
+            for (uint32_t i = 0; i < formatCount && in; ++i) {
+                uint32_t format = 0;
+                in >> format;
+                formats->push_back(static_cast<VkFormat>(format));
+            }
+        }
+        if (!in || key.empty()) {
+            // A truncated or corrupt cache is simply re-queried.
+            entries.clear();
+            return;
+        }
+        entries.emplace(key, caps);
+    }
+    VT_LOG_INFO("Loaded " << entries.size() << " video profile(s) from capability cache.");
+}
+
+void VideoCapabilityCache::save() {
+    std::string path = getCachePath();
+    if (path.empty()) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    // Write to a temporary file and rename so concurrent runs never read a partial cache.
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file) return;
+        file << "vtcaps " << CACHE_FORMAT_VERSION << ' ' << deviceKey << '\n';
+        for (const auto& [key, caps] : entries) {
+            file << key << ' ' << caps.supported << ' ' << caps.flags << ' '
+                 << caps.minCodedExtent.width << ' ' << caps.minCodedExtent.height << ' '
+                 << caps.maxCodedExtent.width << ' ' << caps.maxCodedExtent.height << ' '
+                 << caps.pictureAccessGranularity.width << ' ' << caps.pictureAccessGranularity.height << ' '
+                 << caps.maxDpbSlots << ' ' << caps.maxActiveReferencePictures << ' '
+                 << caps.minBitstreamBufferOffsetAlignment << ' ' << caps.minBitstreamBufferSizeAlignment << ' '
+                 << caps.maxLevelIdc << ' ' << caps.codingFlags << ' ' << caps.rateControlModes << ' '
+                 << caps.maxQualityLevels << ' ' << caps.maxBitrate;
+            for (const auto* formats : {&caps.pictureFormats, &caps.dpbFormats}) {
+                file << ' ' << formats->size();
+                for (VkFormat format : *formats) {
+                    file << ' ' << static_cast<uint32_t>(format);
+                }
+            }
+            file << '\n';
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+}
+
+namespace VideoCapabilityUtils {
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        if (alignment <= 1) return value;
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    VkDeviceSize selectBitstreamRange(VkDeviceSize packetSize, VkDeviceSize alignment, VkDeviceSize bufferSize,
+                                      VkDeviceSize sizeClass) {
+        VkDeviceSize exactRange = alignUp(packetSize, alignment);
+        if (exactRange > bufferSize) {
+            throw std::runtime_error("Packet of " + std::to_string(packetSize) + " bytes exceeds the decode bitstream buffer!");
+        }
+        if (sizeClass == 0) {
+            return exactRange;
+        }
+        // The zero padding after the last NAL unit is ignored by the decoder.
+        VkDeviceSize range = sizeClass;
+        while (range < exactRange) {
+            range *= 2;
+        }
+        return std::min(alignUp(range, alignment), bufferSize);
+    }
+
+    void validateExtent(const VideoProfileCapabilities& caps, VkExtent2D extent, const char* what) {
+        if (extent.width > caps.maxCodedExtent.width || extent.height > caps.maxCodedExtent.height ||
+            extent.width < caps.minCodedExtent.width || extent.height < caps.minCodedExtent.height) {
+            throw std::runtime_error(std::string(what) + ": " + std::to_string(extent.width) + "x" +
+                std::to_string(extent.height) + " is outside the supported range " +
+                std::to_string(caps.minCodedExtent.width) + "x" + std::to_string(caps.minCodedExtent.height) + " - " +
+                std::to_string(caps.maxCodedExtent.width) + "x" + std::to_string(caps.maxCodedExtent.height));
+        }
+    }
+
+} // namespace VideoCapabilityUtils
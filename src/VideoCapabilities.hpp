@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The limits and formats a device reports for one video profile, gathered from
+// vkGetPhysicalDeviceVideoCapabilitiesKHR and vkGetPhysicalDeviceVideoFormatPropertiesKHR.
+struct VideoProfileCapabilities {
+    // False if the device rejected the profile; all other fields are then zero.
+    bool supported = false;
+
+    VkVideoCapabilityFlagsKHR flags = 0;
+    VkExtent2D minCodedExtent{};
+    VkExtent2D maxCodedExtent{};
+    VkExtent2D pictureAccessGranularity{};
+    uint32_t maxDpbSlots = 0;
+    uint32_t maxActiveReferencePictures = 0;
+    VkDeviceSize minBitstreamBufferOffsetAlignment = 1;
+    VkDeviceSize minBitstreamBufferSizeAlignment = 1;
+
+    // Codec-specific maximum level (StdVideoH264LevelIdc / StdVideoH265LevelIdc).
+    uint32_t maxLevelIdc = 0;
+
+    // VkVideoDecodeCapabilityFlagsKHR or VkVideoEncodeCapabilityFlagsKHR.
+    uint32_t codingFlags = 0;
+
+    // Encode only.
+    VkVideoEncodeRateControlModeFlagsKHR rateControlModes = 0;
+    uint32_t maxQualityLevels = 0;
+    uint64_t maxBitrate = 0;
+
+    // Formats for the picture (decode DST / encode SRC) and DPB usages.
+    std::vector<VkFormat> pictureFormats;
+    std::vector<VkFormat> dpbFormats;
+};
+
+// The VideoCapabilityCache class queries and caches video capabilities per profile for
+// one physical device. Results are persisted to disk, keyed by the device and driver
+// version, so repeat runs skip the driver queries entirely.
+class VideoCapabilityCache {
+public:
+    // Loads any persisted capabilities that match this device and driver.
+    VideoCapabilityCache(VkInstance instance, VkPhysicalDevice physicalDevice);
+
+    // Returns the capabilities for a profile, querying the driver on a cache miss.
+    // The returned reference stays valid for the lifetime of the cache.
+    const VideoProfileCapabilities& get(const VkVideoProfileInfoKHR& profile);
+
+    // Returns the location of the on-disk cache. VT_CAPS_CACHE overrides the default
+    // of $XDG_CACHE_HOME (or ~/.cache)/vulkan_transcoder/video_caps.txt.
+    static std::string getCachePath();
+
+private:
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    std::string deviceKey;
+    std::map<std::string, VideoProfileCapabilities> entries;
+    std::mutex mutex;
+
+    PFN_vkGetPhysicalDeviceVideoCapabilitiesKHR pfn_vkGetPhysicalDeviceVideoCapabilitiesKHR = nullptr;
+    PFN_vkGetPhysicalDeviceVideoFormatPropertiesKHR pfn_vkGetPhysicalDeviceVideoFormatPropertiesKHR = nullptr;
+
+    // Builds a stable key from the profile and its codec-specific pNext structure.
+    static std::string profileKey(const VkVideoProfileInfoKHR& profile);
+
+    VideoProfileCapabilities query(const VkVideoProfileInfoKHR& profile);
+    std::vector<VkFormat> queryFormats(const VkVideoProfileInfoKHR& profile, VkImageUsageFlags usage);
+
+    void load();
+    void save();
+};
+
+// Helpers for sizing resources from the negotiated capabilities.
+namespace VideoCapabilityUtils {
+
+    // Rounds value up to a multiple of alignment (alignment 0 is treated as 1).
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment);
+
+    // The decode bitstream range for a packet: its size aligned up or, when sizeClass is
+    // not 0, the next power-of-two multiple of sizeClass, so the range recorded into a
+    // command buffer stays the same across frames of similar size. Never more than
+    // bufferSize; throws a std::runtime_error if the packet does not fit in it.
+    VkDeviceSize selectBitstreamRange(VkDeviceSize packetSize, VkDeviceSize alignment, VkDeviceSize bufferSize,
+                                      VkDeviceSize sizeClass);
+
+    // Throws a std::runtime_error if the extent is outside the profile's coded extent range.
+    void validateExtent(const VideoProfileCapabilities& caps, VkExtent2D extent, const char* what);
+
+} // namespace VideoCapabilityUtils
@@ -0,0 +1,81 @@
+#include "VideoSessionCache.hpp"
+#include "Log.hpp"
+
+#include <tuple>
+
+bool VideoSessionKey::operator==(const VideoSessionKey& other) const {
+    auto fields = [](const VideoSessionKey& key) {
+        return std::tie(key.decode, key.decodeProfileIdc, key.chromaFormatIdc, key.sourceBitDepth, key.encodeProfileIdc,
+                        key.outputBitDepth, key.decodePictureFormat, key.encodePictureFormat, key.maxCodedExtent.width,
+                        key.maxCodedExtent.height, key.decodeDpbSlots, key.decodeActiveReferences, key.encodeDpbSlots,
+                        key.encodeActiveReferences);
+    };
+    return fields(*this) == fields(other);
+}
+
+VideoSessionCache::VideoSessionCache(size_t capacity, Destroyer destroyer)
+    : capacity(capacity), destroyer(std::move(destroyer)) {
+}
+
+VideoSessionCache::~VideoSessionCache() {
+    for (auto& entry : idle) {
+        destroyer(entry.second);
+    }
+}
+
+VideoSessionCache::Destroyer VideoSessionCache::deviceDestroyer(VkDevice device) {
+    auto destroySession = (PFN_vkDestroyVideoSessionKHR)vkGetDeviceProcAddr(device, "vkDestroyVideoSessionKHR");
+    return [device, destroySession](VideoSessions& sessions) {
+        vkDestroyImage(device, sessions.decodeDpbImage, nullptr);
+        vkFreeMemory(device, sessions.decodeDpbImageMemory, nullptr);
+        vkDestroyImage(device, sessions.encodeDpbImage, nullptr);
+        vkFreeMemory(device, sessions.encodeDpbImageMemory, nullptr);
+        if (destroySession) {
+            if (sessions.decodeSession) destroySession(device, sessions.decodeSession, nullptr);
+            if (sessions.encodeSession) destroySession(device, sessions.encodeSession, nullptr);
+        }
+        for (VkDeviceMemory memory : sessions.decodeSessionMemory) vkFreeMemory(device, memory, nullptr);
+        for (VkDeviceMemory memory : sessions.encodeSessionMemory) vkFreeMemory(device, memory, nullptr);
+        sessions = VideoSessions();
+    };
+}
+
+bool VideoSessionCache::checkOut(const VideoSessionKey& key, VideoSessions& sessions) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = idle.rbegin(); it != idle.rend(); ++it) {
+        if (it->first == key) {
+            sessions = std::move(it->second);
+            idle.erase(std::next(it).base());
+            ++stats.hits;
+            return true;
+        }
+    }
+    ++stats.misses;
+    return false;
+}
+
+void VideoSessionCache::checkIn(const VideoSessionKey& key, VideoSessions sessions) {
+    std::deque<std::pair<VideoSessionKey, VideoSessions>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.emplace_back(key, std::move(sessions));
+        while (idle.size() > capacity) {
+            evicted.push_back(std::move(idle.front()));
+            idle.pop_front();
+            ++stats.evictions;
+        }
+    }
+    // Destroying may wait for the driver; other jobs check out meanwhile.
+    for (auto& entry : evicted) {
+        VT_LOG_DEBUG("Session cache: Destroying idle sessions for up to " << entry.first.maxCodedExtent.width << "x"
+                     << entry.first.maxCodedExtent.height);
+        destroyer(entry.second);
+    }
+}
+
+VideoSessionCacheStats VideoSessionCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    VideoSessionCacheStats current = stats;
+    current.idle = idle.size();
+    return current;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// What a job's video sessions were created for: the profiles, picture formats, largest
+// coded extent and DPB limits. A job with an equal key can use them unchanged.
+struct VideoSessionKey {
+    bool decode = false; // Encode-only jobs have no decode session.
+    uint32_t decodeProfileIdc = 0;
+    uint32_t chromaFormatIdc = 0;
+    uint32_t sourceBitDepth = 0;
+    uint32_t encodeProfileIdc = 0;
+    uint32_t outputBitDepth = 0;
+    VkFormat decodePictureFormat = VK_FORMAT_UNDEFINED;
+    VkFormat encodePictureFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D maxCodedExtent{};
+    uint32_t decodeDpbSlots = 0;
+    uint32_t decodeActiveReferences = 0;
+    uint32_t encodeDpbSlots = 0;
+    uint32_t encodeActiveReferences = 0;
+
+    bool operator==(const VideoSessionKey& other) const;
+    bool operator!=(const VideoSessionKey& other) const { return !(*this == other); }
+};
+
+// A job's video sessions with their bound memory, and its DPB images, which were
+// allocated at dpbExtent. Session parameters belong to the job and are not kept.
+struct VideoSessions {
+    VkVideoSessionKHR decodeSession = VK_NULL_HANDLE;
+    std::vector<VkDeviceMemory> decodeSessionMemory;
+    VkVideoSessionKHR encodeSession = VK_NULL_HANDLE;
+    std::vector<VkDeviceMemory> encodeSessionMemory;
+    VkExtent2D dpbExtent{};
+    VkImage decodeDpbImage = VK_NULL_HANDLE;
+    VkDeviceMemory decodeDpbImageMemory = VK_NULL_HANDLE;
+    VkImage encodeDpbImage = VK_NULL_HANDLE;
+    VkDeviceMemory encodeDpbImageMemory = VK_NULL_HANDLE;
+};
+
+struct VideoSessionCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0; // Sets destroyed to stay within the capacity.
+    size_t idle = 0;
+};
+
+// The VideoSessionCache class keeps the video sessions and DPB images of finished jobs,
+// so a later job with the same key skips creating the sessions, binding their memory
+// and allocating the DPBs. At most capacity idle sets are kept, the oldest destroyed
+// first; they hold device memory outside the MemoryBudget, so the daemon keeps the
+// capacity at its job count. The next job resets the sessions before using them.
+// Thread-safe.
+class VideoSessionCache {
+public:
+    using Destroyer = std::function<void(VideoSessions&)>;
+
+    // capacity 0 keeps nothing: every set checked in is destroyed.
+    VideoSessionCache(size_t capacity, Destroyer destroyer);
+    ~VideoSessionCache();
+
+    VideoSessionCache(const VideoSessionCache&) = delete;
+    VideoSessionCache& operator=(const VideoSessionCache&) = delete;
+
+    // Destroys a set's sessions, images and memory on device.
+    static Destroyer deviceDestroyer(VkDevice device);
+
+    // Moves the most recently checked in set with an equal key into sessions. Returns
+    // false, leaving sessions alone, if there is none.
+    bool checkOut(const VideoSessionKey& key, VideoSessions& sessions);
+    // Keeps sessions for a later job. The device must be done with them.
+    void checkIn(const VideoSessionKey& key, VideoSessions sessions);
+
+    VideoSessionCacheStats getStats() const;
+
+private:
+    size_t capacity = 0;
+    Destroyer destroyer;
+
+    mutable std::mutex mutex;
+    // Oldest first.
+    std::deque<std::pair<VideoSessionKey, VideoSessions>> idle;
+    VideoSessionCacheStats stats;
+};
@@ -0,0 +1,38 @@
+#include "VideoTrackSize.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    std::string sizeString(int width, int height) {
+        return std::to_string(width) + "x" + std::to_string(height);
+    }
+}
+
+VideoTrackSize::VideoTrackSize(int width, int height)
+    : declaredWidth(width), declaredHeight(height), pictureWidth(width), pictureHeight(height) {}
+
+void VideoTrackSize::allowChanges(int maxWidth, int maxHeight) {
+    declaredWidth = std::max(declaredWidth, maxWidth);
+    declaredHeight = std::max(declaredHeight, maxHeight);
+    changesAllowed = true;
+}
+
+void VideoTrackSize::change(int width, int height) {
+    if (width == pictureWidth && height == pictureHeight) {
+        return;
+    }
+    if (!changesAllowed) {
+        throw std::runtime_error("Muxer: The output track was declared for " + sizeString(declaredWidth, declaredHeight) +
+                                 " pictures and cannot describe the change to " + sizeString(width, height) +
+                                 "; set --max-size to allow resolution changes.");
+    }
+    if (width > declaredWidth || height > declaredHeight) {
+        throw std::runtime_error("Muxer: Pictures of " + sizeString(width, height) + " exceed the output track's " +
+                                 sizeString(declaredWidth, declaredHeight) + ".");
+    }
+    pictureWidth = width;
+    pictureHeight = height;
+    ++changeCount;
+}
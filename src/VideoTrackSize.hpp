@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// The VideoTrackSize class decides which picture sizes the output video track can
+// describe. MP4 writes the track's size and decoder configuration into the header
+// before the first packet, with one sample description for the whole track, so a
+// mid-stream size change only fits a track declared for it: its size is the largest
+// the stream may switch to (a visual sample entry's width and height are maxima) and
+// its parameter sets travel in band (hev1), so every IDR brings its own. Changes to
+// any other track are rejected rather than written into a file that misdescribes them.
+class VideoTrackSize {
+public:
+    VideoTrackSize(int width, int height);
+
+    // Declares the track for pictures up to maxWidth x maxHeight, and at least the
+    // initial size.
+    void allowChanges(int maxWidth, int maxHeight);
+    bool allowsChanges() const { return changesAllowed; }
+
+    // Pictures from the next IDR on are width x height. Throws a std::runtime_error
+    // if the track cannot describe them.
+    void change(int width, int height);
+
+    // The size the track declares.
+    int getWidth() const { return declaredWidth; }
+    int getHeight() const { return declaredHeight; }
+    // The size of the current pictures.
+    int getPictureWidth() const { return pictureWidth; }
+    int getPictureHeight() const { return pictureHeight; }
+    uint32_t getChangeCount() const { return changeCount; }
+
+private:
+    int declaredWidth;
+    int declaredHeight;
+    int pictureWidth;
+    int pictureHeight;
+    bool changesAllowed = false;
+    uint32_t changeCount = 0;
+};
@@ -1,41 +1,265 @@
 #include "VideoTranscoder.hpp"
 #include "VulkanUtils.hpp"
+#include "PacketPrefetcher.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
 
-#include <iostream>
 #include <stdexcept>
 #include <vector>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
-constexpr VkDeviceSize BITSTREAM_BUFFER_SIZE = 2 * 1024 * 1024;
-constexpr uint32_t NUM_FRAME_RESOURCES = 1;
-constexpr uint32_t DPB_SIZE = 8;
+// Frames that may be in flight at once; the decoder, converter and encoder overlap across
+// them. Fewer are used when the memory budget is short.
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+// Staging buffers for raw input: the CPU fills one while the transfer queue copies the other.
+constexpr uint32_t UPLOAD_STAGING_SLOTS = 2;
+// The encoder codes IPPP with a single reference: the reconstructed picture plus one reference.
+constexpr uint32_t ENCODE_DPB_SLOTS = 2;
+// Reference pictures H.264 allows, plus the picture being decoded.
+constexpr uint32_t H264_MAX_DPB_SLOTS = 17;
+// Smallest bitstream buffer, so tiny resolutions still have room for headers and SEI.
+constexpr VkDeviceSize MIN_BITSTREAM_BUFFER_SIZE = 2 * 1024 * 1024;
+// Smallest decode range the cached command buffers are recorded for.
+constexpr VkDeviceSize MIN_BITSTREAM_RANGE = 4096;
+// Packets demuxed ahead of the transcode loop, audio and other streams included.
+constexpr size_t PREFETCH_PACKETS = 8;
+// Packets admitted and waiting for their stages, or going through them.
+constexpr size_t PIPELINE_PACKETS = 4;
+// Keyframes waiting for the thumbnail extractor; there are rarely more than one or two.
+constexpr size_t THUMBNAIL_PACKETS = 4;
+
+namespace {
+    // Pipeline metrics, totals over every transcoder in the process.
+    struct TranscoderMetrics {
+        MetricCounter& bytesIn;
+        MetricCounter& framesDecoded;
+        MetricCounter& framesEncoded;
+        MetricGauge& framesInFlight;
+        MetricGauge& lookaheadFrames;
+        MetricHistogram& decodeSubmit;
+        MetricHistogram& encodeSubmit;
+        MetricHistogram& encodeLatency;
+        MetricHistogram& frameLatency;
+        MetricHistogram& firstFrame;
+        MetricCounter& corruptPackets;
+        MetricCounter& framesDropped;
+        MetricCounter& parameterUpdates;
+        MetricCounter& parameterRecreations;
+        MetricCounter& resolutionChanges;
+    };
+
+    TranscoderMetrics& metrics() {
+        MetricsRegistry& registry = MetricsRegistry::global();
+        static TranscoderMetrics metrics{
+            registry.counter("transcoder_bitstream_in_bytes_total", "Compressed video bytes read from the input."),
+            registry.counter("transcoder_frames_decoded_total", "Frames queued for decode."),
+            registry.counter("transcoder_frames_encoded_total", "Frames encoded and handed to the muxer."),
+            registry.gauge("transcoder_frames_in_flight", "Encodes submitted and not yet retired."),
+            registry.gauge("transcoder_lookahead_frames", "Decoded frames waiting for the encoder."),
+            registry.histogram("transcoder_decode_submit_seconds", "CPU time to record and queue one decode."),
+            registry.histogram("transcoder_encode_submit_seconds", "CPU time to record and queue one encode."),
+            registry.histogram("transcoder_encode_latency_seconds", "From queueing an encode until its completion is observed."),
+            registry.histogram("transcoder_frame_latency_seconds", "From queueing a decode until the encoded frame is retired."),
+            registry.histogram("transcoder_first_frame_seconds", "From creating a transcoder until its first frame is encoded."),
+            registry.counter("transcoder_corrupt_packets_total", "Damaged video packets skipped by resilient decodes."),
+            registry.counter("transcoder_frames_dropped_total", "Frames skipped by resilient decodes until the next IDR."),
+            registry.counter("transcoder_parameter_updates_total", "In-band SPS/PPS changes added to decode session parameters."),
+            registry.counter("transcoder_parameter_recreations_total", "Decode session parameters recreated for a replaced SPS or PPS."),
+            registry.counter("transcoder_resolution_changes_total", "Mid-stream resolution changes followed at an IDR."),
+        };
+        return metrics;
+    }
+
+    void addLookaheadStats(LookaheadStats& total, const LookaheadStats& stats) {
+        total.framesAnalysed += stats.framesAnalysed;
+        total.sceneCuts += stats.sceneCuts;
+        total.flashesRejected += stats.flashesRejected;
+        total.idrFrames += stats.idrFrames;
+        total.cpuMicroseconds += stats.cpuMicroseconds;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A frame's share of device work, as the scheduler charges batch jobs for it.
+    double megapixels(VkExtent2D extent) {
+        return static_cast<double>(extent.width) * extent.height / 1e6;
+    }
 
-VideoTranscoder::VideoTranscoder(VulkanBase* vulkanBase, const std::string& inPath, const std::string& outPath)
-    : vulkanBase(vulkanBase) {
+    // The output file after index resolution changes: out.mp4, out.1.mp4, out.2.mp4, ...
+    std::string outputFilePath(const std::string& path, uint32_t index) {
+        std::filesystem::path file(path);
+        return (file.parent_path() / (file.stem().string() + "." + std::to_string(index) +
+                                      file.extension().string())).string();
+    }
+}
+
+VideoTranscoder::VideoTranscoder(VulkanBase* vulkanBase, const std::string& inPath, const std::string& outPath,
+                                 const TranscodeOptions& options, VideoSessionCache* sessionCache)
+    : vulkanBase(vulkanBase), sessionCache(sessionCache), options(options),
+      decodeBatch(options.submitBatchSize), encodeBatch(options.submitBatchSize),
+      constructionTime(std::chrono::steady_clock::now()) {
+    validateOptions();
+    auto phaseStart = constructionTime;
+    if (RawVideoReader::isRawInput(inPath, options.rawInput)) {
+        rawReader = std::make_unique<RawVideoReader>(inPath, options.rawInput);
+        endStartupPhase("input probe", phaseStart);
+        setupEncodeOnly(outPath, phaseStart);
+        return;
+    }
+    demuxer = std::make_unique<H264Demuxer>(inPath);
+    endStartupPhase("input probe", phaseStart);
+    setup(outPath, phaseStart);
+}
+
+VideoTranscoder::VideoTranscoder(VulkanBase* vulkanBase, std::unique_ptr<H264Demuxer> openDemuxer,
+                                 const std::string& outPath, const TranscodeOptions& options)
+    : vulkanBase(vulkanBase), options(options),
+      decodeBatch(options.submitBatchSize), encodeBatch(options.submitBatchSize),
+      constructionTime(std::chrono::steady_clock::now()) {
+    if (!openDemuxer) {
+        throw std::invalid_argument("Demuxer cannot be null.");
+    }
+    validateOptions();
+    demuxer = std::move(openDemuxer);
+    setup(outPath, constructionTime);
+}
+
+void VideoTranscoder::validateOptions() const {
     if (!vulkanBase || !vulkanBase->getDevice()) {
         throw std::invalid_argument("VulkanBase pointer or device cannot be null.");
     }
+    if (options.submitBatchSize == 0 || options.submitBatchSize > MAX_FRAMES_IN_FLIGHT) {
+        throw std::invalid_argument("Submit batch size must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT) + ".");
+    }
+    if (options.constantQp > 51) {
+        throw std::invalid_argument("Constant QP must be at most 51 (0 disables it).");
+    }
+    if (options.scheduling.weight == 0) {
+        throw std::invalid_argument("Scheduling weight must be at least 1.");
+    }
+}
 
-    demuxer = std::make_unique<H264Demuxer>(inPath);
-    muxer = std::make_unique<H265Muxer>(outPath, demuxer->getWidth(), demuxer->getHeight(), 30);
+void VideoTranscoder::setup(const std::string& outPath, std::chrono::steady_clock::time_point phaseStart) {
+    demuxer->printSummary();
+    // Rejects unsupported or oversize inputs before anything is allocated or written.
+    negotiateCapabilities();
+    endStartupPhase("capabilities", phaseStart);
+    planMemory();
+    endStartupPhase("memory admission", phaseStart);
+    // Output timestamps stay in the source time base; the muxer rescales them to the container's.
+    timestamps = std::make_unique<TimestampTracker>(demuxer->getTimebase(), demuxer->getTimebase(),
+                                                    demuxer->getFrameRate(), demuxer->getReorderDelay());
+    displayQueue = DisplayOrderQueue<DecodedFrame>(demuxer->getReorderDelay());
+    pictureAssembler = std::make_unique<PictureAssembler>(demuxer->getNalLengthSize());
+    scannedSps = std::make_unique<H264SequenceParameterSet>();
+    if (options.thumbnails.enabled()) {
+        thumbnailExtractor = std::make_unique<ThumbnailExtractor>(*demuxer, options.thumbnails);
+        thumbnailPackets = std::make_unique<PacketRing>(THUMBNAIL_PACKETS);
+    }
+    FragmentedOutput fragmented;
+    fragmented.enabled = options.checkpointIntervalSeconds > 0 || options.resume;
+    if (fragmented.enabled) {
+        checkpointPath = Checkpoint::pathFor(outPath);
+        Timebase timebase = demuxer->getTimebase();
+        checkpointIntervalTicks = av_rescale(options.checkpointIntervalSeconds, timebase.den, timebase.num);
+    }
+    if (options.resume) {
+        loadCheckpoint(outPath, fragmented);
+    }
+    outputPath = outPath;
+    openMuxer(outPath, demuxer->getWidth(), demuxer->getHeight(), fragmented);
+    if (resuming) {
+        if (muxer->getOutputStreamCount() != static_cast<int>(resumePoint.outputStreamCount)) {
+            throw std::runtime_error("Checkpoint: The output was started with " + std::to_string(resumePoint.outputStreamCount) +
+                                     " streams, this job has " + std::to_string(muxer->getOutputStreamCount()) +
+                                     "; resume with the same options.");
+        }
+        muxer->skipPassthroughUntil(resumePoint.passthroughDts);
+        timestamps->resumeAfter(resumePoint.lastOutputPts, resumePoint.lastOutputDts);
+    }
+    endStartupPhase("output open", phaseStart);
+
+    init(phaseStart);
+}
+
+void VideoTranscoder::openMuxer(const std::string& path, int width, int height, const FragmentedOutput& fragmented) {
+    muxer = std::make_unique<H265Muxer>(path, width, height, demuxer->getTimebase(), demuxer->getFrameRate(), fragmented);
+    if (options.maxWidth > 0) {
+        muxer->allowSizeChanges(static_cast<int>(options.maxWidth), static_cast<int>(options.maxHeight));
+    }
+    passthroughStreams.assign(demuxer->getStreamCount(), -1);
+    if (options.passthrough) {
+        for (int i = 0; i < demuxer->getStreamCount(); ++i) {
+            AVMediaType type = demuxer->getStream(i)->codecpar->codec_type;
+            if (type == AVMEDIA_TYPE_AUDIO || type == AVMEDIA_TYPE_SUBTITLE || type == AVMEDIA_TYPE_DATA) {
+                passthroughStreams[i] = muxer->addPassthroughStream(demuxer->getStream(i));
+            }
+        }
+    }
+}
 
-    init();
+void VideoTranscoder::setupEncodeOnly(const std::string& outPath, std::chrono::steady_clock::time_point phaseStart) {
+    // These work on the H.264 bitstream, or add a compute stage the uploader does not hand over to.
+    if (options.downconvert != DownconvertMode::None || options.lookahead.depth > 0 || options.resilientDecode ||
+        options.injectCorruptionInterval || options.checkpointIntervalSeconds || options.resume ||
+        options.thumbnails.enabled()) {
+        throw std::invalid_argument("Raw input does not support downconvert, lookahead, resilient decode, checkpoints or thumbnails.");
+    }
+    rawReader->printSummary();
+    negotiateCapabilities();
+    endStartupPhase("capabilities", phaseStart);
+    planMemory();
+    endStartupPhase("memory admission", phaseStart);
+    // One tick per frame: timestamps are the frame numbers.
+    Timebase frameRate = rawReader->getFrameRate();
+    Timebase timebase{ frameRate.den, frameRate.num };
+    timestamps = std::make_unique<TimestampTracker>(timebase, timebase, frameRate, 0);
+    outputPath = outPath;
+    muxer = std::make_unique<H265Muxer>(outPath, rawReader->getWidth(), rawReader->getHeight(), timebase, frameRate);
+    endStartupPhase("output open", phaseStart);
+
+    init(phaseStart);
 }
 
 VideoTranscoder::~VideoTranscoder() {
-    vkDeviceWaitIdle(vulkanBase->getDevice());
+    try {
+        // Thumbnail tasks of an abandoned transcode still refer to the extractor.
+        thumbnailStrand.wait();
+    } catch (...) {
+    }
+    vulkanBase->waitIdle();
+    // Frames abandoned by an exception no longer count as queued.
+    metrics().framesInFlight.add(-static_cast<int64_t>(inFlightFrames.size()));
+    metrics().lookaheadFrames.add(-static_cast<int64_t>(lookaheadQueue.size()));
     cleanup();
 }
 
 void VideoTranscoder::run() {
-    std::cout << "Starting transcoding process..." << std::endl;
-    transcodeLoop();
-    std::cout << "Transcoding finished successfully." << std::endl;
+    VT_LOG_INFO("Starting transcoding process...");
+    Timebase frameRate = rawReader ? rawReader->getFrameRate() : demuxer->getFrameRate();
+    scheduledJob = SubmitScheduler::global().addJob(options.scheduling, static_cast<double>(frameRate.den) / frameRate.num);
+    if (rawReader) {
+        encodeLoop();
+    } else {
+        transcodeLoop();
+    }
+    printSchedulingStats();
+    scheduledJob = ScheduledJob();
+    if (cancelRequested) {
+        VT_LOG_INFO("Transcoding cancelled after " << progress.framesEncoded << " frames.");
+        return;
+    }
+    VT_LOG_INFO("Transcoding finished successfully.");
 }
 
 void VideoTranscoder::loadVideoFunctionPointers() {
@@ -47,121 +271,452 @@ void VideoTranscoder::loadVideoFunctionPointers() {
     pfn_vkDestroyVideoSessionKHR = (PFN_vkDestroyVideoSessionKHR)vkGetDeviceProcAddr(device, "vkDestroyVideoSessionKHR");
     pfn_vkCreateVideoSessionParametersKHR = (PFN_vkCreateVideoSessionParametersKHR)vkGetDeviceProcAddr(device, "vkCreateVideoSessionParametersKHR");
     pfn_vkDestroyVideoSessionParametersKHR = (PFN_vkDestroyVideoSessionParametersKHR)vkGetDeviceProcAddr(device, "vkDestroyVideoSessionParametersKHR");
+    pfn_vkUpdateVideoSessionParametersKHR = (PFN_vkUpdateVideoSessionParametersKHR)vkGetDeviceProcAddr(device, "vkUpdateVideoSessionParametersKHR");
     pfn_vkCmdBeginVideoCodingKHR = (PFN_vkCmdBeginVideoCodingKHR)vkGetDeviceProcAddr(device, "vkCmdBeginVideoCodingKHR");
     pfn_vkCmdEndVideoCodingKHR = (PFN_vkCmdEndVideoCodingKHR)vkGetDeviceProcAddr(device, "vkCmdEndVideoCodingKHR");
     pfn_vkCmdDecodeVideoKHR = (PFN_vkCmdDecodeVideoKHR)vkGetDeviceProcAddr(device, "vkCmdDecodeVideoKHR");
     pfn_vkCmdEncodeVideoKHR = (PFN_vkCmdEncodeVideoKHR)vkGetDeviceProcAddr(device, "vkCmdEncodeVideoKHR");
+    pfn_vkCmdControlVideoCodingKHR = (PFN_vkCmdControlVideoCodingKHR)vkGetDeviceProcAddr(device, "vkCmdControlVideoCodingKHR");
 
     if (!pfn_vkGetVideoSessionMemoryRequirementsKHR || !pfn_vkBindVideoSessionMemoryKHR || !pfn_vkCreateVideoSessionKHR ||
         !pfn_vkDestroyVideoSessionKHR || !pfn_vkCreateVideoSessionParametersKHR || !pfn_vkDestroyVideoSessionParametersKHR ||
-        !pfn_vkCmdBeginVideoCodingKHR || !pfn_vkCmdEndVideoCodingKHR || !pfn_vkCmdDecodeVideoKHR || !pfn_vkCmdEncodeVideoKHR) {
+        !pfn_vkUpdateVideoSessionParametersKHR || !pfn_vkCmdBeginVideoCodingKHR || !pfn_vkCmdEndVideoCodingKHR ||
+        !pfn_vkCmdDecodeVideoKHR || !pfn_vkCmdEncodeVideoKHR || !pfn_vkCmdControlVideoCodingKHR) {
         throw std::runtime_error("Failed to load one or more Vulkan video function pointers!");
     }
-     std::cout << "Successfully loaded Vulkan video function pointers." << std::endl;
+     VT_LOG_DEBUG("Successfully loaded Vulkan video function pointers.");
 }
 
-void VideoTranscoder::init() {
+void VideoTranscoder::init(std::chrono::steady_clock::time_point& phaseStart) {
     loadVideoFunctionPointers();
-    initDecode();
+    checkOutVideoSessions();
+    if (demuxer) {
+        initDecode();
+    }
     initEncode();
+    endStartupPhase("video sessions", phaseStart);
     createCommandPools();
-    createDpbImages();
+    if (encodeDpbImage == VK_NULL_HANDLE) {
+        createDpbImages();
+    }
+    VkDevice device = vulkanBase->getDevice();
+    if (demuxer) {
+        decodeTimeline = std::make_unique<TimelineSemaphore>(device);
+    }
+    encodeTimeline = std::make_unique<TimelineSemaphore>(device);
+    if (rawReader) {
+        frameUploader = std::make_unique<FrameUploader>(vulkanBase, imageStates, *rawReader, codedExtent, UPLOAD_STAGING_SLOTS);
+    }
+    createComputeStages();
+    if (formatConverter || lookaheadAnalyzer) {
+        computeTimeline = std::make_unique<TimelineSemaphore>(device);
+    }
+    createPicturePool();
     createFrameResources();
+    // Per-frame queues and packet buffers are set up once, so steady-state frames allocate nothing.
+    packetPool = std::make_unique<PacketPool>(encodeBitstreamBufferSize);
+    if (demuxer) {
+        demuxedPayloads = std::make_unique<PacketPool>(decodeBitstreamBufferSize);
+    }
+    inFlightFrames.reserve(framesInFlight);
+    lookaheadQueue.reserve(options.lookahead.depth + 1);
+    pendingPackets.reserve(framesInFlight + (demuxer ? demuxer->getReorderDelay() : 0) + 1);
+    endStartupPhase("resources", phaseStart);
+}
+
+void VideoTranscoder::createComputeStages() {
+    if (outputBitDepth != sourceBitDepth) {
+        formatConverter = std::make_unique<FormatConverter>(vulkanBase, imageStates, codedExtent, options.picturePoolMaxSize, options.downconvert);
+    }
+    if (options.lookahead.depth > 0) {
+        lookaheadAnalyzer = std::make_unique<LookaheadAnalyzer>(vulkanBase, imageStates, codedExtent, sourceBitDepth,
+                                                                options.picturePoolMaxSize, options.lookahead);
+    }
+}
+
+void VideoTranscoder::endStartupPhase(const char* name, std::chrono::steady_clock::time_point& phaseStart) {
+    auto now = std::chrono::steady_clock::now();
+    startupPhases.push_back({ name, std::chrono::duration<double, std::milli>(now - phaseStart).count() });
+    phaseStart = now;
+}
+
+void VideoTranscoder::printStartupPhases() const {
+    std::ostringstream line;
+    line << "Startup:";
+    for (const StartupPhase& phase : startupPhases) {
+        line << " " << phase.name << " " << phase.milliseconds << " ms,";
+    }
+    line << " first frame encoded after "
+         << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - constructionTime).count() << " ms";
+    VT_LOG_INFO(line.str());
+}
+
+void VideoTranscoder::printPacketPoolStats() const {
+    PacketPoolStats stats = packetPool->getStats();
+    VT_LOG_INFO("Packet buffers: " << stats.buffersAllocated << " of " << packetPool->getBufferSize() / 1024
+                << " KiB allocated for " << stats.buffersHandedOut << " encoded packets");
+    if (demuxedPayloads) {
+        stats = demuxedPayloads->getStats();
+        VT_LOG_INFO("Packet buffers: " << stats.buffersAllocated << " of " << demuxedPayloads->getBufferSize() / 1024
+                    << " KiB allocated for " << stats.buffersHandedOut << " demuxed packets");
+    }
+}
+
+void VideoTranscoder::printSchedulingStats() const {
+    SchedulingStats stats = scheduledJob.getStats();
+    if (scheduledJob.isLive()) {
+        VT_LOG_INFO("Scheduling: live, " << stats.deadlineMisses << " of " << stats.framesCompleted << " frames missed the "
+                    << options.scheduling.deadlineMs << " ms deadline (worst " << stats.worstLatenessSeconds * 1000.0
+                    << " ms late), " << stats.deferrals << " frames held back for " << stats.deferredSeconds * 1000.0 << " ms");
+    } else if (stats.deferrals > 0) {
+        VT_LOG_INFO("Scheduling: batch weight " << options.scheduling.weight << ", " << stats.deferrals
+                    << " frames held back for " << stats.deferredSeconds * 1000.0 << " ms");
+    }
+}
+
+// Builds the decode and encode profiles from the SPS, or the encode profile alone from
+// the layout of raw input, and sizes sessions, DPBs and bitstream buffers from the
+// limits the device reports for those profiles.
+void VideoTranscoder::negotiateCapabilities() {
+    // The coded format comes from the SPS; the output format only differs when downconverting.
+    const H264SpsInfo* sps = demuxer ? &demuxer->getSpsInfo() : nullptr;
+    chromaFormatIdc = sps ? sps->chromaFormatIdc : 1;
+    sourceBitDepth = sps ? sps->bitDepthLuma : rawReader->getBitDepth();
+    outputBitDepth = sourceBitDepth;
+    if (options.downconvert != DownconvertMode::None && sourceBitDepth > 8) {
+        if (sourceBitDepth != 10 || chromaFormatIdc != 1) {
+            throw std::runtime_error("Downconvert is only supported for 10-bit 4:2:0 sources.");
+        }
+        outputBitDepth = 8;
+    }
+
+    if (sps) {
+        decodeH264Profile.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR;
+        decodeH264Profile.stdProfileIdc = H264ParameterSets::toStdProfile(
+            sps->profileIdc, sps->chromaFormatIdc, std::max(sps->bitDepthLuma, sps->bitDepthChroma));
+        if (decodeH264Profile.stdProfileIdc == STD_VIDEO_H264_PROFILE_IDC_INVALID) {
+            throw std::runtime_error("H.264 profile_idc " + std::to_string(sps->profileIdc) +
+                                     " cannot be decoded: Vulkan Video supports the Baseline, Main, High, "
+                                     "High 10, High 4:2:2 and High 4:4:4 profiles.");
+        }
+        decodeH264Profile.pictureLayout = VK_VIDEO_DECODE_H264_PICTURE_LAYOUT_PROGRESSIVE_KHR;
+
+        decodeProfile.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
+        decodeProfile.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR;
+        decodeProfile.chromaSubsampling = VulkanUtils::getChromaSubsampling(sps->chromaFormatIdc);
+        decodeProfile.lumaBitDepth = VulkanUtils::getComponentBitDepth(sps->bitDepthLuma);
+        decodeProfile.chromaBitDepth = VulkanUtils::getComponentBitDepth(sps->bitDepthChroma);
+        decodeProfile.pNext = &decodeH264Profile;
+    }
+
+    // Main for 8-bit 4:2:0, Main10 for 10-bit 4:2:0, range extensions for everything else.
+    encodeH265Profile.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_PROFILE_INFO_KHR;
+    if (chromaFormatIdc == 1 && outputBitDepth == 8) {
+        encodeH265Profile.stdProfileIdc = STD_VIDEO_H265_PROFILE_IDC_MAIN;
+    } else if (chromaFormatIdc == 1 && outputBitDepth == 10) {
+        encodeH265Profile.stdProfileIdc = STD_VIDEO_H265_PROFILE_IDC_MAIN_10;
+    } else {
+        encodeH265Profile.stdProfileIdc = STD_VIDEO_H265_PROFILE_IDC_FORMAT_RANGE_EXTENSIONS;
+    }
+
+    encodeProfile.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
+    encodeProfile.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_ENCODE_H265_BIT_KHR;
+    encodeProfile.chromaSubsampling = VulkanUtils::getChromaSubsampling(chromaFormatIdc);
+    encodeProfile.lumaBitDepth = VulkanUtils::getComponentBitDepth(outputBitDepth);
+    encodeProfile.chromaBitDepth = VulkanUtils::getComponentBitDepth(outputBitDepth);
+    encodeProfile.pNext = &encodeH265Profile;
+
+    if (sps) {
+        decodeCaps = vulkanBase->getVideoCapabilities(decodeProfile);
+        if (!decodeCaps.supported) {
+            throw std::runtime_error("H.264 decode profile_idc " + std::to_string(sps->profileIdc) + " (" +
+                                     std::to_string(sourceBitDepth) + "-bit) is not supported by the device!");
+        }
+    }
+    encodeCaps = vulkanBase->getVideoCapabilities(encodeProfile);
+    if (!encodeCaps.supported) {
+        throw std::runtime_error("H.265 encode profile_idc " + std::to_string(encodeH265Profile.stdProfileIdc) + " (" +
+                                 std::to_string(outputBitDepth) + "-bit) is not supported by the device!");
+    }
+
+    if (options.constantQp && !(encodeCaps.rateControlModes & VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR)) {
+        throw std::runtime_error("Constant QP requested but the encoder cannot disable rate control!");
+    }
+
+    if (sps) {
+        decodePictureFormat = selectPictureFormat(decodeCaps.pictureFormats,
+                                                  VulkanUtils::getPictureFormat(chromaFormatIdc, sourceBitDepth));
+    }
+    encodePictureFormat = selectPictureFormat(encodeCaps.pictureFormats,
+                                              VulkanUtils::getPictureFormat(chromaFormatIdc, outputBitDepth));
+
+    // H.264 pictures are coded in whole macroblocks; the driver may need coarser alignment.
+    pictureGranularity.width = std::max(16u, std::max(decodeCaps.pictureAccessGranularity.width, encodeCaps.pictureAccessGranularity.width));
+    pictureGranularity.height = std::max(16u, std::max(decodeCaps.pictureAccessGranularity.height, encodeCaps.pictureAccessGranularity.height));
+    uint32_t width = demuxer ? demuxer->getWidth() : rawReader->getWidth();
+    uint32_t height = demuxer ? demuxer->getHeight() : rawReader->getHeight();
+    codedExtent.width = static_cast<uint32_t>(VideoCapabilityUtils::alignUp(width, pictureGranularity.width));
+    codedExtent.height = static_cast<uint32_t>(VideoCapabilityUtils::alignUp(height, pictureGranularity.height));
+    allocatedExtent = codedExtent;
+    // The sessions are created for the largest resolution the input may switch to;
+    // raw input never changes resolution.
+    maxCodedExtent = codedExtent;
+    if (sps && options.maxWidth > 0) {
+        maxCodedExtent.width = std::max(maxCodedExtent.width,
+            static_cast<uint32_t>(VideoCapabilityUtils::alignUp(options.maxWidth, pictureGranularity.width)));
+        maxCodedExtent.height = std::max(maxCodedExtent.height,
+            static_cast<uint32_t>(VideoCapabilityUtils::alignUp(options.maxHeight, pictureGranularity.height)));
+    }
+    if (sps) {
+        VideoCapabilityUtils::validateExtent(decodeCaps, maxCodedExtent, "Input resolution exceeds decoder limits");
+    }
+    VideoCapabilityUtils::validateExtent(encodeCaps, maxCodedExtent, "Input resolution exceeds encoder limits");
+
+    // The decoder needs every reference the SPS allows plus the picture being decoded.
+    // A stream that may change resolution may also change its SPS, so it gets as many
+    // as H.264 allows, within what the device supports.
+    if (sps) {
+        decodeDpbSlots = sps->maxNumRefFrames + 1;
+        decodeActiveReferences = sps->maxNumRefFrames;
+        if (decodeDpbSlots > decodeCaps.maxDpbSlots || decodeActiveReferences > decodeCaps.maxActiveReferencePictures) {
+            throw std::runtime_error("Stream needs " + std::to_string(sps->maxNumRefFrames) + " reference frames, decoder supports " +
+                                     std::to_string(decodeCaps.maxActiveReferencePictures) + "!");
+        }
+        if (options.maxWidth > 0) {
+            decodeDpbSlots = std::max(decodeDpbSlots, std::min(H264_MAX_DPB_SLOTS, decodeCaps.maxDpbSlots));
+            decodeActiveReferences = std::max(decodeActiveReferences,
+                std::min(decodeDpbSlots - 1, decodeCaps.maxActiveReferencePictures));
+        }
+    }
+    encodeDpbSlots = std::min(ENCODE_DPB_SLOTS, encodeCaps.maxDpbSlots);
+    encodeActiveReferences = std::min(encodeDpbSlots > 0 ? encodeDpbSlots - 1 : 0, encodeCaps.maxActiveReferencePictures);
+
+    sizeBitstreamBuffers();
+
+    VT_LOG_INFO("Negotiated: coded extent " << codedExtent.width << "x" << codedExtent.height
+                << " (sessions up to " << maxCodedExtent.width << "x" << maxCodedExtent.height << ")"
+                << ", decode DPB " << decodeDpbSlots << ", encode DPB " << encodeDpbSlots
+                << ", bitstream buffers " << (encodeBitstreamBufferSize >> 10) << " KiB");
+}
+
+// Sizes the pipeline to the memory that the device, the --memory-budget limit and the
+// other transcodes in the process leave, waiting for them if even the smallest does not fit.
+void VideoTranscoder::sizeBitstreamBuffers() {
+    // A coded picture never needs more room than the raw picture it represents.
+    VkDeviceSize bytesPerSample = sourceBitDepth > 8 ? 2 : 1;
+    VkDeviceSize rawPictureSize = static_cast<VkDeviceSize>(maxCodedExtent.width) * maxCodedExtent.height * 3 / 2 * bytesPerSample;
+    VkDeviceSize bitstreamSize = std::max(rawPictureSize, MIN_BITSTREAM_BUFFER_SIZE);
+    if (demuxer) {
+        decodeBitstreamBufferSize = VideoCapabilityUtils::alignUp(bitstreamSize, decodeCaps.minBitstreamBufferSizeAlignment);
+    }
+    encodeBitstreamBufferSize = VideoCapabilityUtils::alignUp(bitstreamSize, encodeCaps.minBitstreamBufferSizeAlignment);
+}
+
+MemoryCosts VideoTranscoder::getMemoryCosts() const {
+    // Pictures are planned at the largest extent the input may switch to.
+    uint64_t sourcePicture = MemoryPlanner::pictureBytes(maxCodedExtent.width, maxCodedExtent.height, chromaFormatIdc, sourceBitDepth);
+    uint64_t outputPicture = MemoryPlanner::pictureBytes(maxCodedExtent.width, maxCodedExtent.height, chromaFormatIdc, outputBitDepth);
+    MemoryCosts costs;
+    costs.fixedBytes = (demuxer ? decodeDpbSlots * sourcePicture : 0) + encodeDpbSlots * outputPicture;
+    costs.perFrameBytes = (demuxer ? decodeBitstreamBufferSize : 0) + encodeBitstreamBufferSize;
+    costs.perPictureBytes = sourcePicture + (outputBitDepth != sourceBitDepth ? outputPicture : 0);
+    return costs;
+}
+
+void VideoTranscoder::planMemory() {
+    MemoryCosts costs = getMemoryCosts();
+    PipelineDepth requested;
+    requested.framesInFlight = MAX_FRAMES_IN_FLIGHT;
+    requested.lookahead = options.lookahead.depth;
+    requested.picturePoolSize = options.picturePoolSize;
+    requested.picturePoolMaxSize = options.picturePoolMaxSize;
+    MemoryPlan plan;
+    memoryReservation = MemoryBudget::global().reserve(vulkanBase->getDeviceMemoryUsage().budget, costs, requested,
+                                                       options.submitBatchSize, plan);
+    framesInFlight = plan.depth.framesInFlight;
+    options.lookahead.depth = plan.depth.lookahead;
+    options.picturePoolSize = plan.depth.picturePoolSize;
+    options.picturePoolMaxSize = plan.depth.picturePoolMaxSize;
+    if (plan.reduced) {
+        VT_LOG_WARNING("Memory: Pipeline reduced to fit the budget: " << framesInFlight << " frames in flight (of "
+                       << requested.framesInFlight << "), lookahead " << plan.depth.lookahead << " (of "
+                       << requested.lookahead << "), up to " << plan.depth.picturePoolMaxSize << " pictures (of "
+                       << requested.picturePoolMaxSize << ")");
+    }
+    VT_LOG_DEBUG("Memory: Reserved " << MemoryPlanner::formatSize(plan.bytes));
+}
+
+VkFormat VideoTranscoder::selectPictureFormat(const std::vector<VkFormat>& supported, VkFormat preferred) {
+    if (supported.empty()) {
+        throw std::runtime_error("Device reports no picture formats for the video profile!");
+    }
+    for (VkFormat format : supported) {
+        if (format == preferred) {
+            return format;
+        }
+    }
+    VT_LOG_WARNING("Warning: Preferred picture format " << preferred << " not reported, using " << supported[0]);
+    return supported[0];
 }
 
 void VideoTranscoder::initDecode() {
+    if (decodeSession == VK_NULL_HANDLE) {
+        createDecodeSession();
+    }
+    // The container header's parameter sets; in-band ones are added as packets bring them.
+    parameterSets = std::make_unique<H264ParameterSets>();
+    parameterSets->addExtradata(demuxer->getSpsPpsData());
+    createDecodeParameters();
+}
+
+void VideoTranscoder::createDecodeSession() {
     VkDevice device = vulkanBase->getDevice();
-    VkFormat decodedImageFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
 
     VkExtensionProperties h264StdVersion{};
     strncpy(h264StdVersion.extensionName, VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_EXTENSION_NAME, VK_MAX_EXTENSION_NAME_SIZE);
     h264StdVersion.specVersion = VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_SPEC_VERSION;
 
-    VkVideoDecodeH264ProfileInfoKHR h264Profile{};
-    h264Profile.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR;
-    h264Profile.stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_HIGH;
-    h264Profile.pictureLayout = VK_VIDEO_DECODE_H264_PICTURE_LAYOUT_PROGRESSIVE_KHR;
-
-    decodeProfile.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
-    decodeProfile.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR;
-    decodeProfile.chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
-    decodeProfile.lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-    decodeProfile.chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-    decodeProfile.pNext = &h264Profile;
-
     VkVideoSessionCreateInfoKHR sessionCreateInfo{};
     sessionCreateInfo.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_CREATE_INFO_KHR;
     sessionCreateInfo.queueFamilyIndex = vulkanBase->getQueueFamilyIndices().decodeFamily.value();
     sessionCreateInfo.pVideoProfile = &decodeProfile;
-    sessionCreateInfo.pictureFormat = decodedImageFormat;
-    sessionCreateInfo.maxCodedExtent = { (uint32_t)demuxer->getWidth(), (uint32_t)demuxer->getHeight() };
-    sessionCreateInfo.referencePictureFormat = decodedImageFormat;
-    sessionCreateInfo.maxDpbSlots = DPB_SIZE;
-    sessionCreateInfo.maxActiveReferencePictures = DPB_SIZE;
+    sessionCreateInfo.pictureFormat = decodePictureFormat;
+    sessionCreateInfo.maxCodedExtent = maxCodedExtent;
+    sessionCreateInfo.referencePictureFormat = decodePictureFormat;
+    sessionCreateInfo.maxDpbSlots = decodeDpbSlots;
+    sessionCreateInfo.maxActiveReferencePictures = decodeActiveReferences;
     sessionCreateInfo.pStdHeaderVersion = &h264StdVersion;
 
     if (pfn_vkCreateVideoSessionKHR(device, &sessionCreateInfo, nullptr, &decodeSession) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create decode session!");
     }
-    std::cout << "Decode session created." << std::endl;
+    VT_LOG_INFO("Decode session created.");
 
     // --- FIX: Allocate and bind memory for the video session ---
     bindVideoSessionMemory(decodeSession, decodeSessionMemory);
+}
 
-    // --- FIX: Create video session parameters ---
-    // A real implementation would parse SPS/PPS from the bitstream here.
-    // For simplicity, we'll create a placeholder.
-    VkVideoSessionParametersCreateInfoKHR paramsCreateInfo = {VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR};
+void VideoTranscoder::createDecodeParameters() {
+    std::vector<StdVideoH264SequenceParameterSet> spsList;
+    std::vector<StdVideoH264PictureParameterSet> ppsList;
+    parameterSets->collect(true, spsList, ppsList);
+
+    VkVideoDecodeH264SessionParametersAddInfoKHR addInfo{VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_SESSION_PARAMETERS_ADD_INFO_KHR};
+    addInfo.stdSPSCount = static_cast<uint32_t>(spsList.size());
+    addInfo.pStdSPSs = spsList.data();
+    addInfo.stdPPSCount = static_cast<uint32_t>(ppsList.size());
+    addInfo.pStdPPSs = ppsList.data();
+    // Room for every SPS and PPS ID, so new IDs never force a new object.
+    VkVideoDecodeH264SessionParametersCreateInfoKHR h264CreateInfo{VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_SESSION_PARAMETERS_CREATE_INFO_KHR};
+    h264CreateInfo.maxStdSPSCount = H264ParameterSets::MAX_SPS_COUNT;
+    h264CreateInfo.maxStdPPSCount = H264ParameterSets::MAX_PPS_COUNT;
+    h264CreateInfo.pParametersAddInfo = &addInfo;
+
+    VkVideoSessionParametersCreateInfoKHR paramsCreateInfo{VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR};
+    paramsCreateInfo.pNext = &h264CreateInfo;
     paramsCreateInfo.videoSession = decodeSession;
-    if (pfn_vkCreateVideoSessionParametersKHR(device, &paramsCreateInfo, nullptr, &decodeSessionParameters) != VK_SUCCESS) {
+    VkVideoSessionParametersKHR parameters = VK_NULL_HANDLE;
+    if (pfn_vkCreateVideoSessionParametersKHR(vulkanBase->getDevice(), &paramsCreateInfo, nullptr, &parameters) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create decode session parameters!");
     }
+    decodeSessionParameters = parameters;
+    ++decodeParametersGeneration;
+    parameterSets->commit(true);
+    decodeParametersUpdateCount = 0;
+}
+
+void VideoTranscoder::updateDecodeParameters() {
+    std::vector<StdVideoH264SequenceParameterSet> spsList;
+    std::vector<StdVideoH264PictureParameterSet> ppsList;
+    parameterSets->collect(false, spsList, ppsList);
+    for (const StdVideoH264SequenceParameterSet& sps : spsList) {
+        checkSequenceParameterSet(*parameterSets->getSps(sps.seq_parameter_set_id));
+    }
+
+    // Decodes already recorded keep the old object, so it lives until they complete.
+    if (parameterSets->needsRecreate()) {
+        VkVideoSessionParametersKHR replaced = decodeSessionParameters;
+        createDecodeParameters();
+        retiredDecodeParameters.emplace_back(replaced, decodeTimeline->getLastSubmittedValue());
+        ++decodeParametersRecreations;
+        metrics().parameterRecreations.add();
+        VT_LOG_DEBUG("Decode session parameters recreated for a changed SPS or PPS.");
+        return;
+    }
+
+    VkVideoDecodeH264SessionParametersAddInfoKHR addInfo{VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_SESSION_PARAMETERS_ADD_INFO_KHR};
+    addInfo.stdSPSCount = static_cast<uint32_t>(spsList.size());
+    addInfo.pStdSPSs = spsList.data();
+    addInfo.stdPPSCount = static_cast<uint32_t>(ppsList.size());
+    addInfo.pStdPPSs = ppsList.data();
+    VkVideoSessionParametersUpdateInfoKHR updateInfo{VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_UPDATE_INFO_KHR};
+    updateInfo.pNext = &addInfo;
+    updateInfo.updateSequenceCount = decodeParametersUpdateCount + 1;
+    if (pfn_vkUpdateVideoSessionParametersKHR(vulkanBase->getDevice(), decodeSessionParameters, &updateInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to update decode session parameters!");
+    }
+    ++decodeParametersUpdateCount;
+    ++decodeParametersUpdates;
+    metrics().parameterUpdates.add();
+    parameterSets->commit(false);
+}
+
+void VideoTranscoder::checkSequenceParameterSet(const H264SequenceParameterSet& sps) const {
+    std::string id = "SPS " + std::to_string(sps.std.seq_parameter_set_id);
+    if (sps.codedWidth > maxCodedExtent.width || sps.codedHeight > maxCodedExtent.height) {
+        throw std::runtime_error(id + " changes the coded size to " + std::to_string(sps.codedWidth) + "x" +
+                                 std::to_string(sps.codedHeight) + ", beyond the decode session's " +
+                                 std::to_string(maxCodedExtent.width) + "x" + std::to_string(maxCodedExtent.height) +
+                                 "; raise --max-size.");
+    }
+    if (sps.std.chroma_format_idc != chromaFormatIdc || sps.std.bit_depth_luma_minus8 + 8 != sourceBitDepth) {
+        throw std::runtime_error(id + " changes the chroma format or bit depth, which the decode session cannot follow.");
+    }
+    if (sps.std.max_num_ref_frames > decodeActiveReferences) {
+        throw std::runtime_error(id + " needs " + std::to_string(sps.std.max_num_ref_frames) +
+                                 " reference frames, the decode session has " + std::to_string(decodeActiveReferences) +
+                                 (options.maxWidth > 0 ? "." : "; --max-size provisions as many as the device supports."));
+    }
 }
 
 void VideoTranscoder::initEncode() {
+    if (encodeSession == VK_NULL_HANDLE) {
+        createEncodeSession();
+    }
+    // --- FIX: Create video session parameters ---
+    VkVideoSessionParametersCreateInfoKHR paramsCreateInfo = {VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR};
+    paramsCreateInfo.videoSession = encodeSession;
+    if (pfn_vkCreateVideoSessionParametersKHR(vulkanBase->getDevice(), &paramsCreateInfo, nullptr, &encodeSessionParameters) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create encode session parameters!");
+    }
+}
+
+void VideoTranscoder::createEncodeSession() {
     VkDevice device = vulkanBase->getDevice();
-    VkFormat inputImageFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
 
     VkExtensionProperties h265StdVersion{};
     strncpy(h265StdVersion.extensionName, VK_STD_VULKAN_VIDEO_CODEC_H265_ENCODE_EXTENSION_NAME, VK_MAX_EXTENSION_NAME_SIZE);
     h265StdVersion.specVersion = VK_STD_VULKAN_VIDEO_CODEC_H265_ENCODE_SPEC_VERSION;
 
-    VkVideoEncodeH265ProfileInfoKHR h265Profile{};
-    h265Profile.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_PROFILE_INFO_KHR;
-    h265Profile.stdProfileIdc = STD_VIDEO_H265_PROFILE_IDC_MAIN;
-
-    encodeProfile.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
-    encodeProfile.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_ENCODE_H265_BIT_KHR;
-    encodeProfile.chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
-    encodeProfile.lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-    encodeProfile.chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-    encodeProfile.pNext = &h265Profile;
-
     VkVideoSessionCreateInfoKHR sessionCreateInfo{};
     sessionCreateInfo.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_CREATE_INFO_KHR;
     sessionCreateInfo.queueFamilyIndex = vulkanBase->getQueueFamilyIndices().encodeFamily.value();
     sessionCreateInfo.pVideoProfile = &encodeProfile;
-    sessionCreateInfo.pictureFormat = inputImageFormat;
-    sessionCreateInfo.maxCodedExtent = { (uint32_t)demuxer->getWidth(), (uint32_t)demuxer->getHeight() };
-    sessionCreateInfo.referencePictureFormat = inputImageFormat;
-    sessionCreateInfo.maxDpbSlots = DPB_SIZE;
-    sessionCreateInfo.maxActiveReferencePictures = DPB_SIZE;
+    sessionCreateInfo.pictureFormat = encodePictureFormat;
+    sessionCreateInfo.maxCodedExtent = maxCodedExtent;
+    sessionCreateInfo.referencePictureFormat = encodePictureFormat;
+    sessionCreateInfo.maxDpbSlots = encodeDpbSlots;
+    sessionCreateInfo.maxActiveReferencePictures = encodeActiveReferences;
     sessionCreateInfo.pStdHeaderVersion = &h265StdVersion;
 
     if (pfn_vkCreateVideoSessionKHR(device, &sessionCreateInfo, nullptr, &encodeSession) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create encode session!");
     }
-    std::cout << "Encode session created." << std::endl;
+    VT_LOG_INFO("Encode session created (" << outputBitDepth << "-bit, H.265 profile_idc "
+                << encodeH265Profile.stdProfileIdc << ").");
 
     // --- FIX: Allocate and bind memory for the video session ---
     bindVideoSessionMemory(encodeSession, encodeSessionMemory);
-
-    // --- FIX: Create video session parameters ---
-    VkVideoSessionParametersCreateInfoKHR paramsCreateInfo = {VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR};
-    paramsCreateInfo.videoSession = encodeSession;
-    if (pfn_vkCreateVideoSessionParametersKHR(device, &paramsCreateInfo, nullptr, &encodeSessionParameters) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create encode session parameters!");
-    }
 }
 
 // --- FIX: New helper function to bind memory to a video session ---
@@ -205,7 +760,7 @@ void VideoTranscoder::createCommandPools() {
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     poolInfo.queueFamilyIndex = qfIndices.decodeFamily.value();
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &decodeCommandPool) != VK_SUCCESS) {
+    if (demuxer && vkCreateCommandPool(device, &poolInfo, nullptr, &decodeCommandPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create decode command pool!");
     }
     poolInfo.queueFamilyIndex = qfIndices.encodeFamily.value();
@@ -217,9 +772,8 @@ void VideoTranscoder::createCommandPools() {
 void VideoTranscoder::createDpbImages() {
     VkDevice device = vulkanBase->getDevice();
     VkPhysicalDevice pDevice = vulkanBase->getPhysicalDevice();
-    VkFormat format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
-    uint32_t width = demuxer->getWidth();
-    uint32_t height = demuxer->getHeight();
+    uint32_t width = allocatedExtent.width;
+    uint32_t height = allocatedExtent.height;
 
     // --- FIX: Provide video profile info when creating video-related images ---
     VkVideoProfileListInfoKHR decodeProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
@@ -230,167 +784,1173 @@ void VideoTranscoder::createDpbImages() {
     encodeProfileList.profileCount = 1;
     encodeProfileList.pProfiles = &encodeProfile;
 
-    VkImageUsageFlags decodeDpbUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR;
-    VulkanUtils::createImage(pDevice, device, width, height, format, decodeDpbUsage, decodeDpbImage, decodeDpbImageMemory, DPB_SIZE, &decodeProfileList);
+    if (demuxer) {
+        VkImageUsageFlags decodeDpbUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR;
+        VulkanUtils::createImage(pDevice, device, width, height, decodePictureFormat, decodeDpbUsage, decodeDpbImage, decodeDpbImageMemory, decodeDpbSlots, &decodeProfileList);
+    }
 
     VkImageUsageFlags encodeDpbUsage = VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR;
-    VulkanUtils::createImage(pDevice, device, width, height, format, encodeDpbUsage, encodeDpbImage, encodeDpbImageMemory, DPB_SIZE, &encodeProfileList);
+    VulkanUtils::createImage(pDevice, device, width, height, encodePictureFormat, encodeDpbUsage, encodeDpbImage, encodeDpbImageMemory, encodeDpbSlots, &encodeProfileList);
 }
 
-void VideoTranscoder::createFrameResources() {
-    frameResources.resize(NUM_FRAME_RESOURCES);
+void VideoTranscoder::destroyDpbImages() {
     VkDevice device = vulkanBase->getDevice();
-    VkPhysicalDevice pDevice = vulkanBase->getPhysicalDevice();
-    VkFormat imageFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
-    uint32_t width = demuxer->getWidth();
-    uint32_t height = demuxer->getHeight();
+    vkDestroyImage(device, decodeDpbImage, nullptr);
+    vkFreeMemory(device, decodeDpbImageMemory, nullptr);
+    vkDestroyImage(device, encodeDpbImage, nullptr);
+    vkFreeMemory(device, encodeDpbImageMemory, nullptr);
+    decodeDpbImage = VK_NULL_HANDLE;
+    decodeDpbImageMemory = VK_NULL_HANDLE;
+    encodeDpbImage = VK_NULL_HANDLE;
+    encodeDpbImageMemory = VK_NULL_HANDLE;
+}
 
-    // --- FIX: Provide video profile info when creating video-related resources ---
+// The slots' buffers and command buffers are created by ensureDecodeSlot and
+// ensureEncodeSlot the first time each slot is used.
+void VideoTranscoder::createFrameResources() {
+    decodeSlots.resize(framesInFlight);
+    frameResources.resize(framesInFlight);
+}
+
+void VideoTranscoder::ensureDecodeSlot(DecodeSlot& slot) {
+    if (slot.bitstreamBuffer != VK_NULL_HANDLE) {
+        return;
+    }
+    VkDevice device = vulkanBase->getDevice();
     VkVideoProfileListInfoKHR decodeProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
     decodeProfileList.profileCount = 1;
     decodeProfileList.pProfiles = &decodeProfile;
+    VulkanUtils::createBuffer(vulkanBase->getPhysicalDevice(), device, decodeBitstreamBufferSize, VK_BUFFER_USAGE_VIDEO_DECODE_SRC_BIT_KHR,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        slot.bitstreamBuffer, slot.bitstreamBufferMemory, &decodeProfileList);
+    vkMapMemory(device, slot.bitstreamBufferMemory, 0, decodeBitstreamBufferSize, 0, &slot.pBitstreamBufferHost);
+    // Recreated sessions replace the buffers but keep the command buffers.
+    if (slot.commandBuffer != VK_NULL_HANDLE) {
+        return;
+    }
 
+    VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    allocInfo.commandPool = decodeCommandPool;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to allocate decode command buffer!");
+}
+
+void VideoTranscoder::ensureEncodeSlot(FrameResources& res) {
+    if (res.encodeBitstreamBuffer != VK_NULL_HANDLE) {
+        return;
+    }
+    VkDevice device = vulkanBase->getDevice();
     VkVideoProfileListInfoKHR encodeProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
     encodeProfileList.profileCount = 1;
     encodeProfileList.pProfiles = &encodeProfile;
-
-    VkVideoProfileListInfoKHR combinedProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
-    VkVideoProfileInfoKHR profiles[] = {decodeProfile, encodeProfile};
-    combinedProfileList.profileCount = 2;
-    combinedProfileList.pProfiles = profiles;
+    VulkanUtils::createBuffer(vulkanBase->getPhysicalDevice(), device, encodeBitstreamBufferSize, VK_BUFFER_USAGE_VIDEO_ENCODE_DST_BIT_KHR,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        res.encodeBitstreamBuffer, res.encodeBitstreamBufferMemory, &encodeProfileList);
+    vkMapMemory(device, res.encodeBitstreamBufferMemory, 0, encodeBitstreamBufferSize, 0, &res.pEncodeBitstreamBufferHost);
+    if (res.encodeCommandBuffer != VK_NULL_HANDLE) {
+        return;
+    }
 
     VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = 1;
+    allocInfo.commandPool = encodeCommandPool;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &res.encodeCommandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to allocate encode command buffer!");
+}
+
+void VideoTranscoder::createPicturePool() {
+    // Every lookahead frame holds a picture on top of the frames in flight.
+    uint32_t lookaheadDepth = options.lookahead.depth;
+    uint32_t initialSize = options.picturePoolSize ? options.picturePoolSize : framesInFlight + lookaheadDepth;
+    if (options.picturePoolMaxSize < initialSize) {
+        throw std::invalid_argument("Decoded picture pool maximum is smaller than its initial size.");
+    }
+    if (lookaheadDepth > 0 && options.picturePoolMaxSize < lookaheadDepth + framesInFlight + 1) {
+        throw std::invalid_argument("Decoded picture pool maximum must be at least " +
+                                    std::to_string(lookaheadDepth + framesInFlight + 1) + " for a lookahead of " +
+                                    std::to_string(lookaheadDepth) + " frames.");
+    }
+    picturePool = std::make_unique<DecodedPicturePool>(initialSize, options.picturePoolMaxSize,
+        [this](DecodedPicture& picture) { createPicture(picture); },
+        [this](DecodedPicture& picture) { destroyPicture(picture); });
+}
+
+void VideoTranscoder::createPicture(DecodedPicture& picture) {
+    VkDevice device = vulkanBase->getDevice();
+    VkPhysicalDevice pDevice = vulkanBase->getPhysicalDevice();
+    uint32_t width = allocatedExtent.width;
+    uint32_t height = allocatedExtent.height;
 
-    VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, VK_FENCE_CREATE_SIGNALED_BIT};
-    VkSemaphoreCreateInfo semaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VkVideoProfileListInfoKHR decodeProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
+    decodeProfileList.profileCount = 1;
+    decodeProfileList.pProfiles = &decodeProfile;
 
-    for (uint32_t i = 0; i < NUM_FRAME_RESOURCES; ++i) {
-        auto& res = frameResources[i];
-        VulkanUtils::createBuffer(pDevice, device, BITSTREAM_BUFFER_SIZE, VK_BUFFER_USAGE_VIDEO_DECODE_SRC_BIT_KHR,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            res.decodeBitstreamBuffer, res.decodeBitstreamBufferMemory, &decodeProfileList);
-        vkMapMemory(device, res.decodeBitstreamBufferMemory, 0, BITSTREAM_BUFFER_SIZE, 0, &res.pDecodeBitstreamBufferHost);
+    VkVideoProfileListInfoKHR encodeProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
+    encodeProfileList.profileCount = 1;
+    encodeProfileList.pProfiles = &encodeProfile;
 
-        VulkanUtils::createBuffer(pDevice, device, BITSTREAM_BUFFER_SIZE, VK_BUFFER_USAGE_VIDEO_ENCODE_DST_BIT_KHR,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            res.encodeBitstreamBuffer, res.encodeBitstreamBufferMemory, &encodeProfileList);
-        vkMapMemory(device, res.encodeBitstreamBufferMemory, 0, BITSTREAM_BUFFER_SIZE, 0, &res.pEncodeBitstreamBufferHost);
+    // The lookahead samples the decoded picture itself, whichever picture the encoder reads.
+    VkImageUsageFlags analysisUsage = lookaheadAnalyzer ? lookaheadAnalyzer->getPictureUsage() : 0;
+    VkImageCreateFlags analysisFlags = lookaheadAnalyzer ? lookaheadAnalyzer->getImageCreateFlags() : 0;
+
+    if (frameUploader) {
+        // Raw input: the uploader copies each frame straight into the encoder's picture.
+        VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR | FrameUploader::getPictureUsage();
+        VulkanUtils::createImage(pDevice, device, width, height, encodePictureFormat, imageUsage,
+            picture.image, picture.memory, 1, &encodeProfileList);
+        picture.view = VulkanUtils::createImageView(device, picture.image, encodePictureFormat);
+    } else if (formatConverter) {
+        // Downconvert: the decoder writes the source-depth picture, the converter
+        // produces a separate 8-bit picture for the encoder.
+        VkImageCreateFlags convertFlags = formatConverter->getImageCreateFlags();
+        VkImageUsageFlags decodeUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR | formatConverter->getSourceUsage() | analysisUsage;
+        VulkanUtils::createImage(pDevice, device, width, height, decodePictureFormat, decodeUsage,
+            picture.image, picture.memory, 1, &decodeProfileList, convertFlags | analysisFlags);
+        picture.view = VulkanUtils::createImageView(device, picture.image, decodePictureFormat);
+
+        VkImageUsageFlags encodeUsage = VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR | formatConverter->getDestinationUsage();
+        VulkanUtils::createImage(pDevice, device, width, height, encodePictureFormat, encodeUsage,
+            picture.encodeInputImage, picture.encodeInputMemory, 1, &encodeProfileList, convertFlags);
+        picture.encodeInputView = VulkanUtils::createImageView(device, picture.encodeInputImage, encodePictureFormat);
+    } else {
+        VkVideoProfileListInfoKHR combinedProfileList{VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR};
+        VkVideoProfileInfoKHR profiles[] = {decodeProfile, encodeProfile};
+        combinedProfileList.profileCount = 2;
+        combinedProfileList.pProfiles = profiles;
+
+        VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR | VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR | analysisUsage;
+        VulkanUtils::createImage(pDevice, device, width, height, decodePictureFormat, imageUsage,
+            picture.image, picture.memory, 1, &combinedProfileList, analysisFlags);
+        picture.view = VulkanUtils::createImageView(device, picture.image, decodePictureFormat);
+    }
+    bindComputeStages(picture);
+}
 
-        VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR | VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR;
-        VulkanUtils::createImage(pDevice, device, width, height, imageFormat, imageUsage, res.decodedImage, res.decodedImageMemory, 1, &combinedProfileList);
-        res.decodedImageView = VulkanUtils::createImageView(device, res.decodedImage, imageFormat);
+// The compute stages never change for a picture at one resolution, so their command
+// buffers are recorded once here. Each stage acquires the picture from the one before it.
+void VideoTranscoder::bindComputeStages(DecodedPicture& picture) {
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    QueueAccess stage{ImageAccess::DecodeDst, qfIndices.decodeFamily.value()};
+    if (lookaheadAnalyzer) {
+        QueueAccess analysis{lookaheadAnalyzer->getSourceAccess(), qfIndices.computeFamily.value()};
+        QueueAccess next = formatConverter
+            ? QueueAccess{formatConverter->getSourceAccess(), qfIndices.computeFamily.value()}
+            : QueueAccess{ImageAccess::EncodeSrc, qfIndices.encodeFamily.value()};
+        lookaheadAnalyzer->bindSlot(picture.index, picture.image, stage, next);
+        stage = analysis;
+    }
+    if (formatConverter) {
+        formatConverter->bindSlot(picture.index, picture.image, picture.encodeInputImage, stage);
+    }
+}
 
-        allocInfo.commandPool = decodeCommandPool;
-        if (vkAllocateCommandBuffers(device, &allocInfo, &res.decodeCommandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to allocate decode command buffer!");
-        allocInfo.commandPool = encodeCommandPool;
-        if (vkAllocateCommandBuffers(device, &allocInfo, &res.encodeCommandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to allocate encode command buffer!");
-        if (vkCreateFence(device, &fenceInfo, nullptr, &res.encodeCompleteFence) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &res.decodeCompleteSemaphore) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create synchronization objects for a frame!");
-        }
+void VideoTranscoder::destroyPicture(DecodedPicture& picture) {
+    VkDevice device = vulkanBase->getDevice();
+    if (picture.encodeInputImage) {
+        imageStates.forget(picture.encodeInputImage);
+        vkDestroyImageView(device, picture.encodeInputView, nullptr);
+        vkDestroyImage(device, picture.encodeInputImage, nullptr);
+        vkFreeMemory(device, picture.encodeInputMemory, nullptr);
     }
+    imageStates.forget(picture.image);
+    vkDestroyImageView(device, picture.view, nullptr);
+    vkDestroyImage(device, picture.image, nullptr);
+    vkFreeMemory(device, picture.memory, nullptr);
 }
 
 void VideoTranscoder::transcodeLoop() {
     AVPacket* packet = av_packet_alloc();
     if (!packet) throw std::runtime_error("Failed to allocate AVPacket");
     int frameCount = 0;
+    progress.totalFrames = demuxer->getFrameCountEstimate();
+    startTime = std::chrono::steady_clock::now();
+
+    // A resumed transcode skips the source up to the checkpoint's IDR; the passthrough
+    // packets read on the way are filtered by the muxer.
+    bool seekingResumePoint = resuming;
+    if (resuming) {
+        demuxer->seekVideo(resumePoint.inputDts);
+        frameCount = static_cast<int>(resumePoint.frameNumber);
+        videoPacketCount = resumePoint.videoPacketIndex;
+        videoFramesWritten = resumePoint.frameNumber;
+        progress.framesEncoded = resumePoint.frameNumber;
+        haveSegmentStart = true;
+        lastSegmentPts = resumePoint.inputPts;
+    }
+
+    if (options.resilientDecode || options.injectCorruptionInterval) {
+        decodeResync = std::make_unique<DecodeResync>(demuxer->getNalLengthSize(), decodeBitstreamBufferSize,
+                                                      decodeCaps.minBitstreamBufferSizeAlignment,
+                                                      options.resilientDecode, options.maxDecodeErrors);
+    }
 
-    while (demuxer->getNextPacket(packet)) {
+    frameMegapixels = megapixels(codedExtent);
+    PacketPrefetcher prefetcher(*demuxer, TaskPool::global(), PREFETCH_PACKETS);
+    FramePipeline pipeline(*this, TaskPool::global(), PIPELINE_PACKETS, demuxedPayloads.get());
+    while (!cancelRequested && prefetcher.readPacket(packet)) {
+        FrameJob job;
         if (packet->stream_index != demuxer->getVideoStreamIndex()) {
+            // Streams that appear after the header was read are not in the output.
+            if (packet->stream_index < static_cast<int>(passthroughStreams.size()) &&
+                passthroughStreams[packet->stream_index] >= 0) {
+                job.outputStream = passthroughStreams[packet->stream_index];
+                pipeline.push(packet, job);
+            }
             av_packet_unref(packet);
             continue;
         }
 
-        FrameResources& res = frameResources[currentFrame];
-        vkWaitForFences(vulkanBase->getDevice(), 1, &res.encodeCompleteFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(vulkanBase->getDevice(), 1, &res.encodeCompleteFence);
-
-        memcpy(res.pDecodeBitstreamBufferHost, packet->data, packet->size);
-        recordDecodeCommandBuffer(currentFrame, packet->size);
-        recordEncodeCommandBuffer(currentFrame);
-        submitWork(currentFrame);
+        job.video = true;
+        if (seekingResumePoint) {
+            if (packet->pts != resumePoint.inputPts || packet->dts != resumePoint.inputDts) {
+                if (packet->dts != AV_NOPTS_VALUE && packet->dts > resumePoint.inputDts) {
+                    throw std::runtime_error("Checkpoint: The input has no IDR at the checkpointed position.");
+                }
+                av_packet_unref(packet);
+                continue;
+            }
+            seekingResumePoint = false;
+            job.segmentStart = true;
+        }
 
-        std::vector<uint8_t> encodedData(1024, 0);
-        memcpy(encodedData.data(), res.pEncodeBitstreamBufferHost, 1024);
-        muxer->writePacket(encodedData, frameCount);
+        job.packetIndex = videoPacketCount++;
+        if (decodeResync && !admitPacket(packet, job)) {
+            av_packet_unref(packet);
+            continue;
+        }
+        // Only IDRs make thumbnails, and the extractor decodes them on the task pool.
+        if (thumbnailExtractor && (packet->flags & AV_PKT_FLAG_KEY)) {
+            AVPacket* keyframe = thumbnailPackets->acquire();
+            if (av_packet_ref(keyframe, packet) < 0) {
+                thumbnailPackets->release(keyframe);
+                throw std::runtime_error("Failed to reference a keyframe packet");
+            }
+            thumbnailStrand.post([this, keyframe] {
+                try {
+                    thumbnailExtractor->addPacket(keyframe);
+                } catch (...) {
+                    thumbnailPackets->release(keyframe);
+                    throw;
+                }
+                thumbnailPackets->release(keyframe);
+            });
+        }
 
-        av_packet_unref(packet);
-        currentFrame = (currentFrame + 1) % NUM_FRAME_RESOURCES;
-        frameCount++;
-        std::cout << "\rTranscoded frame " << frameCount << std::flush;
+        // Admission blocks, so it stays off the task pool.
+        job.frameNumber = frameCount++;
+        scheduledJob.admitFrame(job.frameNumber, frameMegapixels);
+        pipeline.push(packet, job);
+    }
+    pipeline.finish();
+    progress.framesDropped = framesDropped;
+    scheduledJob.endOfInput();
+    releaseDisplayOrder(true);
+    while (!lookaheadQueue.empty()) {
+        encodeFrame();
     }
+    retireFrames(0);
+    writeReadyPackets(true);
+    muxer->finish();
     av_packet_free(&packet);
-    std::cout << std::endl;
+    if (thumbnailExtractor) {
+        thumbnailStrand.post([this] { thumbnailExtractor->finish(); });
+        thumbnailStrand.wait();
+        thumbnailExtractor->printStats();
+    }
+
+    // A cancelled transcode keeps its checkpoint, so it can still be resumed.
+    if (!checkpointPath.empty() && !cancelRequested) {
+        std::error_code ec;
+        std::filesystem::remove(checkpointPath, ec);
+        if (checkpointCount > 0) {
+            VT_LOG_INFO("Checkpoints: " << checkpointCount << " saved, " << muxer->getFragmentCount() << " fragments");
+        }
+    }
+
+    if (muxer->getPassthroughStreamCount() > 0) {
+        VT_LOG_INFO("Passthrough: " << muxer->getPassthroughPacketCount() << " packets in "
+                    << muxer->getPassthroughStreamCount() << " streams, " << muxer->getForcedPassthroughCount()
+                    << " written early to bound buffering");
+    }
+
+    DecodeErrorStats decodeErrors = getDecodeErrorStats();
+    if (decodeErrors.corruptPackets > 0) {
+        VT_LOG_WARNING("Decode errors: " << decodeErrors.corruptPackets << " damaged packets ("
+                       << decodeErrors.injectedErrors << " injected), " << decodeErrors.droppedFrames
+                       << " frames dropped, " << decodeErrors.resyncs << " resyncs"
+                       << (decodeResync->isAwaitingIdr() ? "; no IDR followed the last damaged packet" : ""));
+    }
+
+    if (timestamps->getSynthesizedCount() || timestamps->getCorrectedCount()) {
+        VT_LOG_INFO("Timestamps: " << timestamps->getSynthesizedCount() << " missing PTS synthesised, "
+                    << timestamps->getCorrectedCount() << " non-increasing PTS corrected");
+    }
+    if (displayQueue.getLateCount()) {
+        VT_LOG_WARNING("Display order: " << displayQueue.getLateCount()
+                       << " pictures reordered further than the stream's reorder delay were encoded out of order");
+    }
+
+    if (frameCount > 0) {
+        VT_LOG_INFO("CPU record+submit: " << cpuSubmitMicroseconds / frameCount << " us/frame ("
+                    << decodeRecordCount << " decode and " << encodeRecordCount << " encode recordings for "
+                    << frameCount << " frames, batch size " << options.submitBatchSize << ")");
+        printPacketPoolStats();
+
+        const DecodedPicturePoolStats& poolStats = picturePool->getStats();
+        VT_LOG_INFO("Decoded picture pool: " << poolStats.capacity << " pictures (grew " << poolStats.growCount
+                    << " times), peak " << poolStats.peakInUse << " in use, mean occupancy "
+                    << static_cast<double>(poolStats.occupancySum) / std::max<uint64_t>(poolStats.acquireCount, 1)
+                    << ", " << poolStats.exhaustedCount << " stalls");
+
+        const ParameterSetStats& setStats = parameterSets->getStats();
+        if (decodeParametersUpdates > 0 || decodeParametersRecreations > 0) {
+            VT_LOG_INFO("Parameter sets: " << setStats.received << " received (" << setStats.repeated << " repeated, "
+                        << setStats.cacheHits << " from cache, " << setStats.parsed << " parsed), " << setStats.added
+                        << " added in " << decodeParametersUpdates << " updates, " << setStats.replaced << " replaced by "
+                        << decodeParametersRecreations << " new parameters objects");
+        }
+
+        const PictureAssemblerStats& assemblerStats = pictureAssembler->getStats();
+        if (assemblerStats.maxSlicesPerPicture > 1) {
+            VT_LOG_INFO("Slices: " << assemblerStats.slices << " in " << assemblerStats.pictures << " pictures, up to "
+                        << assemblerStats.maxSlicesPerPicture << " per picture");
+        }
+
+        if (progress.outputFiles > 1) {
+            VT_LOG_INFO("Output: " << progress.outputFiles << " files, split where the picture size changed");
+        }
+        if (resolutionChanges > 0) {
+            VT_LOG_INFO("Resolution changes: " << resolutionChanges << ", " << resolutionReallocations
+                        << " needing larger pictures, last at " << codedExtent.width << "x" << codedExtent.height
+                        << " (allocated " << allocatedExtent.width << "x" << allocatedExtent.height << ")");
+        }
+
+        if (lookaheadAnalyzer) {
+            LookaheadStats lookaheadStats = replacedLookaheadStats;
+            addLookaheadStats(lookaheadStats, lookaheadAnalyzer->getStats());
+            VT_LOG_INFO("Lookahead: " << lookaheadStats.sceneCuts << " scene cuts, " << lookaheadStats.flashesRejected
+                        << " flashes ignored, " << lookaheadStats.idrFrames << " IDR frames, "
+                        << lookaheadStats.cpuMicroseconds / std::max<uint64_t>(lookaheadStats.framesAnalysed, 1)
+                        << " us/frame CPU analysis");
+        }
+    }
 }
 
-void VideoTranscoder::recordDecodeCommandBuffer(uint32_t frameIndex, VkDeviceSize bitstreamSize) {
-    FrameResources& res = frameResources[frameIndex];
-    vkResetCommandBuffer(res.decodeCommandBuffer, 0);
+// Encode-only counterpart of transcodeLoop for raw input: frames are uploaded instead
+// of decoded, and there is no lookahead, so each is encoded as soon as it is queued.
+void VideoTranscoder::encodeLoop() {
+    int frameCount = 0;
+    progress.totalFrames = rawReader->getFrameCountEstimate();
+    startTime = std::chrono::steady_clock::now();
+
+    const uint8_t* data;
+    while (!cancelRequested && (data = rawReader->nextFrame())) {
+        scheduledJob.admitFrame(frameCount, megapixels(codedExtent));
+        auto cpuStart = std::chrono::steady_clock::now();
+        uploadFrame(data, frameCount++);
+        encodeFrame();
+        cpuSubmitMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cpuStart).count();
+        retireFrames(scheduledJob.getFramesInFlight(framesInFlight));
+        writeReadyPackets(false);
+    }
+    scheduledJob.endOfInput();
+    retireFrames(0);
+    writeReadyPackets(true);
+    muxer->finish();
+
+    if (frameCount > 0) {
+        double seconds = secondsSince(startTime);
+        frameUploader->printStats();
+        VT_LOG_INFO("Encode: " << frameCount << " frames in " << seconds << " s, " << frameCount / seconds << " fps");
+        VT_LOG_INFO("CPU upload+record+submit: " << cpuSubmitMicroseconds / frameCount << " us/frame ("
+                    << encodeRecordCount << " encode recordings for " << frameCount << " frames, batch size "
+                    << options.submitBatchSize << ")");
+        printPacketPoolStats();
+    }
+}
+
+bool VideoTranscoder::admitPacket(AVPacket* packet, FrameJob& job) {
+    if (options.injectCorruptionInterval && videoPacketCount % options.injectCorruptionInterval == 0) {
+        injectCorruption(packet);
+    }
+
+    switch (decodeResync->admit(packet->data, packet->size, packet->flags & AV_PKT_FLAG_CORRUPT, videoPacketCount)) {
+    case DecodeResync::Verdict::Resync:
+        job.resync = true;
+        return true;
+    case DecodeResync::Verdict::Decode:
+        return true;
+    case DecodeResync::Verdict::Damaged:
+        metrics().corruptPackets.add();
+        break;
+    case DecodeResync::Verdict::AwaitingIdr:
+        break;
+    }
+    framesDropped = decodeResync->getStats().droppedFrames;
+    metrics().framesDropped.add();
+    return false;
+}
+
+// Alternates between the two kinds of damage seen in practice: a packet cut short and a
+// bit flipped in a NAL unit header.
+void VideoTranscoder::injectCorruption(AVPacket* packet) {
+    if (packet->size < 8 || av_packet_make_writable(packet) < 0) {
+        return;
+    }
+    if (decodeResync->countInjectedError() % 2 == 0) {
+        packet->size /= 3;
+        return;
+    }
+    uint32_t nalLengthSize = demuxer->getNalLengthSize();
+    size_t header = nalLengthSize ? nalLengthSize : (packet->data[2] == 1 ? 3 : 4);
+    packet->data[header] |= 0x80; // forbidden_zero_bit
+}
+
+void VideoTranscoder::loadCheckpoint(const std::string& outPath, FragmentedOutput& fragmented) {
+    std::error_code ec;
+    if (!std::filesystem::exists(checkpointPath, ec)) {
+        VT_LOG_INFO("Resume: No checkpoint for " << outPath << ", starting from the beginning.");
+        return;
+    }
+    resumePoint = Checkpoint::load(checkpointPath);
+    std::string inputPath = std::filesystem::absolute(demuxer->getFilePath(), ec).string();
+    uintmax_t inputSize = std::filesystem::file_size(demuxer->getFilePath(), ec);
+    if (resumePoint.inputPath != inputPath || resumePoint.inputSize != inputSize) {
+        throw std::runtime_error("Checkpoint: " + checkpointPath + " belongs to " + resumePoint.inputPath +
+                                 ", not " + inputPath + "; remove it to start over.");
+    }
+    fragmented.resumeBytes = resumePoint.outputBytes;
+    fragmented.resumeFragments = resumePoint.fragmentCount;
+    resuming = true;
+    VT_LOG_INFO("Resume: Continuing " << outPath << " at frame " << resumePoint.frameNumber << " ("
+                << resumePoint.outputBytes << " bytes kept)");
+}
+
+bool VideoTranscoder::startsSegment(const AVPacket* packet) {
+    if (!(packet->flags & AV_PKT_FLAG_KEY) || packet->pts == AV_NOPTS_VALUE || packet->dts == AV_NOPTS_VALUE) {
+        return false;
+    }
+    if (!haveSegmentStart) {
+        // The stream's first keyframe starts the first segment; no checkpoint is needed there.
+        haveSegmentStart = true;
+        lastSegmentPts = packet->pts;
+        return false;
+    }
+    if (packet->pts - lastSegmentPts < checkpointIntervalTicks) {
+        return false;
+    }
+    // Sync samples may be recovery points; only an IDR makes the frames after it independent.
+    H264PacketInfo info;
+    if (!H264Parser::inspectPacket(packet->data, packet->size, demuxer->getNalLengthSize(), info) || !info.idr) {
+        return false;
+    }
+    lastSegmentPts = packet->pts;
+    return true;
+}
+
+void VideoTranscoder::writeCheckpoint(const SegmentBoundary& boundary, const FrameTimestamp& idrTimestamp) {
+    std::error_code ec;
+    TranscodeCheckpoint checkpoint;
+    checkpoint.inputPath = std::filesystem::absolute(demuxer->getFilePath(), ec).string();
+    checkpoint.inputSize = std::filesystem::file_size(demuxer->getFilePath(), ec);
+    checkpoint.outputBytes = muxer->cutFragment(idrTimestamp.dts);
+    checkpoint.fragmentCount = muxer->getFragmentCount();
+    checkpoint.outputStreamCount = static_cast<uint32_t>(muxer->getOutputStreamCount());
+    checkpoint.videoPacketIndex = boundary.videoPacketIndex;
+    checkpoint.frameNumber = static_cast<uint64_t>(boundary.frameNumber);
+    checkpoint.inputPts = boundary.pts;
+    checkpoint.inputDts = boundary.dts;
+    checkpoint.lastOutputPts = lastOutputTimestamp.pts;
+    checkpoint.lastOutputDts = lastOutputTimestamp.dts;
+    checkpoint.passthroughDts = muxer->getLastPassthroughDts();
+    // The fragment is already complete, so a failed save only costs the ability to resume here.
+    try {
+        Checkpoint::save(checkpointPath, checkpoint);
+        ++checkpointCount;
+        VT_LOG_DEBUG("Checkpoint: Frame " << boundary.frameNumber << ", " << checkpoint.outputBytes << " bytes");
+    } catch (const std::runtime_error& e) {
+        VT_LOG_WARNING(e.what());
+    }
+}
+
+void VideoTranscoder::parse(FrameJob& job) {
+    const AVPacket* packet = job.packet;
+    if (!job.segmentStart && checkpointIntervalTicks > 0 && startsSegment(packet)) {
+        job.segmentStart = job.frameNumber > 0;
+        if (job.segmentStart) {
+            segmentBoundaries.push_back({ job.frameNumber, job.packetIndex, packet->pts, packet->dts });
+        }
+    }
+    // Only an IDR changes the size. This runs before the picture is assembled, since new
+    // sessions may come with larger bitstream buffers.
+    if ((packet->flags & AV_PKT_FLAG_KEY) && !muxer->getTrackSize().allowsChanges()) {
+        const H264SequenceParameterSet* sps = scanNewSps(packet);
+        if (sps && needsNewOutput(*sps)) {
+            startNewOutput(*sps, job.frameNumber);
+            job.segmentStart = true;
+        }
+    }
+    // Decode slots are reused round-robin; the oldest one's decode must have finished.
+    DecodeSlot& slot = decodeSlots[currentDecodeSlot];
+    ensureDecodeSlot(slot);
+    if (!decodeTimeline->isComplete(slot.decodeValue)) {
+        flushSubmissions();
+        decodeTimeline->wait(slot.decodeValue);
+    }
+    timestamps->pushPacket(packet->pts, packet->dts, packet->duration);
+    metrics().bytesIn.add(static_cast<uint64_t>(packet->size));
+
+    // The picture starts at offset 0, which meets any offset alignment. The decode range
+    // must be a multiple of the device's size alignment; pad with zeros.
+    uint8_t* bitstream = static_cast<uint8_t*>(slot.pBitstreamBufferHost);
+    size_t pictureSize = pictureAssembler->assemble(packet->data, packet->size, bitstream, decodeBitstreamBufferSize);
+    assembled.bitstreamSize = selectBitstreamRange(pictureSize);
+    memset(bitstream + pictureSize, 0, assembled.bitstreamSize - pictureSize);
+
+    // Resent parameter sets are recognised by hash and cost nothing; changed ones are
+    // added to the session parameters before this picture's decode is recorded.
+    for (const H264NalUnit& nal : pictureAssembler->getParameterSets()) {
+        parameterSets->add(nal.data, nal.size);
+    }
+
+    const H264NalUnit& slice = pictureAssembler->getFirstSlice();
+    assembled.idr = (slice.data[0] & 0x1f) == H264Parser::NAL_IDR_SLICE;
+    assembled.extent = getAssembledPictureExtent();
+    const H264PictureParameterSet& pps = getAssembledPps();
+    const H264SequenceParameterSet* sps = parameterSets->getSps(pps.std.seq_parameter_set_id);
+    if (assembled.idr) {
+        // The output track follows the shown size, which the cropping alone can change.
+        muxer->changeVideoSize(static_cast<int>(sps->displayWidth), static_cast<int>(sps->displayHeight));
+    }
+    // A new resolution starts a new segment: the frames before it are finished at
+    // the old one, and this IDR is encoded as one.
+    if (assembled.extent.width != codedExtent.width || assembled.extent.height != codedExtent.height) {
+        if (!assembled.idr) {
+            throw std::runtime_error("Frame " + std::to_string(job.frameNumber) + " changes the resolution to " +
+                                     std::to_string(assembled.extent.width) + "x" +
+                                     std::to_string(assembled.extent.height) + " without an IDR.");
+        }
+        // With checkpoints the new resolution also starts a new output fragment.
+        if (!job.segmentStart && checkpointIntervalTicks > 0 && job.frameNumber > 0 &&
+            packet->pts != AV_NOPTS_VALUE && packet->dts != AV_NOPTS_VALUE) {
+            segmentBoundaries.push_back({ job.frameNumber, job.packetIndex, packet->pts, packet->dts });
+            lastSegmentPts = packet->pts;
+        }
+        job.segmentStart = true;
+    }
+    // Pictures come out of the decoder in decode order; the encoder takes them in display order.
+    assembled.picOrderCnt = pictureOrder.next(slice.data, slice.size, sps->std, pps.std);
+}
+
+void VideoTranscoder::submit(FrameJob& job) {
+    ScopedMetricTimer timer(metrics().decodeSubmit);
+    auto cpuStart = std::chrono::steady_clock::now();
+    if (parameterSets->hasPending()) {
+        updateDecodeParameters();
+    }
+    while (!retiredDecodeParameters.empty() && decodeTimeline->isComplete(retiredDecodeParameters.front().second)) {
+        pfn_vkDestroyVideoSessionParametersKHR(vulkanBase->getDevice(), retiredDecodeParameters.front().first, nullptr);
+        retiredDecodeParameters.pop_front();
+    }
+    if (assembled.extent.width != codedExtent.width || assembled.extent.height != codedExtent.height) {
+        VT_LOG_INFO("Resolution: " << codedExtent.width << "x" << codedExtent.height << " -> "
+                    << assembled.extent.width << "x" << assembled.extent.height << " at frame " << job.frameNumber);
+        changeResolution(assembled.extent);
+    }
+
+    // Decode takes a picture from the pool. When every picture is still referenced,
+    // retire the oldest encodes, or encode early if the lookahead holds them all.
+    DecodeSlot& slot = decodeSlots[currentDecodeSlot];
+    int32_t picture;
+    while ((picture = picturePool->acquire(slot.recordedPicture)) < 0) {
+        if (!inFlightFrames.empty()) {
+            retireFrames(inFlightFrames.size() - 1);
+        } else if (!lookaheadQueue.empty()) {
+            encodeFrame();
+        } else if (!displayQueue.empty()) {
+            // The pool cannot grow; the earliest picture leaves before its order is settled.
+            lookaheadQueue.push_back(displayQueue.pop());
+            metrics().lookaheadFrames.add(1);
+        } else {
+            throw std::runtime_error("Decoded picture pool exhausted with no frames in flight!");
+        }
+    }
+    DecodedFrame frame;
+    frame.pictureIndex = static_cast<uint32_t>(picture);
+    frame.frameNumber = job.frameNumber;
+    frame.segmentStart = job.segmentStart;
+    frame.decodeTime = std::chrono::steady_clock::now();
+
+    // Per-frame data lives in the bitstream buffer, so the command buffer only needs
+    // re-recording when the picture, the decode range, the slice layout or the session
+    // parameters object changes; single-slice streams always have the table {0}.
+    bool reset = resetDecoder || job.resync;
+    resetDecoder = false;
+    VkDeviceSize bitstreamSize = assembled.bitstreamSize;
+    const std::vector<uint32_t>& sliceOffsets = pictureAssembler->getSliceOffsets();
+    if (!options.reuseCommandBuffers || slot.recordedPicture != frame.pictureIndex ||
+        slot.recordedBitstreamRange != bitstreamSize || slot.recordedReset != reset ||
+        slot.recordedSliceOffsets != sliceOffsets || slot.recordedParametersGeneration != decodeParametersGeneration) {
+        slot.recordedSliceOffsets = sliceOffsets;
+        recordDecodeCommandBuffer(currentDecodeSlot, frame.pictureIndex, bitstreamSize, reset);
+        slot.recordedPicture = frame.pictureIndex;
+        slot.recordedBitstreamRange = bitstreamSize;
+        slot.recordedReset = reset;
+        slot.recordedParametersGeneration = decodeParametersGeneration;
+        ++decodeRecordCount;
+    }
+
+    slot.decodeValue = decodeTimeline->nextValue();
+    // Signal after all commands so the queue family release barrier is covered too.
+    decodeBatch.add(slot.commandBuffer, nullptr,
+        decodeTimeline->submitInfo(slot.decodeValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+    frame.readyValue = slot.decodeValue;
+    frame.readyTimeline = decodeTimeline.get();
+
+    // Compute stages are submitted directly, so their decode must already be on the queue.
+    if (lookaheadAnalyzer || formatConverter) {
+        decodeBatch.submit(vulkanBase, vulkanBase->getDecodeQueue());
+        VkSemaphoreSubmitInfo wait = decodeTimeline->submitInfo(slot.decodeValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+        if (lookaheadAnalyzer) {
+            frame.analysisValue = computeTimeline->nextValue();
+            lookaheadAnalyzer->submit(frame.pictureIndex, wait,
+                computeTimeline->submitInfo(frame.analysisValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+            wait = computeTimeline->submitInfo(frame.analysisValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            frame.readyValue = frame.analysisValue;
+        }
+        if (formatConverter) {
+            frame.readyValue = computeTimeline->nextValue();
+            formatConverter->submit(frame.pictureIndex, wait,
+                computeTimeline->submitInfo(frame.readyValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+        }
+        frame.readyTimeline = computeTimeline.get();
+    } else if (decodeBatch.size() >= options.submitBatchSize) {
+        decodeBatch.submit(vulkanBase, vulkanBase->getDecodeQueue());
+    }
+
+    displayQueue.push(frame, assembled.picOrderCnt, assembled.idr);
+    releaseDisplayOrder(false);
+    currentDecodeSlot = (currentDecodeSlot + 1) % framesInFlight;
+    metrics().framesDecoded.add();
+
+    // The encoder trails the decoder by the lookahead depth.
+    while (lookaheadQueue.size() > options.lookahead.depth) {
+        encodeFrame();
+    }
+    cpuSubmitMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cpuStart).count();
+}
+
+void VideoTranscoder::readback(FrameJob&) {
+    // Picks up whatever has already finished without stalling the submit path.
+    retireFrames(scheduledJob.getFramesInFlight(framesInFlight));
+}
+
+void VideoTranscoder::mux(FrameJob&) {
+    writeReadyPackets(false);
+}
+
+void VideoTranscoder::passthrough(FrameJob& job) {
+    muxer->writePassthroughPacket(job.packet, job.outputStream);
+}
+
+void VideoTranscoder::releaseDisplayOrder(bool flush) {
+    while (displayQueue.ready(flush)) {
+        lookaheadQueue.push_back(displayQueue.pop());
+        metrics().lookaheadFrames.add(1);
+    }
+}
+
+const H264PictureParameterSet& VideoTranscoder::getAssembledPps() const {
+    const H264NalUnit& slice = pictureAssembler->getFirstSlice();
+    uint32_t ppsId = 0;
+    if (!H264Parser::parseSlicePpsId(slice.data, slice.size, ppsId)) {
+        throw std::runtime_error("Decode: Truncated slice header.");
+    }
+    const H264PictureParameterSet* pps = parameterSets->getPps(ppsId);
+    if (!pps) {
+        throw std::runtime_error("Decode: Slice refers to PPS " + std::to_string(ppsId) + ", which has not been seen.");
+    }
+    return *pps;
+}
+
+VkExtent2D VideoTranscoder::getAssembledPictureExtent() const {
+    // The PPS could only be added once its SPS was known.
+    const H264SequenceParameterSet* sps = parameterSets->getSps(getAssembledPps().std.seq_parameter_set_id);
+    return { static_cast<uint32_t>(VideoCapabilityUtils::alignUp(sps->codedWidth, pictureGranularity.width)),
+             static_cast<uint32_t>(VideoCapabilityUtils::alignUp(sps->codedHeight, pictureGranularity.height)) };
+}
+
+// The frames before the change are encoded and retired first, so no GPU work refers to
+// the pictures or the compute stages any more; their packets wait for timestamps as usual.
+// The compute stages work on the coded extent and are rebuilt for the new one. Pictures
+// and DPBs are kept when the new extent fits in them, and only reallocated if it grows.
+void VideoTranscoder::changeResolution(VkExtent2D extent) {
+    releaseDisplayOrder(true);
+    while (!lookaheadQueue.empty()) {
+        encodeFrame();
+    }
+    retireFrames(0);
+
+    if (lookaheadAnalyzer) {
+        addLookaheadStats(replacedLookaheadStats, lookaheadAnalyzer->getStats());
+    }
+    lookaheadAnalyzer.reset();
+    formatConverter.reset();
+    codedExtent = extent;
+    frameMegapixels = megapixels(extent);
+    ++resolutionChanges;
+    metrics().resolutionChanges.add();
+
+    if (extent.width > allocatedExtent.width || extent.height > allocatedExtent.height) {
+        picturePool.reset();
+        destroyDpbImages();
+        allocatedExtent.width = std::max(allocatedExtent.width, extent.width);
+        allocatedExtent.height = std::max(allocatedExtent.height, extent.height);
+        createDpbImages();
+        createComputeStages();
+        createPicturePool();
+        ++resolutionReallocations;
+        VT_LOG_DEBUG("Resolution: Pictures reallocated at " << allocatedExtent.width << "x" << allocatedExtent.height);
+    } else {
+        createComputeStages();
+        for (uint32_t i = 0; i < picturePool->getStats().capacity; ++i) {
+            bindComputeStages(picturePool->get(i));
+        }
+    }
+
+    invalidateRecordings();
+    resetDecoder = true;
+}
+
+void VideoTranscoder::invalidateRecordings() {
+    for (DecodeSlot& slot : decodeSlots) {
+        slot.recordedPicture = UINT32_MAX;
+    }
+    for (FrameResources& res : frameResources) {
+        res.recordedPicture = UINT32_MAX;
+    }
+}
+
+// The last SPS is kept as bytes, so a resent one costs a compare; only a changed one is
+// parsed. A packet that cannot be split is left for decodeFrame to reject.
+const H264SequenceParameterSet* VideoTranscoder::scanNewSps(const AVPacket* packet) {
+    if (H264Parser::splitNalUnits(packet->data, packet->size, demuxer->getNalLengthSize(), scannedNalUnits)) {
+        return nullptr;
+    }
+    for (const H264NalUnit& nal : scannedNalUnits) {
+        if (nal.size == 0 || (nal.data[0] & 0x1f) != H264Parser::NAL_SPS) {
+            continue;
+        }
+        if (nal.size == scannedSpsNal.size() && std::equal(nal.data, nal.data + nal.size, scannedSpsNal.begin())) {
+            return nullptr;
+        }
+        scannedSpsNal.assign(nal.data, nal.data + nal.size);
+        return H264ParameterSets::parseSps(nal.data, nal.size, *scannedSps) ? nullptr : scannedSps.get();
+    }
+    return nullptr;
+}
+
+bool VideoTranscoder::needsNewOutput(const H264SequenceParameterSet& sps) const {
+    // No session follows a new chroma format or bit depth; checkSequenceParameterSet
+    // rejects those.
+    if (sps.std.chroma_format_idc != chromaFormatIdc || sps.std.bit_depth_luma_minus8 + 8 != sourceBitDepth) {
+        return false;
+    }
+    const VideoTrackSize& track = muxer->getTrackSize();
+    return static_cast<int>(sps.displayWidth) != track.getPictureWidth() ||
+           static_cast<int>(sps.displayHeight) != track.getPictureHeight() ||
+           sps.codedWidth > maxCodedExtent.width || sps.codedHeight > maxCodedExtent.height ||
+           sps.std.max_num_ref_frames > decodeActiveReferences;
+}
+
+// Without --max-size the output track is declared for the input's size and the sessions
+// are created for it, so a change would fail the job. Instead the frames before the IDR
+// finish the current file and the rest of the input goes to out.1.mp4, out.2.mp4 and so
+// on. Checkpoints name one output file, so checkpointed jobs still need --max-size.
+void VideoTranscoder::startNewOutput(const H264SequenceParameterSet& sps, int frameNumber) {
+    std::string size = std::to_string(sps.displayWidth) + "x" + std::to_string(sps.displayHeight);
+    if (checkpointIntervalTicks > 0 || resuming) {
+        throw std::runtime_error("Frame " + std::to_string(frameNumber) + " changes the picture size to " + size +
+                                 "; checkpointed output stays in one file, so set --max-size to follow it.");
+    }
+    releaseDisplayOrder(true);
+    while (!lookaheadQueue.empty()) {
+        encodeFrame();
+    }
+    retireFrames(0);
+    writeReadyPackets(true);
+    muxer->finish();
+    muxer.reset();
+
+    std::string path = outputFilePath(outputPath, progress.outputFiles++);
+    VT_LOG_INFO("Output: Frame " << frameNumber << " changes the picture size to " << size << ", continuing in " << path);
+    openMuxer(path, static_cast<int>(sps.displayWidth), static_cast<int>(sps.displayHeight), FragmentedOutput{});
+
+    VkExtent2D extent{ static_cast<uint32_t>(VideoCapabilityUtils::alignUp(sps.codedWidth, pictureGranularity.width)),
+                       static_cast<uint32_t>(VideoCapabilityUtils::alignUp(sps.codedHeight, pictureGranularity.height)) };
+    if (extent.width > maxCodedExtent.width || extent.height > maxCodedExtent.height ||
+        sps.std.max_num_ref_frames > decodeActiveReferences) {
+        recreateVideoSessions(extent, sps.std.max_num_ref_frames);
+    }
+}
+
+// The pipeline is empty, so nothing refers to the old sessions or buffers. The sessions
+// keep the larger of the old and new limits, so switching back needs no new ones.
+void VideoTranscoder::recreateVideoSessions(VkExtent2D extent, uint32_t refFrames) {
+    maxCodedExtent.width = std::max(maxCodedExtent.width, extent.width);
+    maxCodedExtent.height = std::max(maxCodedExtent.height, extent.height);
+    VideoCapabilityUtils::validateExtent(decodeCaps, maxCodedExtent, "Input resolution exceeds decoder limits");
+    VideoCapabilityUtils::validateExtent(encodeCaps, maxCodedExtent, "Input resolution exceeds encoder limits");
+    if (refFrames + 1 > decodeCaps.maxDpbSlots || refFrames > decodeCaps.maxActiveReferencePictures) {
+        throw std::runtime_error("Stream needs " + std::to_string(refFrames) + " reference frames, decoder supports " +
+                                 std::to_string(decodeCaps.maxActiveReferencePictures) + "!");
+    }
+    uint32_t dpbSlots = decodeDpbSlots;
+    decodeDpbSlots = std::max(decodeDpbSlots, refFrames + 1);
+    decodeActiveReferences = std::max(decodeActiveReferences, refFrames);
+
+    vulkanBase->waitIdle();
+    destroyVideoSessions();
+    createDecodeSession();
+    createDecodeParameters();
+    initEncode();
+
+    VkDeviceSize decodeSize = decodeBitstreamBufferSize;
+    VkDeviceSize encodeSize = encodeBitstreamBufferSize;
+    sizeBitstreamBuffers();
+    if (decodeBitstreamBufferSize != decodeSize || encodeBitstreamBufferSize != encodeSize) {
+        destroyBitstreamBuffers();
+        // Packets still holding buffers of the old size free them when they are done.
+        packetPool->resize(encodeBitstreamBufferSize);
+        if (demuxedPayloads) {
+            demuxedPayloads->resize(decodeBitstreamBufferSize);
+        }
+        if (decodeResync) {
+            decodeResync->setBitstreamBufferSize(decodeBitstreamBufferSize);
+        }
+    }
+    if (decodeDpbSlots != dpbSlots) {
+        destroyDpbImages();
+        createDpbImages();
+    }
+    invalidateRecordings();
+    resetDecoder = true;
+
+    // The pipeline keeps its depth; the reservation follows the new costs.
+    PipelineDepth depth;
+    depth.framesInFlight = framesInFlight;
+    depth.lookahead = options.lookahead.depth;
+    depth.picturePoolSize = options.picturePoolSize;
+    depth.picturePoolMaxSize = options.picturePoolMaxSize;
+    MemoryPlan plan;
+    memoryReservation = MemoryReservation();
+    memoryReservation = MemoryBudget::global().reserve(vulkanBase->getDeviceMemoryUsage().budget, getMemoryCosts(),
+                                                       depth, framesInFlight, plan);
+    if (!plan.fits || plan.reduced) {
+        VT_LOG_WARNING("Memory: The pipeline needs more than the budget at " << maxCodedExtent.width << "x"
+                       << maxCodedExtent.height << "; allocations may fail");
+    }
+    VT_LOG_INFO("Resolution: Sessions recreated for up to " << maxCodedExtent.width << "x" << maxCodedExtent.height
+                << ", decode DPB " << decodeDpbSlots << ", bitstream buffers "
+                << MemoryPlanner::formatSize(encodeBitstreamBufferSize));
+}
+
+void VideoTranscoder::uploadFrame(const uint8_t* data, int frameNumber) {
+    // As in decodeFrame, a picture comes free once the oldest encode has been retired.
+    int32_t picture;
+    while ((picture = picturePool->acquire()) < 0) {
+        if (inFlightFrames.empty()) {
+            throw std::runtime_error("Decoded picture pool exhausted with no frames in flight!");
+        }
+        retireFrames(inFlightFrames.size() - 1);
+    }
+    DecodedFrame frame;
+    frame.pictureIndex = static_cast<uint32_t>(picture);
+    frame.frameNumber = frameNumber;
+    frame.decodeTime = std::chrono::steady_clock::now();
+    timestamps->pushPacket(frameNumber, frameNumber, 1);
+
+    frame.readyValue = frameUploader->upload(data, picturePool->get(frame.pictureIndex).image);
+    frame.readyTimeline = &frameUploader->getTimeline();
+    lookaheadQueue.push_back(frame);
+    metrics().lookaheadFrames.add(1);
+}
+
+void VideoTranscoder::encodeFrame() {
+    ScopedMetricTimer timer(metrics().encodeSubmit);
+    // The analysis of the frame being encoded is needed now; later frames join the
+    // window only once their analysis has finished, so the encoder never stalls on them.
+    FrameHint hint;
+    if (lookaheadAnalyzer) {
+        for (size_t i = 0; i < lookaheadQueue.size(); ++i) {
+            DecodedFrame& queued = lookaheadQueue[i];
+            if (queued.analysed) {
+                continue;
+            }
+            if (i == 0) {
+                computeTimeline->wait(queued.analysisValue);
+            } else if (!computeTimeline->isComplete(queued.analysisValue)) {
+                break;
+            }
+            lookaheadAnalyzer->collect(queued.pictureIndex);
+            queued.analysed = true;
+        }
+        hint = lookaheadAnalyzer->nextHint(lookaheadQueue.front().segmentStart);
+    } else {
+        hint.idr = lookaheadQueue.front().frameNumber == 0 || lookaheadQueue.front().segmentStart;
+    }
+    DecodedFrame frame = lookaheadQueue.front();
+    lookaheadQueue.pop_front();
+    metrics().lookaheadFrames.add(-1);
+
+    // Encode slots are reused round-robin, so a full pipeline means the oldest frame owns this slot.
+    retireFrames(framesInFlight - 1);
+    FrameResources& res = frameResources[currentFrame];
+    ensureEncodeSlot(res);
+    res.pictureIndex = frame.pictureIndex;
+    res.frameNumber = frame.frameNumber;
+    res.idr = hint.idr;
+    res.decodeTime = frame.decodeTime;
+    res.encodeTime = std::chrono::steady_clock::now();
+
+    int32_t qp = options.constantQp ? std::clamp(static_cast<int32_t>(options.constantQp) + hint.qpDelta, 1, 51) : 0;
+    if (!options.reuseCommandBuffers || res.recordedPicture != res.pictureIndex ||
+        res.recordedIdr != hint.idr || res.recordedQp != qp) {
+        res.recordedPicture = res.pictureIndex;
+        res.recordedIdr = hint.idr;
+        res.recordedQp = qp;
+        recordEncodeCommandBuffer(currentFrame, hint);
+        ++encodeRecordCount;
+    }
+
+    VkSemaphoreSubmitInfo encodeWait = frame.readyTimeline->submitInfo(frame.readyValue, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR);
+    res.encodeValue = encodeTimeline->nextValue();
+    encodeBatch.add(res.encodeCommandBuffer, &encodeWait,
+        encodeTimeline->submitInfo(res.encodeValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+    if (encodeBatch.size() >= options.submitBatchSize) {
+        flushSubmissions();
+    }
+
+    inFlightFrames.push_back(currentFrame);
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    metrics().framesInFlight.add(1);
+}
+
+VkDeviceSize VideoTranscoder::selectBitstreamRange(size_t packetSize) const {
+    return VideoCapabilityUtils::selectBitstreamRange(packetSize, decodeCaps.minBitstreamBufferSizeAlignment,
+                                                      decodeBitstreamBufferSize,
+                                                      options.reuseCommandBuffers ? MIN_BITSTREAM_RANGE : 0);
+}
+
+void VideoTranscoder::retireFrames(size_t maxInFlight) {
+    while (!inFlightFrames.empty()) {
+        FrameResources& res = frameResources[inFlightFrames.front()];
+        if (!encodeTimeline->isComplete(res.encodeValue)) {
+            if (inFlightFrames.size() <= maxInFlight) {
+                break;
+            }
+            // The frame may still be sitting in a batch; it can only complete once submitted.
+            flushSubmissions();
+            encodeTimeline->wait(res.encodeValue);
+        }
+
+        EncodedPacket encoded;
+        encoded.size = 1024;
+        encoded.buffer = packetPool->getBuffer();
+        memcpy(encoded.buffer.data(), res.pEncodeBitstreamBufferHost, encoded.size);
+        // A reused buffer holds an earlier packet's bytes where the padding goes.
+        memset(encoded.buffer.data() + encoded.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        encoded.idr = res.idr;
+        pendingPackets.push_back(std::move(encoded));
+
+        // Encode completion drops the frame's reference; the picture returns to the pool.
+        picturePool->release(res.pictureIndex);
+        inFlightFrames.pop_front();
+        metrics().framesInFlight.add(-1);
+        metrics().framesEncoded.add();
+        metrics().encodeLatency.observe(secondsSince(res.encodeTime));
+        metrics().frameLatency.observe(secondsSince(res.decodeTime));
+        if (scheduledJob.completeFrame(res.frameNumber)) {
+            ++progress.deadlineMisses;
+        }
+        ++progress.framesEncoded;
+        if (progress.framesEncoded == (resuming ? resumePoint.frameNumber : 0) + 1) {
+            metrics().firstFrame.observe(secondsSince(constructionTime));
+            printStartupPhases();
+        }
+        if (progressCallback) {
+            progress.framesDropped = framesDropped;
+            progress.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            progressCallback(progress);
+        } else {
+            Log::status("Transcoded frame " + std::to_string(res.frameNumber + 1));
+        }
+    }
+}
+
+// Frames are encoded in display order, and timestamps are handed out in presentation
+// order, so each frame gets its own source picture's timestamp. With B-frames a frame's
+// timestamp is only known once the source's reorder delay worth of later packets has
+// been demuxed, which displayQueue has already waited for.
+void VideoTranscoder::writeReadyPackets(bool flush) {
+    while (!pendingPackets.empty() && timestamps->hasFrame(flush)) {
+        FrameTimestamp timestamp = timestamps->popFrame();
+        // The checkpoint goes between the last frame before a segment's IDR and the IDR.
+        if (!segmentBoundaries.empty() &&
+            videoFramesWritten == static_cast<uint64_t>(segmentBoundaries.front().frameNumber)) {
+            writeCheckpoint(segmentBoundaries.front(), timestamp);
+            segmentBoundaries.pop_front();
+        }
+        lastOutputTimestamp = timestamp;
+        EncodedPacket& encoded = pendingPackets.front();
+        muxer->writePacket(encoded.buffer.data(), encoded.size, lastOutputTimestamp, encoded.idr);
+        pendingPackets.pop_front();
+        ++videoFramesWritten;
+    }
+}
+
+void VideoTranscoder::recordDecodeCommandBuffer(uint32_t slotIndex, uint32_t pictureIndex, VkDeviceSize bitstreamSize,
+                                                bool resetSession) {
+    DecodeSlot& slot = decodeSlots[slotIndex];
+    vkResetCommandBuffer(slot.commandBuffer, 0);
 
     VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    vkBeginCommandBuffer(res.decodeCommandBuffer, &beginInfo);
+    vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+    // The decoder overwrites the whole picture, so the previous contents can be discarded;
+    // this also takes the picture back from the encode or compute queue family.
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    uint32_t decodeFamily = qfIndices.decodeFamily.value();
+    BarrierBuilder barriers(imageStates);
+    DecodedPicture& picture = picturePool->get(pictureIndex);
+    barriers.transition(picture.image, ImageAccess::DecodeDst, decodeFamily, true)
+            .record(slot.commandBuffer);
 
     // --- FIX: Bind session parameters and manage DPB ---
     VkVideoBeginCodingInfoKHR beginCodingInfo{VK_STRUCTURE_TYPE_VIDEO_BEGIN_CODING_INFO_KHR};
     beginCodingInfo.videoSession = decodeSession;
     beginCodingInfo.videoSessionParameters = decodeSessionParameters;
     // A real implementation would manage reference slots here.
-    pfn_vkCmdBeginVideoCodingKHR(res.decodeCommandBuffer, &beginCodingInfo);
+    pfn_vkCmdBeginVideoCodingKHR(slot.commandBuffer, &beginCodingInfo);
+
+    // A new session starts in an undefined state, and after lost packets its reference
+    // state is stale; either way decoding restarts from an IDR.
+    if (resetSession) {
+        VkVideoCodingControlInfoKHR controlInfo{VK_STRUCTURE_TYPE_VIDEO_CODING_CONTROL_INFO_KHR};
+        controlInfo.flags = VK_VIDEO_CODING_CONTROL_RESET_BIT_KHR;
+        pfn_vkCmdControlVideoCodingKHR(slot.commandBuffer, &controlInfo);
+    }
 
     VkVideoPictureResourceInfoKHR dstPictureResource{VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR};
-    dstPictureResource.imageViewBinding = res.decodedImageView;
-    dstPictureResource.codedExtent = { (uint32_t)demuxer->getWidth(), (uint32_t)demuxer->getHeight() };
+    dstPictureResource.imageViewBinding = picture.view;
+    dstPictureResource.codedExtent = codedExtent;
 
     // --- FIX: Provide required codec-specific picture info ---
     VkVideoDecodeH264PictureInfoKHR h264PicInfo{VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PICTURE_INFO_KHR};
     // A real implementation would parse this from the bitstream.
     // h264PicInfo.pStdPictureInfo = &some_StdVideoDecodeH264PictureInfo;
+    h264PicInfo.sliceCount = static_cast<uint32_t>(slot.recordedSliceOffsets.size());
+    h264PicInfo.pSliceOffsets = slot.recordedSliceOffsets.data();
 
     VkVideoDecodeInfoKHR decodeInfo{VK_STRUCTURE_TYPE_VIDEO_DECODE_INFO_KHR};
     decodeInfo.pNext = &h264PicInfo; // <-- Chain the picture info
-    decodeInfo.srcBuffer = res.decodeBitstreamBuffer;
+    decodeInfo.srcBuffer = slot.bitstreamBuffer;
     decodeInfo.srcBufferOffset = 0;
     decodeInfo.srcBufferRange = bitstreamSize;
     decodeInfo.dstPictureResource = dstPictureResource;
     // A real implementation needs to set up pSetupReferenceSlot and pReferenceSlots.
 
-    pfn_vkCmdDecodeVideoKHR(res.decodeCommandBuffer, &decodeInfo);
+    pfn_vkCmdDecodeVideoKHR(slot.commandBuffer, &decodeInfo);
 
     VkVideoEndCodingInfoKHR endCodingInfo{VK_STRUCTURE_TYPE_VIDEO_END_CODING_INFO_KHR};
-    pfn_vkCmdEndVideoCodingKHR(res.decodeCommandBuffer, &endCodingInfo);
+    pfn_vkCmdEndVideoCodingKHR(slot.commandBuffer, &endCodingInfo);
+
+    // Hand the picture to its first consumer: the lookahead, the converter or the encoder.
+    if (lookaheadAnalyzer) {
+        barriers.release(picture.image, lookaheadAnalyzer->getSourceAccess(), qfIndices.computeFamily.value());
+    } else if (formatConverter) {
+        barriers.release(picture.image, formatConverter->getSourceAccess(), qfIndices.computeFamily.value());
+    } else {
+        barriers.release(picture.image, ImageAccess::EncodeSrc, qfIndices.encodeFamily.value());
+    }
+    barriers.record(slot.commandBuffer);
 
-    vkEndCommandBuffer(res.decodeCommandBuffer);
+    vkEndCommandBuffer(slot.commandBuffer);
 }
 
-void VideoTranscoder::recordEncodeCommandBuffer(uint32_t frameIndex) {
+void VideoTranscoder::recordEncodeCommandBuffer(uint32_t frameIndex, const FrameHint& hint) {
     FrameResources& res = frameResources[frameIndex];
     vkResetCommandBuffer(res.encodeCommandBuffer, 0);
 
     VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
     vkBeginCommandBuffer(res.encodeCommandBuffer, &beginInfo);
 
-    VulkanUtils::transitionImageLayout(res.encodeCommandBuffer, res.decodedImage,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR);
+    // Acquire the picture from the last stage before the encoder: the uploader, the
+    // converter, the lookahead or the decoder.
+    const auto& qfIndices = vulkanBase->getQueueFamilyIndices();
+    DecodedPicture& picture = picturePool->get(res.pictureIndex);
+    VkImage encodeSourceImage = formatConverter ? picture.encodeInputImage : picture.image;
+    VkImageView encodeSourceView = formatConverter ? picture.encodeInputView : picture.view;
+    QueueAccess handoff{ImageAccess::DecodeDst, qfIndices.decodeFamily.value()};
+    if (frameUploader) {
+        handoff = frameUploader->getHandoff();
+    } else if (formatConverter) {
+        handoff = {formatConverter->getDestinationAccess(), qfIndices.computeFamily.value()};
+    } else if (lookaheadAnalyzer) {
+        handoff = {lookaheadAnalyzer->getSourceAccess(), qfIndices.computeFamily.value()};
+    }
+    BarrierBuilder(imageStates)
+        .acquireFrom(encodeSourceImage, handoff, {ImageAccess::EncodeSrc, qfIndices.encodeFamily.value()})
+        .record(res.encodeCommandBuffer);
 
     VkVideoBeginCodingInfoKHR beginCodingInfo{VK_STRUCTURE_TYPE_VIDEO_BEGIN_CODING_INFO_KHR};
     beginCodingInfo.videoSession = encodeSession;
     beginCodingInfo.videoSessionParameters = encodeSessionParameters;
     pfn_vkCmdBeginVideoCodingKHR(res.encodeCommandBuffer, &beginCodingInfo);
 
+    // An IDR starts a new coded video sequence: reset the session state, and in
+    // constant-QP mode switch the driver's rate control off again.
+    if (hint.idr) {
+        VkVideoEncodeRateControlInfoKHR rateControlInfo{VK_STRUCTURE_TYPE_VIDEO_ENCODE_RATE_CONTROL_INFO_KHR};
+        rateControlInfo.rateControlMode = VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DISABLED_BIT_KHR;
+        VkVideoCodingControlInfoKHR controlInfo{VK_STRUCTURE_TYPE_VIDEO_CODING_CONTROL_INFO_KHR};
+        controlInfo.flags = VK_VIDEO_CODING_CONTROL_RESET_BIT_KHR;
+        if (options.constantQp) {
+            controlInfo.pNext = &rateControlInfo;
+            controlInfo.flags |= VK_VIDEO_CODING_CONTROL_ENCODE_RATE_CONTROL_BIT_KHR;
+        }
+        pfn_vkCmdControlVideoCodingKHR(res.encodeCommandBuffer, &controlInfo);
+    }
+
     VkVideoPictureResourceInfoKHR srcPictureResource{VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR};
-    srcPictureResource.imageViewBinding = res.decodedImageView;
-    srcPictureResource.codedExtent = { (uint32_t)demuxer->getWidth(), (uint32_t)demuxer->getHeight() };
+    srcPictureResource.imageViewBinding = encodeSourceView;
+    srcPictureResource.codedExtent = codedExtent;
+
+    // Frame type from the lookahead: IDR at scene cuts and interval boundaries, P otherwise.
+    StdVideoEncodeH265PictureInfo stdPictureInfo{};
+    stdPictureInfo.flags.is_reference = 1;
+    stdPictureInfo.flags.IrapPicFlag = hint.idr ? 1 : 0;
+    stdPictureInfo.flags.pic_output_flag = 1;
+    stdPictureInfo.pic_type = hint.idr ? STD_VIDEO_H265_PICTURE_TYPE_IDR : STD_VIDEO_H265_PICTURE_TYPE_P;
+    // A real implementation would also set PicOrderCntVal and the reference lists.
+
+    StdVideoEncodeH265SliceSegmentHeader sliceHeader{};
+    sliceHeader.slice_type = hint.idr ? STD_VIDEO_H265_SLICE_TYPE_I : STD_VIDEO_H265_SLICE_TYPE_P;
+
+    VkVideoEncodeH265NaluSliceSegmentInfoKHR sliceInfo{VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_NALU_SLICE_SEGMENT_INFO_KHR};
+    sliceInfo.constantQp = res.recordedQp;
+    sliceInfo.pStdSliceSegmentHeader = &sliceHeader;
 
     VkVideoEncodeH265PictureInfoKHR h265PicInfo{VK_STRUCTURE_TYPE_VIDEO_ENCODE_H265_PICTURE_INFO_KHR};
-    // A real implementation would configure NALU type, etc.
+    h265PicInfo.naluSliceSegmentEntryCount = 1;
+    h265PicInfo.pNaluSliceSegmentEntries = &sliceInfo;
+    h265PicInfo.pStdPictureInfo = &stdPictureInfo;
 
     VkVideoEncodeInfoKHR encodeInfo{VK_STRUCTURE_TYPE_VIDEO_ENCODE_INFO_KHR};
     encodeInfo.pNext = &h265PicInfo;
     encodeInfo.dstBuffer = res.encodeBitstreamBuffer;
-    encodeInfo.dstBufferRange = BITSTREAM_BUFFER_SIZE;
+    encodeInfo.dstBufferRange = encodeBitstreamBufferSize;
     encodeInfo.srcPictureResource = srcPictureResource;
 
     pfn_vkCmdEncodeVideoKHR(res.encodeCommandBuffer, &encodeInfo);
@@ -401,50 +1961,126 @@ void VideoTranscoder::recordEncodeCommandBuffer(uint32_t frameIndex) {
     vkEndCommandBuffer(res.encodeCommandBuffer);
 }
 
-void VideoTranscoder::submitWork(uint32_t frameIndex) {
-    FrameResources& res = frameResources[frameIndex];
-    VkSubmitInfo decodeSubmitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    decodeSubmitInfo.commandBufferCount = 1;
-    decodeSubmitInfo.pCommandBuffers = &res.decodeCommandBuffer;
-    decodeSubmitInfo.signalSemaphoreCount = 1;
-    decodeSubmitInfo.pSignalSemaphores = &res.decodeCompleteSemaphore;
-    vkQueueSubmit(vulkanBase->getDecodeQueue(), 1, &decodeSubmitInfo, VK_NULL_HANDLE);
-
-    VkSubmitInfo encodeSubmitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR };
-    encodeSubmitInfo.waitSemaphoreCount = 1;
-    encodeSubmitInfo.pWaitSemaphores = &res.decodeCompleteSemaphore;
-    encodeSubmitInfo.pWaitDstStageMask = waitStages;
-    encodeSubmitInfo.commandBufferCount = 1;
-    encodeSubmitInfo.pCommandBuffers = &res.encodeCommandBuffer;
-    vkQueueSubmit(vulkanBase->getEncodeQueue(), 1, &encodeSubmitInfo, res.encodeCompleteFence);
+void VideoTranscoder::flushSubmissions() {
+    // Decode first so every encode wait refers to work already on a queue.
+    decodeBatch.submit(vulkanBase, vulkanBase->getDecodeQueue());
+    encodeBatch.submit(vulkanBase, vulkanBase->getEncodeQueue());
 }
 
 void VideoTranscoder::cleanup() {
     VkDevice device = vulkanBase->getDevice();
+    // The compute stages' plane views go before the pool destroys their images.
+    lookaheadAnalyzer.reset();
+    formatConverter.reset();
+    frameUploader.reset();
+    picturePool.reset();
+    decodeTimeline.reset();
+    computeTimeline.reset();
+    encodeTimeline.reset();
+    destroyBitstreamBuffers();
+    vkDestroyCommandPool(device, decodeCommandPool, nullptr);
+    vkDestroyCommandPool(device, encodeCommandPool, nullptr);
+    // Whatever the cache took is left as null handles here.
+    checkInVideoSessions();
+    destroyDpbImages();
+    destroyVideoSessions();
+}
+
+VideoSessionKey VideoTranscoder::getSessionKey() const {
+    VideoSessionKey key;
+    key.decode = demuxer != nullptr;
+    key.decodeProfileIdc = demuxer ? static_cast<uint32_t>(decodeH264Profile.stdProfileIdc) : 0;
+    key.chromaFormatIdc = chromaFormatIdc;
+    key.sourceBitDepth = sourceBitDepth;
+    key.encodeProfileIdc = static_cast<uint32_t>(encodeH265Profile.stdProfileIdc);
+    key.outputBitDepth = outputBitDepth;
+    key.decodePictureFormat = demuxer ? decodePictureFormat : VK_FORMAT_UNDEFINED;
+    key.encodePictureFormat = encodePictureFormat;
+    key.maxCodedExtent = maxCodedExtent;
+    key.decodeDpbSlots = demuxer ? decodeDpbSlots : 0;
+    key.decodeActiveReferences = demuxer ? decodeActiveReferences : 0;
+    key.encodeDpbSlots = encodeDpbSlots;
+    key.encodeActiveReferences = encodeActiveReferences;
+    return key;
+}
+
+bool VideoTranscoder::checkOutVideoSessions() {
+    VideoSessions sessions;
+    if (!sessionCache || !sessionCache->checkOut(getSessionKey(), sessions)) {
+        return false;
+    }
+    decodeSession = sessions.decodeSession;
+    decodeSessionMemory = std::move(sessions.decodeSessionMemory);
+    encodeSession = sessions.encodeSession;
+    encodeSessionMemory = std::move(sessions.encodeSessionMemory);
+    decodeDpbImage = sessions.decodeDpbImage;
+    decodeDpbImageMemory = sessions.decodeDpbImageMemory;
+    encodeDpbImage = sessions.encodeDpbImage;
+    encodeDpbImageMemory = sessions.encodeDpbImageMemory;
+    // The sessions take any extent up to the key's; the DPBs only the one they have.
+    bool dpbFits = sessions.dpbExtent.width == allocatedExtent.width && sessions.dpbExtent.height == allocatedExtent.height;
+    if (!dpbFits) {
+        destroyDpbImages();
+    }
+    VT_LOG_INFO("Video sessions" << (dpbFits ? " and DPBs" : "") << " reused from an earlier job.");
+    return true;
+}
+
+// The sessions' state is not carried over: the next job's first decode resets the
+// decode session and its first IDR the encode session.
+void VideoTranscoder::checkInVideoSessions() {
+    if (!sessionCache || encodeSession == VK_NULL_HANDLE || encodeDpbImage == VK_NULL_HANDLE ||
+        (demuxer && (decodeSession == VK_NULL_HANDLE || decodeDpbImage == VK_NULL_HANDLE))) {
+        return;
+    }
+    VideoSessions sessions;
+    sessions.decodeSession = decodeSession;
+    sessions.decodeSessionMemory = std::move(decodeSessionMemory);
+    sessions.encodeSession = encodeSession;
+    sessions.encodeSessionMemory = std::move(encodeSessionMemory);
+    sessions.dpbExtent = allocatedExtent;
+    sessions.decodeDpbImage = decodeDpbImage;
+    sessions.decodeDpbImageMemory = decodeDpbImageMemory;
+    sessions.encodeDpbImage = encodeDpbImage;
+    sessions.encodeDpbImageMemory = encodeDpbImageMemory;
+    sessionCache->checkIn(getSessionKey(), std::move(sessions));
+    decodeSession = VK_NULL_HANDLE;
+    decodeSessionMemory.clear();
+    encodeSession = VK_NULL_HANDLE;
+    encodeSessionMemory.clear();
+    decodeDpbImage = VK_NULL_HANDLE;
+    decodeDpbImageMemory = VK_NULL_HANDLE;
+    encodeDpbImage = VK_NULL_HANDLE;
+    encodeDpbImageMemory = VK_NULL_HANDLE;
+}
+
+void VideoTranscoder::destroyBitstreamBuffers() {
+    VkDevice device = vulkanBase->getDevice();
+    for (auto& slot : decodeSlots) {
+        if (slot.pBitstreamBufferHost) vkUnmapMemory(device, slot.bitstreamBufferMemory);
+        vkDestroyBuffer(device, slot.bitstreamBuffer, nullptr);
+        vkFreeMemory(device, slot.bitstreamBufferMemory, nullptr);
+        slot.bitstreamBuffer = VK_NULL_HANDLE;
+        slot.bitstreamBufferMemory = VK_NULL_HANDLE;
+        slot.pBitstreamBufferHost = nullptr;
+    }
     for (auto& res : frameResources) {
-        vkDestroyFence(device, res.encodeCompleteFence, nullptr);
-        vkDestroySemaphore(device, res.decodeCompleteSemaphore, nullptr);
-        vkUnmapMemory(device, res.decodeBitstreamBufferMemory);
-        vkDestroyBuffer(device, res.decodeBitstreamBuffer, nullptr);
-        vkFreeMemory(device, res.decodeBitstreamBufferMemory, nullptr);
-        vkUnmapMemory(device, res.encodeBitstreamBufferMemory);
+        if (res.pEncodeBitstreamBufferHost) vkUnmapMemory(device, res.encodeBitstreamBufferMemory);
         vkDestroyBuffer(device, res.encodeBitstreamBuffer, nullptr);
         vkFreeMemory(device, res.encodeBitstreamBufferMemory, nullptr);
-        vkDestroyImageView(device, res.decodedImageView, nullptr);
-        vkDestroyImage(device, res.decodedImage, nullptr);
-        vkFreeMemory(device, res.decodedImageMemory, nullptr);
+        res.encodeBitstreamBuffer = VK_NULL_HANDLE;
+        res.encodeBitstreamBufferMemory = VK_NULL_HANDLE;
+        res.pEncodeBitstreamBufferHost = nullptr;
     }
+}
 
-    vkDestroyImage(device, decodeDpbImage, nullptr);
-    vkFreeMemory(device, decodeDpbImageMemory, nullptr);
-    vkDestroyImage(device, encodeDpbImage, nullptr);
-    vkFreeMemory(device, encodeDpbImageMemory, nullptr);
-    vkDestroyCommandPool(device, decodeCommandPool, nullptr);
-    vkDestroyCommandPool(device, encodeCommandPool, nullptr);
-
+void VideoTranscoder::destroyVideoSessions() {
+    VkDevice device = vulkanBase->getDevice();
     if (pfn_vkDestroyVideoSessionParametersKHR) {
         if (decodeSessionParameters) pfn_vkDestroyVideoSessionParametersKHR(device, decodeSessionParameters, nullptr);
+        for (const auto& retired : retiredDecodeParameters) {
+            pfn_vkDestroyVideoSessionParametersKHR(device, retired.first, nullptr);
+        }
         if (encodeSessionParameters) pfn_vkDestroyVideoSessionParametersKHR(device, encodeSessionParameters, nullptr);
     }
 
@@ -455,5 +2091,12 @@ void VideoTranscoder::cleanup() {
 
     for(auto& mem : decodeSessionMemory) vkFreeMemory(device, mem, nullptr);
     for(auto& mem : encodeSessionMemory) vkFreeMemory(device, mem, nullptr);
+    decodeSessionParameters = VK_NULL_HANDLE;
+    retiredDecodeParameters.clear();
+    encodeSessionParameters = VK_NULL_HANDLE;
+    decodeSession = VK_NULL_HANDLE;
+    encodeSession = VK_NULL_HANDLE;
+    decodeSessionMemory.clear();
+    encodeSessionMemory.clear();
 }
 
@@ -3,6 +3,30 @@
 #include "VulkanBase.hpp"
 #include "H264Demuxer.hpp"
 #include "H265Muxer.hpp"
+#include "FormatConverter.hpp"
+#include "LookaheadAnalyzer.hpp"
+#include "TimelineSemaphore.hpp"
+#include "SubmitBatch.hpp"
+#include "BarrierBuilder.hpp"
+#include "DecodedPicturePool.hpp"
+#include "TimestampTracker.hpp"
+#include "PictureAssembler.hpp"
+#include "PictureOrderCounter.hpp"
+#include "DisplayOrderQueue.hpp"
+#include "H264ParameterSets.hpp"
+#include "ThumbnailExtractor.hpp"
+#include "Checkpoint.hpp"
+#include "RawVideoReader.hpp"
+#include "FrameUploader.hpp"
+#include "MemoryPlanner.hpp"
+#include "SubmitScheduler.hpp"
+#include "TaskPool.hpp"
+#include "FramePipeline.hpp"
+#include "PacketPool.hpp"
+#include "PacketRing.hpp"
+#include "RingQueue.hpp"
+#include "DecodeResync.hpp"
+#include "VideoSessionCache.hpp"
 
 #include <vulkan/vulkan.h>
 #include "/usr/include/vk_video/vulkan_video_codec_h264std_decode.h"
@@ -11,48 +35,336 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <chrono>
 
 
+// A decode slot: the bitstream buffer and command buffer for one decode submission.
+// Slots are reused round-robin once the decode timeline passes their value.
+// Created on first use, so short clips only allocate the slots they reach.
+struct DecodeSlot {
+    VkBuffer bitstreamBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory bitstreamBufferMemory = VK_NULL_HANDLE;
+    void* pBitstreamBufferHost = nullptr;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    uint64_t decodeValue = 0;
+    // What the cached command buffer was recorded for.
+    uint32_t recordedPicture = UINT32_MAX;
+    VkDeviceSize recordedBitstreamRange = 0;
+    bool recordedReset = false;
+    // Which decode session parameters object it binds; handles of destroyed objects can be reused.
+    uint32_t recordedParametersGeneration = 0;
+    // The slice offset table is read when recording, so it is part of the recording.
+    std::vector<uint32_t> recordedSliceOffsets;
+};
+
+// A decoded or uploaded picture waiting in the display order or lookahead queue for its encode.
+struct DecodedFrame {
+    uint32_t pictureIndex = 0;
+    int frameNumber = 0;
+    // The timeline point the encoder waits for: the decode or upload, or the last
+    // compute stage (analysis or conversion) when there is one.
+    uint64_t readyValue = 0;
+    const TimelineSemaphore* readyTimeline = nullptr;
+    // Analysis point on the compute timeline, and whether its result has been collected.
+    uint64_t analysisValue = 0;
+    bool analysed = false;
+    // Encoded as an IDR: the first frame of a segment after a checkpoint, of a resume,
+    // or of a new resolution.
+    bool segmentStart = false;
+    // When the decode was queued, for the end-to-end latency metric.
+    std::chrono::steady_clock::time_point decodeTime;
+};
+
+// An encode slot: one frame from encode submission until its packet is written.
+// Created on first use like the decode slots.
 struct FrameResources {
-    VkBuffer decodeBitstreamBuffer;
-    VkDeviceMemory decodeBitstreamBufferMemory;
-    void* pDecodeBitstreamBufferHost;
-    VkImage decodedImage;
-    VkDeviceMemory decodedImageMemory;
-    VkImageView decodedImageView;
-    VkBuffer encodeBitstreamBuffer;
-    VkDeviceMemory encodeBitstreamBufferMemory;
-    void* pEncodeBitstreamBufferHost;
-    VkCommandBuffer decodeCommandBuffer;
-    VkCommandBuffer encodeCommandBuffer;
-    VkFence encodeCompleteFence;
-    VkSemaphore decodeCompleteSemaphore;
+    VkBuffer encodeBitstreamBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory encodeBitstreamBufferMemory = VK_NULL_HANDLE;
+    void* pEncodeBitstreamBufferHost = nullptr;
+    VkCommandBuffer encodeCommandBuffer = VK_NULL_HANDLE;
+    // The decoded picture this frame holds a reference to until its encode completes.
+    uint32_t pictureIndex = 0;
+    // The slot is free for reuse once the encode timeline reaches encodeValue.
+    uint64_t encodeValue = 0;
+    int frameNumber = 0;
+    // What the cached command buffer was recorded for: the picture and the frame type
+    // and QP decided by the lookahead. Everything else is per-frame data in buffers.
+    uint32_t recordedPicture = UINT32_MAX;
+    bool recordedIdr = false;
+    int32_t recordedQp = 0;
+    bool idr = false;
+    // When the frame's decode and encode were queued, for latency metrics.
+    std::chrono::steady_clock::time_point decodeTime;
+    std::chrono::steady_clock::time_point encodeTime;
+};
+
+// A packet's picture as the parse stage packed it into its decode slot, for the submit
+// stage that follows it. The slices point into the packet, which is gone by then.
+struct AssembledPicture {
+    VkDeviceSize bitstreamSize = 0;
+    VkExtent2D extent{};
+    bool idr = false;
+    int32_t picOrderCnt = 0;
+};
+
+// A source IDR at which the output starts a new fragment, with a checkpoint before it.
+struct SegmentBoundary {
+    int frameNumber = 0;
+    uint64_t videoPacketIndex = 0;
+    int64_t pts = 0;
+    int64_t dts = 0;
+};
+
+// User-selectable behaviour for a transcode job.
+struct TranscodeOptions {
+    // Converts 10-bit sources to 8-bit Main profile output instead of Main10.
+    DownconvertMode downconvert = DownconvertMode::None;
+    // Reuses each slot's recorded command buffers instead of re-recording every frame.
+    bool reuseCommandBuffers = true;
+    // Frames collected per vkQueueSubmit2 call. Downconvert jobs always submit per frame.
+    uint32_t submitBatchSize = 1;
+    // Decoded pictures allocated up front (0 = one per in-flight frame) and the
+    // limit the pool may grow to when pictures are held longer, e.g. by lookahead.
+    uint32_t picturePoolSize = 0;
+    uint32_t picturePoolMaxSize = 16;
+    // Frame analysis ahead of the encoder for IDR placement and QP hints.
+    LookaheadOptions lookahead;
+    // Constant QP (1-51) with rate control disabled; 0 leaves rate control to the driver.
+    // QP hints from the lookahead are only applied in this mode.
+    uint32_t constantQp = 0;
+    // Copies the source's audio, subtitle and data streams into the output.
+    bool passthrough = true;
+    // Skips damaged video packets, and the frames depending on them up to the next IDR,
+    // instead of failing. The job still fails after maxDecodeErrors damaged packets
+    // (0 = no limit). Without it, packets go to the decoder unchecked.
+    bool resilientDecode = false;
+    uint32_t maxDecodeErrors = 0;
+    // Testing aid: damages every Nth video packet on the CPU before it is checked (0 = off).
+    uint32_t injectCorruptionInterval = 0;
+    // Seconds of source video between checkpoints (0 = off). The output is written as
+    // fragmented MP4, and at the first source IDR after each interval a checkpoint is
+    // saved next to it. A completed transcode removes its checkpoint.
+    uint32_t checkpointIntervalSeconds = 0;
+    // Continues from the output's checkpoint if there is one, with the same options.
+    bool resume = false;
+    // Thumbnails from the source's IDR frames, decoded on the CPU in the same pass.
+    ThumbnailOptions thumbnails;
+    // Largest picture size the video sessions are created for (0 = the input's initial
+    // size). Resolution changes at an IDR up to this size are handled in the same job;
+    // larger ones fail it. The output track is declared at this size with in-band
+    // parameter sets; without it, a size change starts a new output file.
+    uint32_t maxWidth = 0;
+    uint32_t maxHeight = 0;
+    // Reads the input as headerless raw frames of this layout and only encodes them.
+    // Inputs named *.y4m are read as raw frames without it.
+    RawVideoOptions rawInput;
+    // Live deadline or batch weight against other transcodes sharing the device.
+    SchedulingOptions scheduling;
+};
+
+// Progress of a running transcode, reported as frames are retired.
+struct TranscodeProgress {
+    uint64_t framesEncoded = 0;
+    uint64_t totalFrames = 0; // Estimated from the container; 0 if unknown.
+    uint64_t framesDropped = 0; // Skipped by a resilient decode.
+    uint64_t deadlineMisses = 0; // Live jobs: frames encoded after their deadline.
+    uint32_t outputFiles = 1; // More after resolution changes without --max-size.
+    double elapsedSeconds = 0.0;
+};
+
+// Wall time of one step of setting up a transcode.
+struct StartupPhase {
+    std::string name;
+    double milliseconds = 0.0;
 };
 
-class VideoTranscoder {
+class VideoTranscoder : private FrameStages {
 public:
-    VideoTranscoder(VulkanBase* vulkanBase, const std::string& inPath, const std::string& outPath);
+    // Opens an H.264 input, or raw input (see TranscodeOptions::rawInput) for an
+    // encode-only job. With a sessionCache, the video sessions and DPBs are taken from
+    // it when an earlier job left matching ones, and given back to it at the end.
+    VideoTranscoder(VulkanBase* vulkanBase, const std::string& inPath, const std::string& outPath,
+                    const TranscodeOptions& options = TranscodeOptions{}, VideoSessionCache* sessionCache = nullptr);
+    // Takes a demuxer that is already open, e.g. one probed while the device was created.
+    VideoTranscoder(VulkanBase* vulkanBase, std::unique_ptr<H264Demuxer> demuxer, const std::string& outPath,
+                    const TranscodeOptions& options = TranscodeOptions{});
     ~VideoTranscoder();
     void run();
 
+    // Called after every encoded frame, from the task pool for demuxed input; calls never
+    // overlap. Replaces the console progress line; set before run().
+    void setProgressCallback(std::function<void(const TranscodeProgress&)> callback) { progressCallback = std::move(callback); }
+
+    // Stops reading input; run() drains the frames in flight and returns. The output is
+    // a valid file with the frames encoded so far. May be called from any thread.
+    void cancel() { cancelRequested = true; }
+    bool isCancelled() const { return cancelRequested; }
+
+    DecodeErrorStats getDecodeErrorStats() const { return decodeResync ? decodeResync->getStats() : DecodeErrorStats(); }
+
 private:
     VulkanBase* vulkanBase = nullptr;
+    VideoSessionCache* sessionCache = nullptr;
     std::unique_ptr<H264Demuxer> demuxer;
+    // Raw input and its upload path; set instead of the demuxer for encode-only jobs.
+    std::unique_ptr<RawVideoReader> rawReader;
+    std::unique_ptr<FrameUploader> frameUploader;
     std::unique_ptr<H265Muxer> muxer;
+    std::string outputPath;
+    // Source packet timestamps, handed to encoded frames in presentation order.
+    std::unique_ptr<TimestampTracker> timestamps;
+    // Packs each packet's slices into the decode bitstream buffer.
+    std::unique_ptr<PictureAssembler> pictureAssembler;
+    // Decoded pictures are put back into display order before the lookahead, since the
+    // encoder codes them in the order it gets them.
+    PictureOrderCounter pictureOrder;
+    DisplayOrderQueue<DecodedFrame> displayQueue;
+    std::unique_ptr<ThumbnailExtractor> thumbnailExtractor;
+    // References to the keyframes queued for the extractor.
+    std::unique_ptr<PacketRing> thumbnailPackets;
+    // Runs the extractor's work in packet order on the shared task pool.
+    TaskStrand thumbnailStrand{TaskPool::global()};
+    // Payload buffers of the encoded packets, returned once the muxer has written them.
+    // Declared before the queues holding them, which must go first.
+    std::unique_ptr<PacketPool> packetPool;
+    // Copies of the demuxed video payloads, returned once parsed.
+    std::unique_ptr<PacketPool> demuxedPayloads;
+    // Encoded frames waiting for the source's reorder window to settle their timestamps.
+    RingQueue<EncodedPacket> pendingPackets;
+    // Output stream index of each input stream that is copied, -1 for the others.
+    std::vector<int> passthroughStreams;
+    TranscodeOptions options;
 
     VkVideoSessionKHR decodeSession = VK_NULL_HANDLE;
     VkVideoSessionParametersKHR decodeSessionParameters = VK_NULL_HANDLE;
+    // The stream's SPS and PPS, and which of them decodeSessionParameters holds.
+    std::unique_ptr<H264ParameterSets> parameterSets;
+    // The last SPS an IDR packet carried, kept to tell a changed SPS from a resent one
+    // before the picture is assembled; see scanNewSps.
+    std::vector<uint8_t> scannedSpsNal;
+    std::unique_ptr<H264SequenceParameterSet> scannedSps;
+    std::vector<H264NalUnit> scannedNalUnits;
+    // Counts the parameters objects created, and the updates applied to the current one.
+    uint32_t decodeParametersGeneration = 0;
+    uint32_t decodeParametersUpdateCount = 0;
+    uint32_t decodeParametersUpdates = 0;
+    uint32_t decodeParametersRecreations = 0;
+    // Replaced parameters objects with the last decode value that may use them.
+    std::deque<std::pair<VkVideoSessionParametersKHR, uint64_t>> retiredDecodeParameters;
     VkVideoSessionKHR encodeSession = VK_NULL_HANDLE;
     VkVideoSessionParametersKHR encodeSessionParameters = VK_NULL_HANDLE;
 
     // --- FIX: Add missing member variable declarations ---
     VkVideoProfileInfoKHR decodeProfile{};
     VkVideoProfileInfoKHR encodeProfile{};
+    // Codec-specific profile structs chained into the profiles above; they are members
+    // because the profiles are referenced again when creating images and buffers.
+    VkVideoDecodeH264ProfileInfoKHR decodeH264Profile{};
+    VkVideoEncodeH265ProfileInfoKHR encodeH265Profile{};
+
+    // Picture formats derived from the SPS bit depth/chroma format and the device's
+    // supported video formats. They differ only when downconverting.
+    uint32_t chromaFormatIdc = 1;
+    uint32_t sourceBitDepth = 8;
+    uint32_t outputBitDepth = 8;
+    VkFormat decodePictureFormat = VK_FORMAT_UNDEFINED;
+    VkFormat encodePictureFormat = VK_FORMAT_UNDEFINED;
+    std::unique_ptr<FormatConverter> formatConverter;
+    std::unique_ptr<LookaheadAnalyzer> lookaheadAnalyzer;
+    // Totals of the analyzers replaced at resolution changes.
+    LookaheadStats replacedLookaheadStats;
+
+    // Limits negotiated with the device for both profiles. Sessions, DPBs and
+    // bitstream buffers are sized from these rather than from fixed constants.
+    VideoProfileCapabilities decodeCaps;
+    VideoProfileCapabilities encodeCaps;
+    // The coded extent of the current pictures, the extent the DPBs and pool pictures
+    // were allocated for, and the largest one the sessions were created for. Pictures
+    // only shrink into the allocation; it grows when a resolution change needs more.
+    VkExtent2D codedExtent{};
+    VkExtent2D allocatedExtent{};
+    VkExtent2D maxCodedExtent{};
+    // Alignment of coded extents that both sessions can access.
+    VkExtent2D pictureGranularity{};
+    uint32_t resolutionChanges = 0;
+    uint32_t resolutionReallocations = 0;
+    uint32_t decodeDpbSlots = 0;
+    uint32_t decodeActiveReferences = 0;
+    uint32_t encodeDpbSlots = 0;
+    uint32_t encodeActiveReferences = 0;
+    VkDeviceSize decodeBitstreamBufferSize = 0;
+    VkDeviceSize encodeBitstreamBufferSize = 0;
     std::vector<VkDeviceMemory> decodeSessionMemory;
     std::vector<VkDeviceMemory> encodeSessionMemory;
 
+    // Layout and queue family ownership of every picture, in recording order.
+    ImageStateTracker imageStates;
+    std::unique_ptr<DecodedPicturePool> picturePool;
+    std::vector<DecodeSlot> decodeSlots;
+    uint32_t currentDecodeSlot = 0;
+    // The next decode resets the session: the first one, and the IDR after a damaged packet.
+    bool resetDecoder = true;
+    // Screens video packets when decoding resiliently or injecting damage.
+    std::unique_ptr<DecodeResync> decodeResync;
+    // Read by the transcode thread only.
+    uint64_t videoPacketCount = 0;
+    // decodeResync's dropped frames, for the progress the stages report.
+    std::atomic<uint64_t> framesDropped{0};
+    // Megapixels of the current pictures, each frame's cost to the scheduler. The stages
+    // change it at a resolution change while the transcode thread admits frames.
+    std::atomic<double> frameMegapixels{0.0};
+    AssembledPicture assembled;
+
+    // Checkpointing: the file, the interval in input time base units, and the source IDRs
+    // waiting for the output to reach them. Frames are written in display order, but
+    // every frame before an IDR in decode order is also displayed before it, so when the
+    // IDR is next to be muxed videoFramesWritten equals its decode index.
+    std::string checkpointPath;
+    int64_t checkpointIntervalTicks = 0;
+    bool haveSegmentStart = false;
+    int64_t lastSegmentPts = 0;
+    std::deque<SegmentBoundary> segmentBoundaries;
+    uint64_t videoFramesWritten = 0;
+    FrameTimestamp lastOutputTimestamp;
+    uint32_t checkpointCount = 0;
+    // Where a resumed transcode continues; the source is skipped up to its IDR.
+    bool resuming = false;
+    TranscodeCheckpoint resumePoint;
+    // Decoded frames not yet submitted for encode, in display order: demuxed frames have
+    // been through displayQueue, uploaded ones are read in display order.
+    RingQueue<DecodedFrame> lookaheadQueue;
     std::vector<FrameResources> frameResources;
     uint32_t currentFrame = 0;
+    // Decode and encode slots, as many as the memory plan allows.
+    uint32_t framesInFlight = 0;
+    // The memory plan's share of the process budget, held until the transcoder is gone.
+    MemoryReservation memoryReservation;
+    // Orders this transcode's frames against the others' while it runs.
+    ScheduledJob scheduledJob;
+    // Frame slots submitted but not yet written to the muxer, oldest first.
+    RingQueue<uint32_t> inFlightFrames;
+
+    // One timeline per queue; each submission signals the next value.
+    std::unique_ptr<TimelineSemaphore> decodeTimeline;
+    std::unique_ptr<TimelineSemaphore> computeTimeline;
+    std::unique_ptr<TimelineSemaphore> encodeTimeline;
+    SubmitBatch decodeBatch;
+    SubmitBatch encodeBatch;
+
+    // CPU cost of preparing and submitting frames, reported at the end of the run.
+    double cpuSubmitMicroseconds = 0.0;
+    std::function<void(const TranscodeProgress&)> progressCallback;
+    std::atomic<bool> cancelRequested{false};
+    TranscodeProgress progress;
+    std::chrono::steady_clock::time_point startTime;
+    // Set-up steps, printed with the time to the first encoded frame when that is retired.
+    std::vector<StartupPhase> startupPhases;
+    std::chrono::steady_clock::time_point constructionTime;
+    uint32_t decodeRecordCount = 0;
+    uint32_t encodeRecordCount = 0;
     VkImage decodeDpbImage = VK_NULL_HANDLE;
     VkDeviceMemory decodeDpbImageMemory = VK_NULL_HANDLE;
     std::vector<VkImageView> decodeDpbImageViews;
@@ -70,25 +382,127 @@ private:
     PFN_vkDestroyVideoSessionKHR pfn_vkDestroyVideoSessionKHR;
     PFN_vkCreateVideoSessionParametersKHR pfn_vkCreateVideoSessionParametersKHR;
     PFN_vkDestroyVideoSessionParametersKHR pfn_vkDestroyVideoSessionParametersKHR;
+    PFN_vkUpdateVideoSessionParametersKHR pfn_vkUpdateVideoSessionParametersKHR;
     PFN_vkCmdBeginVideoCodingKHR pfn_vkCmdBeginVideoCodingKHR;
     PFN_vkCmdEndVideoCodingKHR pfn_vkCmdEndVideoCodingKHR;
     PFN_vkCmdDecodeVideoKHR pfn_vkCmdDecodeVideoKHR;
     PFN_vkCmdEncodeVideoKHR pfn_vkCmdEncodeVideoKHR;
+    PFN_vkCmdControlVideoCodingKHR pfn_vkCmdControlVideoCodingKHR;
 
+    // Shared by both constructors once the demuxer is open.
+    void validateOptions() const;
+    void setup(const std::string& outPath, std::chrono::steady_clock::time_point phaseStart);
+    void setupEncodeOnly(const std::string& outPath, std::chrono::steady_clock::time_point phaseStart);
     void loadVideoFunctionPointers();
-    void init();
+    void init(std::chrono::steady_clock::time_point& phaseStart);
+    void negotiateCapabilities();
+    void planMemory();
+    // What the pipeline's device memory costs at the current session limits.
+    MemoryCosts getMemoryCosts() const;
+    // Sizes the bitstream buffers for the largest picture the sessions take.
+    void sizeBitstreamBuffers();
     void initDecode();
+    void createDecodeSession();
+    // Creates decodeSessionParameters holding every active parameter set.
+    void createDecodeParameters();
+    // Adds the parameter sets the last packet changed to the decode session parameters,
+    // or replaces the parameters object when an update cannot add them.
+    void updateDecodeParameters();
+    // Throws if the decode session cannot decode pictures of the SPS.
+    void checkSequenceParameterSet(const H264SequenceParameterSet& sps) const;
+    // The PPS the picture last assembled refers to; throws if it has not been seen.
+    const H264PictureParameterSet& getAssembledPps() const;
+    // The coded extent of the picture last assembled, from the SPS its PPS refers to.
+    VkExtent2D getAssembledPictureExtent() const;
+    // Moves the decoded frames whose display order is settled to the lookahead queue;
+    // with flush, all of them.
+    void releaseDisplayOrder(bool flush);
+    // Finishes every frame in the pipeline, then switches to the coded extent of an IDR,
+    // reallocating the pictures and DPBs only if they are too small for it.
+    void changeResolution(VkExtent2D extent);
+    // Drops every cached command buffer; they name a destroyed picture, session or extent.
+    void invalidateRecordings();
+    // Opens an output file for pictures of width x height, with the passthrough streams.
+    void openMuxer(const std::string& path, int width, int height, const FragmentedOutput& fragmented);
+    // The SPS an IDR packet carries if it differs from the last one scanned, else nullptr.
+    const H264SequenceParameterSet* scanNewSps(const AVPacket* packet);
+    // True when neither the output track nor the sessions can follow the SPS, but a new
+    // output file with new sessions can.
+    bool needsNewOutput(const H264SequenceParameterSet& sps) const;
+    // Finishes the output file before the current IDR and continues in the next one.
+    void startNewOutput(const H264SequenceParameterSet& sps, int frameNumber);
+    // Recreates the sessions for coded pictures up to extent with refFrames references.
+    void recreateVideoSessions(VkExtent2D extent, uint32_t refFrames);
+    void destroyVideoSessions();
+    // What the sessions are created for, once the capabilities are negotiated.
+    VideoSessionKey getSessionKey() const;
+    // Takes matching sessions and DPBs from the session cache; returns false if it has none.
+    bool checkOutVideoSessions();
+    // Gives the sessions and DPBs to the session cache, if there is one.
+    void checkInVideoSessions();
     void initEncode();
+    void createEncodeSession();
     // --- FIX: Add missing function declaration ---
     void bindVideoSessionMemory(VkVideoSessionKHR session, std::vector<VkDeviceMemory>& memory);
+    // Picks the preferred picture format if the device reports it, otherwise the first supported one.
+    VkFormat selectPictureFormat(const std::vector<VkFormat>& supported, VkFormat preferred);
     void createFrameResources();
+    void ensureDecodeSlot(DecodeSlot& slot);
+    void ensureEncodeSlot(FrameResources& res);
+    // Appends the time since phaseStart as a startup phase and restarts the clock.
+    void endStartupPhase(const char* name, std::chrono::steady_clock::time_point& phaseStart);
+    void printStartupPhases() const;
+    void printSchedulingStats() const;
+    void printPacketPoolStats() const;
+    void createPicturePool();
+    void createPicture(DecodedPicture& picture);
+    void destroyPicture(DecodedPicture& picture);
+    // Records the lookahead and conversion command buffers for a pool picture.
+    void bindComputeStages(DecodedPicture& picture);
+    // Creates the lookahead and the converter for the current coded extent.
+    void createComputeStages();
     void createDpbImages();
+    void destroyDpbImages();
+    // Bitstream buffers are created again by ensureDecodeSlot and ensureEncodeSlot.
+    void destroyBitstreamBuffers();
     void createCommandPools();
     void cleanup();
 
+    // Demuxes, screens and admits the packets, and leaves their stages to a FramePipeline.
     void transcodeLoop();
-    void recordDecodeCommandBuffer(uint32_t frameIndex, VkDeviceSize bitstreamSize);
-    void recordEncodeCommandBuffer(uint32_t frameIndex);
-    void submitWork(uint32_t frameIndex);
+    void encodeLoop();
+    // The stages of a demuxed packet, run in order on the task pool. parse packs the
+    // packet into its decode slot and reads its headers, submit decodes it into a pool
+    // picture with its analysis and conversion and encodes what the lookahead lets go,
+    // readback collects the finished encodes and mux writes them out.
+    void parse(FrameJob& job) override;
+    void submit(FrameJob& job) override;
+    void readback(FrameJob& job) override;
+    void mux(FrameJob& job) override;
+    void passthrough(FrameJob& job) override;
+    // Passes a video packet through decodeResync and returns whether it is decoded.
+    bool admitPacket(AVPacket* packet, FrameJob& job);
+    // Uploads a raw frame into a pool picture and appends it to the lookahead queue.
+    void uploadFrame(const uint8_t* data, int frameNumber);
+    void injectCorruption(AVPacket* packet);
+    // Loads the output's checkpoint for --resume and sets up the muxer to append.
+    void loadCheckpoint(const std::string& outPath, FragmentedOutput& fragmented);
+    // True for a source IDR at least the checkpoint interval after the last segment start.
+    bool startsSegment(const AVPacket* packet);
+    // Closes the output fragment before the boundary's IDR, which is muxed next with
+    // idrTimestamp, and saves the checkpoint.
+    void writeCheckpoint(const SegmentBoundary& boundary, const FrameTimestamp& idrTimestamp);
+    // Encodes the oldest frame in the lookahead queue with the analyzer's hint.
+    void encodeFrame();
+    void recordDecodeCommandBuffer(uint32_t slotIndex, uint32_t pictureIndex, VkDeviceSize bitstreamSize, bool resetSession);
+    void recordEncodeCommandBuffer(uint32_t frameIndex, const FrameHint& hint);
+    void flushSubmissions();
+    // Rounds an assembled picture size up to the decode range used for the cached command buffers.
+    VkDeviceSize selectBitstreamRange(size_t packetSize) const;
+    // Moves every in-flight frame whose encode has completed to pendingPackets, then
+    // blocks until at most maxInFlight frames remain.
+    void retireFrames(size_t maxInFlight);
+    // Hands encoded frames to the muxer once their timestamps are known.
+    void writeReadyPackets(bool flush);
 };
 
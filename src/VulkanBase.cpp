@@ -1,6 +1,7 @@
 #include "VulkanBase.hpp"
+#include "Metrics.hpp"
+#include "Log.hpp"
 #include <stdexcept>
-#include <iostream>
 #include <vector>
 #include <set>
 
@@ -12,6 +13,9 @@ VulkanBase::VulkanBase() {}
 
 // Destructor: Cleans up all Vulkan resources in the reverse order of creation.
 VulkanBase::~VulkanBase() {
+    if (metricsCollectorId) {
+        MetricsRegistry::global().removeCollector(metricsCollectorId);
+    }
     if (device != VK_NULL_HANDLE) {
         vkDeviceWaitIdle(device);
         vkDestroyDevice(device, nullptr);
@@ -21,11 +25,59 @@ VulkanBase::~VulkanBase() {
     }
 }
 
+// Submits work to a queue while no other thread uses the queues.
+VkResult VulkanBase::queueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* submits) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueueSubmit2(queue, submitCount, submits, VK_NULL_HANDLE);
+}
+
+// Waits for the device while no other thread submits; this covers every job's work.
+void VulkanBase::waitIdle() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    vkDeviceWaitIdle(device);
+}
+
 // Main initialization function that calls the setup steps in order.
 void VulkanBase::initVulkan() {
     createInstance();
     pickPhysicalDevice();
+    videoCapabilities = std::make_unique<VideoCapabilityCache>(instance, physicalDevice);
     createLogicalDevice();
+
+    MetricsRegistry& registry = MetricsRegistry::global();
+    MetricGauge& usageGauge = registry.gauge("transcoder_device_memory_usage_bytes",
+                                             "Device-local memory in use by this process (VK_EXT_memory_budget).");
+    MetricGauge& budgetGauge = registry.gauge("transcoder_device_memory_budget_bytes",
+                                              "Device-local memory this process can use.");
+    metricsCollectorId = registry.addCollector([this, &usageGauge, &budgetGauge] {
+        DeviceMemoryUsage memory = getDeviceMemoryUsage();
+        usageGauge.set(static_cast<int64_t>(memory.usage));
+        budgetGauge.set(static_cast<int64_t>(memory.budget));
+    });
+}
+
+DeviceMemoryUsage VulkanBase::getDeviceMemoryUsage() const {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+    VkPhysicalDeviceMemoryProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+    if (memoryBudgetSupported) {
+        properties.pNext = &budgetProperties;
+    }
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+    DeviceMemoryUsage result;
+    const VkPhysicalDeviceMemoryProperties& memory = properties.memoryProperties;
+    for (uint32_t i = 0; i < memory.memoryHeapCount; ++i) {
+        if (!(memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            continue;
+        }
+        if (memoryBudgetSupported) {
+            result.usage += budgetProperties.heapUsage[i];
+            result.budget += budgetProperties.heapBudget[i];
+        } else {
+            result.budget += memory.memoryHeaps[i].size;
+        }
+    }
+    return result;
 }
 
 // Creates the Vulkan instance.
@@ -58,7 +110,7 @@ void VulkanBase::createInstance() {
     if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create Vulkan instance!");
     }
-    std::cout << "Vulkan instance created." << std::endl;
+    VT_LOG_INFO("Vulkan instance created.");
 }
 
 // --- MODIFIED: This function now prioritizes NVIDIA discrete GPUs ---
@@ -71,8 +123,7 @@ void VulkanBase::pickPhysicalDevice() {
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    std::cout << "\n--- Finding a Suitable GPU ---" << std::endl;
-    std::cout << "Found " << deviceCount << " device(s)." << std::endl;
+    VT_LOG_DEBUG("Found " << deviceCount << " device(s).");
 
     VkPhysicalDevice candidate = VK_NULL_HANDLE;
 
@@ -99,14 +150,12 @@ void VulkanBase::pickPhysicalDevice() {
     }
 
     if (physicalDevice == VK_NULL_HANDLE) {
-        std::cout << "\n--------------------------------" << std::endl;
         throw std::runtime_error("Failed to find a suitable GPU!");
     }
 
     VkPhysicalDeviceProperties props;
     vkGetPhysicalDeviceProperties(physicalDevice, &props);
-    std::cout << "\nSuccessfully selected Physical Device: " << props.deviceName << std::endl;
-    std::cout << "--------------------------------\n" << std::endl;
+    VT_LOG_INFO("Selected Physical Device: " << props.deviceName);
 }
 
 
@@ -119,6 +168,12 @@ void VulkanBase::createLogicalDevice() {
         queueFamilyIndices.decodeFamily.value(),
         queueFamilyIndices.encodeFamily.value()
     };
+    if (queueFamilyIndices.computeFamily.has_value()) {
+        uniqueQueueFamilies.insert(queueFamilyIndices.computeFamily.value());
+    }
+    if (queueFamilyIndices.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(queueFamilyIndices.transferFamily.value());
+    }
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -130,17 +185,36 @@ void VulkanBase::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // Timeline semaphores carry per-frame completion values across the decode,
+    // compute and encode queues instead of per-frame fences and binary semaphores.
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+
     VkPhysicalDeviceSynchronization2Features syncFeatures{};
     syncFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
     syncFeatures.synchronization2 = VK_TRUE;
+    syncFeatures.pNext = &timelineFeatures;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pNext = &syncFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // Memory budget queries are optional; they feed the device memory metrics.
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& extension : availableExtensions) {
+        if (std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            memoryBudgetSupported = true;
+        }
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create logical device!");
@@ -148,38 +222,29 @@ void VulkanBase::createLogicalDevice() {
 
     vkGetDeviceQueue(device, queueFamilyIndices.decodeFamily.value(), 0, &decodeQueue);
     vkGetDeviceQueue(device, queueFamilyIndices.encodeFamily.value(), 0, &encodeQueue);
-    std::cout << "Logical device and queues created." << std::endl;
+    if (queueFamilyIndices.computeFamily.has_value()) {
+        vkGetDeviceQueue(device, queueFamilyIndices.computeFamily.value(), 0, &computeQueue);
+    }
+    if (queueFamilyIndices.transferFamily.has_value()) {
+        vkGetDeviceQueue(device, queueFamilyIndices.transferFamily.value(), 0, &transferQueue);
+    }
+    VT_LOG_INFO("Logical device and queues created.");
 }
 
 bool VulkanBase::isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceProperties props;
     vkGetPhysicalDeviceProperties(device, &props);
-    std::cout << "\n[INFO] Checking device: " << props.deviceName << std::endl;
-
-    std::cout << "  - Checking for queue families..." << std::endl;
+    // Only failures are itemised; a suitable device gets a single line.
+    VT_LOG_DEBUG("[INFO] Checking device: " << props.deviceName);
     QueueFamilyIndices indices = findQueueFamilies(device);
-    bool queuesFound = indices.isComplete();
-    if (indices.decodeFamily.has_value()) {
-        std::cout << "    [PASS] Video Decode Queue Family found at index " << indices.decodeFamily.value() << std::endl;
-    } else {
-        std::cout << "    [FAIL] Video Decode Queue Family NOT found." << std::endl;
+    if (!indices.decodeFamily.has_value()) {
+        VT_LOG_INFO("    [FAIL] Video Decode Queue Family NOT found.");
     }
-    if (indices.encodeFamily.has_value()) {
-        std::cout << "    [PASS] Video Encode Queue Family found at index " << indices.encodeFamily.value() << std::endl;
-    } else {
-        std::cout << "    [FAIL] Video Encode Queue Family NOT found." << std::endl;
+    if (!indices.encodeFamily.has_value()) {
+        VT_LOG_INFO("    [FAIL] Video Encode Queue Family NOT found.");
     }
-
-    std::cout << "  - Checking for required device extensions..." << std::endl;
     bool extensionsSupported = checkDeviceExtensionSupport(device);
-
-    if (queuesFound && extensionsSupported) {
-        std::cout << "[INFO] >>> This device IS suitable! <<<" << std::endl;
-        return true;
-    } else {
-        std::cout << "[INFO] >>> This device is NOT suitable. <<<" << std::endl;
-        return false;
-    }
+    return indices.isComplete() && extensionsSupported;
 }
 
 QueueFamilyIndices VulkanBase::findQueueFamilies(VkPhysicalDevice device) {
@@ -207,6 +272,29 @@ QueueFamilyIndices VulkanBase::findQueueFamilies(VkPhysicalDevice device) {
                 indices.encodeFamily = i;
             }
         }
+        // Prefer an async compute family so conversion work does not queue behind graphics.
+        VkQueueFlags flags = queueFamilyProperties[i].queueFamilyProperties.queueFlags;
+        if (flags & VK_QUEUE_COMPUTE_BIT) {
+            bool haveAsyncCompute = indices.computeFamily.has_value() &&
+                !(queueFamilyProperties[indices.computeFamily.value()].queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+            if (!indices.computeFamily.has_value() || (!haveAsyncCompute && !(flags & VK_QUEUE_GRAPHICS_BIT))) {
+                indices.computeFamily = i;
+            }
+        }
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !indices.transferFamily.has_value() &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_VIDEO_DECODE_BIT_KHR | VK_QUEUE_VIDEO_ENCODE_BIT_KHR))) {
+            indices.transferFamily = i;
+        }
+    }
+    // Without a dedicated transfer family, uploads share a queue that can copy. Compute
+    // families always can, even when they do not report the transfer bit.
+    if (!indices.transferFamily.has_value()) {
+        if (indices.encodeFamily.has_value() &&
+            (queueFamilyProperties[indices.encodeFamily.value()].queueFamilyProperties.queueFlags & VK_QUEUE_TRANSFER_BIT)) {
+            indices.transferFamily = indices.encodeFamily;
+        } else {
+            indices.transferFamily = indices.computeFamily;
+        }
     }
     return indices;
 }
@@ -224,13 +312,10 @@ bool VulkanBase::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 
     bool allFound = true;
     for (const char* requiredExt : deviceExtensions) {
-        if (available.count(requiredExt)) {
-            std::cout << "    [Found] " << requiredExt << std::endl;
-        } else {
-            std::cout << "    [Missing] " << requiredExt << std::endl;
+        if (!available.count(requiredExt)) {
+            VT_LOG_INFO("    [Missing] " << requiredExt);
             allFound = false;
         }
     }
     return allFound;
 }
-
@@ -1,15 +1,24 @@
 #pragma once
 
+#include "VideoCapabilities.hpp"
+
 #include <vulkan/vulkan.h>
 #include <vector>
 #include <optional>
 #include <string>
+#include <memory>
+#include <mutex>
 
 // A structure to hold the indices of the queue families we need.
 // We need separate families for video decoding and encoding.
 struct QueueFamilyIndices {
     std::optional<uint32_t> decodeFamily;
     std::optional<uint32_t> encodeFamily;
+    // Optional: used for format conversion and frame analysis shaders.
+    std::optional<uint32_t> computeFamily;
+    // Uploads of raw input: a transfer-only family (a DMA engine) if the device has one,
+    // otherwise the encode family if it supports transfers, otherwise the compute family.
+    std::optional<uint32_t> transferFamily;
 
     // Helper function to check if we have found all required families.
     bool isComplete() const {
@@ -17,6 +26,13 @@ struct QueueFamilyIndices {
     }
 };
 
+// Device-local memory in use by this process and the amount it can use, summed over
+// the device-local heaps.
+struct DeviceMemoryUsage {
+    VkDeviceSize usage = 0;
+    VkDeviceSize budget = 0;
+};
+
 // This class handles the boilerplate setup for a Vulkan application.
 // It initializes the instance, selects a physical device, creates a logical device,
 // and retrieves the necessary queue handles.
@@ -35,8 +51,27 @@ public:
     VkDevice getDevice() const { return device; }
     VkQueue getDecodeQueue() const { return decodeQueue; }
     VkQueue getEncodeQueue() const { return encodeQueue; }
+    VkQueue getComputeQueue() const { return computeQueue; }
+    // The queue of the transfer family; the encode or compute queue when it is that family.
+    VkQueue getTransferQueue() const { return transferQueue; }
     const QueueFamilyIndices& getQueueFamilyIndices() const { return queueFamilyIndices; }
 
+    // Returns the negotiated limits and formats for a video profile on the selected device.
+    // Results are cached per profile and persisted on disk across runs.
+    const VideoProfileCapabilities& getVideoCapabilities(const VkVideoProfileInfoKHR& profile) {
+        return videoCapabilities->get(profile);
+    }
+
+    // vkQueueSubmit2 and vkDeviceWaitIdle, serialised so several transcoders can share
+    // the device and its queues from different threads.
+    VkResult queueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* submits);
+    void waitIdle();
+
+    // Reads the device-local memory usage and budget from VK_EXT_memory_budget. Without
+    // the extension, usage is 0 and the budget is the total heap size.
+    DeviceMemoryUsage getDeviceMemoryUsage() const;
+    bool hasMemoryBudget() const { return memoryBudgetSupported; }
+
 private:
     // --- Core Vulkan Handles ---
     VkInstance instance = VK_NULL_HANDLE;
@@ -44,7 +79,15 @@ private:
     VkDevice device = VK_NULL_HANDLE;
     VkQueue decodeQueue = VK_NULL_HANDLE;
     VkQueue encodeQueue = VK_NULL_HANDLE;
+    VkQueue computeQueue = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
     QueueFamilyIndices queueFamilyIndices;
+    std::unique_ptr<VideoCapabilityCache> videoCapabilities;
+    // Queues are externally synchronised objects; one lock covers all of them.
+    std::mutex queueMutex;
+    bool memoryBudgetSupported = false;
+    // Samples the device memory gauges for metrics exports.
+    uint64_t metricsCollectorId = 0;
 
     // --- Private Helper Methods for Initialization ---
 
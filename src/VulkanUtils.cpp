@@ -1,5 +1,6 @@
 #include "VulkanUtils.hpp"
 #include <stdexcept>
+#include <string>
 
 namespace VulkanUtils {
 
@@ -18,10 +19,11 @@ namespace VulkanUtils {
 
     void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size,
                       VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                      VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+                      VkBuffer& buffer, VkDeviceMemory& bufferMemory, const void* pNext) {
 
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = pNext;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -47,10 +49,13 @@ namespace VulkanUtils {
 
     void createImage(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t width, uint32_t height,
                      VkFormat format, VkImageUsageFlags usage,
-                     VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers) {
+                     VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers, const void* pNext,
+                     VkImageCreateFlags flags) {
 
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.pNext = pNext;
+        imageInfo.flags = flags;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
         imageInfo.extent.width = width;
         imageInfo.extent.height = height;
@@ -103,35 +108,77 @@ namespace VulkanUtils {
         return imageView;
     }
 
-    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
-                               VkImageLayout oldLayout, VkImageLayout newLayout) {
-        VkImageMemoryBarrier2 imageBarrier{};
-        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-        imageBarrier.oldLayout = oldLayout;
-        imageBarrier.newLayout = newLayout;
-        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        imageBarrier.image = image;
-        imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        imageBarrier.subresourceRange.baseMipLevel = 0;
-        imageBarrier.subresourceRange.levelCount = 1;
-        imageBarrier.subresourceRange.baseArrayLayer = 0;
-        imageBarrier.subresourceRange.layerCount = 1;
-
-        // Set appropriate stage and access masks based on layouts
-        // This is a simplified version. A robust implementation would need to
-        // be more specific based on the exact transition.
-        imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-        imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
-        imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-        imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
-
-        VkDependencyInfo dependencyInfo{};
-        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-        dependencyInfo.imageMemoryBarrierCount = 1;
-        dependencyInfo.pImageMemoryBarriers = &imageBarrier;
-
-        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    VkImageView createPlaneImageView(VkDevice device, VkImage image, VkFormat planeFormat,
+                                     VkImageAspectFlagBits planeAspect, VkImageUsageFlags usage) {
+        // Restrict the view usage; the parent image also carries video usages that
+        // the single-plane format does not support.
+        VkImageViewUsageCreateInfo usageInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO};
+        usageInfo.usage = usage;
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.pNext = &usageInfo;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = planeFormat;
+        viewInfo.subresourceRange.aspectMask = planeAspect;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image plane view!");
+        }
+
+        return imageView;
+    }
+
+    VkFormat getPictureFormat(uint32_t chromaFormatIdc, uint32_t bitDepth) {
+        if (bitDepth == 8) {
+            switch (chromaFormatIdc) {
+                case 1: return VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+                case 2: return VK_FORMAT_G8_B8R8_2PLANE_422_UNORM;
+                case 3: return VK_FORMAT_G8_B8R8_2PLANE_444_UNORM;
+                default: break;
+            }
+        } else if (bitDepth == 10) {
+            switch (chromaFormatIdc) {
+                case 1: return VK_FORMAT_G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16;
+                case 2: return VK_FORMAT_G10X6_B10X6R10X6_2PLANE_422_UNORM_3PACK16;
+                case 3: return VK_FORMAT_G10X6_B10X6R10X6_2PLANE_444_UNORM_3PACK16;
+                default: break;
+            }
+        } else if (bitDepth == 12) {
+            switch (chromaFormatIdc) {
+                case 1: return VK_FORMAT_G12X4_B12X4R12X4_2PLANE_420_UNORM_3PACK16;
+                case 2: return VK_FORMAT_G12X4_B12X4R12X4_2PLANE_422_UNORM_3PACK16;
+                case 3: return VK_FORMAT_G12X4_B12X4R12X4_2PLANE_444_UNORM_3PACK16;
+                default: break;
+            }
+        }
+        throw std::runtime_error("Unsupported picture format: chroma_format_idc " + std::to_string(chromaFormatIdc) +
+                                 ", " + std::to_string(bitDepth) + "-bit");
+    }
+
+    VkVideoComponentBitDepthFlagBitsKHR getComponentBitDepth(uint32_t bitDepth) {
+        switch (bitDepth) {
+            case 8: return VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
+            case 10: return VK_VIDEO_COMPONENT_BIT_DEPTH_10_BIT_KHR;
+            case 12: return VK_VIDEO_COMPONENT_BIT_DEPTH_12_BIT_KHR;
+            default: throw std::runtime_error("Unsupported video bit depth: " + std::to_string(bitDepth));
+        }
+    }
+
+    VkVideoChromaSubsamplingFlagBitsKHR getChromaSubsampling(uint32_t chromaFormatIdc) {
+        switch (chromaFormatIdc) {
+            case 0: return VK_VIDEO_CHROMA_SUBSAMPLING_MONOCHROME_BIT_KHR;
+            case 1: return VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
+            case 2: return VK_VIDEO_CHROMA_SUBSAMPLING_422_BIT_KHR;
+            case 3: return VK_VIDEO_CHROMA_SUBSAMPLING_444_BIT_KHR;
+            default: throw std::runtime_error("Unsupported chroma_format_idc: " + std::to_string(chromaFormatIdc));
+        }
     }
 
 } // namespace VulkanUtils
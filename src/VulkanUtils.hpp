@@ -21,14 +21,30 @@ namespace VulkanUtils {
     // FIX: Added pNext parameter to support chaining video profiles.
     void createImage(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t width, uint32_t height,
                      VkFormat format, VkImageUsageFlags usage,
-                     VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1, const void* pNext = nullptr);
+                     VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1, const void* pNext = nullptr,
+                     VkImageCreateFlags flags = 0);
 
     // Creates a VkImageView for a given VkImage.
     VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, uint32_t arrayLayers = 1);
 
-    // Records a command to transition the layout of an image.
-    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
-                               VkImageLayout oldLayout, VkImageLayout newLayout);
+    // Creates a single-plane view of a multi-planar image, e.g. an R16_UINT view of the
+    // luma plane of a P010 picture. The image must have been created with MUTABLE_FORMAT
+    // and EXTENDED_USAGE so the plane can be reinterpreted with the given usage.
+    VkImageView createPlaneImageView(VkDevice device, VkImage image, VkFormat planeFormat,
+                                     VkImageAspectFlagBits planeAspect, VkImageUsageFlags usage);
+
+    // --- Video Picture Format Helpers ---
+
+    // Returns the multi-planar picture format for a chroma_format_idc and bit depth,
+    // e.g. NV12 for 8-bit 4:2:0 and P010 (G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16) for 10-bit 4:2:0.
+    // Throws for combinations that have no matching Vulkan format.
+    VkFormat getPictureFormat(uint32_t chromaFormatIdc, uint32_t bitDepth);
+
+    // Maps a bit depth to the Vulkan video component bit depth flag.
+    VkVideoComponentBitDepthFlagBitsKHR getComponentBitDepth(uint32_t bitDepth);
+
+    // Maps a chroma_format_idc to the Vulkan video chroma subsampling flag.
+    VkVideoChromaSubsamplingFlagBitsKHR getChromaSubsampling(uint32_t chromaFormatIdc);
 
 } // namespace VulkanUtils
 
@@ -1,46 +1,456 @@
 #include "VulkanBase.hpp"
 #include "VideoTranscoder.hpp"
+#include "TranscodeDaemon.hpp"
+#include "MetricsExporter.hpp"
+#include "QualityVerifier.hpp"
+#include "MemoryPlanner.hpp"
+#include "TaskPool.hpp"
+#include "Log.hpp"
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include <cstdint>
+
+// Parses the numeric value of a "--name=N" option. Returns false if it is not a number.
+static bool parseCountOption(const std::string& arg, size_t valueOffset, uint32_t& value) {
+    try {
+        size_t end = 0;
+        unsigned long parsed = std::stoul(arg.substr(valueOffset), &end);
+        if (end != arg.size() - valueOffset || parsed > UINT32_MAX) {
+            return false;
+        }
+        value = static_cast<uint32_t>(parsed);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Compares the transcode against its source on the CPU. Returns the exit code.
+static int verifyOutput(const std::string& inputPath, const std::string& outputPath,
+                        const VerifyOptions& verifyOptions, double minPsnr) {
+    QualityVerifier verifier(inputPath, outputPath, verifyOptions);
+    QualityReport report = verifier.run();
+    QualityVerifier::printReport(report);
+    if (!report.isComplete()) {
+        return EXIT_FAILURE;
+    }
+    if (report.globalPsnr < minPsnr) {
+        VT_LOG_ERROR("Verify: PSNR " << report.globalPsnr << " dB is below the required " << minPsnr << " dB");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Writes thumbnails from the input's IDR frames on the CPU. Returns the exit code.
+static int extractThumbnails(const std::string& inputPath, const ThumbnailOptions& thumbnailOptions) {
+    H264Demuxer demuxer(inputPath);
+    ThumbnailExtractor extractor(demuxer, thumbnailOptions);
+    extractor.run(demuxer);
+    extractor.printStats();
+    return extractor.getStats().thumbnails > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 // The main entry point for the Vulkan Transcoder application.
 int main(int argc, char* argv[]) {
     // --- Argument Parsing ---
-    // The application expects two command-line arguments:
-    // 1. The path to the input H.264 video file.
+    // The application expects two positional arguments:
+    // 1. The path to the input H.264 video file, or to raw Y4M or YUV frames.
     // 2. The path for the output H.265 video file.
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input_file.mp4> <output_file.mp4>" << std::endl;
+    // Options may appear anywhere on the command line.
+    TranscodeOptions options;
+    DaemonOptions daemonOptions;
+    bool cachedSessionsSet = false;
+    std::string clientSocketPath;
+    uint32_t metricsPort = 0;
+    std::string metricsFilePath;
+    uint32_t metricsIntervalMs = 1000;
+    bool verify = false;
+    bool verifyOnly = false;
+    VerifyOptions verifyOptions;
+    double verifyMinPsnr = 0.0;
+    bool thumbnailsOnly = false;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--downconvert-8bit" || arg == "--downconvert-8bit=auto") {
+            options.downconvert = DownconvertMode::Auto;
+        } else if (arg == "--downconvert-8bit=gpu") {
+            options.downconvert = DownconvertMode::Gpu;
+        } else if (arg == "--downconvert-8bit=cpu") {
+            options.downconvert = DownconvertMode::Cpu;
+        } else if (arg == "--no-passthrough") {
+            options.passthrough = false;
+        } else if (arg == "--no-command-reuse") {
+            options.reuseCommandBuffers = false;
+        } else if (arg.rfind("--submit-batch=", 0) == 0) {
+            if (!parseCountOption(arg, 15, options.submitBatchSize)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--picture-pool=", 0) == 0) {
+            if (!parseCountOption(arg, 15, options.picturePoolSize)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--picture-pool-max=", 0) == 0) {
+            if (!parseCountOption(arg, 19, options.picturePoolMaxSize)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--lookahead=", 0) == 0) {
+            if (!parseCountOption(arg, 12, options.lookahead.depth)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--cqp=", 0) == 0) {
+            if (!parseCountOption(arg, 6, options.constantQp)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--resilient") {
+            options.resilientDecode = true;
+        } else if (arg.rfind("--max-decode-errors=", 0) == 0) {
+            if (!parseCountOption(arg, 20, options.maxDecodeErrors)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.resilientDecode = true;
+        } else if (arg.rfind("--inject-corruption=", 0) == 0) {
+            if (!parseCountOption(arg, 20, options.injectCorruptionInterval)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--checkpoint=", 0) == 0) {
+            if (!parseCountOption(arg, 13, options.checkpointIntervalSeconds) || options.checkpointIntervalSeconds == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg.rfind("--daemon=", 0) == 0) {
+            daemonOptions.socketPath = arg.substr(9);
+        } else if (arg.rfind("--daemon-jobs=", 0) == 0) {
+            if (!parseCountOption(arg, 14, daemonOptions.maxConcurrentJobs) || daemonOptions.maxConcurrentJobs == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--daemon-cached-sessions=", 0) == 0) {
+            if (!parseCountOption(arg, 25, daemonOptions.cachedSessions)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            cachedSessionsSet = true;
+        } else if (arg.rfind("--metrics-port=", 0) == 0) {
+            if (!parseCountOption(arg, 15, metricsPort) || metricsPort == 0 || metricsPort > UINT16_MAX) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--metrics-file=", 0) == 0) {
+            metricsFilePath = arg.substr(15);
+        } else if (arg.rfind("--metrics-interval=", 0) == 0) {
+            if (!parseCountOption(arg, 19, metricsIntervalMs) || metricsIntervalMs == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--memory-budget=", 0) == 0) {
+            uint32_t megabytes = 0;
+            if (!parseCountOption(arg, 16, megabytes) || megabytes == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            MemoryBudget::global().setLimit(static_cast<uint64_t>(megabytes) << 20);
+        } else if (arg.rfind("--deadline=", 0) == 0) {
+            if (!parseCountOption(arg, 11, options.scheduling.deadlineMs) || options.scheduling.deadlineMs == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--weight=", 0) == 0) {
+            if (!parseCountOption(arg, 9, options.scheduling.weight) || options.scheduling.weight == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--cpu-threads=", 0) == 0) {
+            uint32_t threads = 0;
+            if (!parseCountOption(arg, 14, threads)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            TaskPool::setGlobalThreadCount(threads);
+        } else if (arg.rfind("--log-level=", 0) == 0) {
+            LogLevel level;
+            if (!Log::parseLevel(arg.substr(12), level)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            Log::setLevel(level);
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--verify-only") {
+            verifyOnly = true;
+        } else if (arg.rfind("--verify-threads=", 0) == 0) {
+            if (!parseCountOption(arg, 17, verifyOptions.threads)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--verify-min-psnr=", 0) == 0) {
+            try {
+                size_t end = 0;
+                verifyMinPsnr = std::stod(arg.substr(18), &end);
+                if (end != arg.size() - 18) {
+                    throw std::invalid_argument(arg);
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            verify = true;
+        } else if (arg.rfind("--thumbnails=", 0) == 0) {
+            options.thumbnails.outputPattern = arg.substr(13);
+        } else if (arg == "--thumbnails-only") {
+            thumbnailsOnly = true;
+        } else if (arg.rfind("--thumbnail-interval=", 0) == 0) {
+            if (!parseCountOption(arg, 21, options.thumbnails.intervalSeconds)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--thumbnail-width=", 0) == 0) {
+            if (!parseCountOption(arg, 18, options.thumbnails.width)) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--sprite=", 0) == 0) {
+            size_t separator = arg.find('x', 9);
+            if (separator == std::string::npos ||
+                !parseCountOption(arg.substr(0, separator), 9, options.thumbnails.spriteColumns) ||
+                !parseCountOption(arg, separator + 1, options.thumbnails.spriteRows) ||
+                options.thumbnails.spriteColumns == 0 || options.thumbnails.spriteRows == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--max-size=", 0) == 0) {
+            size_t separator = arg.find('x', 11);
+            if (separator == std::string::npos ||
+                !parseCountOption(arg.substr(0, separator), 11, options.maxWidth) ||
+                !parseCountOption(arg, separator + 1, options.maxHeight) ||
+                options.maxWidth == 0 || options.maxHeight == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--raw-format=", 0) == 0) {
+            try {
+                options.rawInput.format = RawVideoReader::parsePixelFormat(arg.substr(13));
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--raw-size=", 0) == 0) {
+            size_t separator = arg.find('x', 11);
+            if (separator == std::string::npos ||
+                !parseCountOption(arg.substr(0, separator), 11, options.rawInput.width) ||
+                !parseCountOption(arg, separator + 1, options.rawInput.height) ||
+                options.rawInput.width == 0 || options.rawInput.height == 0) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--raw-rate=", 0) == 0) {
+            size_t separator = arg.find('/', 11);
+            uint32_t num = 0;
+            uint32_t den = 1;
+            if (!parseCountOption(separator == std::string::npos ? arg : arg.substr(0, separator), 11, num) ||
+                (separator != std::string::npos && !parseCountOption(arg, separator + 1, den)) ||
+                num == 0 || den == 0 || num > INT32_MAX || den > INT32_MAX) {
+                std::cerr << "Invalid value: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.rawInput.frameRate = { static_cast<int>(num), static_cast<int>(den) };
+        } else if (arg.rfind("--client=", 0) == 0) {
+            clientSocketPath = arg.substr(9);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return EXIT_FAILURE;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    // Client mode: send one JSON request to a running daemon.
+    if (!clientSocketPath.empty()) {
+        if (positional.size() != 1) {
+            std::cerr << "Usage: " << argv[0] << " --client=<socket> '<json request>'" << std::endl;
+            return EXIT_FAILURE;
+        }
+        try {
+            return TranscodeDaemon::sendRequest(clientSocketPath, positional[0]) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch (const std::exception& e) {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool daemonMode = !daemonOptions.socketPath.empty();
+    size_t expectedPositional = daemonMode ? 0u : (thumbnailsOnly ? 1u : 2u);
+    if (positional.size() != expectedPositional || (daemonMode && (verifyOnly || thumbnailsOnly)) ||
+        (thumbnailsOnly && (verifyOnly || !options.thumbnails.enabled())) ||
+        (options.rawInput.enabled() && (daemonMode || thumbnailsOnly || verifyOnly || verify)) ||
+        (options.rawInput.enabled() != (options.rawInput.width > 0))) {
+        std::cerr << "Usage: " << argv[0] << " [options] <input_file.mp4> <output_file.mp4>\n"
+                  << "       " << argv[0] << " [options] --daemon=<socket> [--daemon-jobs=N]\n"
+                  << "       " << argv[0] << " --client=<socket> '<json request>'\n"
+                  << "       " << argv[0] << " --verify-only [--verify-threads=N] <input_file.mp4> <output_file.mp4>\n"
+                  << "       " << argv[0] << " --thumbnails-only --thumbnails=<pattern> [thumbnail options] <input_file.mp4>\n"
+                  << "Options:\n"
+                  << "  --downconvert-8bit[=auto|gpu|cpu]  Encode 10-bit sources as 8-bit Main profile\n"
+                  << "  --submit-batch=N                   Submit N frames per queue submission (default 1)\n"
+                  << "  --no-passthrough                   Drop audio, subtitle and data streams instead of copying them\n"
+                  << "  --no-command-reuse                 Re-record command buffers for every frame\n"
+                  << "  --picture-pool=N                   Decoded pictures allocated up front (default: one per frame in flight)\n"
+                  << "  --picture-pool-max=N               Limit the decoded picture pool grows to (default 16)\n"
+                  << "  --lookahead=N                      Analyse N frames ahead to place IDRs at scene cuts (default 0)\n"
+                  << "  --cqp=N                            Constant QP 1-51 without rate control (0: off); applies lookahead QP hints\n"
+                  << "  --resilient                        Skip damaged video packets and resume at the next IDR instead of failing\n"
+                  << "  --max-decode-errors=N              Fail after N damaged packets; implies --resilient (default: no limit)\n"
+                  << "  --inject-corruption=N              Testing: damage every Nth video packet before it is checked\n"
+                  << "  --checkpoint=SECONDS               Write fragmented MP4 and save a resume point every SECONDS of input\n"
+                  << "  --resume                           Continue from the output's checkpoint if it has one\n"
+                  << "  --max-size=WxH                     Largest picture size mid-stream resolution changes may switch to\n"
+                  << "                                     (default: none; a change starts a new file, <output>.1.mp4, ...)\n"
+                  << "  --metrics-port=N                   Serve Prometheus metrics on http://127.0.0.1:N/metrics\n"
+                  << "  --metrics-file=<path>              Write metrics as JSON to a file periodically\n"
+                  << "  --metrics-interval=MS              Interval for --metrics-file in milliseconds (default 1000)\n"
+                  << "  --verify                           Decode the output on the CPU and report PSNR and SSIM against the input\n"
+                  << "  --verify-only                      Only compare the two existing files; needs no GPU\n"
+                  << "  --verify-threads=N                 Frames scored in parallel (default: one per hardware thread)\n"
+                  << "  --verify-min-psnr=DB               Fail if the output's PSNR is below DB; implies --verify\n"
+                  << "  --thumbnails=<pattern>             Write JPEG or PNG thumbnails of the input's IDR frames, e.g. thumbs/%04d.jpg\n"
+                  << "  --thumbnails-only                  Only write the thumbnails, reading just the keyframes; needs no GPU\n"
+                  << "  --thumbnail-interval=SECONDS       One thumbnail per SECONDS of video (default 0: every IDR)\n"
+                  << "  --thumbnail-width=N                Thumbnail width; the height keeps the aspect ratio (default 320)\n"
+                  << "  --sprite=COLSxROWS                 Tile the thumbnails into sprite sheets of COLS x ROWS\n"
+                  << "  --raw-format=FORMAT                Read the input as headerless i420, nv12, yuv420p10 or p010 frames and\n"
+                  << "                                     only encode them; needs --raw-size. *.y4m inputs are read this way without it\n"
+                  << "  --raw-size=WxH                     Frame size of headerless raw input\n"
+                  << "  --raw-rate=N[/D]                   Frame rate of headerless raw input (default 25)\n"
+                  << "  --memory-budget=MIB                Device memory all transcodes together may plan to use; pipelines\n"
+                  << "                                     shrink to fit and jobs wait for room (default: the device's budget)\n"
+                  << "  --deadline=MS                      Schedule as a live job: each frame is due MS after it arrives at the\n"
+                  << "                                     source frame rate; batch jobs yield to it on a shared device\n"
+                  << "  --weight=N                         A batch job's share of the device against other batch jobs (default 1)\n"
+                  << "  --cpu-threads=N                    Workers shared by every transcode's CPU stages (default: one per\n"
+                  << "                                     hardware thread)\n"
+                  << "  --log-level=LEVEL                  Print debug, info, warning or error messages and above (default info)\n"
+                  << "  --daemon=<socket>                  Serve transcode jobs on a Unix socket; options above become job defaults\n"
+                  << "  --daemon-jobs=N                    Jobs the daemon runs at the same time (default 1)\n"
+                  << "  --daemon-cached-sessions=N         Finished jobs' video sessions kept for later jobs with the same\n"
+                  << "                                     profile and size (default: --daemon-jobs; 0 disables)\n"
+                  << "  --client=<socket>                  Send a JSON request to a daemon and print the responses" << std::endl;
         return EXIT_FAILURE;
     }
 
-    std::string inputFilePath = argv[1];
-    std::string outputFilePath = argv[2];
+    // Verification alone never touches Vulkan, so it also runs on machines without a GPU.
+    if (verifyOnly) {
+        try {
+            return verifyOutput(positional[0], positional[1], verifyOptions, verifyMinPsnr);
+        } catch (const std::exception& e) {
+            VT_LOG_ERROR("An error occurred: " << e.what());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Thumbnails alone are decoded on the CPU too.
+    if (thumbnailsOnly) {
+        try {
+            return extractThumbnails(positional[0], options.thumbnails);
+        } catch (const std::exception& e) {
+            VT_LOG_ERROR("An error occurred: " << e.what());
+            return EXIT_FAILURE;
+        }
+    }
 
     // --- Application Logic ---
     // All core logic is wrapped in a try-catch block to handle exceptions
     // thrown by the Vulkan and FFmpeg components.
     try {
+        // The input is probed on another thread while the device is created; both take
+        // tens to hundreds of milliseconds and do not depend on each other.
+        auto startupStart = std::chrono::steady_clock::now();
+        std::future<std::unique_ptr<H264Demuxer>> demuxerFuture;
+        double probeMilliseconds = 0.0;
+        // Raw input is only mapped, which takes no time worth overlapping.
+        bool rawInput = !daemonMode && RawVideoReader::isRawInput(positional[0], options.rawInput);
+        if (!daemonMode && !rawInput) {
+            demuxerFuture = std::async(std::launch::async, [&positional, &probeMilliseconds, startupStart] {
+                auto demuxer = std::make_unique<H264Demuxer>(positional[0]);
+                probeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+                return demuxer;
+            });
+        }
+
         // 1. Initialize the core Vulkan components (instance, device, queues).
         VulkanBase vulkanBase;
         vulkanBase.initVulkan();
+        double deviceMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
 
-        // 2. Initialize the main transcoder class, which sets up video sessions
-        //    and all necessary resources.
-        VideoTranscoder transcoder(&vulkanBase, inputFilePath, outputFilePath);
+        // Exporters are destroyed before the device, so the last file snapshot still
+        // sees its memory collector.
+        std::unique_ptr<MetricsHttpServer> metricsServer;
+        std::unique_ptr<MetricsFileWriter> metricsWriter;
+        if (metricsPort != 0) {
+            metricsServer = std::make_unique<MetricsHttpServer>(MetricsRegistry::global(), static_cast<uint16_t>(metricsPort));
+        }
+        if (!metricsFilePath.empty()) {
+            metricsWriter = std::make_unique<MetricsFileWriter>(MetricsRegistry::global(), metricsFilePath,
+                                                                std::chrono::milliseconds(metricsIntervalMs));
+        }
+
+        if (daemonMode) {
+            // The device stays resident; jobs reuse the video sessions of earlier ones.
+            daemonOptions.jobDefaults = options;
+            if (!cachedSessionsSet) {
+                daemonOptions.cachedSessions = daemonOptions.maxConcurrentJobs;
+            }
+            TranscodeDaemon daemon(&vulkanBase, daemonOptions);
+            daemon.run();
+            return EXIT_SUCCESS;
+        }
+        std::string outputFilePath = positional[1];
+        std::unique_ptr<VideoTranscoder> transcoder;
+        if (rawInput) {
+            VT_LOG_INFO("Startup: device " << deviceMilliseconds << " ms");
+            transcoder = std::make_unique<VideoTranscoder>(&vulkanBase, positional[0], outputFilePath, options);
+        } else {
+            std::unique_ptr<H264Demuxer> demuxer = demuxerFuture.get();
+            double wallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+            VT_LOG_INFO("Startup: device " << deviceMilliseconds << " ms and input probe " << probeMilliseconds
+                        << " ms in parallel, " << wallMilliseconds << " ms wall");
+
+            // 2. Initialize the main transcoder class, which sets up video sessions
+            //    and all necessary resources.
+            transcoder = std::make_unique<VideoTranscoder>(&vulkanBase, std::move(demuxer), outputFilePath, options);
+        }
 
         // 3. Start the main transcoding loop.
-        transcoder.run();
+        transcoder->run();
+
+        if (verify) {
+            int result = verifyOutput(positional[0], outputFilePath, verifyOptions, verifyMinPsnr);
+            if (result != EXIT_SUCCESS) {
+                return result;
+            }
+        }
 
     } catch (const std::exception& e) {
         // If any part of the setup or execution fails, print the error and exit.
-        std::cerr << "An error occurred: " << e.what() << std::endl;
+        VT_LOG_ERROR("An error occurred: " << e.what());
         return EXIT_FAILURE;
     }
 
     // If the program completes without exceptions, it was successful.
-    std::cout << "\nApplication finished successfully." << std::endl;
+    VT_LOG_INFO("Application finished successfully.");
     return EXIT_SUCCESS;
 }
 
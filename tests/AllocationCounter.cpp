@@ -0,0 +1,72 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <new>
+
+// glibc's own allocator, which the replacements below forward to.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+}
+
+namespace {
+    std::atomic<uint64_t> allocations{ 0 };
+
+    void* counted(void* pointer) {
+        if (pointer) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pointer;
+    }
+
+    void* newOrThrow(size_t size, size_t alignment) {
+        void* pointer = alignment > alignof(std::max_align_t) ? __libc_memalign(alignment, size ? size : 1)
+                                                              : __libc_malloc(size ? size : 1);
+        if (!pointer) {
+            throw std::bad_alloc();
+        }
+        return counted(pointer);
+    }
+}
+
+uint64_t AllocationCounter::total() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+extern "C" {
+void* malloc(size_t size) { return counted(__libc_malloc(size)); }
+void* calloc(size_t count, size_t size) { return counted(__libc_calloc(count, size)); }
+// Counted even when the block grows in place: the caller asked for memory.
+void* realloc(void* pointer, size_t size) { return size ? counted(__libc_realloc(pointer, size)) : __libc_realloc(pointer, size); }
+void* memalign(size_t alignment, size_t size) { return counted(__libc_memalign(alignment, size)); }
+void* aligned_alloc(size_t alignment, size_t size) { return counted(__libc_memalign(alignment, size)); }
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+    void* allocated = __libc_memalign(alignment, size);
+    if (!allocated) {
+        return ENOMEM;
+    }
+    *pointer = counted(allocated);
+    return 0;
+}
+void free(void* pointer) { __libc_free(pointer); }
+}
+
+void* operator new(size_t size) { return newOrThrow(size, 0); }
+void* operator new[](size_t size) { return newOrThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return newOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return newOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted(__libc_malloc(size ? size : 1)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted(__libc_malloc(size ? size : 1)); }
+void operator delete(void* pointer) noexcept { __libc_free(pointer); }
+void operator delete[](void* pointer) noexcept { __libc_free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { __libc_free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { __libc_free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { __libc_free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { __libc_free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { __libc_free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { __libc_free(pointer); }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts the heap allocations of the whole process, every thread and library included:
+// the test executable that links AllocationCounter.cpp replaces operator new and
+// interposes malloc and its relatives (glibc only). Built with VT_COUNT_ALLOCATIONS.
+namespace AllocationCounter {
+
+    uint64_t total();
+
+} // namespace AllocationCounter
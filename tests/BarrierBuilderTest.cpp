@@ -0,0 +1,196 @@
+#include "TestHarness.hpp"
+#include "BarrierBuilder.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t DECODE_FAMILY = 1;
+    constexpr uint32_t ENCODE_FAMILY = 2;
+
+    // Handles are only used as keys, so any distinct value will do. The cast also
+    // compiles where non-dispatchable handles are 64-bit integers.
+    VkImage fakeImage(uintptr_t id) {
+        return (VkImage)id;
+    }
+}
+
+TEST_CASE(decodeToEncodeOnDifferentFamiliesIsAReleaseAcquirePair) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x10);
+
+    BarrierBuilder decode(tracker);
+    decode.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    decode.release(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK_EQ(decode.getBarriers().size(), 2u);
+    const VkImageMemoryBarrier2& release = decode.getBarriers()[1];
+    CHECK_EQ(release.srcQueueFamilyIndex, DECODE_FAMILY);
+    CHECK_EQ(release.dstQueueFamilyIndex, ENCODE_FAMILY);
+    CHECK_EQ(release.oldLayout, VK_IMAGE_LAYOUT_VIDEO_DECODE_DST_KHR);
+    CHECK_EQ(release.newLayout, VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR);
+    CHECK_EQ(release.srcStageMask, VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR);
+    CHECK_EQ(release.srcAccessMask, VK_ACCESS_2_VIDEO_DECODE_WRITE_BIT_KHR);
+    // The destination half belongs to the acquire.
+    CHECK_EQ(release.dstStageMask, VK_PIPELINE_STAGE_2_NONE);
+    CHECK_EQ(release.dstAccessMask, VK_ACCESS_2_NONE);
+
+    ImageState pending = tracker.getState(image);
+    CHECK(pending.acquirePending);
+    CHECK_EQ(pending.releasedBy, DECODE_FAMILY);
+    CHECK(pending.releasedFrom == ImageAccess::DecodeDst);
+
+    BarrierBuilder encode(tracker);
+    encode.acquire(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK_EQ(encode.getBarriers().size(), 1u);
+    const VkImageMemoryBarrier2& acquire = encode.getBarriers()[0];
+    CHECK_EQ(acquire.srcQueueFamilyIndex, DECODE_FAMILY);
+    CHECK_EQ(acquire.dstQueueFamilyIndex, ENCODE_FAMILY);
+    // The layout transition repeats the release exactly.
+    CHECK_EQ(acquire.oldLayout, release.oldLayout);
+    CHECK_EQ(acquire.newLayout, release.newLayout);
+    CHECK_EQ(acquire.srcStageMask, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR);
+    CHECK_EQ(acquire.srcAccessMask, VK_ACCESS_2_NONE);
+    CHECK_EQ(acquire.dstStageMask, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR);
+    CHECK_EQ(acquire.dstAccessMask, VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR);
+
+    ImageState owned = tracker.getState(image);
+    CHECK(!owned.acquirePending);
+    CHECK_EQ(owned.queueFamily, ENCODE_FAMILY);
+    CHECK(owned.access == ImageAccess::EncodeSrc);
+
+    // Acquiring again, e.g. by a replayed recording, adds nothing.
+    encode.acquire(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK_EQ(encode.getBarriers().size(), 1u);
+}
+
+TEST_CASE(releaseWithinOneFamilyIsATransition) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x20);
+
+    BarrierBuilder builder(tracker);
+    builder.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    builder.release(image, ImageAccess::EncodeSrc, DECODE_FAMILY);
+    CHECK_EQ(builder.getBarriers().size(), 2u);
+    const VkImageMemoryBarrier2& barrier = builder.getBarriers()[1];
+    CHECK_EQ(barrier.srcQueueFamilyIndex, VK_QUEUE_FAMILY_IGNORED);
+    CHECK_EQ(barrier.dstQueueFamilyIndex, VK_QUEUE_FAMILY_IGNORED);
+    CHECK_EQ(barrier.oldLayout, VK_IMAGE_LAYOUT_VIDEO_DECODE_DST_KHR);
+    CHECK_EQ(barrier.newLayout, VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR);
+    CHECK_EQ(barrier.srcStageMask, VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR);
+    CHECK_EQ(barrier.dstStageMask, VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR);
+    CHECK_EQ(barrier.dstAccessMask, VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR);
+
+    ImageState state = tracker.getState(image);
+    CHECK(!state.acquirePending);
+    CHECK_EQ(state.queueFamily, DECODE_FAMILY);
+    CHECK(state.access == ImageAccess::EncodeSrc);
+
+    // Nothing is pending, so the acquire on the same family is a no-op.
+    builder.acquire(image, ImageAccess::EncodeSrc, DECODE_FAMILY);
+    CHECK_EQ(builder.getBarriers().size(), 2u);
+}
+
+TEST_CASE(mismatchedAcquireThrows) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x30);
+    BarrierBuilder builder(tracker);
+
+    CHECK_THROWS(builder.acquire(image, ImageAccess::EncodeSrc, ENCODE_FAMILY), std::logic_error);
+
+    builder.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    builder.release(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK_THROWS(builder.acquire(image, ImageAccess::ComputeRead, ENCODE_FAMILY), std::logic_error);
+    CHECK_THROWS(builder.acquire(image, ImageAccess::EncodeSrc, DECODE_FAMILY), std::logic_error);
+    // Keeping the contents across families needs the acquire, so a plain transition is refused too.
+    CHECK_THROWS(builder.transition(image, ImageAccess::EncodeSrc, ENCODE_FAMILY), std::logic_error);
+    // So is releasing an image whose acquire is still pending.
+    CHECK_THROWS(builder.release(image, ImageAccess::DecodeDst, DECODE_FAMILY), std::logic_error);
+
+    // The failed calls left the pending release intact.
+    builder.acquire(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK(!tracker.getState(image).acquirePending);
+}
+
+TEST_CASE(reuseByAnotherFamilyDiscardsWithoutATransfer) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x40);
+
+    BarrierBuilder encode(tracker);
+    encode.transition(image, ImageAccess::EncodeSrc, ENCODE_FAMILY, true);
+
+    BarrierBuilder decode(tracker);
+    decode.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    CHECK_EQ(decode.getBarriers().size(), 1u);
+    const VkImageMemoryBarrier2& barrier = decode.getBarriers()[0];
+    CHECK_EQ(barrier.oldLayout, VK_IMAGE_LAYOUT_UNDEFINED);
+    CHECK_EQ(barrier.newLayout, VK_IMAGE_LAYOUT_VIDEO_DECODE_DST_KHR);
+    // The semaphore that allowed the reuse orders the encode; the barrier does not wait on it.
+    CHECK_EQ(barrier.srcStageMask, VK_PIPELINE_STAGE_2_NONE);
+    CHECK_EQ(barrier.srcAccessMask, VK_ACCESS_2_NONE);
+    CHECK_EQ(barrier.srcQueueFamilyIndex, VK_QUEUE_FAMILY_IGNORED);
+    CHECK_EQ(barrier.dstQueueFamilyIndex, VK_QUEUE_FAMILY_IGNORED);
+    CHECK_EQ(tracker.getState(image).queueFamily, DECODE_FAMILY);
+}
+
+TEST_CASE(discardOnTheSameFamilyWaitsForTheLastUse) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x50);
+
+    BarrierBuilder builder(tracker);
+    builder.transition(image, ImageAccess::ComputeWrite, DECODE_FAMILY, true);
+    builder.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    const VkImageMemoryBarrier2& barrier = builder.getBarriers()[1];
+    CHECK_EQ(barrier.oldLayout, VK_IMAGE_LAYOUT_UNDEFINED);
+    CHECK_EQ(barrier.srcStageMask, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+    CHECK_EQ(barrier.srcAccessMask, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
+
+TEST_CASE(repeatedReadsNeedNoBarrier) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x60);
+
+    BarrierBuilder builder(tracker);
+    builder.transition(image, ImageAccess::EncodeSrc, ENCODE_FAMILY, true);
+    builder.transition(image, ImageAccess::EncodeSrc, ENCODE_FAMILY);
+    CHECK_EQ(builder.getBarriers().size(), 1u);
+    // Writes always need one, even to the same access.
+    builder.transition(image, ImageAccess::ComputeWrite, ENCODE_FAMILY);
+    builder.transition(image, ImageAccess::ComputeWrite, ENCODE_FAMILY);
+    CHECK_EQ(builder.getBarriers().size(), 3u);
+    // A read after a read only needs an execution dependency.
+    builder.transition(image, ImageAccess::TransferSrc, ENCODE_FAMILY);
+    builder.transition(image, ImageAccess::ComputeRead, ENCODE_FAMILY);
+    CHECK_EQ(builder.getBarriers().back().srcAccessMask, VK_ACCESS_2_NONE);
+}
+
+TEST_CASE(acquireFromTakesTheHandoffRatherThanHistory) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x70);
+
+    // Nothing was recorded for the image, as when a cached recording is replayed.
+    BarrierBuilder builder(tracker);
+    builder.acquireFrom(image, { ImageAccess::DecodeDst, DECODE_FAMILY }, { ImageAccess::ComputeRead, ENCODE_FAMILY });
+    CHECK_EQ(builder.getBarriers().size(), 1u);
+    const VkImageMemoryBarrier2& barrier = builder.getBarriers()[0];
+    CHECK_EQ(barrier.srcQueueFamilyIndex, DECODE_FAMILY);
+    CHECK_EQ(barrier.dstQueueFamilyIndex, ENCODE_FAMILY);
+    CHECK_EQ(barrier.oldLayout, VK_IMAGE_LAYOUT_VIDEO_DECODE_DST_KHR);
+    CHECK_EQ(barrier.newLayout, VK_IMAGE_LAYOUT_GENERAL);
+
+    // Within one family the handoff was a transition, so nothing is acquired.
+    builder.acquireFrom(image, { ImageAccess::ComputeRead, ENCODE_FAMILY }, { ImageAccess::EncodeSrc, ENCODE_FAMILY });
+    CHECK_EQ(builder.getBarriers().size(), 1u);
+    CHECK(tracker.getState(image).access == ImageAccess::EncodeSrc);
+}
+
+TEST_CASE(forgottenImagesStartUndefined) {
+    ImageStateTracker tracker;
+    VkImage image = fakeImage(0x80);
+    BarrierBuilder builder(tracker);
+    builder.transition(image, ImageAccess::DecodeDst, DECODE_FAMILY, true);
+    CHECK_EQ(tracker.size(), 1u);
+    tracker.forget(image);
+    CHECK_EQ(tracker.size(), 0u);
+    CHECK(tracker.getState(image).access == ImageAccess::Undefined);
+    CHECK_EQ(tracker.getState(image).queueFamily, VK_QUEUE_FAMILY_IGNORED);
+}
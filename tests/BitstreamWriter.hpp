@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds H.264 NAL units bit by bit for the parser tests: the one-byte NAL header, then
+// the RBSP, which finish() ends with the stop bit and escapes with emulation
+// prevention bytes.
+class BitstreamWriter {
+public:
+    BitstreamWriter(uint8_t nalRefIdc, uint8_t nalType) : header(static_cast<uint8_t>((nalRefIdc << 5) | nalType)) {}
+
+    BitstreamWriter& bits(uint32_t value, uint32_t count) {
+        for (uint32_t i = count; i-- > 0;) {
+            rbsp.push_back((value >> i) & 1);
+        }
+        return *this;
+    }
+
+    BitstreamWriter& flag(bool value) { return bits(value ? 1 : 0, 1); }
+
+    // ue(v): value + 1 in binary, after as many zeros as it has bits less one.
+    BitstreamWriter& ue(uint32_t value) {
+        uint64_t code = static_cast<uint64_t>(value) + 1;
+        uint32_t length = 0;
+        while ((code >> length) > 1) {
+            ++length;
+        }
+        bits(0, length);
+        for (uint32_t i = length + 1; i-- > 0;) {
+            rbsp.push_back((code >> i) & 1);
+        }
+        return *this;
+    }
+
+    // se(v): positive values map to odd codes, the others to even ones.
+    BitstreamWriter& se(int32_t value) {
+        return ue(value > 0 ? static_cast<uint32_t>(value) * 2 - 1 : static_cast<uint32_t>(-static_cast<int64_t>(value)) * 2);
+    }
+
+    // The NAL unit, including its header.
+    std::vector<uint8_t> finish() const {
+        std::vector<bool> padded = rbsp;
+        padded.push_back(true);
+        while (padded.size() % 8) {
+            padded.push_back(false);
+        }
+        std::vector<uint8_t> nal{ header };
+        uint32_t zeros = 0;
+        for (size_t i = 0; i < padded.size(); i += 8) {
+            uint8_t byte = 0;
+            for (size_t j = 0; j < 8; ++j) {
+                byte = static_cast<uint8_t>((byte << 1) | (padded[i + j] ? 1 : 0));
+            }
+            if (zeros >= 2 && byte <= 3) {
+                nal.push_back(3);
+                zeros = 0;
+            }
+            nal.push_back(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+        return nal;
+    }
+
+private:
+    uint8_t header;
+    std::vector<bool> rbsp;
+};
@@ -0,0 +1,248 @@
+#include "TestHarness.hpp"
+#include "Checkpoint.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    // A directory of its own for each test, removed afterwards.
+    class TemporaryDirectory {
+    public:
+        explicit TemporaryDirectory(const std::string& name)
+            : path(std::filesystem::temp_directory_path() / (name + "-" + std::to_string(::getpid()))) {
+            std::filesystem::remove_all(path);
+            std::filesystem::create_directories(path);
+        }
+        ~TemporaryDirectory() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+        std::string file(const std::string& name) const { return (path / name).string(); }
+
+    private:
+        std::filesystem::path path;
+    };
+
+    TranscodeCheckpoint makeCheckpoint(uint64_t frameNumber) {
+        TranscodeCheckpoint checkpoint;
+        checkpoint.inputPath = "/media/in \"quoted\".mp4";
+        checkpoint.inputSize = 123456789012ull;
+        checkpoint.outputBytes = 4096 + frameNumber;
+        checkpoint.fragmentCount = 3;
+        checkpoint.outputStreamCount = 3;
+        checkpoint.videoPacketIndex = frameNumber + 2;
+        checkpoint.frameNumber = frameNumber;
+        checkpoint.inputPts = 1801800;
+        checkpoint.inputDts = 1798797;
+        checkpoint.lastOutputPts = -3003;
+        checkpoint.lastOutputDts = -6006;
+        checkpoint.passthroughDts = { INT64_MIN, 59989333, -21333 };
+        return checkpoint;
+    }
+
+    std::string readFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const std::string& path, const std::string& contents) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+    }
+
+    // Waits for a child to create a file, so it is killed while it is working.
+    bool waitForFile(const std::string& path) {
+        for (int i = 0; i < 5000 && !std::filesystem::exists(path); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return std::filesystem::exists(path);
+    }
+
+    // The checkpoint protocol of a fragmented transcode, without the codecs: each frame
+    // appends its bytes to the output, and every SEGMENT frames the file is synced and
+    // a checkpoint is saved before the segment's first frame, as VideoTranscoder does
+    // before an IDR. A resume truncates the output to the checkpoint and continues
+    // from its frame.
+    constexpr uint64_t FRAME_COUNT = 300;
+    constexpr uint64_t SEGMENT = 16;
+    constexpr size_t FRAME_BYTES = 97;
+
+    void transcode(const std::string& outputPath, const std::string& checkpointPath, bool resume,
+                   std::chrono::microseconds frameTime) {
+        uint64_t frame = 0;
+        uint32_t fragments = 0;
+        if (resume) {
+            TranscodeCheckpoint checkpoint = Checkpoint::load(checkpointPath);
+            std::filesystem::resize_file(outputPath, checkpoint.outputBytes);
+            frame = checkpoint.frameNumber;
+            fragments = checkpoint.fragmentCount;
+        }
+        int fd = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | (resume ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open " + outputPath);
+        }
+        for (; frame < FRAME_COUNT; ++frame) {
+            if (frame > 0 && frame % SEGMENT == 0) {
+                ::fsync(fd);
+                TranscodeCheckpoint checkpoint;
+                checkpoint.inputPath = "input";
+                checkpoint.outputBytes = static_cast<uint64_t>(::lseek(fd, 0, SEEK_END));
+                checkpoint.fragmentCount = ++fragments;
+                checkpoint.outputStreamCount = 1;
+                checkpoint.frameNumber = frame;
+                Checkpoint::save(checkpointPath, checkpoint);
+            }
+            std::string bytes(FRAME_BYTES, static_cast<char>('a' + frame % 26));
+            bytes[0] = static_cast<char>(frame & 0xff);
+            // Written in two parts, so a kill can leave half a frame behind.
+            if (::write(fd, bytes.data(), FRAME_BYTES / 2) < 0 ||
+                ::write(fd, bytes.data() + FRAME_BYTES / 2, FRAME_BYTES - FRAME_BYTES / 2) < 0) {
+                throw std::runtime_error("cannot write " + outputPath);
+            }
+            std::this_thread::sleep_for(frameTime);
+        }
+        ::close(fd);
+    }
+}
+
+TEST_CASE(saveAndLoadRoundTrip) {
+    TemporaryDirectory directory("vt-checkpoint-roundtrip");
+    std::string path = Checkpoint::pathFor(directory.file("out.mp4"));
+    CHECK_EQ(path, directory.file("out.mp4.checkpoint"));
+    TranscodeCheckpoint saved = makeCheckpoint(240);
+    Checkpoint::save(path, saved);
+    TranscodeCheckpoint loaded = Checkpoint::load(path);
+    CHECK_EQ(loaded.inputPath, saved.inputPath);
+    CHECK_EQ(loaded.inputSize, saved.inputSize);
+    CHECK_EQ(loaded.outputBytes, saved.outputBytes);
+    CHECK_EQ(loaded.fragmentCount, saved.fragmentCount);
+    CHECK_EQ(loaded.outputStreamCount, saved.outputStreamCount);
+    CHECK_EQ(loaded.videoPacketIndex, saved.videoPacketIndex);
+    CHECK_EQ(loaded.frameNumber, saved.frameNumber);
+    CHECK_EQ(loaded.inputPts, saved.inputPts);
+    CHECK_EQ(loaded.inputDts, saved.inputDts);
+    CHECK_EQ(loaded.lastOutputPts, saved.lastOutputPts);
+    CHECK_EQ(loaded.lastOutputDts, saved.lastOutputDts);
+    CHECK(loaded.passthroughDts == saved.passthroughDts);
+}
+
+TEST_CASE(saveReplacesTheFileAndLeavesNoTemporary) {
+    TemporaryDirectory directory("vt-checkpoint-replace");
+    std::string path = directory.file("out.mp4.checkpoint");
+    Checkpoint::save(path, makeCheckpoint(1));
+    Checkpoint::save(path, makeCheckpoint(2));
+    CHECK_EQ(Checkpoint::load(path).frameNumber, 2u);
+    CHECK(!std::filesystem::exists(path + ".tmp"));
+    // A file that cannot be written is reported, and the old checkpoint stays.
+    std::filesystem::create_directory(path + ".tmp");
+    CHECK_THROWS(Checkpoint::save(path, makeCheckpoint(3)), std::runtime_error);
+    CHECK_EQ(Checkpoint::load(path).frameNumber, 2u);
+}
+
+TEST_CASE(loadRejectsBadFiles) {
+    TemporaryDirectory directory("vt-checkpoint-bad");
+    std::string path = directory.file("c");
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+    writeFile(path, "");
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+    writeFile(path, "{\"version\":1,\"input\":\n");
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+
+    Checkpoint::save(path, makeCheckpoint(5));
+    std::string text = readFile(path);
+    // Another format version.
+    std::string other = text;
+    other.replace(other.find("\"version\":1"), 11, "\"version\":9");
+    writeFile(path, other);
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+    // No complete fragment to resume after.
+    TranscodeCheckpoint empty = makeCheckpoint(5);
+    empty.fragmentCount = 0;
+    Checkpoint::save(path, empty);
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+    // A field of the wrong type.
+    std::string wrongType = text;
+    wrongType.replace(wrongType.find("\"frame_number\":5"), 16, "\"frame_number\":\"5\"");
+    writeFile(path, wrongType);
+    CHECK_THROWS(Checkpoint::load(path), std::runtime_error);
+}
+
+TEST_CASE(killWhileSavingKeepsACompleteCheckpoint) {
+    TemporaryDirectory directory("vt-checkpoint-kill");
+    std::string path = directory.file("out.mp4.checkpoint");
+    std::mt19937 random(7);
+    for (int round = 0; round < 8; ++round) {
+        std::filesystem::remove(path);
+        pid_t child = ::fork();
+        if (child == 0) {
+            try {
+                for (uint64_t frame = 1;; ++frame) {
+                    Checkpoint::save(path, makeCheckpoint(frame));
+                }
+            } catch (...) {
+            }
+            ::_exit(1);
+        }
+        CHECK(child > 0);
+        CHECK(waitForFile(path));
+        std::this_thread::sleep_for(std::chrono::microseconds(random() % 20000));
+        ::kill(child, SIGKILL);
+        ::waitpid(child, nullptr, 0);
+        // Whichever save was cut short, the file holds a whole earlier one.
+        TranscodeCheckpoint loaded = Checkpoint::load(path);
+        CHECK(loaded.frameNumber >= 1);
+        CHECK_EQ(loaded.outputBytes, 4096 + loaded.frameNumber);
+    }
+}
+
+TEST_CASE(killAndResumeGivesTheUninterruptedOutput) {
+    TemporaryDirectory directory("vt-checkpoint-resume");
+    std::string reference = directory.file("reference.mp4");
+    transcode(reference, directory.file("reference.mp4.checkpoint"), false, std::chrono::microseconds(0));
+    std::string expected = readFile(reference);
+    CHECK_EQ(expected.size(), FRAME_COUNT * FRAME_BYTES);
+
+    std::string output = directory.file("out.mp4");
+    std::string checkpointPath = Checkpoint::pathFor(output);
+    std::mt19937 random(11);
+    for (int round = 0; round < 4; ++round) {
+        std::filesystem::remove(output);
+        std::filesystem::remove(checkpointPath);
+        // Killed somewhere after the first checkpoint, possibly mid-frame or mid-save,
+        // then resumed, possibly more than once.
+        bool resume = false;
+        for (int kill = 0; kill < 1 + round % 3; ++kill) {
+            pid_t child = ::fork();
+            if (child == 0) {
+                try {
+                    transcode(output, checkpointPath, resume, std::chrono::microseconds(100));
+                } catch (...) {
+                    ::_exit(1);
+                }
+                ::_exit(0);
+            }
+            CHECK(child > 0);
+            CHECK(waitForFile(checkpointPath));
+            std::this_thread::sleep_for(std::chrono::microseconds(random() % 10000));
+            ::kill(child, SIGKILL);
+            ::waitpid(child, nullptr, 0);
+            resume = true;
+        }
+        transcode(output, checkpointPath, true, std::chrono::microseconds(0));
+        CHECK(readFile(output) == expected);
+    }
+}
@@ -0,0 +1,106 @@
+#include "TestHarness.hpp"
+#include "H264TestStream.hpp"
+#include "DecodeResync.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using namespace H264TestStream;
+using Verdict = DecodeResync::Verdict;
+
+namespace {
+    constexpr uint32_t NAL_LENGTH_SIZE = 4;
+    constexpr uint64_t BUFFER_SIZE = 4096;
+    constexpr uint64_t ALIGNMENT = 256;
+
+    std::vector<uint8_t> picture(bool idr, uint32_t frameNum) {
+        return lengthPrefixed({ slice(idr, frameNum, frameNum * 2) }, NAL_LENGTH_SIZE);
+    }
+
+    // A length prefix that runs past the end of the packet.
+    std::vector<uint8_t> truncated(bool idr, uint32_t frameNum) {
+        std::vector<uint8_t> packet = picture(idr, frameNum);
+        packet.resize(packet.size() - 3);
+        return packet;
+    }
+
+    Verdict admit(DecodeResync& resync, const std::vector<uint8_t>& packet, uint64_t index, bool flagged = false) {
+        return resync.admit(packet.data(), packet.size(), flagged, index);
+    }
+}
+
+TEST_CASE(intactPacketsAreDecoded) {
+    DecodeResync resync(NAL_LENGTH_SIZE, BUFFER_SIZE, ALIGNMENT, true, 0);
+    CHECK(admit(resync, picture(true, 0), 1) == Verdict::Decode);
+    CHECK(admit(resync, picture(false, 1), 2) == Verdict::Decode);
+    CHECK(!resync.isAwaitingIdr());
+    CHECK_EQ(resync.getStats().corruptPackets, 0u);
+    CHECK_EQ(resync.getStats().droppedFrames, 0u);
+}
+
+TEST_CASE(decodingResumesAtTheNextIdr) {
+    DecodeResync resync(NAL_LENGTH_SIZE, BUFFER_SIZE, ALIGNMENT, true, 0);
+    CHECK(admit(resync, picture(true, 0), 1) == Verdict::Decode);
+    CHECK(admit(resync, truncated(false, 1), 2) == Verdict::Damaged);
+    CHECK(resync.isAwaitingIdr());
+    // Intact frames may reference the lost one, so they wait for the IDR too.
+    CHECK(admit(resync, picture(false, 2), 3) == Verdict::AwaitingIdr);
+    CHECK(admit(resync, picture(false, 3), 4) == Verdict::AwaitingIdr);
+    CHECK(admit(resync, picture(true, 0), 5) == Verdict::Resync);
+    CHECK(!resync.isAwaitingIdr());
+    CHECK(admit(resync, picture(false, 1), 6) == Verdict::Decode);
+
+    const DecodeErrorStats& stats = resync.getStats();
+    CHECK_EQ(stats.corruptPackets, 1u);
+    CHECK_EQ(stats.droppedFrames, 3u);
+    CHECK_EQ(stats.resyncs, 1u);
+}
+
+TEST_CASE(aDamagedIdrIsNotAResync) {
+    DecodeResync resync(NAL_LENGTH_SIZE, BUFFER_SIZE, ALIGNMENT, true, 0);
+    CHECK(admit(resync, truncated(true, 0), 1) == Verdict::Damaged);
+    CHECK(admit(resync, truncated(true, 0), 2) == Verdict::Damaged);
+    CHECK(admit(resync, picture(true, 0), 3) == Verdict::Resync);
+    CHECK_EQ(resync.getStats().corruptPackets, 2u);
+    CHECK_EQ(resync.getStats().resyncs, 1u);
+}
+
+TEST_CASE(flaggedAndOversizedPacketsAreDamaged) {
+    std::vector<uint8_t> intact = picture(true, 0);
+    // The packed picture is aligned up, so a buffer one alignment unit short of it
+    // is too small even though the packet itself fits.
+    uint64_t packed = intact.size() + 3;
+    uint64_t aligned = (packed + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    DecodeResync small(NAL_LENGTH_SIZE, aligned - ALIGNMENT, ALIGNMENT, true, 0);
+    CHECK(admit(small, intact, 1) == Verdict::Damaged);
+    DecodeResync exact(NAL_LENGTH_SIZE, aligned, ALIGNMENT, true, 0);
+    CHECK(admit(exact, intact, 1) == Verdict::Decode);
+    CHECK(admit(exact, intact, 2, true) == Verdict::Damaged);
+    CHECK(admit(exact, intact, 3) == Verdict::Resync);
+}
+
+TEST_CASE(damageThrowsWithoutAResilientDecode) {
+    DecodeResync resync(NAL_LENGTH_SIZE, BUFFER_SIZE, ALIGNMENT, false, 0);
+    CHECK(admit(resync, picture(true, 0), 1) == Verdict::Decode);
+    CHECK_THROWS(admit(resync, truncated(false, 1), 2), std::runtime_error);
+    CHECK_THROWS(admit(resync, picture(false, 2), 3, true), std::runtime_error);
+    CHECK_EQ(resync.getStats().corruptPackets, 0u);
+}
+
+TEST_CASE(tooManyDamagedPacketsThrow) {
+    DecodeResync resync(NAL_LENGTH_SIZE, BUFFER_SIZE, ALIGNMENT, true, 2);
+    CHECK(admit(resync, truncated(true, 0), 1) == Verdict::Damaged);
+    CHECK(admit(resync, picture(true, 0), 2) == Verdict::Resync);
+    CHECK(admit(resync, truncated(false, 1), 3) == Verdict::Damaged);
+    CHECK_THROWS(admit(resync, truncated(false, 2), 4), std::runtime_error);
+}
+
+TEST_CASE(injectedErrorsAreCounted) {
+    DecodeResync resync(0, BUFFER_SIZE, 0, true, 0);
+    CHECK_EQ(resync.countInjectedError(), 0u);
+    CHECK_EQ(resync.countInjectedError(), 1u);
+    CHECK_EQ(resync.getStats().injectedErrors, 2u);
+    // Annex B packets, and an alignment of 0 treated as 1.
+    CHECK(admit(resync, annexB({ slice(true, 0, 0) }), 1) == Verdict::Decode);
+}
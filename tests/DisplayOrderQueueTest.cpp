@@ -0,0 +1,98 @@
+#include "TestHarness.hpp"
+#include "DisplayOrderQueue.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+    struct Picture {
+        std::string name;
+        int32_t picOrderCnt;
+        bool idr;
+    };
+
+    // Pushes the pictures in decode order and returns the names in the order they leave.
+    std::string reorder(const std::vector<Picture>& pictures, uint32_t reorderDelay) {
+        DisplayOrderQueue<std::string> queue(reorderDelay);
+        std::string order;
+        for (const Picture& picture : pictures) {
+            queue.push(picture.name, picture.picOrderCnt, picture.idr);
+            while (queue.ready(false)) {
+                order += queue.pop();
+            }
+        }
+        while (queue.ready(true)) {
+            order += queue.pop();
+        }
+        return order;
+    }
+}
+
+TEST_CASE(ibbpComesOutInDisplayOrder) {
+    // I0 P3 B1 B2 P6 B4 B5 in decode order, two frames of reordering.
+    std::vector<Picture> pictures = {
+        { "I0", 0, true }, { "P3", 6, false }, { "B1", 2, false }, { "B2", 4, false },
+        { "P6", 12, false }, { "B4", 8, false }, { "B5", 10, false },
+    };
+    CHECK_EQ(reorder(pictures, 2), std::string("I0B1B2P3B4B5P6"));
+}
+
+TEST_CASE(pictureLeavesOnceTheDelayIsFilled) {
+    DisplayOrderQueue<int> queue(2);
+    queue.push(0, 0, true);
+    queue.push(3, 6, false);
+    CHECK(!queue.ready(false));
+    queue.push(1, 2, false);
+    CHECK(queue.ready(false));
+    CHECK_EQ(queue.pop(), 0);
+    CHECK(!queue.ready(false));
+    CHECK(queue.ready(true));
+    CHECK_EQ(queue.pop(), 1);
+    CHECK_EQ(queue.pop(), 3);
+    CHECK(!queue.ready(true));
+}
+
+TEST_CASE(idrReleasesTheEarlierPictures) {
+    // The count restarts at the second IDR: its pictures follow the first GOP's even
+    // though their counts are lower, and need not wait for the delay to fill.
+    std::vector<Picture> pictures = {
+        { "I0", 0, true }, { "P2", 4, false }, { "B1", 2, false },
+        { "I3", 0, true }, { "P5", 4, false }, { "B4", 2, false },
+    };
+    CHECK_EQ(reorder(pictures, 4), std::string("I0B1P2I3B4P5"));
+
+    DisplayOrderQueue<int> queue(4);
+    queue.push(0, 0, true);
+    queue.push(1, 2, false);
+    CHECK(!queue.ready(false));
+    queue.push(2, 0, true);
+    CHECK(queue.ready(false));
+    CHECK_EQ(queue.pop(), 0);
+    CHECK_EQ(queue.pop(), 1);
+    CHECK(!queue.ready(false));
+}
+
+TEST_CASE(zeroDelayKeepsDecodeOrder) {
+    std::vector<Picture> pictures = { { "I0", 0, true }, { "P1", 2, false }, { "P2", 4, false } };
+    CHECK_EQ(reorder(pictures, 0), std::string("I0P1P2"));
+}
+
+TEST_CASE(underestimatedDelayIsCounted) {
+    // The stream reorders by two frames but claims one: B1 arrives after P3 has left.
+    DisplayOrderQueue<std::string> queue(1);
+    std::string order;
+    std::vector<Picture> pictures = {
+        { "I0", 0, true }, { "P3", 6, false }, { "P6", 12, false }, { "B1", 2, false }, { "B2", 4, false },
+    };
+    for (const Picture& picture : pictures) {
+        queue.push(picture.name, picture.picOrderCnt, picture.idr);
+        while (queue.ready(false)) {
+            order += queue.pop();
+        }
+    }
+    while (queue.ready(true)) {
+        order += queue.pop();
+    }
+    CHECK_EQ(order, std::string("I0P3B1B2P6"));
+    CHECK_EQ(queue.getLateCount(), 2u);
+}
@@ -0,0 +1,72 @@
+#include "TestHarness.hpp"
+#include "FormatKernels.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace FormatKernels;
+
+namespace {
+    // The shader's formula, one sample at a time.
+    uint8_t reference(uint16_t sample) {
+        uint32_t rounded = ((sample >> 6) + 2u) >> 2;
+        return static_cast<uint8_t>(rounded > 255 ? 255 : rounded);
+    }
+
+    // Converts samples with both kernels, starting one sample in so the loads are
+    // unaligned, and compares them with the formula.
+    void checkRow(const std::vector<uint16_t>& samples) {
+        std::vector<uint16_t> source(samples.size() + 1);
+        std::copy(samples.begin(), samples.end(), source.begin() + 1);
+        // One guard byte past the end catches writes beyond count.
+        std::vector<uint8_t> simd(samples.size() + 1, 0xEE);
+        std::vector<uint8_t> scalar(samples.size() + 1, 0xEE);
+        downconvertRow(source.data() + 1, simd.data(), samples.size());
+        downconvertRowScalar(source.data() + 1, scalar.data(), samples.size());
+        bool matches = true;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            matches &= simd[i] == reference(samples[i]) && scalar[i] == simd[i];
+        }
+        CHECK(matches);
+        CHECK_EQ(static_cast<int>(simd.back()), 0xEE);
+        CHECK_EQ(static_cast<int>(scalar.back()), 0xEE);
+    }
+}
+
+TEST_CASE(edgeValuesMatchTheShader) {
+    // 10-bit samples in the top bits: v << 6. The rounding boundaries are where the
+    // two bits dropped go from 01 to 10.
+    std::vector<uint16_t> samples = {
+        0, 1 << 6, 2 << 6, 3 << 6, 5 << 6, 6 << 6, 513 << 6, 514 << 6,
+        1019 << 6, 1020 << 6, 1021 << 6, 1022 << 6, 1023 << 6, 0xFFFF, 63, 0xFFC0,
+    };
+    std::vector<uint8_t> expected = { 0, 0, 1, 1, 1, 2, 128, 129, 255, 255, 255, 255, 255, 255, 0, 255 };
+    std::vector<uint8_t> converted(samples.size());
+    downconvertRow(samples.data(), converted.data(), samples.size());
+    CHECK(converted == expected);
+    // 1022 and 1023 round to 256 and saturate instead of wrapping to 0.
+    CHECK_EQ(static_cast<int>(reference(1023 << 6)), 255);
+    checkRow(samples);
+}
+
+TEST_CASE(everySampleValueMatches) {
+    std::vector<uint16_t> samples(65536);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = static_cast<uint16_t>(i);
+    }
+    checkRow(samples);
+}
+
+TEST_CASE(lengthsAroundTheVectorWidthMatch) {
+    std::mt19937 random(26);
+    std::uniform_int_distribution<uint32_t> sample(0, 1023);
+    for (size_t count : { 0, 1, 7, 15, 16, 17, 31, 33, 100, 1921 }) {
+        std::vector<uint16_t> samples(count);
+        for (uint16_t& value : samples) {
+            value = static_cast<uint16_t>(sample(random) << 6);
+        }
+        checkRow(samples);
+    }
+}
@@ -0,0 +1,188 @@
+#include "TestHarness.hpp"
+#include "FramePipeline.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+    // Logs every stage with the packet's pts, frame number or stream, and what the
+    // stages saw of the job.
+    struct RecordingStages : FrameStages {
+        std::vector<std::string> log;
+        bool packetsBlankAfterParse = true;
+        // The payload bytes parse() saw, and whether the packet still had its own buffer.
+        std::vector<std::vector<uint8_t>> payloads;
+        std::vector<bool> ownBuffers;
+        int throwInSubmitAt = -1;
+        std::atomic<bool> parseOpen{true};
+
+        void record(const char* stage, int64_t pts) { log.push_back(std::string(stage) + " " + std::to_string(pts)); }
+
+        void parse(FrameJob& job) override {
+            while (!parseOpen) {
+                std::this_thread::yield();
+            }
+            record("parse", job.packet->pts);
+            payloads.emplace_back(job.packet->data, job.packet->data + job.packet->size);
+            ownBuffers.push_back(job.packet->buf != nullptr);
+            job.segmentStart = job.packet->pts % 3 == 0;
+        }
+        void submit(FrameJob& job) override {
+            packetsBlankAfterParse &= job.packet->data == nullptr;
+            if (job.frameNumber == throwInSubmitAt) {
+                throw std::runtime_error("Submit failed");
+            }
+            record("submit", job.frameNumber);
+        }
+        void readback(FrameJob& job) override { record("readback", job.frameNumber); }
+        void mux(FrameJob& job) override { record(job.segmentStart ? "mux-idr" : "mux", job.frameNumber); }
+        void passthrough(FrameJob& job) override { record("passthrough", job.outputStream); }
+    };
+
+    // A demuxed packet whose payload bytes count up from its pts, freed when it goes out
+    // of scope.
+    struct DemuxedPacket {
+        AVPacket* packet = av_packet_alloc();
+
+        explicit DemuxedPacket(int64_t pts, int size = 16) {
+            av_new_packet(packet, size);
+            packet->pts = pts;
+            for (int i = 0; i < size; ++i) {
+                packet->data[i] = static_cast<uint8_t>(pts + i);
+            }
+        }
+        ~DemuxedPacket() { av_packet_free(&packet); }
+    };
+
+    // Returns whether the pipeline took the packet's reference.
+    bool pushVideo(FramePipeline& pipeline, int frameNumber, int size = 16) {
+        DemuxedPacket demuxed(frameNumber, size);
+        FrameJob job;
+        job.video = true;
+        job.frameNumber = frameNumber;
+        pipeline.push(demuxed.packet, job);
+        return demuxed.packet->data == nullptr;
+    }
+
+    void pushPassthrough(FramePipeline& pipeline, int outputStream) {
+        DemuxedPacket demuxed(0);
+        FrameJob job;
+        job.outputStream = outputStream;
+        pipeline.push(demuxed.packet, job);
+    }
+}
+
+TEST_CASE(stagesRunInOrderPacketByPacket) {
+    TaskPool pool(4);
+    RecordingStages stages;
+    FramePipeline pipeline(stages, pool, 2);
+    CHECK(pushVideo(pipeline, 0));
+    pushPassthrough(pipeline, 1);
+    pushVideo(pipeline, 1);
+    pushVideo(pipeline, 2);
+    pushPassthrough(pipeline, 2);
+    pipeline.finish();
+    CHECK(stages.log == std::vector<std::string>({
+        "parse 0", "submit 0", "readback 0", "mux-idr 0", "passthrough 1",
+        "parse 1", "submit 1", "readback 1", "mux 1",
+        "parse 2", "submit 2", "readback 2", "mux 2", "passthrough 2" }));
+    CHECK(stages.packetsBlankAfterParse);
+}
+
+TEST_CASE(payloadsThatFitAreCopiedIntoThePool) {
+    TaskPool pool(2);
+    PacketPool payloads(16);
+    RecordingStages stages;
+    {
+        FramePipeline pipeline(stages, pool, 2, &payloads);
+        for (int frame = 0; frame < 6; ++frame) {
+            CHECK(pushVideo(pipeline, frame, frame == 3 ? 17 : 16));
+        }
+        pipeline.finish();
+    }
+    CHECK(stages.ownBuffers == std::vector<bool>({ false, false, false, true, false, false }));
+    bool intact = stages.payloads.size() == 6;
+    for (size_t frame = 0; intact && frame < stages.payloads.size(); ++frame) {
+        const std::vector<uint8_t>& payload = stages.payloads[frame];
+        intact = payload.size() == (frame == 3 ? 17u : 16u);
+        for (size_t i = 0; intact && i < payload.size(); ++i) {
+            intact = payload[i] == static_cast<uint8_t>(frame + i);
+        }
+    }
+    CHECK(intact);
+    // The buffers went back after parse(), so two were enough for two packets in flight.
+    PacketPoolStats stats = payloads.getStats();
+    CHECK_EQ(stats.buffersHandedOut, 5u);
+    CHECK(stats.buffersAllocated <= 2u);
+}
+
+TEST_CASE(pushWaitsWhileThePipelineIsFull) {
+    TaskPool pool(2);
+    RecordingStages stages;
+    stages.parseOpen = false;
+    FramePipeline pipeline(stages, pool, 2);
+    std::atomic<int> pushed{0};
+    std::thread demuxer([&] {
+        for (int frame = 0; frame < 3; ++frame) {
+            pushVideo(pipeline, frame);
+            ++pushed;
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_EQ(pushed.load(), 2);
+    stages.parseOpen = true;
+    demuxer.join();
+    pipeline.finish();
+    CHECK_EQ(pushed.load(), 3);
+    CHECK_EQ(stages.log.size(), 12u);
+}
+
+TEST_CASE(aThrowingStageSkipsTheStagesAfterIt) {
+    TaskPool pool(2);
+    RecordingStages stages;
+    stages.throwInSubmitAt = 1;
+    FramePipeline pipeline(stages, pool, 1);
+    pushVideo(pipeline, 0);
+    pushVideo(pipeline, 1);
+    // The slot comes free once frame 1's skipped stages have run.
+    CHECK_THROWS(pushVideo(pipeline, 2), std::runtime_error);
+    CHECK_THROWS(pipeline.finish(), std::runtime_error);
+    CHECK(stages.log == std::vector<std::string>({ "parse 0", "submit 0", "readback 0", "mux-idr 0", "parse 1" }));
+}
+
+TEST_CASE(sessionsShareThePoolAndKeepTheirOrder) {
+    TaskPool pool(4);
+    constexpr int SESSIONS = 4;
+    constexpr int FRAMES = 200;
+    std::vector<RecordingStages> stages(SESSIONS);
+    std::vector<std::thread> sessions;
+    for (int session = 0; session < SESSIONS; ++session) {
+        sessions.emplace_back([&pool, &stages, session] {
+            FramePipeline pipeline(stages[session], pool, 4);
+            for (int frame = 0; frame < FRAMES; ++frame) {
+                pushVideo(pipeline, frame);
+            }
+            pipeline.finish();
+        });
+    }
+    for (std::thread& session : sessions) {
+        session.join();
+    }
+    for (const RecordingStages& session : stages) {
+        bool ordered = session.log.size() == 4u * FRAMES;
+        for (int frame = 0; ordered && frame < FRAMES; ++frame) {
+            ordered = session.log[frame * 4] == "parse " + std::to_string(frame) &&
+                      session.log[frame * 4 + 3].rfind("mux", 0) == 0;
+        }
+        CHECK(ordered);
+    }
+}
@@ -0,0 +1,112 @@
+#include "TestHarness.hpp"
+#include "H264ParameterSets.hpp"
+#include "H264TestStream.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+using namespace H264TestStream;
+
+namespace {
+    bool add(H264ParameterSets& sets, const std::vector<uint8_t>& nal) {
+        return sets.add(nal.data(), nal.size());
+    }
+}
+
+TEST_CASE(spsGivesCodedAndDisplaySizes) {
+    SpsFields fields;
+    fields.widthInMbs = 120;
+    fields.heightInMapUnits = 68;
+    fields.cropBottom = 4;
+    std::vector<uint8_t> nal = sps(fields);
+    H264SequenceParameterSet set;
+    CHECK(H264ParameterSets::parseSps(nal.data(), nal.size(), set) == nullptr);
+    CHECK_EQ(set.codedWidth, 1920u);
+    CHECK_EQ(set.codedHeight, 1088u);
+    CHECK_EQ(set.displayWidth, 1920u);
+    CHECK_EQ(set.displayHeight, 1080u);
+    CHECK_EQ(set.std.profile_idc, STD_VIDEO_H264_PROFILE_IDC_HIGH);
+
+    fields.heightInMapUnits = 34;
+    fields.frameMbsOnly = false;
+    fields.cropBottom = 2;
+    fields.cropRight = 8;
+    nal = sps(fields);
+    H264SequenceParameterSet interlaced;
+    CHECK(H264ParameterSets::parseSps(nal.data(), nal.size(), interlaced) == nullptr);
+    CHECK_EQ(interlaced.codedHeight, 1088u);
+    CHECK_EQ(interlaced.displayWidth, 1904u);
+    CHECK_EQ(interlaced.displayHeight, 1080u);
+}
+
+TEST_CASE(spsWithACroppingWindowOutsideThePictureIsRejected) {
+    SpsFields fields;
+    fields.widthInMbs = 2;
+    fields.heightInMapUnits = 2;
+    fields.cropRight = 16;
+    std::vector<uint8_t> nal = sps(fields);
+    H264SequenceParameterSet set;
+    CHECK(H264ParameterSets::parseSps(nal.data(), nal.size(), set) != nullptr);
+    H264ParameterSets sets;
+    CHECK_THROWS(add(sets, nal), std::runtime_error);
+}
+
+TEST_CASE(resentSetsChangeNothing) {
+    H264ParameterSets sets;
+    CHECK(add(sets, sps(SpsFields{})));
+    CHECK(add(sets, pps(0, 0)));
+    CHECK(sets.hasPending());
+    CHECK(!sets.needsRecreate());
+    sets.commit(false);
+    CHECK(!sets.hasPending());
+    CHECK(!add(sets, sps(SpsFields{})));
+    CHECK(!add(sets, pps(0, 0)));
+    CHECK(!sets.hasPending());
+    CHECK_EQ(sets.getStats().received, 4u);
+    CHECK_EQ(sets.getStats().repeated, 2u);
+    CHECK_EQ(sets.getStats().parsed, 2u);
+    CHECK_EQ(sets.getStats().added, 2u);
+}
+
+TEST_CASE(newIdsAreAddedAndReplacedIdsNeedANewObject) {
+    H264ParameterSets sets;
+    add(sets, sps(SpsFields{}));
+    add(sets, pps(0, 0));
+    sets.commit(false);
+
+    // Another PPS ID fits in the parameters object.
+    CHECK(add(sets, pps(1, 0)));
+    CHECK(!sets.needsRecreate());
+    std::vector<StdVideoH264SequenceParameterSet> spsList;
+    std::vector<StdVideoH264PictureParameterSet> ppsList;
+    sets.collect(false, spsList, ppsList);
+    CHECK_EQ(spsList.size(), 0u);
+    CHECK(ppsList.size() == 1 && ppsList[0].pic_parameter_set_id == 1);
+    sets.commit(false);
+
+    // Different content under SPS ID 0 does not.
+    SpsFields smaller;
+    smaller.widthInMbs = 40;
+    CHECK(add(sets, sps(smaller)));
+    CHECK(sets.needsRecreate());
+    spsList.clear();
+    ppsList.clear();
+    sets.collect(true, spsList, ppsList);
+    CHECK_EQ(spsList.size(), 1u);
+    CHECK_EQ(ppsList.size(), 2u);
+    sets.commit(true);
+    CHECK_EQ(sets.getStats().replaced, 1u);
+    CHECK_EQ(sets.getSps(0)->displayWidth, 640u);
+
+    // Switching back finds the first SPS in the cache.
+    CHECK(add(sets, sps(SpsFields{})));
+    CHECK_EQ(sets.getStats().cacheHits, 1u);
+    CHECK_EQ(sets.getSps(0)->displayWidth, 1280u);
+}
+
+TEST_CASE(ppsNeedsItsSps) {
+    H264ParameterSets sets;
+    CHECK_THROWS(add(sets, pps(0, 2)), std::runtime_error);
+    CHECK(sets.getPps(0) == nullptr);
+    CHECK(!add(sets, slice(true, 0, 0)));
+}
@@ -0,0 +1,189 @@
+#include "TestHarness.hpp"
+#include "H264Parser.hpp"
+#include "H264TestStream.hpp"
+
+#include <cstring>
+#include <vector>
+
+using namespace H264TestStream;
+
+namespace {
+    H264SpsInfo parse(const std::vector<uint8_t>& nal) {
+        H264SpsInfo info;
+        CHECK(H264Parser::parseSps(nal.data(), nal.size(), info));
+        return info;
+    }
+
+    H264PacketInfo inspect(const std::vector<uint8_t>& packet, uint32_t nalLengthSize = 0) {
+        H264PacketInfo info;
+        H264Parser::inspectPacket(packet.data(), packet.size(), nalLengthSize, info);
+        return info;
+    }
+}
+
+TEST_CASE(unescapeRemovesEmulationPrevention) {
+    std::vector<uint8_t> escaped = { 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x03 };
+    std::vector<uint8_t> expected = { 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00 };
+    CHECK(H264Parser::unescapeRbsp(escaped.data(), escaped.size()) == expected);
+}
+
+TEST_CASE(bitReaderReadsExpGolombCodes) {
+    BitstreamWriter writer(0, 0);
+    writer.ue(0).ue(1).ue(254).se(-3).se(4).bits(0x5, 3);
+    std::vector<uint8_t> nal = writer.finish();
+    BitReader reader(nal.data() + 1, nal.size() - 1);
+    CHECK_EQ(reader.readUE(), 0u);
+    CHECK_EQ(reader.readUE(), 1u);
+    CHECK_EQ(reader.readUE(), 254u);
+    CHECK_EQ(reader.readSE(), -3);
+    CHECK_EQ(reader.readSE(), 4);
+    CHECK_EQ(reader.readBits(3), 5u);
+    CHECK(!reader.moreRbspData());
+    CHECK(!reader.overrun());
+    reader.readBits(16);
+    CHECK(reader.overrun());
+}
+
+TEST_CASE(spsGivesTheCroppedSize) {
+    SpsFields fields;
+    fields.widthInMbs = 120;
+    fields.heightInMapUnits = 68;
+    fields.cropBottom = 4;
+    fields.maxNumRefFrames = 4;
+    H264SpsInfo info = parse(sps(fields));
+    CHECK_EQ(info.profileIdc, 100u);
+    CHECK_EQ(info.levelIdc, 40u);
+    CHECK_EQ(info.chromaFormatIdc, 1u);
+    CHECK_EQ(info.bitDepthLuma, 8u);
+    CHECK_EQ(info.picOrderCntType, 0u);
+    CHECK_EQ(info.log2MaxPicOrderCntLsbMinus4, 2u);
+    CHECK_EQ(info.maxNumRefFrames, 4u);
+    CHECK(info.frameMbsOnly);
+    CHECK_EQ(info.width, 1920u);
+    CHECK_EQ(info.height, 1080u);
+
+    // Field macroblocks: map units are macroblock pairs and crop units two frame lines.
+    fields.id = 3;
+    fields.heightInMapUnits = 34;
+    fields.frameMbsOnly = false;
+    fields.cropBottom = 2;
+    fields.cropRight = 4;
+    info = parse(sps(fields));
+    CHECK_EQ(info.spsId, 3u);
+    CHECK(!info.frameMbsOnly);
+    CHECK_EQ(info.width, 1912u);
+    CHECK_EQ(info.height, 1080u);
+}
+
+TEST_CASE(spsRejectsOtherAndTruncatedUnits) {
+    H264SpsInfo info;
+    std::vector<uint8_t> nal = sps(SpsFields{});
+    CHECK(!H264Parser::parseSps(nal.data(), nal.size() / 2, info));
+    std::vector<uint8_t> ppsNal = pps(0, 0);
+    CHECK(!H264Parser::parseSps(ppsNal.data(), ppsNal.size(), info));
+}
+
+TEST_CASE(avcCListsTheParameterSets) {
+    std::vector<uint8_t> spsNal = sps(SpsFields{});
+    std::vector<uint8_t> ppsNal = pps(0, 0);
+    std::vector<uint8_t> record = { 1, 100, 0, 40, 0xFF, 0xE1 };
+    record.push_back(static_cast<uint8_t>(spsNal.size() >> 8));
+    record.push_back(static_cast<uint8_t>(spsNal.size()));
+    record.insert(record.end(), spsNal.begin(), spsNal.end());
+    record.push_back(1);
+    record.push_back(static_cast<uint8_t>(ppsNal.size() >> 8));
+    record.push_back(static_cast<uint8_t>(ppsNal.size()));
+    record.insert(record.end(), ppsNal.begin(), ppsNal.end());
+
+    std::vector<std::vector<uint8_t>> spsList, ppsList;
+    uint32_t nalLengthSize = 0;
+    CHECK(H264Parser::parseAvcC(record, spsList, ppsList, nalLengthSize));
+    CHECK_EQ(nalLengthSize, 4u);
+    CHECK(spsList.size() == 1 && spsList[0] == spsNal);
+    CHECK(ppsList.size() == 1 && ppsList[0] == ppsNal);
+
+    std::vector<uint8_t> truncated(record.begin(), record.end() - 2);
+    CHECK(!H264Parser::parseAvcC(truncated, spsList, ppsList, nalLengthSize));
+    // Annex B extradata is not an avcC record.
+    CHECK(!H264Parser::parseAvcC(annexB({ spsNal, ppsNal }), spsList, ppsList, nalLengthSize));
+}
+
+TEST_CASE(annexBPacketsSplitAtStartCodes) {
+    std::vector<uint8_t> a = sps(SpsFields{});
+    std::vector<uint8_t> b = slice(true, 0, 0);
+    // A 3-byte start code, and zeros before the next start code that belong to neither.
+    std::vector<uint8_t> packet = { 0, 0, 1 };
+    packet.insert(packet.end(), a.begin(), a.end());
+    packet.insert(packet.end(), { 0, 0, 0, 0, 1 });
+    packet.insert(packet.end(), b.begin(), b.end());
+    std::vector<H264NalUnit> nals;
+    CHECK(H264Parser::splitNalUnits(packet.data(), packet.size(), 0, nals) == nullptr);
+    CHECK_EQ(nals.size(), 2u);
+    CHECK(nals[0].size == a.size() && std::memcmp(nals[0].data, a.data(), a.size()) == 0);
+    CHECK(nals[1].size == b.size() && std::memcmp(nals[1].data, b.data(), b.size()) == 0);
+
+    std::vector<uint8_t> noStartCode(b.begin(), b.end());
+    CHECK(H264Parser::splitNalUnits(noStartCode.data(), noStartCode.size(), 0, nals) != nullptr);
+}
+
+TEST_CASE(lengthPrefixedPacketsSplitForEverySize) {
+    std::vector<std::vector<uint8_t>> units = { sps(SpsFields{}), pps(0, 0), slice(true, 0, 0) };
+    for (uint32_t lengthSize = 1; lengthSize <= 4; ++lengthSize) {
+        std::vector<uint8_t> packet = lengthPrefixed(units, lengthSize);
+        std::vector<H264NalUnit> nals;
+        CHECK(H264Parser::splitNalUnits(packet.data(), packet.size(), lengthSize, nals) == nullptr);
+        CHECK_EQ(nals.size(), 3u);
+        for (size_t i = 0; i < nals.size() && i < units.size(); ++i) {
+            CHECK(nals[i].size == units[i].size() && std::memcmp(nals[i].data, units[i].data(), nals[i].size) == 0);
+        }
+        std::vector<uint8_t> overrun(packet.begin(), packet.end() - 1);
+        CHECK(H264Parser::splitNalUnits(overrun.data(), overrun.size(), lengthSize, nals) != nullptr);
+    }
+    std::vector<uint8_t> packet = lengthPrefixed(units, 4);
+    std::vector<H264NalUnit> nals;
+    CHECK(H264Parser::splitNalUnits(packet.data(), 2, 4, nals) != nullptr);
+    CHECK(H264Parser::splitNalUnits(packet.data(), packet.size(), 5, nals) != nullptr);
+}
+
+TEST_CASE(sliceHeadersGiveThePictureStartAndPps) {
+    std::vector<uint8_t> first = slice(false, 1, 2, 7);
+    std::vector<uint8_t> second = slice(false, 1, 2, 7, 40);
+    CHECK(H264Parser::isFirstSlice(first.data(), first.size()));
+    CHECK(!H264Parser::isFirstSlice(second.data(), second.size()));
+    uint32_t ppsId = 0;
+    CHECK(H264Parser::parseSlicePpsId(second.data(), second.size(), ppsId));
+    CHECK_EQ(ppsId, 7u);
+    CHECK(!H264Parser::parseSlicePpsId(second.data(), 1, ppsId));
+}
+
+TEST_CASE(inspectionSummarisesGoodPackets) {
+    H264PacketInfo info = inspect(annexB({ sps(SpsFields{}), pps(0, 0), slice(true, 0, 0), slice(true, 0, 0, 0, 1800) }));
+    CHECK(info.error == nullptr);
+    CHECK(info.hasSlice);
+    CHECK(info.idr);
+    CHECK_EQ(info.nalCount, 4u);
+    CHECK_EQ(info.sliceCount, 2u);
+
+    info = inspect(lengthPrefixed({ slice(false, 1, 2) }, 4), 4);
+    CHECK(info.error == nullptr);
+    CHECK(!info.idr);
+}
+
+TEST_CASE(inspectionRejectsDamagedPackets) {
+    std::vector<uint8_t> forbidden = slice(false, 1, 2);
+    forbidden[0] |= 0x80;
+    std::vector<uint8_t> nonReferenceIdr = slice(true, 0, 0);
+    nonReferenceIdr[0] &= 0x9f;
+    std::vector<uint8_t> truncated = slice(false, 1, 2);
+    truncated.resize(1);
+
+    CHECK(inspect(annexB({ forbidden })).error != nullptr);
+    CHECK(inspect(annexB({ nonReferenceIdr })).error != nullptr);
+    CHECK(inspect(annexB({ truncated })).error != nullptr);
+    CHECK(inspect(annexB({ slice(true, 0, 0), slice(false, 0, 0, 0, 10) })).error != nullptr);
+    CHECK(inspect(annexB({ slice(false, 1, 2), slice(false, 2, 4) })).error != nullptr);
+    CHECK(inspect(annexB({ sps(SpsFields{}), pps(0, 0) })).error != nullptr);
+    CHECK(inspect(lengthPrefixed({ std::vector<uint8_t>() }, 4), 4).error != nullptr);
+    H264PacketInfo info;
+    CHECK(!H264Parser::inspectPacket(nullptr, 0, 4, info));
+}
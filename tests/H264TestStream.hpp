@@ -0,0 +1,88 @@
+#pragma once
+
+#include "BitstreamWriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Builds small H.264 streams for the parser tests: High profile 4:2:0 8-bit parameter
+// sets, and slice headers that carry only what the transcoder reads. The slice data
+// after the header is filler.
+namespace H264TestStream {
+
+    struct SpsFields {
+        uint32_t id = 0;
+        uint32_t widthInMbs = 80;
+        uint32_t heightInMapUnits = 45;
+        bool frameMbsOnly = true;
+        // Crop offsets in chroma samples (pairs of lines for field macroblocks).
+        uint32_t cropRight = 0;
+        uint32_t cropBottom = 0;
+        uint32_t maxNumRefFrames = 1;
+    };
+
+    // log2_max_frame_num is 4 and log2_max_pic_order_cnt_lsb is 6.
+    inline std::vector<uint8_t> sps(const SpsFields& fields) {
+        BitstreamWriter writer(3, 7);
+        writer.bits(100, 8).bits(0, 8).bits(40, 8).ue(fields.id);
+        writer.ue(1).ue(0).ue(0).flag(false).flag(false); // 4:2:0, 8-bit, no scaling matrices
+        writer.ue(0).ue(0).ue(2);                         // frame_num, POC type 0 and its LSB size
+        writer.ue(fields.maxNumRefFrames).flag(false);
+        writer.ue(fields.widthInMbs - 1).ue(fields.heightInMapUnits - 1).flag(fields.frameMbsOnly);
+        if (!fields.frameMbsOnly) {
+            writer.flag(false); // mb_adaptive_frame_field_flag
+        }
+        writer.flag(true); // direct_8x8_inference_flag
+        bool cropping = fields.cropRight > 0 || fields.cropBottom > 0;
+        writer.flag(cropping);
+        if (cropping) {
+            writer.ue(0).ue(fields.cropRight).ue(0).ue(fields.cropBottom);
+        }
+        writer.flag(false); // vui_parameters_present_flag
+        return writer.finish();
+    }
+
+    inline std::vector<uint8_t> pps(uint32_t id, uint32_t spsId) {
+        BitstreamWriter writer(3, 8);
+        writer.ue(id).ue(spsId).flag(true).flag(false).ue(0).ue(0).ue(0);
+        writer.flag(false).bits(0, 2).se(0).se(0).se(0).flag(true).flag(false).flag(false);
+        return writer.finish();
+    }
+
+    // A slice of a progressive frame; firstMb 0 starts a picture.
+    inline std::vector<uint8_t> slice(bool idr, uint32_t frameNum, uint32_t picOrderCntLsb, uint32_t ppsId = 0,
+                                      uint32_t firstMb = 0) {
+        BitstreamWriter writer(idr ? 3 : 2, idr ? 5 : 1);
+        writer.ue(firstMb).ue(idr ? 7 : 5).ue(ppsId).bits(frameNum, 4);
+        if (idr) {
+            writer.ue(0); // idr_pic_id
+        }
+        writer.bits(picOrderCntLsb, 6);
+        writer.bits(0xA5, 8).bits(0x3C, 8).bits(0, 8).bits(0, 8).bits(1, 8);
+        return writer.finish();
+    }
+
+    // A packet of NAL units behind 4-byte start codes.
+    inline std::vector<uint8_t> annexB(const std::vector<std::vector<uint8_t>>& nals) {
+        std::vector<uint8_t> packet;
+        for (const auto& nal : nals) {
+            packet.insert(packet.end(), { 0, 0, 0, 1 });
+            packet.insert(packet.end(), nal.begin(), nal.end());
+        }
+        return packet;
+    }
+
+    // A packet of NAL units behind big-endian length prefixes of lengthSize bytes.
+    inline std::vector<uint8_t> lengthPrefixed(const std::vector<std::vector<uint8_t>>& nals, uint32_t lengthSize) {
+        std::vector<uint8_t> packet;
+        for (const auto& nal : nals) {
+            for (uint32_t i = lengthSize; i-- > 0;) {
+                packet.push_back(static_cast<uint8_t>(nal.size() >> (8 * i)));
+            }
+            packet.insert(packet.end(), nal.begin(), nal.end());
+        }
+        return packet;
+    }
+
+} // namespace H264TestStream
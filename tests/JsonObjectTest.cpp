@@ -0,0 +1,73 @@
+#include "TestHarness.hpp"
+#include "JsonObject.hpp"
+
+#include <stdexcept>
+#include <string>
+
+TEST_CASE(dumpKeepsInsertionOrder) {
+    JsonObject object;
+    object.set("b", 1).set("a", "x").set("c", true).set("d", nullptr);
+    CHECK_EQ(object.dump(), std::string("{\"b\":1,\"a\":\"x\",\"c\":true,\"d\":null}"));
+    // Replacing a value keeps its place.
+    object.set("b", 2.5);
+    CHECK_EQ(object.dump(), std::string("{\"b\":2.5,\"a\":\"x\",\"c\":true,\"d\":null}"));
+}
+
+TEST_CASE(parseReadsEveryValueType) {
+    JsonObject object = JsonObject::parse(" { \"s\" : \"text\", \"n\": -12, \"f\": 0.25, \"t\": true, \"z\": null } ");
+    CHECK_EQ(object.getString("s"), std::string("text"));
+    CHECK_EQ(object.getInt64("n"), -12);
+    CHECK(object.getBool("t", false));
+    CHECK(object.has("z"));
+    CHECK(!object.has("missing"));
+    CHECK_EQ(object.getString("missing", "fallback"), std::string("fallback"));
+    CHECK_EQ(object.getUint32("missing", 7), 7u);
+    CHECK(JsonObject::parse("{}").dump() == "{}");
+}
+
+TEST_CASE(stringsRoundTrip) {
+    std::string text = "quote \" backslash \\ newline \n tab \t control \x01 utf-8 \xc3\xa9";
+    JsonObject object;
+    object.set("k", text);
+    JsonObject parsed = JsonObject::parse(object.dump());
+    CHECK_EQ(parsed.getString("k"), text);
+    // \u escapes, including a surrogate pair, decode to UTF-8.
+    JsonObject escaped = JsonObject::parse("{\"k\":\"\\u00e9\\ud83d\\ude00\\/\"}");
+    CHECK_EQ(escaped.getString("k"), std::string("\xc3\xa9\xf0\x9f\x98\x80/"));
+}
+
+TEST_CASE(integersRoundTripExactly) {
+    JsonObject object;
+    object.set("max", int64_t(9007199254740991)).set("min", int64_t(-9007199254740991)).set("big", uint64_t(1) << 40);
+    std::string text = object.dump();
+    CHECK_EQ(text, std::string("{\"max\":9007199254740991,\"min\":-9007199254740991,\"big\":1099511627776}"));
+    JsonObject parsed = JsonObject::parse(text);
+    CHECK_EQ(parsed.getInt64("max"), int64_t(9007199254740991));
+    CHECK_EQ(parsed.getInt64("min"), int64_t(-9007199254740991));
+    CHECK_EQ(parsed.getUint64("big"), uint64_t(1) << 40);
+}
+
+TEST_CASE(malformedInputIsRejected) {
+    const char* inputs[] = {
+        "", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1} x", "[1]", "{\"a\":{}}", "{\"a\":[1]}",
+        "{\"a\":0x10}", "{\"a\":inf}", "{\"a\":\"\\q\"}", "{\"a\":\"\\ud83d\"}", "{\"a\":\"open}", "{\"a\":tru}",
+        "{\"a\":\"\x01\"}",
+    };
+    for (const char* input : inputs) {
+        CHECK_THROWS(JsonObject::parse(input), std::invalid_argument);
+    }
+}
+
+TEST_CASE(accessorsCheckTypesAndRanges) {
+    JsonObject object = JsonObject::parse("{\"s\":\"1\",\"neg\":-1,\"frac\":1.5,\"big\":4294967296,\"b\":true}");
+    CHECK_THROWS(object.getString("neg"), std::invalid_argument);
+    CHECK_THROWS(object.getString("missing"), std::invalid_argument);
+    CHECK_THROWS(object.getUint64("s"), std::invalid_argument);
+    CHECK_THROWS(object.getUint64("neg"), std::invalid_argument);
+    CHECK_THROWS(object.getUint64("frac"), std::invalid_argument);
+    CHECK_THROWS(object.getInt64("frac"), std::invalid_argument);
+    CHECK_THROWS(object.getUint32("big", 0), std::invalid_argument);
+    CHECK_THROWS(object.getBool("s", false), std::invalid_argument);
+    CHECK_EQ(object.getUint64("big"), 4294967296ull);
+    CHECK(object.getBool("b", false));
+}
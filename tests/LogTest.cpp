@@ -0,0 +1,212 @@
+#include "TestHarness.hpp"
+
+// Compiled out below Info, as in release builds.
+#undef VT_LOG_MIN_LEVEL
+#define VT_LOG_MIN_LEVEL 1
+#include "Log.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Redirects the console to strings while it lives. Lines logged before it are
+    // written out first, and lines logged during it before it restores the console.
+    class CapturedOutput {
+    public:
+        explicit CapturedOutput(std::streambuf* outBuffer = nullptr) {
+            Log::flush();
+            oldOut = std::cout.rdbuf(outBuffer ? outBuffer : out.rdbuf());
+            oldErr = std::cerr.rdbuf(err.rdbuf());
+        }
+        ~CapturedOutput() { restore(); }
+
+        void restore() {
+            if (oldOut) {
+                Log::flush();
+                std::cout.rdbuf(oldOut);
+                std::cerr.rdbuf(oldErr);
+                oldOut = nullptr;
+            }
+        }
+
+        std::ostringstream out;
+        std::ostringstream err;
+
+    private:
+        std::streambuf* oldOut = nullptr;
+        std::streambuf* oldErr = nullptr;
+    };
+
+    // Holds the writer thread in its first write until opened, so the test can fill
+    // the ring behind it.
+    class GatedBuffer : public std::stringbuf {
+    public:
+        void waitUntilBlocked() {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return blocked; });
+        }
+
+        void open() {
+            std::lock_guard<std::mutex> lock(mutex);
+            opened = true;
+            changed.notify_all();
+        }
+
+    protected:
+        std::streamsize xsputn(const char* text, std::streamsize count) override {
+            pass();
+            return std::stringbuf::xsputn(text, count);
+        }
+
+        int_type overflow(int_type c) override {
+            pass();
+            return std::stringbuf::overflow(c);
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool blocked = false;
+        bool opened = false;
+
+        void pass() {
+            std::unique_lock<std::mutex> lock(mutex);
+            blocked = true;
+            changed.notify_all();
+            changed.wait(lock, [this] { return opened; });
+        }
+    };
+
+    std::vector<std::string> lines(const std::string& text) {
+        std::vector<std::string> result;
+        std::istringstream stream(text);
+        std::string line;
+        while (std::getline(stream, line)) {
+            result.push_back(line);
+        }
+        return result;
+    }
+
+    int evaluated = 0;
+
+    int evaluate() {
+        return ++evaluated;
+    }
+}
+
+TEST_CASE(linesFromManyProducersArriveOnceAndInOrder) {
+    const int producers = 4;
+    const int linesPerRound = 1000;
+    const int rounds = 3;
+    uint64_t droppedBefore = Log::getDroppedCount();
+    CapturedOutput output;
+    // Each round stays below the ring's capacity, so no line may be dropped, and the
+    // rounds together wrap the ring.
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<std::thread> threads;
+        for (int producer = 0; producer < producers; ++producer) {
+            threads.emplace_back([producer, round] {
+                for (int i = 0; i < linesPerRound; ++i) {
+                    VT_LOG_INFO(producer << ' ' << round * linesPerRound + i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        Log::flush();
+    }
+    output.restore();
+
+    std::vector<int> next(producers, 0);
+    bool ordered = true;
+    for (const std::string& line : lines(output.out.str())) {
+        std::istringstream fields(line);
+        int producer = -1;
+        int index = -1;
+        fields >> producer >> index;
+        ordered &= producer >= 0 && producer < producers && index == next[producer];
+        if (producer >= 0 && producer < producers) {
+            ++next[producer];
+        }
+    }
+    CHECK(ordered);
+    for (int producer = 0; producer < producers; ++producer) {
+        CHECK_EQ(next[producer], rounds * linesPerRound);
+    }
+    CHECK_EQ(Log::getDroppedCount(), droppedBefore);
+    CHECK(output.err.str().empty());
+}
+
+TEST_CASE(aFullRingDropsAndCountsLines) {
+    GatedBuffer gate;
+    uint64_t droppedBefore = Log::getDroppedCount();
+    CapturedOutput output(&gate);
+    VT_LOG_INFO("blocked");
+    gate.waitUntilBlocked();
+    // The writer is stuck on the first line; more than a ring's worth goes in behind it.
+    const uint64_t pushed = 10000;
+    for (uint64_t i = 0; i < pushed; ++i) {
+        VT_LOG_INFO("queued " << i);
+    }
+    uint64_t dropped = Log::getDroppedCount() - droppedBefore;
+    gate.open();
+    output.restore();
+
+    std::vector<std::string> written = lines(gate.str());
+    CHECK(dropped > 0);
+    CHECK_EQ(written.size(), 1 + pushed - dropped);
+    // The lines that fit are the oldest ones, in order.
+    bool ordered = !written.empty() && written[0] == "blocked";
+    for (size_t i = 1; i < written.size(); ++i) {
+        ordered &= written[i] == "queued " + std::to_string(i - 1);
+    }
+    CHECK(ordered);
+    CHECK_EQ(output.err.str(), "Log: " + std::to_string(dropped) + " lines dropped\n");
+}
+
+TEST_CASE(levelsFilterAtRunAndCompileTime) {
+    CapturedOutput output;
+    Log::setLevel(LogLevel::Warning);
+    VT_LOG_INFO("hidden " << evaluate());
+    VT_LOG_WARNING("warning " << evaluate());
+    VT_LOG_ERROR("error");
+    // Below VT_LOG_MIN_LEVEL the call is gone whatever the run-time level is.
+    Log::setLevel(LogLevel::Debug);
+    VT_LOG_DEBUG("compiled out " << evaluate());
+    Log::setLevel(LogLevel::Info);
+    VT_LOG_INFO("info");
+    output.restore();
+
+    CHECK_EQ(evaluated, 1);
+    CHECK_EQ(output.out.str(), std::string("info\n"));
+    CHECK_EQ(output.err.str(), std::string("warning 1\nerror\n"));
+    LogLevel level = LogLevel::Info;
+    CHECK(Log::parseLevel("debug", level) && level == LogLevel::Debug);
+    CHECK(!Log::parseLevel("verbose", level));
+}
+
+// Last, since it leaves the status line open.
+TEST_CASE(queuedStatusUpdatesCoalesce) {
+    GatedBuffer gate;
+    CapturedOutput output(&gate);
+    VT_LOG_INFO("blocked");
+    gate.waitUntilBlocked();
+    Log::status("10%");
+    Log::status("20%");
+    VT_LOG_INFO("line");
+    Log::status("30%");
+    Log::status("40%");
+    gate.open();
+    output.restore();
+
+    // Only the newest status before each line, and the newest at the end, are printed;
+    // a line moves below the status line.
+    CHECK_EQ(gate.str(), std::string("blocked\n\r20%\nline\n\r40%"));
+}
@@ -0,0 +1,138 @@
+#include "TestHarness.hpp"
+#include "LookaheadKernels.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace LookaheadKernels;
+
+namespace {
+    // The definition the shader implements: the rounded mean of (sample >> shift) over
+    // the part of each block inside the picture.
+    std::vector<uint8_t> referenceDownscale(const std::vector<uint16_t>& plane, uint32_t width, uint32_t height,
+                                            uint32_t shift) {
+        uint32_t outWidth = getThumbnailWidth(width);
+        std::vector<uint8_t> out(static_cast<size_t>(outWidth) * getThumbnailHeight(height), 0);
+        for (uint32_t by = 0; by * BLOCK_SIZE < height; ++by) {
+            for (uint32_t bx = 0; bx * BLOCK_SIZE < width; ++bx) {
+                uint32_t sum = 0;
+                uint32_t count = 0;
+                for (uint32_t y = by * BLOCK_SIZE; y < height && y < (by + 1) * BLOCK_SIZE; ++y) {
+                    for (uint32_t x = bx * BLOCK_SIZE; x < width && x < (bx + 1) * BLOCK_SIZE; ++x) {
+                        sum += plane[static_cast<size_t>(y) * width + x] >> shift;
+                        ++count;
+                    }
+                }
+                out[static_cast<size_t>(by) * outWidth + bx] = static_cast<uint8_t>((sum + count / 2) / count);
+            }
+        }
+        return out;
+    }
+
+    // Runs both kernels over a random plane of the given size, stored with a row pitch
+    // wider than the picture, and compares them with the reference.
+    void checkDownscale(uint32_t width, uint32_t height, uint32_t bytesPerSample, std::mt19937& random) {
+        size_t pitch = (static_cast<size_t>(width) + 5) * bytesPerSample;
+        std::vector<uint8_t> storage(pitch * height + 1);
+        // Unaligned on purpose: the readback buffer is only guaranteed sample alignment.
+        uint8_t* base = storage.data() + (bytesPerSample == 1 ? 1 : 0);
+        std::vector<uint16_t> plane(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint16_t value = static_cast<uint16_t>(random());
+                if (bytesPerSample == 1) {
+                    value &= 0xff;
+                    base[y * pitch + x] = static_cast<uint8_t>(value);
+                } else {
+                    value &= 0xffc0; // 10 bits, MSB aligned as in P010
+                    reinterpret_cast<uint16_t*>(base + y * pitch)[x] = value;
+                }
+                plane[static_cast<size_t>(y) * width + x] = value;
+            }
+        }
+
+        std::vector<uint8_t> expected = referenceDownscale(plane, width, height, bytesPerSample == 2 ? 8 : 0);
+        std::vector<uint8_t> simd(expected.size(), 0xee);
+        std::vector<uint8_t> scalar(expected.size(), 0xee);
+        downscaleLuma(base, pitch, bytesPerSample, width, height, simd.data());
+        downscaleLumaScalar(base, pitch, bytesPerSample, width, height, scalar.data());
+        CHECK(simd == expected);
+        CHECK(scalar == expected);
+    }
+}
+
+TEST_CASE(thumbnailGeometry) {
+    CHECK_EQ(getThumbnailWidth(1920), 240u);
+    CHECK_EQ(getThumbnailHeight(1080), 135u);
+    // 13 blocks, padded to a multiple of 4.
+    CHECK_EQ(getThumbnailWidth(100), 16u);
+    CHECK_EQ(getThumbnailWidth(1), 4u);
+    CHECK_EQ(getThumbnailHeight(1), 1u);
+    CHECK_EQ(getThumbnailHeight(9), 2u);
+}
+
+TEST_CASE(downscaleMatchesTheReference8Bit) {
+    std::mt19937 random(1);
+    const uint32_t sizes[][2] = { { 8, 8 }, { 16, 16 }, { 1, 1 }, { 7, 3 }, { 17, 9 }, { 33, 31 },
+                                  { 64, 24 }, { 100, 37 }, { 129, 65 }, { 1920 / 8, 1080 / 8 } };
+    for (const auto& size : sizes) {
+        checkDownscale(size[0], size[1], 1, random);
+    }
+}
+
+TEST_CASE(downscaleMatchesTheReference16Bit) {
+    std::mt19937 random(2);
+    const uint32_t sizes[][2] = { { 8, 8 }, { 16, 16 }, { 15, 15 }, { 31, 17 }, { 48, 8 }, { 100, 37 }, { 257, 33 } };
+    for (const auto& size : sizes) {
+        checkDownscale(size[0], size[1], 2, random);
+    }
+}
+
+TEST_CASE(downscaleRoundsHalfUp) {
+    // A block of 32 ones and 32 zeros averages 0.5, which rounds up.
+    std::vector<uint8_t> plane(64, 0);
+    for (size_t i = 0; i < 32; ++i) {
+        plane[i] = 1;
+    }
+    uint8_t simd[4] = {};
+    uint8_t scalar[4] = {};
+    downscaleLuma(plane.data(), 8, 1, 8, 8, simd);
+    downscaleLumaScalar(plane.data(), 8, 1, 8, 8, scalar);
+    CHECK_EQ(static_cast<int>(simd[0]), 1);
+    CHECK_EQ(static_cast<int>(scalar[0]), 1);
+    // Padding columns are zero.
+    CHECK_EQ(simd[1] + simd[2] + simd[3], 0);
+}
+
+TEST_CASE(sumAbsDiffMatchesScalar) {
+    std::mt19937 random(3);
+    std::vector<uint8_t> a(1000);
+    std::vector<uint8_t> b(1000);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<uint8_t>(random());
+        b[i] = static_cast<uint8_t>(random());
+    }
+    // Every length around the vector widths, from unaligned starts.
+    for (size_t offset = 0; offset < 3; ++offset) {
+        for (size_t count = 0; count <= 70; ++count) {
+            uint64_t expected = 0;
+            for (size_t i = 0; i < count; ++i) {
+                int difference = a[offset + i] - b[offset + i];
+                expected += static_cast<uint64_t>(difference < 0 ? -difference : difference);
+            }
+            CHECK_EQ(sumAbsDiff(a.data() + offset, b.data() + offset, count), expected);
+            CHECK_EQ(sumAbsDiffScalar(a.data() + offset, b.data() + offset, count), expected);
+        }
+    }
+    CHECK_EQ(sumAbsDiff(a.data(), b.data(), a.size()), sumAbsDiffScalar(a.data(), b.data(), a.size()));
+}
+
+TEST_CASE(sumAbsDiffOfExtremes) {
+    // 255 per byte over many vectors must not overflow the SIMD accumulators.
+    std::vector<uint8_t> zeros(1 << 16, 0);
+    std::vector<uint8_t> full(1 << 16, 255);
+    CHECK_EQ(sumAbsDiff(zeros.data(), full.data(), zeros.size()), 255ull << 16);
+    CHECK_EQ(sumAbsDiff(full.data(), zeros.data(), zeros.size()), 255ull << 16);
+    CHECK_EQ(sumAbsDiff(full.data(), full.data(), full.size()), 0u);
+}
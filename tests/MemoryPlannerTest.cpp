@@ -0,0 +1,215 @@
+#include "TestHarness.hpp"
+#include "MemoryPlanner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace {
+    // Round numbers: the DPBs cost 100, a frame in flight 10 and a pool picture 1.
+    MemoryCosts costs() {
+        MemoryCosts costs;
+        costs.fixedBytes = 100;
+        costs.perFrameBytes = 10;
+        costs.perPictureBytes = 1;
+        return costs;
+    }
+
+    // 4 frames in flight and 8 lookahead frames need 13 pictures; the pool may grow to 20.
+    PipelineDepth requested() {
+        PipelineDepth depth;
+        depth.framesInFlight = 4;
+        depth.lookahead = 8;
+        depth.picturePoolSize = 16;
+        depth.picturePoolMaxSize = 20;
+        return depth;
+    }
+
+    void checkDepth(const MemoryPlan& plan, uint32_t framesInFlight, uint32_t lookahead, uint32_t poolMaxSize) {
+        CHECK_EQ(plan.depth.framesInFlight, framesInFlight);
+        CHECK_EQ(plan.depth.lookahead, lookahead);
+        CHECK_EQ(plan.depth.picturePoolMaxSize, poolMaxSize);
+    }
+
+    constexpr uint64_t FULL_BYTES = 100 + 4 * 10 + 20;
+}
+
+TEST_CASE(sizesAndCosts) {
+    CHECK_EQ(MemoryPlanner::pictureBytes(1920, 1080, 1, 8), 1920u * 1080 * 3 / 2);
+    CHECK_EQ(MemoryPlanner::pictureBytes(1920, 1080, 1, 10), 1920u * 1080 * 3);
+    CHECK_EQ(MemoryPlanner::pictureBytes(64, 64, 3, 8), 64u * 64 * 3);
+    CHECK_EQ(MemoryPlanner::pictureBytes(64, 64, 0, 8), 64u * 64);
+    CHECK_EQ(MemoryPlanner::minimumPoolSize(4, 8), 13u);
+    CHECK_EQ(MemoryPlanner::minimumPoolSize(4, 0), 4u);
+    CHECK_EQ(MemoryPlanner::requiredBytes(costs(), requested()), FULL_BYTES);
+}
+
+TEST_CASE(smallSizesAreNotLoggedAsZero) {
+    CHECK_EQ(MemoryPlanner::formatSize(0), std::string("0 KiB"));
+    CHECK_EQ(MemoryPlanner::formatSize(300 * 1024 + 1), std::string("301 KiB"));
+    CHECK_EQ(MemoryPlanner::formatSize(1024 * 1024), std::string("1.0 MiB"));
+    CHECK_EQ(MemoryPlanner::formatSize(1536 * 1024 + 10), std::string("1.5 MiB"));
+}
+
+TEST_CASE(requestedDepthIsKeptWhenItFits) {
+    MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), FULL_BYTES, 2);
+    checkDepth(plan, 4, 8, 20);
+    CHECK_EQ(plan.depth.picturePoolSize, 16u);
+    CHECK_EQ(plan.bytes, FULL_BYTES);
+    CHECK(plan.fits);
+    CHECK(!plan.reduced);
+}
+
+TEST_CASE(poolGrowthShrinksFirst) {
+    MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), FULL_BYTES - 1, 2);
+    checkDepth(plan, 4, 8, 19);
+    CHECK(plan.fits);
+    CHECK(plan.reduced);
+    // Down to the 13 pictures the depth needs, nothing else goes.
+    plan = MemoryPlanner::plan(costs(), requested(), 153, 2);
+    checkDepth(plan, 4, 8, 13);
+    // The pool's initial size never exceeds its limit.
+    CHECK_EQ(plan.depth.picturePoolSize, 13u);
+}
+
+TEST_CASE(lookaheadShrinksNextDownToOne) {
+    // One lookahead frame less frees a picture from the pool minimum.
+    MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), 152, 2);
+    checkDepth(plan, 4, 7, 12);
+    plan = MemoryPlanner::plan(costs(), requested(), 146, 2);
+    checkDepth(plan, 4, 1, 6);
+    CHECK(plan.fits);
+}
+
+TEST_CASE(framesInFlightShrinkLast) {
+    MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), 145, 2);
+    checkDepth(plan, 3, 1, 6);
+    CHECK(plan.fits);
+    plan = MemoryPlanner::plan(costs(), requested(), 135, 2);
+    checkDepth(plan, 3, 1, 5);
+    plan = MemoryPlanner::plan(costs(), requested(), 124, 2);
+    checkDepth(plan, 2, 1, 4);
+    CHECK(plan.fits);
+}
+
+TEST_CASE(eachStepKeepsTheEarlierStagesAtTheirFloor) {
+    // Walking the budget down, lookahead only drops once the pool is at its minimum for
+    // the frames above it, and frames in flight only once lookahead is at one.
+    MemoryPlan previous = MemoryPlanner::plan(costs(), requested(), FULL_BYTES, 2);
+    for (uint64_t available = FULL_BYTES; available >= 124; --available) {
+        MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), available, 2);
+        CHECK(plan.fits);
+        CHECK(plan.bytes <= available);
+        CHECK(plan.depth.framesInFlight <= previous.depth.framesInFlight);
+        CHECK(plan.depth.lookahead <= previous.depth.lookahead);
+        if (plan.depth.lookahead < 8) {
+            CHECK(plan.depth.picturePoolMaxSize <=
+                  MemoryPlanner::minimumPoolSize(plan.depth.framesInFlight, plan.depth.lookahead + 1));
+        }
+        if (plan.depth.framesInFlight < 4) {
+            CHECK_EQ(plan.depth.lookahead, 1u);
+        }
+        CHECK(plan.depth.picturePoolMaxSize >= MemoryPlanner::minimumPoolSize(plan.depth.framesInFlight, plan.depth.lookahead));
+        previous = plan;
+    }
+}
+
+TEST_CASE(smallestDepthIsTheFloor) {
+    // Below the floor the smallest depth comes back, marked as not fitting.
+    MemoryPlan plan = MemoryPlanner::plan(costs(), requested(), 123, 2);
+    checkDepth(plan, 2, 1, 4);
+    CHECK_EQ(plan.bytes, 124u);
+    CHECK(!plan.fits);
+    CHECK(plan.reduced);
+    plan = MemoryPlanner::plan(costs(), requested(), 0, 0);
+    checkDepth(plan, 1, 1, 3);
+
+    // Without lookahead, the floor is one picture per frame in flight.
+    PipelineDepth noLookahead = requested();
+    noLookahead.lookahead = 0;
+    plan = MemoryPlanner::plan(costs(), noLookahead, 0, 2);
+    checkDepth(plan, 2, 0, 2);
+    // A minimum above the request is the request.
+    plan = MemoryPlanner::plan(costs(), requested(), 0, 9);
+    checkDepth(plan, 4, 1, 6);
+}
+
+TEST_CASE(budgetPlansAgainstWhatIsLeft) {
+    MemoryBudget budget;
+    MemoryPlan first;
+    MemoryReservation a = budget.reserve(300, costs(), requested(), 2, first);
+    CHECK(first.fits && !first.reduced);
+    CHECK_EQ(a.getBytes(), FULL_BYTES);
+    CHECK_EQ(budget.getReserved(), FULL_BYTES);
+
+    MemoryPlan second;
+    MemoryReservation b = budget.reserve(300, costs(), requested(), 2, second);
+    checkDepth(second, 3, 1, 6);
+    CHECK_EQ(budget.getReserved(), FULL_BYTES + 136);
+
+    // Moving a reservation moves the bytes; assigning over one gives its bytes back.
+    MemoryReservation moved = std::move(b);
+    CHECK_EQ(b.getBytes(), 0u);
+    CHECK_EQ(budget.getReserved(), FULL_BYTES + 136);
+    a = std::move(moved);
+    CHECK_EQ(budget.getReserved(), 136u);
+    a = MemoryReservation();
+    CHECK_EQ(budget.getReserved(), 0u);
+}
+
+TEST_CASE(limitCapsTheDeviceBudget) {
+    MemoryBudget budget;
+    budget.setLimit(146);
+    CHECK_EQ(budget.getLimit(), 146u);
+    MemoryPlan plan;
+    MemoryReservation reservation = budget.reserve(1000, costs(), requested(), 2, plan);
+    checkDepth(plan, 4, 1, 6);
+    // A device budget below the limit wins.
+    MemoryBudget other;
+    other.setLimit(1000);
+    MemoryReservation smaller = other.reserve(152, costs(), requested(), 2, plan);
+    checkDepth(plan, 4, 7, 12);
+}
+
+TEST_CASE(aloneTheSmallestDepthGoesAhead) {
+    MemoryBudget budget;
+    MemoryPlan plan;
+    {
+        MemoryReservation reservation = budget.reserve(50, costs(), requested(), 2, plan);
+        CHECK(!plan.fits);
+        CHECK_EQ(reservation.getBytes(), 124u);
+        CHECK_EQ(budget.getReserved(), 124u);
+    }
+    CHECK_EQ(budget.getReserved(), 0u);
+}
+
+TEST_CASE(admissionWaitsForAReservationToBeReleased) {
+    MemoryBudget budget;
+    MemoryPlan firstPlan;
+    std::optional<MemoryReservation> first(budget.reserve(200, costs(), requested(), 2, firstPlan));
+    CHECK_EQ(budget.getReserved(), FULL_BYTES);
+
+    // 40 bytes are left and the second transcode needs at least 124, so it waits.
+    std::atomic<bool> admitted{ false };
+    MemoryPlan secondPlan;
+    uint64_t reservedWhileHeld = 0;
+    std::thread second([&] {
+        MemoryReservation reservation = budget.reserve(200, costs(), requested(), 2, secondPlan);
+        reservedWhileHeld = budget.getReserved();
+        admitted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!admitted);
+    CHECK_EQ(budget.getReserved(), FULL_BYTES);
+
+    // Destroying the first reservation wakes it, and it gets the full depth.
+    first.reset();
+    second.join();
+    CHECK(admitted);
+    CHECK(secondPlan.fits);
+    CHECK(!secondPlan.reduced);
+    CHECK_EQ(reservedWhileHeld, FULL_BYTES);
+    CHECK_EQ(budget.getReserved(), 0u);
+}
@@ -0,0 +1,116 @@
+#include "TestHarness.hpp"
+#include "Metrics.hpp"
+#include "JsonObject.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    bool contains(const std::string& text, const std::string& part) {
+        return text.find(part) != std::string::npos;
+    }
+}
+
+TEST_CASE(countersAndGaugesRenderWithHelpAndType) {
+    MetricsRegistry registry;
+    registry.counter("frames_total", "Frames transcoded.").add(42);
+    registry.gauge("queue_depth", "Frames queued.").set(-3);
+    std::string text = registry.renderPrometheus();
+    // Sorted by name, each sample after its HELP and TYPE lines.
+    CHECK_EQ(text, std::string("# HELP frames_total Frames transcoded.\n"
+                               "# TYPE frames_total counter\n"
+                               "frames_total 42\n"
+                               "# HELP queue_depth Frames queued.\n"
+                               "# TYPE queue_depth gauge\n"
+                               "queue_depth -3\n"));
+}
+
+TEST_CASE(helpTextIsEscaped) {
+    MetricsRegistry registry;
+    registry.counter("escaped_total", "A \\ backslash\nand a newline.");
+    CHECK(contains(registry.renderPrometheus(), "# HELP escaped_total A \\\\ backslash\\nand a newline.\n"));
+}
+
+TEST_CASE(histogramBucketsAreCumulative) {
+    MetricsRegistry registry;
+    MetricHistogram& histogram = registry.histogram("latency_seconds", "Latency.", { 0.125, 0.25, 1, 2.5 });
+    // On a bound counts in that bucket ("le"); above the last goes to +Inf. Binary
+    // fractions keep the sum exact.
+    for (double value : { 0.0625, 0.125, 0.1875, 0.25, 0.5, 3.0, 7.0 }) {
+        histogram.observe(value);
+    }
+    std::string text = registry.renderPrometheus();
+    CHECK(contains(text, "# TYPE latency_seconds histogram\n"));
+    CHECK(contains(text, "latency_seconds_bucket{le=\"0.125\"} 2\n"
+                         "latency_seconds_bucket{le=\"0.25\"} 4\n"
+                         "latency_seconds_bucket{le=\"1\"} 5\n"
+                         "latency_seconds_bucket{le=\"2.5\"} 5\n"
+                         "latency_seconds_bucket{le=\"+Inf\"} 7\n"
+                         "latency_seconds_sum 11.125\n"
+                         "latency_seconds_count 7\n"));
+}
+
+TEST_CASE(boundsRenderAsShortestExactValues) {
+    MetricsRegistry registry;
+    registry.histogram("bounds_seconds", "Bounds.", { 1e-7, 0.1, 123456789 });
+    std::string text = registry.renderPrometheus();
+    CHECK(contains(text, "bounds_seconds_bucket{le=\"1e-07\"} 0\n"));
+    CHECK(contains(text, "bounds_seconds_bucket{le=\"0.1\"} 0\n"));
+    CHECK(contains(text, "bounds_seconds_bucket{le=\"123456789\"} 0\n"));
+    CHECK(contains(text, "bounds_seconds_sum 0\n"));
+}
+
+TEST_CASE(jsonHasHistogramSummaries) {
+    MetricsRegistry registry;
+    registry.counter("frames_total", "Frames.").add(7);
+    MetricHistogram& histogram = registry.histogram("latency_seconds", "Latency.", { 1, 2, 3, 4 });
+    for (int i = 0; i < 4; ++i) {
+        histogram.observe(0.5 + i);
+    }
+    JsonObject json;
+    registry.renderJson(json);
+    CHECK_EQ(json.getUint64("frames_total"), 7u);
+    CHECK_EQ(json.getUint64("latency_seconds_count"), 4u);
+    CHECK_EQ(json.getUint64("latency_seconds_sum"), 8u);
+    // The second of four values, at the top of the second bucket.
+    CHECK_EQ(json.getUint64("latency_seconds_p50"), 2u);
+    CHECK(json.has("latency_seconds_p99"));
+}
+
+TEST_CASE(aNameKeepsItsKind) {
+    MetricsRegistry registry;
+    MetricCounter& counter = registry.counter("jobs_total", "Jobs.");
+    CHECK(&registry.counter("jobs_total", "Jobs.") == &counter);
+    CHECK_THROWS(registry.gauge("jobs_total", "Jobs."), std::logic_error);
+    CHECK_THROWS(MetricHistogram({ 1, 1 }), std::invalid_argument);
+}
+
+TEST_CASE(concurrentUpdatesAreNotLost) {
+    MetricsRegistry registry;
+    MetricCounter& counter = registry.counter("updates_total", "Updates.");
+    MetricHistogram& histogram = registry.histogram("values", "Values.", { 0.5 });
+    const int threadCount = 4;
+    const int updates = 20000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < updates; ++i) {
+                counter.add();
+                // Sums of 0.25 and 1 are exact, so a lost CAS would show.
+                histogram.observe(i % 2 ? 0.25 : 1.0);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK_EQ(counter.get(), static_cast<uint64_t>(threadCount * updates));
+    CHECK_EQ(histogram.getSum(), threadCount * updates / 2 * 1.25);
+    std::string text = registry.renderPrometheus();
+    CHECK(contains(text, "updates_total 80000\n"));
+    CHECK(contains(text, "values_bucket{le=\"0.5\"} 40000\n"));
+    CHECK(contains(text, "values_count 80000\n"));
+}
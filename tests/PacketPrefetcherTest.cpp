@@ -0,0 +1,75 @@
+#include "TestHarness.hpp"
+#include "PacketPrefetcher.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+    // A demuxer that numbers its packets and ends, or fails, after a given count.
+    PacketPrefetcher::PacketSource countingSource(std::atomic<int64_t>& read, int64_t count, bool fail) {
+        return [&read, count, fail](AVPacket* packet) {
+            if (read == count) {
+                if (fail) {
+                    throw std::runtime_error("Read error");
+                }
+                return false;
+            }
+            if (av_new_packet(packet, 16) < 0) {
+                throw std::runtime_error("Failed to allocate packet");
+            }
+            packet->pts = read++;
+            return true;
+        };
+    }
+}
+
+TEST_CASE(packetsComeOutInOrder) {
+    TaskPool pool(2);
+    std::atomic<int64_t> read{ 0 };
+    PacketPrefetcher prefetcher(countingSource(read, 100, false), pool, 8);
+    AVPacket* packet = av_packet_alloc();
+    int64_t next = 0;
+    bool ordered = true;
+    while (prefetcher.readPacket(packet)) {
+        ordered &= packet->pts == next++;
+        av_packet_unref(packet);
+    }
+    CHECK(ordered);
+    CHECK_EQ(next, 100);
+    CHECK(!prefetcher.readPacket(packet));
+    av_packet_free(&packet);
+}
+
+TEST_CASE(aFailedReadIsRethrownAfterThePacketsBeforeIt) {
+    TaskPool pool(2);
+    std::atomic<int64_t> read{ 0 };
+    PacketPrefetcher prefetcher(countingSource(read, 5, true), pool, 8);
+    AVPacket* packet = av_packet_alloc();
+    for (int64_t i = 0; i < 5; ++i) {
+        CHECK(prefetcher.readPacket(packet));
+        CHECK_EQ(packet->pts, i);
+        av_packet_unref(packet);
+    }
+    // Neither this read nor a retry waits for a read that will never come.
+    CHECK_THROWS(prefetcher.readPacket(packet), std::runtime_error);
+    CHECK_THROWS(prefetcher.readPacket(packet), std::runtime_error);
+    av_packet_free(&packet);
+}
+
+TEST_CASE(destroyingStopsReadingAhead) {
+    TaskPool pool(2);
+    std::atomic<int64_t> read{ 0 };
+    {
+        PacketPrefetcher prefetcher(countingSource(read, -1, false), pool, 4);
+        AVPacket* packet = av_packet_alloc();
+        CHECK(prefetcher.readPacket(packet));
+        av_packet_free(&packet);
+    }
+    // At most the packet read and one of each blank packet.
+    CHECK(read <= 5);
+}
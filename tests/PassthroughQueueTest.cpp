@@ -0,0 +1,143 @@
+#include "TestHarness.hpp"
+#include "PassthroughQueue.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace {
+    // Packets are only referenced, so a tag in the pointer is enough to tell them apart.
+    AVPacket* fakePacket(uintptr_t tag) {
+        return reinterpret_cast<AVPacket*>(tag);
+    }
+
+    uintptr_t tagOf(const PassthroughQueue::Entry& entry) {
+        return reinterpret_cast<uintptr_t>(entry.packet);
+    }
+
+    // One packet in the output, in write order.
+    struct Written {
+        bool video;
+        int64_t dtsMicroseconds;
+    };
+
+    void writeDue(PassthroughQueue& queue, int64_t videoDts, std::vector<Written>& output) {
+        PassthroughQueue::Entry entry;
+        while (queue.popDue(videoDts, entry)) {
+            output.push_back({ false, entry.dtsMicroseconds });
+        }
+    }
+}
+
+TEST_CASE(audioIsInterleavedByDecodeTime) {
+    // 48 kHz AAC (21.333 ms frames) demuxed with 25 fps video, whose encoded packets
+    // come out of the pipeline 8 frames after their source packets were read.
+    PassthroughQueue queue;
+    std::vector<Written> output;
+    const int64_t audioFrame = 1024 * 1000000 / 48000;
+    const int64_t videoFrame = 40000;
+    int64_t nextAudio = 0;
+    uintptr_t tag = 1;
+    size_t maxQueued = 0;
+    for (int frame = 0; frame < 100; ++frame) {
+        int64_t demuxedUpTo = (frame + 8) * videoFrame;
+        while (nextAudio <= demuxedUpTo) {
+            queue.push(fakePacket(tag++), nextAudio);
+            nextAudio += audioFrame;
+        }
+        maxQueued = std::max(maxQueued, queue.size());
+        int64_t videoDts = frame * videoFrame;
+        writeDue(queue, videoDts, output);
+        output.push_back({ true, videoDts });
+    }
+    PassthroughQueue::Entry entry;
+    while (queue.pop(entry)) {
+        output.push_back({ false, entry.dtsMicroseconds });
+    }
+
+    // One read of the input gives one output in decode order, without forcing.
+    CHECK_EQ(queue.getForcedCount(), 0u);
+    size_t audioPackets = 0;
+    for (size_t i = 0; i < output.size(); ++i) {
+        audioPackets += output[i].video ? 0 : 1;
+        if (i > 0) {
+            CHECK(output[i].dtsMicroseconds >= output[i - 1].dtsMicroseconds);
+        }
+    }
+    CHECK_EQ(audioPackets, tag - 1);
+    // The queue holds no more than the pipeline's lead of 8 frames in audio.
+    CHECK(maxQueued <= 8 * videoFrame / audioFrame + 2);
+}
+
+TEST_CASE(packetsWaitForTheVideo) {
+    PassthroughQueue queue;
+    queue.push(fakePacket(1), 0);
+    queue.push(fakePacket(2), 30000);
+    queue.push(fakePacket(3), 50000);
+    PassthroughQueue::Entry entry;
+    CHECK(queue.popDue(40000, entry));
+    CHECK_EQ(tagOf(entry), 1u);
+    CHECK(queue.popDue(40000, entry));
+    CHECK_EQ(tagOf(entry), 2u);
+    CHECK(!queue.popDue(40000, entry));
+    CHECK_EQ(queue.size(), 1u);
+    // A video packet without a decode time orders nothing.
+    CHECK(!queue.popDue(PassthroughQueue::UNKNOWN_DTS, entry));
+    // Equal decode times go before the video.
+    CHECK(queue.popDue(50000, entry));
+    CHECK_EQ(tagOf(entry), 3u);
+    CHECK(queue.empty());
+}
+
+TEST_CASE(packetsWithoutTimestampsGoWithTheNextVideoPacket) {
+    PassthroughQueue queue;
+    queue.push(fakePacket(1), PassthroughQueue::UNKNOWN_DTS);
+    queue.push(fakePacket(2), 80000);
+    PassthroughQueue::Entry entry;
+    CHECK(queue.popDue(0, entry));
+    CHECK_EQ(tagOf(entry), 1u);
+    CHECK(!queue.popDue(0, entry));
+    CHECK_EQ(queue.getForcedCount(), 0u);
+}
+
+TEST_CASE(queueSpanIsBounded) {
+    // With the video stalled, packets leave once the queue spans more than a second.
+    PassthroughQueue queue(1000000, 100);
+    std::vector<Written> output;
+    for (int i = 0; i <= 60; ++i) {
+        queue.push(fakePacket(i + 1), i * 20000);
+        writeDue(queue, PassthroughQueue::UNKNOWN_DTS, output);
+    }
+    // 0..1.2 s queued: everything more than 1 s before the newest packet has gone.
+    CHECK_EQ(output.size(), 10u);
+    CHECK_EQ(queue.getForcedCount(), 10u);
+    CHECK_EQ(output.front().dtsMicroseconds, 0);
+    CHECK_EQ(output.back().dtsMicroseconds, 180000);
+    CHECK_EQ(queue.size(), 51u);
+}
+
+TEST_CASE(queueCountIsBounded) {
+    // Packets without timestamps are only bounded by the count.
+    PassthroughQueue queue(1000000, 4);
+    std::vector<Written> output;
+    for (int i = 0; i < 10; ++i) {
+        queue.push(fakePacket(i + 1), PassthroughQueue::UNKNOWN_DTS);
+        writeDue(queue, PassthroughQueue::UNKNOWN_DTS, output);
+        CHECK(queue.size() <= 4u);
+    }
+    CHECK_EQ(output.size(), 6u);
+    CHECK_EQ(queue.getForcedCount(), 6u);
+}
+
+TEST_CASE(popTakesEverythingInArrivalOrder) {
+    PassthroughQueue queue;
+    queue.push(fakePacket(1), 500000);
+    queue.push(fakePacket(2), PassthroughQueue::UNKNOWN_DTS);
+    queue.push(fakePacket(3), 100);
+    PassthroughQueue::Entry entry;
+    std::vector<uintptr_t> order;
+    while (queue.pop(entry)) {
+        order.push_back(tagOf(entry));
+    }
+    CHECK(order == std::vector<uintptr_t>({ 1, 2, 3 }));
+}
@@ -0,0 +1,70 @@
+// Cost of packing a multi-slice picture for decode, against copying the packet as-is,
+// which is what decodeFrame did before the PictureAssembler. The pictures are
+// synthetic AVCC access units of one IDR split into equal slices.
+//
+//   PictureAssemblerBenchmark [picture KiB] [iterations]
+#include "H264TestStream.hpp"
+#include "PictureAssembler.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace H264TestStream;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr uint32_t NAL_LENGTH_SIZE = 4;
+    constexpr uint32_t SLICE_COUNTS[] = { 1, 4, 8, 16, 68 };
+
+    // An SPS, a PPS and sliceCount slices of about pictureSize bytes in all. The slice
+    // data is filled with 0x5A, so it has no start code or emulation prevention bytes.
+    std::vector<uint8_t> picture(size_t pictureSize, uint32_t sliceCount) {
+        std::vector<std::vector<uint8_t>> nals = { sps(SpsFields{}), pps(0, 0) };
+        for (uint32_t i = 0; i < sliceCount; ++i) {
+            std::vector<uint8_t> nal = slice(true, 0, 0, 0, i * 8);
+            nal.resize(pictureSize / sliceCount, 0x5A);
+            nals.push_back(std::move(nal));
+        }
+        return lengthPrefixed(nals, NAL_LENGTH_SIZE);
+    }
+
+    template <typename Pack>
+    double microsecondsPerPicture(uint32_t iterations, Pack pack) {
+        // One untimed pass warms the caches the timed ones run in.
+        pack();
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < iterations; ++i) {
+            pack();
+        }
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t pictureSize = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256) * 1024;
+    uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 2000;
+    std::printf("%zu KiB pictures, %u iterations\n", pictureSize / 1024, iterations);
+    std::printf("%16s %14s %14s\n", "slices/picture", "memcpy us", "assemble us");
+    for (uint32_t sliceCount : SLICE_COUNTS) {
+        std::vector<uint8_t> packet = picture(pictureSize, sliceCount);
+        std::vector<uint8_t> buffer(PictureAssembler::packedSizeBound(packet.size(), sliceCount + 2));
+        PictureAssembler assembler(NAL_LENGTH_SIZE);
+        double copy = microsecondsPerPicture(iterations, [&] {
+            std::memcpy(buffer.data(), packet.data(), packet.size());
+        });
+        double assemble = microsecondsPerPicture(iterations, [&] {
+            assembler.assemble(packet.data(), packet.size(), buffer.data(), buffer.size());
+        });
+        if (assembler.getSliceOffsets().size() != sliceCount) {
+            std::fprintf(stderr, "Assembled %zu slices, expected %u\n", assembler.getSliceOffsets().size(), sliceCount);
+            return 1;
+        }
+        std::printf("%16u %14.1f %14.1f\n", sliceCount, copy, assemble);
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "TestHarness.hpp"
+#include "H264ParameterSets.hpp"
+#include "H264TestStream.hpp"
+#include "PictureAssembler.hpp"
+#include "VideoTrackSize.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace H264TestStream;
+
+namespace {
+    bool packedAt(const std::vector<uint8_t>& buffer, uint32_t offset, const std::vector<uint8_t>& nal) {
+        return offset + 3 + nal.size() <= buffer.size() && buffer[offset] == 0 && buffer[offset + 1] == 0 &&
+               buffer[offset + 2] == 1 && std::memcmp(buffer.data() + offset + 3, nal.data(), nal.size()) == 0;
+    }
+
+    // One picture as VideoTranscoder::decodeFrame sees it.
+    struct Picture {
+        bool idr;
+        uint32_t displayWidth;
+        uint32_t displayHeight;
+        bool parametersChanged;
+    };
+
+    Picture assemble(PictureAssembler& assembler, H264ParameterSets& parameterSets, const std::vector<uint8_t>& packet) {
+        std::vector<uint8_t> buffer(PictureAssembler::packedSizeBound(packet.size(), 8));
+        assembler.assemble(packet.data(), packet.size(), buffer.data(), buffer.size());
+        Picture picture{};
+        for (const H264NalUnit& nal : assembler.getParameterSets()) {
+            picture.parametersChanged |= parameterSets.add(nal.data, nal.size);
+        }
+        const H264NalUnit& slice = assembler.getFirstSlice();
+        uint32_t ppsId = 0;
+        CHECK(H264Parser::parseSlicePpsId(slice.data, slice.size, ppsId));
+        const H264SequenceParameterSet* sps = parameterSets.getSps(parameterSets.getPps(ppsId)->std.seq_parameter_set_id);
+        picture.idr = (slice.data[0] & 0x1f) == H264Parser::NAL_IDR_SLICE;
+        picture.displayWidth = sps->displayWidth;
+        picture.displayHeight = sps->displayHeight;
+        return picture;
+    }
+
+    // 1280x720 for three frames, then 640x360 from an IDR that resends SPS 0.
+    std::vector<std::vector<uint8_t>> resolutionChangeStream() {
+        SpsFields large;
+        large.widthInMbs = 80;
+        large.heightInMapUnits = 45;
+        SpsFields small;
+        small.widthInMbs = 40;
+        small.heightInMapUnits = 23;
+        small.cropBottom = 4;
+        return {
+            annexB({ sps(large), pps(0, 0), slice(true, 0, 0) }),
+            annexB({ slice(false, 1, 2) }),
+            annexB({ slice(false, 2, 4) }),
+            annexB({ sps(small), pps(0, 0), slice(true, 0, 0) }),
+            annexB({ slice(false, 1, 2) }),
+        };
+    }
+}
+
+TEST_CASE(slicesArePackedBehindStartCodes) {
+    std::vector<uint8_t> spsNal = sps(SpsFields{});
+    std::vector<uint8_t> ppsNal = pps(0, 0);
+    std::vector<uint8_t> sei = { 0x06, 0x05, 0x01, 0xAA, 0x80 };
+    std::vector<uint8_t> first = slice(true, 0, 0);
+    std::vector<uint8_t> second = slice(true, 0, 0, 0, 1800);
+    std::vector<uint8_t> packet = lengthPrefixed({ spsNal, ppsNal, sei, first, second }, 4);
+
+    PictureAssembler assembler(4);
+    std::vector<uint8_t> buffer(PictureAssembler::packedSizeBound(packet.size(), 5));
+    size_t written = assembler.assemble(packet.data(), packet.size(), buffer.data(), buffer.size());
+    CHECK_EQ(written, 6 + first.size() + second.size());
+    CHECK(assembler.getSliceOffsets() == std::vector<uint32_t>({ 0, static_cast<uint32_t>(3 + first.size()) }));
+    CHECK(packedAt(buffer, 0, first));
+    CHECK(packedAt(buffer, assembler.getSliceOffsets()[1], second));
+    CHECK(assembler.getFirstSlice().size == first.size());
+    CHECK_EQ(assembler.getParameterSets().size(), 2u);
+    CHECK_EQ(assembler.getParameterSets()[0].size, spsNal.size());
+    CHECK_EQ(assembler.getParameterSets()[1].size, ppsNal.size());
+    CHECK_EQ(assembler.getStats().pictures, 1u);
+    CHECK_EQ(assembler.getStats().slices, 2u);
+    CHECK_EQ(assembler.getStats().maxSlicesPerPicture, 2u);
+    CHECK_EQ(assembler.getStats().skippedNalUnits, 3u);
+
+    // The next packet's lists replace this one's.
+    std::vector<uint8_t> next = lengthPrefixed({ slice(false, 1, 2) }, 4);
+    assembler.assemble(next.data(), next.size(), buffer.data(), buffer.size());
+    CHECK(assembler.getParameterSets().empty());
+    CHECK_EQ(assembler.getSliceOffsets().size(), 1u);
+}
+
+TEST_CASE(packingFitsTheBoundForShortPrefixes) {
+    // One-byte prefixes grow to three-byte start codes.
+    std::vector<std::vector<uint8_t>> slices;
+    for (uint32_t i = 0; i < 8; ++i) {
+        slices.push_back(slice(false, 1, 2, 0, i * 100));
+    }
+    std::vector<uint8_t> packet = lengthPrefixed(slices, 1);
+    PictureAssembler assembler(1);
+    std::vector<uint8_t> buffer(PictureAssembler::packedSizeBound(packet.size(), 8));
+    CHECK(assembler.assemble(packet.data(), packet.size(), buffer.data(), buffer.size()) > packet.size());
+}
+
+TEST_CASE(badPacketsAreRejected) {
+    CHECK_THROWS(PictureAssembler(5), std::invalid_argument);
+    PictureAssembler assembler(0);
+    std::vector<uint8_t> buffer(256);
+    std::vector<uint8_t> noSlice = annexB({ sps(SpsFields{}), pps(0, 0) });
+    CHECK_THROWS(assembler.assemble(noSlice.data(), noSlice.size(), buffer.data(), buffer.size()), std::runtime_error);
+    std::vector<uint8_t> twoPictures = annexB({ slice(false, 1, 2), slice(false, 2, 4) });
+    CHECK_THROWS(assembler.assemble(twoPictures.data(), twoPictures.size(), buffer.data(), buffer.size()), std::runtime_error);
+    std::vector<uint8_t> damaged = { 0x12, 0x34 };
+    CHECK_THROWS(assembler.assemble(damaged.data(), damaged.size(), buffer.data(), buffer.size()), std::runtime_error);
+    std::vector<uint8_t> picture = annexB({ slice(true, 0, 0) });
+    CHECK_THROWS(assembler.assemble(picture.data(), picture.size(), buffer.data(), 4), std::runtime_error);
+    CHECK_EQ(assembler.getStats().pictures, 0u);
+}
+
+TEST_CASE(resolutionChangeAtAnIdr) {
+    PictureAssembler assembler(0);
+    H264ParameterSets parameterSets;
+    std::vector<Picture> pictures;
+    for (const auto& packet : resolutionChangeStream()) {
+        pictures.push_back(assemble(assembler, parameterSets, packet));
+        if (parameterSets.hasPending()) {
+            parameterSets.commit(parameterSets.needsRecreate());
+        }
+    }
+    CHECK_EQ(pictures.size(), 5u);
+    for (size_t i = 0; i < pictures.size(); ++i) {
+        bool afterChange = i >= 3;
+        CHECK_EQ(pictures[i].idr, i == 0 || i == 3);
+        CHECK_EQ(pictures[i].displayWidth, afterChange ? 640u : 1280u);
+        CHECK_EQ(pictures[i].displayHeight, afterChange ? 360u : 720u);
+        CHECK_EQ(pictures[i].parametersChanged, i == 0 || i == 3);
+    }
+    // SPS 0 now has other content, which the decoder's parameters object cannot update.
+    CHECK_EQ(parameterSets.getStats().replaced, 1u);
+    CHECK_EQ(parameterSets.getSps(0)->codedHeight, 368u);
+
+    // The output track follows at the IDR when it was declared for changes ...
+    VideoTrackSize declared(1280, 720);
+    declared.allowChanges(1920, 1080);
+    for (const Picture& picture : pictures) {
+        if (picture.idr) {
+            declared.change(static_cast<int>(picture.displayWidth), static_cast<int>(picture.displayHeight));
+        }
+    }
+    CHECK_EQ(declared.getChangeCount(), 1u);
+    CHECK_EQ(declared.getPictureWidth(), 640);
+    CHECK_EQ(declared.getWidth(), 1920);
+    CHECK_EQ(declared.getHeight(), 1080);
+
+    // ... and the change fails the job when it was not.
+    VideoTrackSize fixed(1280, 720);
+    fixed.change(static_cast<int>(pictures[0].displayWidth), static_cast<int>(pictures[0].displayHeight));
+    CHECK_THROWS(fixed.change(static_cast<int>(pictures[3].displayWidth), static_cast<int>(pictures[3].displayHeight)),
+                 std::runtime_error);
+}
@@ -0,0 +1,150 @@
+#include "TestHarness.hpp"
+#include "BitstreamWriter.hpp"
+#include "H264Parser.hpp"
+#include "PictureOrderCounter.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // 16 frame_num and 16 pic_order_cnt_lsb values, progressive frames.
+    StdVideoH264SequenceParameterSet makeSps(StdVideoH264PocType pocType) {
+        StdVideoH264SequenceParameterSet sps{};
+        sps.pic_order_cnt_type = pocType;
+        sps.log2_max_frame_num_minus4 = 0;
+        sps.log2_max_pic_order_cnt_lsb_minus4 = 0;
+        sps.flags.frame_mbs_only_flag = 1;
+        return sps;
+    }
+
+    struct Slice {
+        bool idr;
+        bool reference;
+        uint32_t frameNum;
+        // pic_order_cnt_lsb for type 0, delta_pic_order_cnt[0] for type 1.
+        int32_t order;
+    };
+
+    std::vector<uint8_t> makeSlice(const Slice& slice, const StdVideoH264SequenceParameterSet& sps) {
+        BitstreamWriter writer(slice.reference ? 2 : 0, slice.idr ? H264Parser::NAL_IDR_SLICE : H264Parser::NAL_SLICE);
+        writer.ue(0).ue(slice.idr ? 7 : (slice.reference ? 5 : 6)).ue(0); // first_mb, slice_type, pps_id
+        writer.bits(slice.frameNum, sps.log2_max_frame_num_minus4 + 4u);
+        if (slice.idr) {
+            writer.ue(0); // idr_pic_id
+        }
+        if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_0) {
+            writer.bits(static_cast<uint32_t>(slice.order), sps.log2_max_pic_order_cnt_lsb_minus4 + 4u);
+        } else if (sps.pic_order_cnt_type == STD_VIDEO_H264_POC_TYPE_1 && !sps.flags.delta_pic_order_always_zero_flag) {
+            writer.se(slice.order);
+        }
+        // Some slice data, so the header is not at the end of the NAL unit.
+        writer.flag(true).ue(3).ue(0);
+        return writer.finish();
+    }
+
+    std::vector<int32_t> count(const std::vector<Slice>& slices, const StdVideoH264SequenceParameterSet& sps) {
+        StdVideoH264PictureParameterSet pps{};
+        PictureOrderCounter counter;
+        std::vector<int32_t> counts;
+        for (const Slice& slice : slices) {
+            std::vector<uint8_t> nal = makeSlice(slice, sps);
+            counts.push_back(counter.next(nal.data(), nal.size(), sps, pps));
+        }
+        return counts;
+    }
+}
+
+TEST_CASE(type0FollowsTheLsbAcrossWrapAround) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_0);
+    // I P B B P B B P B B in decode order, counting up by 2 per frame; the LSBs wrap at 16.
+    std::vector<Slice> slices = {
+        { true, true, 0, 0 }, { false, true, 1, 6 }, { false, false, 2, 2 }, { false, false, 2, 4 },
+        { false, true, 2, 12 }, { false, false, 3, 8 }, { false, false, 3, 10 },
+        { false, true, 3, 18 % 16 }, { false, false, 4, 14 }, { false, false, 4, 16 % 16 },
+    };
+    std::vector<int32_t> expected = { 0, 6, 2, 4, 12, 8, 10, 18, 14, 16 };
+    CHECK(count(slices, sps) == expected);
+}
+
+TEST_CASE(type0RestartsAtAnIdr) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_0);
+    std::vector<Slice> slices = {
+        { true, true, 0, 0 }, { false, true, 1, 6 }, { false, true, 2, 12 }, { false, true, 3, 2 },
+        { true, true, 0, 0 }, { false, true, 1, 2 },
+    };
+    // 12 to 2 is a wrap-around of the LSBs: 18.
+    std::vector<int32_t> expected = { 0, 6, 12, 18, 0, 2 };
+    CHECK(count(slices, sps) == expected);
+}
+
+TEST_CASE(type0IgnoresNonReferenceLsbs) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_0);
+    // The non-reference B at 15 counts back across the wrap-around, but does not move
+    // the MSBs the next P is counted from.
+    std::vector<Slice> slices = {
+        { true, true, 0, 0 }, { false, true, 1, 6 }, { false, false, 2, 15 }, { false, true, 2, 12 },
+    };
+    std::vector<int32_t> expected = { 0, 6, -1, 12 };
+    CHECK(count(slices, sps) == expected);
+}
+
+TEST_CASE(type1AppliesTheCycleOffsets) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_1);
+    int32_t offsets[] = { 4 };
+    sps.num_ref_frames_in_pic_order_cnt_cycle = 1;
+    sps.pOffsetForRefFrame = offsets;
+    sps.offset_for_non_ref_pic = -2;
+    // I P b P: the non-reference picture shows between the two Ps.
+    std::vector<Slice> slices = {
+        { true, true, 0, 0 }, { false, true, 1, 0 }, { false, false, 2, 0 }, { false, true, 2, 0 },
+        // delta_pic_order_cnt[0] moves a picture by itself.
+        { false, true, 3, 1 },
+    };
+    std::vector<int32_t> expected = { 0, 4, 2, 8, 13 };
+    CHECK(count(slices, sps) == expected);
+}
+
+TEST_CASE(type2FollowsFrameNum) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_2);
+    std::vector<Slice> slices = { { true, true, 0, 0 }, { false, true, 1, 0 }, { false, false, 2, 0 }, { false, true, 2, 0 } };
+    for (uint32_t frameNum = 3; frameNum < 16; ++frameNum) {
+        slices.push_back({ false, true, frameNum, 0 });
+    }
+    // frame_num wraps to 0 after 15.
+    slices.push_back({ false, true, 0, 0 });
+    std::vector<int32_t> counts = count(slices, sps);
+    CHECK_EQ(counts[0], 0);
+    CHECK_EQ(counts[1], 2);
+    CHECK_EQ(counts[2], 3);
+    CHECK_EQ(counts[3], 4);
+    CHECK_EQ(counts[counts.size() - 2], 30);
+    CHECK_EQ(counts.back(), 32);
+}
+
+TEST_CASE(bottomFieldDeltaIsRead) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_0);
+    StdVideoH264PictureParameterSet pps{};
+    pps.flags.bottom_field_pic_order_in_frame_present_flag = 1;
+    BitstreamWriter writer(2, H264Parser::NAL_SLICE);
+    writer.ue(0).ue(5).ue(0).bits(1, 4).bits(8, 4).se(-3).flag(true);
+    std::vector<uint8_t> nal = writer.finish();
+    H264SliceOrderFields fields;
+    CHECK(PictureOrderCounter::parseSlice(nal.data(), nal.size(), sps, pps, fields));
+    CHECK_EQ(fields.frameNum, 1u);
+    CHECK_EQ(fields.picOrderCntLsb, 8u);
+    CHECK_EQ(fields.deltaPicOrderCntBottom, -3);
+    // A frame is displayed at the earlier of its fields.
+    PictureOrderCounter counter;
+    CHECK_EQ(counter.next(fields, sps), 5);
+}
+
+TEST_CASE(truncatedSliceHeaderThrows) {
+    StdVideoH264SequenceParameterSet sps = makeSps(STD_VIDEO_H264_POC_TYPE_0);
+    sps.log2_max_pic_order_cnt_lsb_minus4 = 12;
+    StdVideoH264PictureParameterSet pps{};
+    const uint8_t nal[] = { 0x41, 0x9a };
+    H264SliceOrderFields fields;
+    CHECK(!PictureOrderCounter::parseSlice(nal, sizeof(nal), sps, pps, fields));
+    PictureOrderCounter counter;
+    CHECK_THROWS(counter.next(nal, sizeof(nal), sps, pps), std::runtime_error);
+}
@@ -0,0 +1,139 @@
+#include "TestHarness.hpp"
+#include "QualityKernels.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace QualityKernels;
+
+namespace {
+    const int BIT_DEPTHS[] = { 8, 10, MAX_BIT_DEPTH };
+
+    // count random samples below 2^bitDepth, starting one sample into the buffer so the
+    // loads are unaligned. extremes picks only 0 and the peak, the largest differences.
+    std::vector<uint16_t> randomRow(size_t count, int bitDepth, bool extremes, std::mt19937& random) {
+        uint32_t peak = (1u << bitDepth) - 1;
+        std::uniform_int_distribution<uint32_t> sample(0, peak);
+        std::vector<uint16_t> row(count + 1);
+        for (size_t i = 1; i < row.size(); ++i) {
+            uint32_t value = sample(random);
+            row[i] = static_cast<uint16_t>(extremes ? (value & 1 ? peak : 0) : value);
+        }
+        return row;
+    }
+
+    bool sameSums(const std::vector<BlockSums>& a, const std::vector<BlockSums>& b) {
+        bool same = a.size() == b.size();
+        for (size_t i = 0; same && i < a.size(); ++i) {
+            same = a[i].sumA == b[i].sumA && a[i].sumB == b[i].sumB && a[i].sumSquares == b[i].sumSquares &&
+                   a[i].sumProducts == b[i].sumProducts;
+        }
+        return same;
+    }
+}
+
+TEST_CASE(squaredErrorMatchesScalar) {
+    std::mt19937 random(39);
+    for (int bitDepth : BIT_DEPTHS) {
+        for (size_t count : { 0, 1, 7, 8, 9, 15, 17, 33, 1001, 1920 }) {
+            for (bool extremes : { false, true }) {
+                std::vector<uint16_t> a = randomRow(count, bitDepth, extremes, random);
+                std::vector<uint16_t> b = randomRow(count, bitDepth, extremes, random);
+                CHECK_EQ(sumSquaredError(a.data() + 1, b.data() + 1, count),
+                         sumSquaredErrorScalar(a.data() + 1, b.data() + 1, count));
+            }
+        }
+    }
+}
+
+TEST_CASE(squaredErrorOfThePeakDoesNotOverflow) {
+    // Every difference at its largest, in both directions: eight 32-bit lanes of two
+    // squares each must not wrap.
+    uint16_t peak = (1u << MAX_BIT_DEPTH) - 1;
+    std::vector<uint16_t> a(64, peak);
+    std::vector<uint16_t> b(64, 0);
+    for (size_t i = 0; i < a.size(); i += 2) {
+        std::swap(a[i], b[i]);
+    }
+    uint64_t expected = 64ull * peak * peak;
+    CHECK_EQ(sumSquaredError(a.data(), b.data(), a.size()), expected);
+    CHECK_EQ(sumSquaredErrorScalar(a.data(), b.data(), a.size()), expected);
+}
+
+TEST_CASE(blockSumsMatchScalar) {
+    std::mt19937 random(4);
+    for (int bitDepth : BIT_DEPTHS) {
+        for (size_t blocksX : { 1, 2, 3, 5, 17, 480 }) {
+            for (bool extremes : { false, true }) {
+                // Four rows plus the slack the verifier leaves after each.
+                std::vector<uint16_t> rowsA[4];
+                std::vector<uint16_t> rowsB[4];
+                const uint16_t* pointersA[4];
+                const uint16_t* pointersB[4];
+                for (int r = 0; r < 4; ++r) {
+                    rowsA[r] = randomRow(blocksX * 4 + 8, bitDepth, extremes, random);
+                    rowsB[r] = randomRow(blocksX * 4 + 8, bitDepth, extremes, random);
+                    pointersA[r] = rowsA[r].data() + 1;
+                    pointersB[r] = rowsB[r].data() + 1;
+                }
+                // Stale sums must be overwritten, not added to.
+                std::vector<BlockSums> simd(blocksX, BlockSums{ 1, 2, 3, 4 });
+                std::vector<BlockSums> scalar(blocksX, BlockSums{ 5, 6, 7, 8 });
+                accumulateBlockRow(pointersA, pointersB, blocksX, simd.data());
+                accumulateBlockRowScalar(pointersA, pointersB, blocksX, scalar.data());
+                CHECK(sameSums(simd, scalar));
+            }
+        }
+    }
+}
+
+TEST_CASE(blockSumsOfThePeak) {
+    uint64_t peak = (1u << MAX_BIT_DEPTH) - 1;
+    std::vector<uint16_t> row(16, static_cast<uint16_t>(peak));
+    const uint16_t* rows[4] = { row.data(), row.data(), row.data(), row.data() };
+    std::vector<BlockSums> sums(4);
+    accumulateBlockRow(rows, rows, sums.size(), sums.data());
+    for (const BlockSums& block : sums) {
+        CHECK_EQ(block.sumA, 16 * peak);
+        CHECK_EQ(block.sumB, 16 * peak);
+        CHECK_EQ(block.sumSquares, 32 * peak * peak);
+        CHECK_EQ(block.sumProducts, 16 * peak * peak);
+    }
+}
+
+TEST_CASE(widenedRowsMatchScalar) {
+    std::mt19937 random(14);
+    for (size_t width : { 1, 7, 8, 9, 15, 16, 17, 33, 1921 }) {
+        // 8-bit samples raised to 8, 10 and 14 bits, and 10-bit ones to 10 and 14.
+        std::vector<uint8_t> narrow(width + 1);
+        for (uint8_t& sample : narrow) {
+            sample = static_cast<uint8_t>(random());
+        }
+        std::vector<uint16_t> wideSamples = randomRow(width, 10, false, random);
+        std::vector<uint8_t> wide(wideSamples.size() * 2);
+        std::memcpy(wide.data(), wideSamples.data(), wide.size());
+        struct Case {
+            const uint8_t* row;
+            bool wide;
+            int shift;
+        } cases[] = {
+            { narrow.data() + 1, false, 0 },
+            { narrow.data() + 1, false, 2 },
+            { narrow.data() + 1, false, MAX_BIT_DEPTH - 8 },
+            // Two bytes in, so the 16-bit loads are unaligned too.
+            { wide.data() + 2, true, 0 },
+            { wide.data() + 2, true, MAX_BIT_DEPTH - 10 },
+        };
+        for (const Case& test : cases) {
+            std::vector<uint16_t> simd(width + 1, 0xBEEF);
+            std::vector<uint16_t> scalar(width + 1, 0xBEEF);
+            widenRow(test.row, test.wide, test.shift, width, simd.data());
+            widenRowScalar(test.row, test.wide, test.shift, width, scalar.data());
+            CHECK(simd == scalar);
+            CHECK_EQ(simd.back(), 0xBEEF);
+        }
+    }
+}
@@ -0,0 +1,155 @@
+#include "TestHarness.hpp"
+#include "RawVideoReader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+    // A directory of its own for each test, removed afterwards.
+    class TemporaryDirectory {
+    public:
+        explicit TemporaryDirectory(const std::string& name)
+            : path(std::filesystem::temp_directory_path() / (name + "-" + std::to_string(::getpid()))) {
+            std::filesystem::remove_all(path);
+            std::filesystem::create_directories(path);
+        }
+        ~TemporaryDirectory() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+
+        std::string write(const std::string& name, const std::string& contents) const {
+            std::string file = (path / name).string();
+            std::ofstream(file, std::ios::binary) << contents;
+            return file;
+        }
+
+    private:
+        std::filesystem::path path;
+    };
+
+    // size bytes counting up from first, so frames can be told apart.
+    std::string samples(size_t size, uint8_t first) {
+        std::string bytes(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            bytes[i] = static_cast<char>(first + i);
+        }
+        return bytes;
+    }
+
+    RawVideoReader openY4m(const TemporaryDirectory& directory, const std::string& contents) {
+        return RawVideoReader(directory.write("input.y4m", contents), RawVideoOptions());
+    }
+}
+
+TEST_CASE(y4mHeaderIsParsed) {
+    TemporaryDirectory directory("RawVideoReaderTest-header");
+    // 4x2 4:2:0 is 8 luma and two 2x1 chroma planes.
+    std::string frame0 = samples(12, 0);
+    std::string frame1 = samples(12, 100);
+    RawVideoReader reader = openY4m(directory, "YUV4MPEG2 W4 H2 F30000:1001 Ip A1:1 C420mpeg2 XYSCSS=420MPEG2\n"
+                                               "FRAME\n" + frame0 + "FRAME Ixyz\n" + frame1);
+    CHECK_EQ(reader.getWidth(), 4u);
+    CHECK_EQ(reader.getHeight(), 2u);
+    CHECK_EQ(reader.getFrameRate().num, 30000);
+    CHECK_EQ(reader.getFrameRate().den, 1001);
+    CHECK(reader.getPixelFormat() == RawPixelFormat::I420);
+    CHECK_EQ(reader.getFrameSize(), 12u);
+    const uint8_t* frame = reader.nextFrame();
+    CHECK(frame && std::string(reinterpret_cast<const char*>(frame), 12) == frame0);
+    // Frame parameters after the marker are skipped.
+    frame = reader.nextFrame();
+    CHECK(frame && std::string(reinterpret_cast<const char*>(frame), 12) == frame1);
+    CHECK(reader.nextFrame() == nullptr);
+    CHECK(reader.nextFrame() == nullptr);
+}
+
+TEST_CASE(y4mDefaultsToEightBit420) {
+    TemporaryDirectory directory("RawVideoReaderTest-default");
+    RawVideoReader reader = openY4m(directory, "YUV4MPEG2 W2 H2 F25:1\nFRAME\n" + samples(6, 0));
+    CHECK(reader.getPixelFormat() == RawPixelFormat::I420);
+    CHECK_EQ(reader.getBitDepth(), 8u);
+    CHECK(reader.nextFrame() != nullptr);
+}
+
+TEST_CASE(tenBitFramesUseTwoBytesPerSample) {
+    TemporaryDirectory directory("RawVideoReaderTest-10bit");
+    // Odd sizes round the chroma planes up: 3x3 luma and two 2x2 chroma planes.
+    size_t frameSize = (9 + 2 * 4) * 2;
+    RawVideoReader reader = openY4m(directory, "YUV4MPEG2 W3 H3 F25:1 C420p10\nFRAME\n" + samples(frameSize, 0));
+    CHECK(reader.getPixelFormat() == RawPixelFormat::I420P10);
+    CHECK_EQ(reader.getBitDepth(), 10u);
+    CHECK_EQ(reader.getFrameSize(), frameSize);
+    CHECK(reader.nextFrame() != nullptr);
+    CHECK(reader.nextFrame() == nullptr);
+}
+
+TEST_CASE(unsupportedY4mHeadersAreRejected) {
+    TemporaryDirectory directory("RawVideoReaderTest-reject");
+    std::string frame = "FRAME\n" + samples(6, 0);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:1 It\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:1 Im\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:1 C422\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:1 C444p10\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:0\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 F25:1\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 Wx H2 F25:1\n" + frame), std::runtime_error);
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG W2 H2 F25:1\n" + frame), std::runtime_error);
+    // No end to the header line.
+    CHECK_THROWS(openY4m(directory, "YUV4MPEG2 W2 H2 F25:1"), std::runtime_error);
+}
+
+TEST_CASE(aTruncatedLastFrameIsDropped) {
+    TemporaryDirectory directory("RawVideoReaderTest-truncated");
+    RawVideoReader reader = openY4m(directory, "YUV4MPEG2 W2 H2 F25:1\nFRAME\n" + samples(6, 0) + "FRAME\n" + samples(5, 0));
+    CHECK(reader.nextFrame() != nullptr);
+    CHECK(reader.nextFrame() == nullptr);
+    CHECK(reader.nextFrame() == nullptr);
+}
+
+TEST_CASE(aMissingFrameMarkerThrows) {
+    TemporaryDirectory directory("RawVideoReaderTest-marker");
+    RawVideoReader reader = openY4m(directory, "YUV4MPEG2 W2 H2 F25:1\nFRAME\n" + samples(6, 0) + "FRAMX\n" + samples(6, 0));
+    CHECK(reader.nextFrame() != nullptr);
+    CHECK_THROWS(reader.nextFrame(), std::runtime_error);
+}
+
+TEST_CASE(headerlessFilesUseTheGivenLayout) {
+    TemporaryDirectory directory("RawVideoReaderTest-headerless");
+    RawVideoOptions options;
+    options.format = RawVideoReader::parsePixelFormat("p010");
+    options.width = 4;
+    options.height = 2;
+    options.frameRate = { 50, 1 };
+    size_t frameSize = 12 * 2;
+    std::string path = directory.write("input.yuv", samples(frameSize, 0) + samples(frameSize, 50) + samples(3, 0));
+    CHECK(RawVideoReader::isRawInput(path, options));
+    CHECK(!RawVideoReader::isRawInput(path, RawVideoOptions()));
+    CHECK(RawVideoReader::isRawInput("clip.Y4M", RawVideoOptions()));
+
+    RawVideoReader reader(path, options);
+    CHECK(reader.getPixelFormat() == RawPixelFormat::P010);
+    CHECK_EQ(reader.getFrameSize(), frameSize);
+    CHECK_EQ(reader.getFrameCountEstimate(), 2u);
+    const uint8_t* first = reader.nextFrame();
+    const uint8_t* second = reader.nextFrame();
+    CHECK(first && second && second - first == static_cast<ptrdiff_t>(frameSize) && second[0] == 50);
+    // The 3 bytes left over are a truncated frame.
+    CHECK(reader.nextFrame() == nullptr);
+}
+
+TEST_CASE(headerlessFilesNeedAFormatAndSize) {
+    TemporaryDirectory directory("RawVideoReaderTest-options");
+    std::string path = directory.write("input.yuv", samples(12, 0));
+    RawVideoOptions options;
+    options.format = RawPixelFormat::I420;
+    CHECK_THROWS(RawVideoReader(path, options), std::invalid_argument);
+    CHECK_THROWS(RawVideoReader::parsePixelFormat("yuv444p"), std::invalid_argument);
+    CHECK_THROWS(RawVideoReader(directory.write("empty.y4m", ""), RawVideoOptions()), std::runtime_error);
+}
@@ -0,0 +1,313 @@
+#include "TestHarness.hpp"
+#include "AllocationCounter.hpp"
+#include "DisplayOrderQueue.hpp"
+#include "FramePipeline.hpp"
+#include "H264ParameterSets.hpp"
+#include "H264Parser.hpp"
+#include "H264TestStream.hpp"
+#include "PacketPool.hpp"
+#include "PacketPrefetcher.hpp"
+#include "PacketRing.hpp"
+#include "PassthroughQueue.hpp"
+#include "PictureAssembler.hpp"
+#include "PictureOrderCounter.hpp"
+#include "RingQueue.hpp"
+#include "TaskPool.hpp"
+#include "TimestampTracker.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Each case runs a per-frame path until its pools and queues have grown to what it
+// needs, then checks that a further window of frames allocates nothing.
+namespace {
+    constexpr int WARM_UP_FRAMES = 200;
+    constexpr int WINDOW_FRAMES = 2000;
+
+    template <typename Frame>
+    uint64_t allocationsInWindow(Frame frame) {
+        int index = 0;
+        for (; index < WARM_UP_FRAMES; ++index) {
+            frame(index);
+        }
+        uint64_t before = AllocationCounter::total();
+        for (; index < WARM_UP_FRAMES + WINDOW_FRAMES; ++index) {
+            frame(index);
+        }
+        return AllocationCounter::total() - before;
+    }
+}
+
+namespace {
+    // A 16-frame group of pictures in decode order, I P B B P B B ..., with SPS and PPS
+    // before the IDR as a broadcast stream resends them; NAL units are length-prefixed
+    // as in MP4. Frame k of the group is shown at display(k).
+    constexpr int GOP_FRAMES = 16;
+    constexpr int64_t FRAME_TICKS = 3600;
+
+    int display(int k) {
+        if (k == 0) {
+            return 0;
+        }
+        const int offsets[3] = { 3, 1, 2 };
+        return (k - 1) / 3 * 3 + offsets[(k - 1) % 3];
+    }
+
+    std::vector<std::vector<uint8_t>> groupOfPictures() {
+        std::vector<std::vector<uint8_t>> packets;
+        for (int k = 0; k < GOP_FRAMES; ++k) {
+            std::vector<std::vector<uint8_t>> nals;
+            if (k == 0) {
+                nals.push_back(H264TestStream::sps({}));
+                nals.push_back(H264TestStream::pps(0, 0));
+            }
+            uint32_t picOrderCntLsb = static_cast<uint32_t>(2 * display(k));
+            nals.push_back(H264TestStream::slice(k == 0, static_cast<uint32_t>(k), picOrderCntLsb));
+            packets.push_back(H264TestStream::lengthPrefixed(nals, 4));
+        }
+        return packets;
+    }
+
+    // Takes the video packets as H265Muxer::writePacket() does, and checks their order.
+    struct StubMuxer {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        int64_t lastDts = INT64_MIN;
+        bool ordered = true;
+
+        void writePacket(const uint8_t* data, int size, const FrameTimestamp& timestamp, bool) {
+            ordered &= timestamp.dts > lastDts && data[size] == 0;
+            lastDts = timestamp.dts;
+            bytes += static_cast<uint64_t>(size);
+            ++packets;
+        }
+    };
+
+    // VideoTranscoder's stages without the device: parse runs the same parsers on the
+    // packet, submit stands in for the decode and the encode by putting the picture in
+    // display order, readback copies a fake bitstream into a pooled packet and mux hands
+    // the packets whose timestamps are settled to the muxer.
+    struct TranscodeStages : FrameStages {
+        static constexpr size_t FRAMES_IN_FLIGHT = 4;
+        static constexpr uint32_t REORDER_DELAY = 2;
+
+        TimestampTracker timestamps{ { 1, 90000 }, { 1, 90000 }, { 25, 1 }, REORDER_DELAY, 0 };
+        PictureAssembler assembler{ 4 };
+        H264ParameterSets parameterSets;
+        PictureOrderCounter pictureOrder;
+        DisplayOrderQueue<int> displayQueue{ REORDER_DELAY };
+        RingQueue<int> inFlightFrames;
+        RingQueue<EncodedPacket> pendingPackets;
+        PacketPool packetPool{ 4096 };
+        std::vector<uint8_t> decodeBitstream = std::vector<uint8_t>(4096);
+        std::vector<uint8_t> encodeBitstream = std::vector<uint8_t>(1024, 0x5A);
+        StubMuxer muxer;
+        size_t bitstreamSize = 0;
+        bool idr = false;
+        int32_t picOrderCnt = 0;
+
+        TranscodeStages() {
+            inFlightFrames.reserve(FRAMES_IN_FLIGHT + 1);
+            pendingPackets.reserve(FRAMES_IN_FLIGHT + REORDER_DELAY + 1);
+        }
+
+        void parse(FrameJob& job) override {
+            const AVPacket* packet = job.packet;
+            timestamps.pushPacket(packet->pts, packet->dts, packet->duration);
+            bitstreamSize = assembler.assemble(packet->data, static_cast<size_t>(packet->size), decodeBitstream.data(),
+                                               decodeBitstream.size());
+            for (const H264NalUnit& nal : assembler.getParameterSets()) {
+                parameterSets.add(nal.data, nal.size);
+            }
+            const H264NalUnit& slice = assembler.getFirstSlice();
+            idr = (slice.data[0] & 0x1f) == H264Parser::NAL_IDR_SLICE;
+            uint32_t ppsId = 0;
+            CHECK(H264Parser::parseSlicePpsId(slice.data, slice.size, ppsId));
+            const H264PictureParameterSet* pps = parameterSets.getPps(ppsId);
+            const H264SequenceParameterSet* sps = parameterSets.getSps(pps->std.seq_parameter_set_id);
+            picOrderCnt = pictureOrder.next(slice.data, slice.size, sps->std, pps->std);
+        }
+        void submit(FrameJob& job) override {
+            if (parameterSets.hasPending()) {
+                parameterSets.commit(parameterSets.needsRecreate());
+            }
+            displayQueue.push(job.frameNumber, picOrderCnt, idr);
+            while (displayQueue.ready(false)) {
+                inFlightFrames.push_back(displayQueue.pop());
+            }
+        }
+        void readback(FrameJob&) override {
+            while (inFlightFrames.size() > FRAMES_IN_FLIGHT) {
+                EncodedPacket encoded;
+                encoded.size = static_cast<int>(encodeBitstream.size() - bitstreamSize % 64);
+                encoded.buffer = packetPool.getBuffer();
+                memcpy(encoded.buffer.data(), encodeBitstream.data(), static_cast<size_t>(encoded.size));
+                memset(encoded.buffer.data() + encoded.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+                encoded.idr = inFlightFrames.front() % GOP_FRAMES == 0;
+                pendingPackets.push_back(std::move(encoded));
+                inFlightFrames.pop_front();
+            }
+        }
+        void mux(FrameJob&) override {
+            while (!pendingPackets.empty() && timestamps.hasFrame(false)) {
+                EncodedPacket& encoded = pendingPackets.front();
+                muxer.writePacket(encoded.buffer.data(), encoded.size, timestamps.popFrame(), encoded.idr);
+                pendingPackets.pop_front();
+            }
+        }
+        void passthrough(FrameJob&) override {}
+    };
+}
+
+TEST_CASE(theCounterSeesAllocations) {
+    uint64_t before = AllocationCounter::total();
+    std::vector<int>* vector = new std::vector<int>(100);
+    delete vector;
+    CHECK_EQ(AllocationCounter::total() - before, 2u);
+}
+
+TEST_CASE(strandTasksDoNotAllocate) {
+    TaskPool pool(2);
+    TaskStrand strand(pool);
+    TaskStrand other(pool);
+    uint64_t sum = 0;
+    uint64_t allocations = allocationsInWindow([&](int frame) {
+        // Four stages of one frame, next to another session's.
+        for (int stage = 0; stage < 4; ++stage) {
+            strand.post([&sum, frame, stage] { sum += static_cast<uint64_t>(frame + stage); });
+            other.post([&pool] { (void)pool.getThreadCount(); });
+        }
+        strand.wait();
+        other.wait();
+    });
+    CHECK_EQ(allocations, 0u);
+    CHECK_EQ(pool.getStats().nodesAllocated, 0u);
+    CHECK(sum > 0);
+}
+
+TEST_CASE(prefetchingDoesNotAllocate) {
+    // The payload is the demuxer's; this covers the prefetcher's own queues and tasks.
+    TaskPool pool(2);
+    int64_t next = 0;
+    PacketPrefetcher prefetcher([&next](AVPacket* packet) {
+        packet->pts = next++;
+        return true;
+    }, pool, 8);
+    AVPacket* packet = av_packet_alloc();
+    bool ordered = true;
+    int64_t expected = 0;
+    uint64_t allocations = allocationsInWindow([&](int) {
+        ordered &= prefetcher.readPacket(packet) && packet->pts == expected++;
+        av_packet_unref(packet);
+    });
+    av_packet_free(&packet);
+    CHECK_EQ(allocations, 0u);
+    CHECK(ordered);
+}
+
+TEST_CASE(passthroughQueueingDoesNotAllocate) {
+    // As in H265Muxer: demuxed audio packets move into ring packets, wait in the queue
+    // for the video and go back to the ring once written.
+    PacketRing ring(4);
+    PassthroughQueue queue;
+    AVPacket* demuxed = av_packet_alloc();
+    CHECK(av_new_packet(demuxed, 256) == 0);
+    AVPacket* written = av_packet_alloc();
+    const int64_t audioFrame = 21333;
+    const int64_t videoFrame = 40000;
+    int64_t nextAudio = 0;
+    uint64_t allocations = allocationsInWindow([&](int frame) {
+        int64_t videoDts = static_cast<int64_t>(frame) * videoFrame;
+        // The demuxer runs 8 video frames ahead.
+        while (nextAudio < videoDts + 8 * videoFrame) {
+            AVPacket* queued = ring.acquire();
+            av_packet_move_ref(queued, demuxed);
+            queue.push(queued, nextAudio);
+            nextAudio += audioFrame;
+        }
+        PassthroughQueue::Entry entry;
+        while (queue.popDue(videoDts, entry)) {
+            // The muxer hands the reference on; here it goes back to the next read.
+            av_packet_move_ref(written, entry.packet);
+            ring.release(entry.packet);
+            av_packet_move_ref(demuxed, written);
+        }
+    });
+    CHECK_EQ(allocations, 0u);
+    CHECK(ring.getAllocatedCount() < 32);
+    PassthroughQueue::Entry entry;
+    while (queue.pop(entry)) {
+        ring.release(entry.packet);
+    }
+    av_packet_free(&written);
+    av_packet_free(&demuxed);
+}
+
+TEST_CASE(timestampTrackingDoesNotAllocate) {
+    // B-frames with one frame of reordering, as decoded.
+    TimestampTracker tracker({ 1, 90000 }, { 1, 90000 }, { 25, 1 }, 1, 1);
+    const int64_t pattern[4] = { 0, 3, 1, 2 };
+    int64_t frames = 0;
+    uint64_t allocations = allocationsInWindow([&](int frame) {
+        int64_t group = frame / 4 * 4;
+        tracker.pushPacket((group + pattern[frame % 4] + 1) * 3600, (frame - 1) * 3600, 3600);
+        while (tracker.hasFrame(false)) {
+            tracker.popFrame();
+            ++frames;
+        }
+    });
+    CHECK_EQ(allocations, 0u);
+    CHECK(frames > WINDOW_FRAMES);
+}
+
+TEST_CASE(demuxedFramesThroughTheStagesDoNotAllocate) {
+    // packet -> prefetcher -> pipeline (parse, submit, readback, mux) -> muxer, as in
+    // VideoTranscoder::transcodeLoop(). The demuxer hands out packets pointing at the
+    // stream, which stands in for the payload av_read_frame() allocates.
+    const std::vector<std::vector<uint8_t>> stream = groupOfPictures();
+    TaskPool pool(2);
+    PacketPool demuxedPayloads(4096);
+    TranscodeStages stages;
+    int64_t next = 0;
+    PacketPrefetcher prefetcher([&stream, &next](AVPacket* packet) {
+        int k = static_cast<int>(next % GOP_FRAMES);
+        const std::vector<uint8_t>& payload = stream[static_cast<size_t>(k)];
+        packet->data = const_cast<uint8_t*>(payload.data());
+        packet->size = static_cast<int>(payload.size());
+        packet->pts = (next - k + display(k) + 1) * FRAME_TICKS;
+        packet->dts = next * FRAME_TICKS;
+        packet->duration = FRAME_TICKS;
+        packet->flags = k == 0 ? AV_PKT_FLAG_KEY : 0;
+        ++next;
+        return true;
+    }, pool, 8);
+    FramePipeline pipeline(stages, pool, 4, &demuxedPayloads);
+    AVPacket* packet = av_packet_alloc();
+    auto transcode = [&](int frames) {
+        for (int frame = 0; frame < frames; ++frame) {
+            CHECK(prefetcher.readPacket(packet));
+            FrameJob job;
+            job.video = true;
+            job.frameNumber = static_cast<int>(stages.muxer.packets) + frame;
+            pipeline.push(packet, job);
+        }
+        // Counts what the stages still queued allocate, too.
+        pipeline.finish();
+    };
+    transcode(WARM_UP_FRAMES);
+    uint64_t written = stages.muxer.packets;
+    uint64_t before = AllocationCounter::total();
+    transcode(WINDOW_FRAMES);
+    uint64_t allocations = AllocationCounter::total() - before;
+    av_packet_free(&packet);
+    CHECK_EQ(allocations, 0u);
+    CHECK(stages.muxer.ordered);
+    CHECK(stages.muxer.packets - written > WINDOW_FRAMES - GOP_FRAMES);
+    CHECK_EQ(stages.parameterSets.getStats().parsed, 2u);
+    CHECK_EQ(demuxedPayloads.getStats().buffersHandedOut, static_cast<uint64_t>(WARM_UP_FRAMES + WINDOW_FRAMES));
+}
@@ -0,0 +1,203 @@
+#include "TestHarness.hpp"
+#include "SubmitScheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+using Clock = SubmitScheduler::Clock;
+using std::chrono::milliseconds;
+
+namespace {
+    SchedulingOptions live(uint32_t deadlineMs) {
+        SchedulingOptions options;
+        options.deadlineMs = deadlineMs;
+        return options;
+    }
+
+    SchedulingOptions batch(uint32_t weight) {
+        SchedulingOptions options;
+        options.weight = weight;
+        return options;
+    }
+
+    double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // The GPU queue: frames run one at a time in submission order, and a submitted frame
+    // runs to completion.
+    class SimulatedDevice {
+    public:
+        void run(Clock::duration work) {
+            std::unique_lock<std::mutex> lock(mutex);
+            uint64_t ticket = nextTicket++;
+            turn.wait(lock, [&] { return serving == ticket; });
+            lock.unlock();
+            std::this_thread::sleep_for(work);
+            lock.lock();
+            ++serving;
+            turn.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable turn;
+        uint64_t nextTicket = 0;
+        uint64_t serving = 0;
+    };
+
+    // A live job: frames arrive every interval, and each is admitted once it has arrived.
+    void runLive(ScheduledJob& job, SimulatedDevice& device, Clock::duration interval, uint64_t frames,
+                 Clock::duration work) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t frame = 0; frame < frames; ++frame) {
+            std::this_thread::sleep_until(start + interval * static_cast<int64_t>(frame));
+            job.admitFrame(frame, 2.0);
+            device.run(work);
+            job.completeFrame(frame);
+        }
+        job.endOfInput();
+    }
+
+    // A batch job: frames are always ready.
+    uint64_t runBatch(ScheduledJob& job, SimulatedDevice& device, const std::atomic<bool>& stop, Clock::duration work) {
+        uint64_t frame = 0;
+        while (!stop) {
+            job.admitFrame(frame, 1.0);
+            device.run(work);
+            job.completeFrame(frame);
+            ++frame;
+        }
+        job.endOfInput();
+        return frame;
+    }
+}
+
+TEST_CASE(liveJobsGoInDeadlineOrder) {
+    SubmitScheduler scheduler;
+    // Both have a frame due every 10 ms; the urgent one's frames are due 100 ms after
+    // they arrive, the relaxed one's 500 ms after.
+    ScheduledJob urgent = scheduler.addJob(live(100), 0.010);
+    ScheduledJob relaxed = scheduler.addJob(live(500), 0.010);
+    urgent.admitFrame(0, 1.0);
+
+    // The urgent job's next frame is due and its deadline is earlier, so the relaxed
+    // job waits for it.
+    std::atomic<bool> admitted{ false };
+    Clock::time_point waitStart = Clock::now();
+    double waitedMs = 0.0;
+    std::thread relaxedThread([&] {
+        relaxed.admitFrame(0, 1.0);
+        waitedMs = millisecondsSince(waitStart);
+        admitted = true;
+    });
+    std::this_thread::sleep_for(milliseconds(20));
+    CHECK(!admitted);
+    urgent.admitFrame(1, 1.0);
+    std::this_thread::sleep_for(milliseconds(10));
+    CHECK(!admitted);
+    // Once the urgent job has no frame due, the relaxed one goes, well before the cap.
+    urgent.endOfInput();
+    relaxedThread.join();
+    CHECK(waitedMs < 90.0);
+    CHECK_EQ(relaxed.getStats().deferrals, 1u);
+    CHECK_EQ(urgent.getStats().deferrals, 0u);
+
+    // The other way round nothing waits: a due job with a later deadline holds back no one.
+    ScheduledJob second = scheduler.addJob(live(100), 0.010);
+    Clock::time_point start = Clock::now();
+    second.admitFrame(0, 1.0);
+    second.admitFrame(1, 1.0);
+    CHECK(millisecondsSince(start) < 50.0);
+    CHECK_EQ(second.getStats().deferrals, 0u);
+}
+
+TEST_CASE(liveJobMeetsDeadlinesUnderBatchSaturation) {
+    // A 25 fps live job whose frames are due 20 ms after arrival and take 4 ms of device
+    // time, against two batch jobs that always have a 2 ms frame ready. The batch jobs
+    // share what the live job leaves by weight, 1:3.
+    SubmitScheduler scheduler;
+    SimulatedDevice device;
+    ScheduledJob light = scheduler.addJob(batch(1), 0.0);
+    ScheduledJob heavy = scheduler.addJob(batch(3), 0.0);
+    ScheduledJob liveJob = scheduler.addJob(live(20), 0.040);
+    CHECK_EQ(light.getFramesInFlight(4), 1u);
+
+    std::atomic<bool> stop{ false };
+    uint64_t lightFrames = 0;
+    uint64_t heavyFrames = 0;
+    std::thread lightThread([&] { lightFrames = runBatch(light, device, stop, milliseconds(2)); });
+    std::thread heavyThread([&] { heavyFrames = runBatch(heavy, device, stop, milliseconds(2)); });
+    std::this_thread::sleep_for(milliseconds(50));
+    std::thread liveThread([&] { runLive(liveJob, device, milliseconds(40), 30, milliseconds(4)); });
+    liveThread.join();
+    stop = true;
+    lightThread.join();
+    heavyThread.join();
+
+    SchedulingStats liveStats = liveJob.getStats();
+    CHECK_EQ(liveStats.framesCompleted, 30u);
+    CHECK_EQ(liveStats.deadlineMisses, 0u);
+    CHECK(liveStats.worstLatenessSeconds == 0.0);
+    // The batch jobs kept the device busy in between, at about 1:3.
+    CHECK(lightFrames + heavyFrames > 200);
+    double ratio = static_cast<double>(heavyFrames) / static_cast<double>(lightFrames);
+    CHECK(ratio > 2.4 && ratio < 3.6);
+    CHECK(light.getStats().deferrals > 0);
+    // With the live job gone, batch jobs keep their planned depth again.
+    CHECK_EQ(light.getFramesInFlight(4), 4u);
+}
+
+TEST_CASE(batchJobsShareByWeightAlone) {
+    SubmitScheduler scheduler;
+    SimulatedDevice device;
+    ScheduledJob light = scheduler.addJob(batch(1), 0.0);
+    ScheduledJob heavy = scheduler.addJob(batch(3), 0.0);
+    CHECK_EQ(light.getFramesInFlight(4), 4u);
+    std::atomic<bool> stop{ false };
+    uint64_t lightFrames = 0;
+    uint64_t heavyFrames = 0;
+    std::thread lightThread([&] { lightFrames = runBatch(light, device, stop, milliseconds(1)); });
+    std::thread heavyThread([&] { heavyFrames = runBatch(heavy, device, stop, milliseconds(1)); });
+    std::this_thread::sleep_for(milliseconds(600));
+    stop = true;
+    lightThread.join();
+    heavyThread.join();
+    double ratio = static_cast<double>(heavyFrames) / static_cast<double>(lightFrames);
+    CHECK(lightFrames + heavyFrames > 200);
+    CHECK(ratio > 2.4 && ratio < 3.6);
+}
+
+TEST_CASE(noFrameWaitsLongerThanTheCap) {
+    // A live job that stops admitting frames stays due, as if overloaded.
+    SubmitScheduler scheduler;
+    ScheduledJob stalled = scheduler.addJob(live(1000), 0.001);
+    stalled.admitFrame(0, 1.0);
+    ScheduledJob batchJob = scheduler.addJob(batch(1), 0.0);
+    ScheduledJob laterLive = scheduler.addJob(live(5000), 0.001);
+
+    double capMs = std::chrono::duration<double, std::milli>(SubmitScheduler::MAX_DEFERRAL).count();
+    for (ScheduledJob* job : { &batchJob, &laterLive }) {
+        Clock::time_point start = Clock::now();
+        job->admitFrame(0, 1.0);
+        double waitedMs = millisecondsSince(start);
+        CHECK(waitedMs >= capMs - 1.0);
+        CHECK(waitedMs < capMs + 150.0);
+        SchedulingStats stats = job->getStats();
+        CHECK_EQ(stats.deferrals, 1u);
+        CHECK(stats.deferredSeconds * 1000.0 >= capMs - 1.0);
+    }
+    // The stalled job itself was never held back, nor is a job with an earlier deadline,
+    // whose late frame counts as a miss.
+    CHECK_EQ(stalled.getStats().deferrals, 0u);
+    ScheduledJob tight = scheduler.addJob(live(1), 0.001);
+    tight.admitFrame(0, 1.0);
+    std::this_thread::sleep_for(milliseconds(5));
+    CHECK(tight.completeFrame(0));
+    CHECK_EQ(tight.getStats().deferrals, 0u);
+    CHECK_EQ(tight.getStats().deadlineMisses, 1u);
+}
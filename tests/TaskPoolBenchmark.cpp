@@ -0,0 +1,86 @@
+// Throughput of the CPU stages of many transcodes on the shared TaskPool, against a
+// thread per transcode. Each session runs frames of four busy stages; the pool runs
+// every session's stages on one strand per session. One table per worker count, from
+// 1 up to maxWorkers in powers of two, shows how the sessions scale with the cores.
+//
+//   TaskPoolBenchmark [maxWorkers, 0 = hardware threads] [stage microseconds]
+#include "TaskPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr uint32_t STAGES_PER_FRAME = 4;
+    // Split evenly over the sessions, so every row does the same work.
+    constexpr uint32_t TOTAL_FRAMES = 2048;
+
+    void busy(std::chrono::microseconds duration) {
+        Clock::time_point end = Clock::now() + duration;
+        while (Clock::now() < end) {
+        }
+    }
+
+    double threadPerSession(uint32_t sessions, uint32_t frames, std::chrono::microseconds stage) {
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> threads;
+        for (uint32_t session = 0; session < sessions; ++session) {
+            threads.emplace_back([=] {
+                for (uint32_t frame = 0; frame < frames * STAGES_PER_FRAME; ++frame) {
+                    busy(stage);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return sessions * frames / std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double pooled(TaskPool& pool, uint32_t sessions, uint32_t frames, std::chrono::microseconds stage) {
+        Clock::time_point start = Clock::now();
+        std::vector<TaskStrand> strands(sessions, TaskStrand(pool));
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            for (TaskStrand& strand : strands) {
+                for (uint32_t i = 0; i < STAGES_PER_FRAME; ++i) {
+                    strand.post([stage] { busy(stage); });
+                }
+            }
+        }
+        for (const TaskStrand& strand : strands) {
+            strand.wait();
+        }
+        return sessions * frames / std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t maxWorkers = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 0;
+    if (maxWorkers == 0) {
+        maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::chrono::microseconds stage(argc > 2 ? std::strtol(argv[2], nullptr, 10) : 50);
+    std::printf("%u hardware threads, %u stages of %lld us per frame\n", std::thread::hardware_concurrency(),
+                STAGES_PER_FRAME, static_cast<long long>(stage.count()));
+    for (uint32_t workers = 1; workers <= maxWorkers; workers = workers * 2 > maxWorkers && workers < maxWorkers
+                                                                    ? maxWorkers : workers * 2) {
+        TaskPool pool(workers);
+        std::printf("\n%u workers\n", pool.getThreadCount());
+        std::printf("%8s %16s %16s %8s %10s\n", "sessions", "threads fps", "pool fps", "ratio", "steals");
+        for (uint32_t sessions = 1; sessions <= 64; sessions *= 2) {
+            uint32_t frames = TOTAL_FRAMES / sessions;
+            double threadsFps = threadPerSession(sessions, frames, stage);
+            uint64_t steals = pool.getStats().steals;
+            double poolFps = pooled(pool, sessions, frames, stage);
+            std::printf("%8u %16.0f %16.0f %8.2f %10llu\n", sessions, threadsFps, poolFps, poolFps / threadsFps,
+                        static_cast<unsigned long long>(pool.getStats().steals - steals));
+        }
+    }
+    return 0;
+}
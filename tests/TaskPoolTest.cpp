@@ -0,0 +1,92 @@
+#include "TestHarness.hpp"
+#include "TaskPool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE(strandsKeepTheirOrder) {
+    TaskPool pool(4);
+    std::vector<std::vector<int>> seen(8);
+    std::vector<TaskStrand> strands(seen.size(), TaskStrand(pool));
+    for (int task = 0; task < 500; ++task) {
+        for (size_t i = 0; i < strands.size(); ++i) {
+            strands[i].post([&seen, i, task] { seen[i].push_back(task); });
+        }
+    }
+    for (size_t i = 0; i < strands.size(); ++i) {
+        strands[i].wait();
+        CHECK_EQ(seen[i].size(), 500u);
+        bool ordered = true;
+        for (size_t task = 0; task < seen[i].size(); ++task) {
+            ordered &= seen[i][task] == static_cast<int>(task);
+        }
+        CHECK(ordered);
+    }
+    CHECK_EQ(pool.getStats().tasksRun, 8u * 500);
+}
+
+TEST_CASE(aThrowingTaskDoesNotStopItsStrand) {
+    TaskPool pool(2);
+    TaskStrand strand(pool);
+    std::vector<int> ran;
+    strand.post([&] { ran.push_back(1); });
+    strand.post([] { throw std::runtime_error("first"); });
+    strand.post([&] { ran.push_back(3); });
+    strand.post([] { throw std::logic_error("second"); });
+    strand.post([&] { ran.push_back(5); });
+    // The first exception is the one reported, and again on the next wait.
+    CHECK_THROWS(strand.wait(), std::runtime_error);
+    CHECK_THROWS(strand.wait(), std::runtime_error);
+    CHECK(ran == std::vector<int>({ 1, 3, 5 }));
+}
+
+TEST_CASE(dependentsRunAfterTheirDependencies) {
+    TaskPool pool(3);
+    std::atomic<int> stage{ 0 };
+    std::atomic<bool> ordered{ true };
+    TaskHandle top = pool.submit([&] { stage = 1; });
+    TaskHandle left = pool.submit([&] { ordered = ordered && stage >= 1; }, { top });
+    TaskHandle right = pool.submit([&] { ordered = ordered && stage >= 1; }, { top });
+    TaskHandle bottom = pool.submit([&] { stage = 2; }, { left, right });
+    bottom.wait();
+    CHECK(ordered);
+    CHECK_EQ(stage.load(), 2);
+}
+
+TEST_CASE(aFailedDependencySkipsItsDependents) {
+    TaskPool pool(2);
+    std::atomic<bool> ran{ false };
+    TaskHandle failing = pool.submit([] { throw std::runtime_error("failed"); });
+    TaskHandle dependent = pool.submit([&] { ran = true; }, { failing });
+    CHECK_THROWS(dependent.wait(), std::runtime_error);
+    CHECK(!ran);
+    // Submitted after the failure is known, it is skipped all the same.
+    TaskHandle late = pool.submit([&] { ran = true; }, { failing });
+    CHECK_THROWS(late.wait(), std::runtime_error);
+    CHECK(!ran);
+}
+
+TEST_CASE(tasksSubmitTasks) {
+    std::atomic<int> count{ 0 };
+    {
+        TaskPool pool(2);
+        std::vector<TaskHandle> inner(16);
+        TaskHandle outer = pool.submit([&] {
+            for (auto& handle : inner) {
+                handle = pool.submit([&] { ++count; });
+            }
+        });
+        outer.wait();
+        for (const auto& handle : inner) {
+            handle.wait();
+        }
+        CHECK_EQ(count.load(), 16);
+        // The destructor still runs what is queued.
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&] { ++count; });
+        }
+    }
+    CHECK_EQ(count.load(), 116);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+// A minimal unit test harness. TEST_CASE defines a test that TestMain.cpp runs; the
+// CHECK macros record a failure with its location and let the test carry on. A test
+// that throws fails with the exception's message.
+namespace TestHarness {
+    void registerTest(const char* name, void (*function)());
+    void reportFailure(const char* file, int line, const std::string& message);
+
+    struct Registrar {
+        Registrar(const char* name, void (*function)()) { registerTest(name, function); }
+    };
+}
+
+#define TEST_CASE(name)                                                  \
+    static void name();                                                  \
+    static TestHarness::Registrar name##Registrar(#name, &name);         \
+    static void name()
+
+#define CHECK(expression)                                                                     \
+    do {                                                                                      \
+        if (!(expression)) {                                                                  \
+            TestHarness::reportFailure(__FILE__, __LINE__, "CHECK(" #expression ")");         \
+        }                                                                                     \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                            \
+    do {                                                                                      \
+        const auto& checkActual = (actual);                                                   \
+        const auto& checkExpected = (expected);                                               \
+        if (!(checkActual == checkExpected)) {                                                \
+            std::ostringstream checkMessage;                                                  \
+            checkMessage << "CHECK_EQ(" #actual ", " #expected "): " << checkActual           \
+                         << " != " << checkExpected;                                          \
+            TestHarness::reportFailure(__FILE__, __LINE__, checkMessage.str());               \
+        }                                                                                     \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                               \
+    do {                                                                                      \
+        double checkActual = (actual);                                                        \
+        double checkExpected = (expected);                                                    \
+        if (!(std::fabs(checkActual - checkExpected) <= (tolerance))) {                       \
+            std::ostringstream checkMessage;                                                  \
+            checkMessage << "CHECK_NEAR(" #actual ", " #expected "): " << checkActual         \
+                         << " is not within " << (tolerance) << " of " << checkExpected;      \
+            TestHarness::reportFailure(__FILE__, __LINE__, checkMessage.str());               \
+        }                                                                                     \
+    } while (0)
+
+#define CHECK_THROWS(expression, exceptionType)                                               \
+    do {                                                                                      \
+        bool checkThrown = false;                                                             \
+        try {                                                                                 \
+            (void)(expression);                                                               \
+        } catch (const exceptionType&) {                                                     \
+            checkThrown = true;                                                               \
+        }                                                                                     \
+        if (!checkThrown) {                                                                   \
+            TestHarness::reportFailure(__FILE__, __LINE__,                                    \
+                                       "CHECK_THROWS(" #expression ", " #exceptionType ")");  \
+        }                                                                                     \
+    } while (0)
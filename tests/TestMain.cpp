@@ -0,0 +1,60 @@
+#include "TestHarness.hpp"
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+namespace {
+    struct TestEntry {
+        const char* name;
+        void (*function)();
+    };
+
+    std::vector<TestEntry>& tests() {
+        static std::vector<TestEntry> registered;
+        return registered;
+    }
+
+    int failuresInTest = 0;
+}
+
+namespace TestHarness {
+    void registerTest(const char* name, void (*function)()) {
+        tests().push_back({ name, function });
+    }
+
+    void reportFailure(const char* file, int line, const std::string& message) {
+        std::cerr << file << ':' << line << ": " << message << std::endl;
+        ++failuresInTest;
+    }
+}
+
+// Runs every test, or the tests whose name contains the first argument.
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int run = 0;
+    int failed = 0;
+    for (const TestEntry& test : tests()) {
+        if (filter && !strstr(test.name, filter)) {
+            continue;
+        }
+        failuresInTest = 0;
+        try {
+            test.function();
+        } catch (const std::exception& e) {
+            TestHarness::reportFailure(test.name, 0, std::string("uncaught exception: ") + e.what());
+        } catch (...) {
+            TestHarness::reportFailure(test.name, 0, "uncaught exception");
+        }
+        ++run;
+        if (failuresInTest > 0) {
+            ++failed;
+            std::cout << "FAILED " << test.name << std::endl;
+        } else {
+            std::cout << "passed " << test.name << std::endl;
+        }
+    }
+    std::cout << run - failed << " of " << run << " tests passed" << std::endl;
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include "TestHarness.hpp"
+#include "DisplayOrderQueue.hpp"
+#include "TimestampTracker.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+namespace {
+    // A demuxed packet of an IBBP stream in a 1/25 time base, one tick per frame. The
+    // PTS is what the encoded frame holding this picture must be muxed with.
+    struct SourcePacket {
+        char type;
+        int64_t pts;
+        int64_t dts;
+        int32_t picOrderCnt;
+    };
+
+    // I0 P3 B1 B2 P6 B4 B5 P9 B7 B8 in decode order. The DTS starts two frames early, as
+    // muxers write it for two frames of reordering.
+    const std::vector<SourcePacket> IBBP = {
+        { 'I', 0, -2, 0 }, { 'P', 3, -1, 6 }, { 'B', 1, 0, 2 }, { 'B', 2, 1, 4 }, { 'P', 6, 2, 12 },
+        { 'B', 4, 3, 8 }, { 'B', 5, 4, 10 }, { 'P', 9, 5, 18 }, { 'B', 7, 6, 14 }, { 'B', 8, 7, 16 },
+    };
+}
+
+TEST_CASE(ibbpFramesGetTheirOwnTimestamps) {
+    // What the transcoder does: pictures are put in display order before the encoder,
+    // and the tracker hands out timestamps in presentation order.
+    Timebase timebase{ 1, 25 };
+    TimestampTracker tracker(timebase, timebase, Timebase{ 25, 1 }, 2);
+    DisplayOrderQueue<SourcePacket> displayQueue(2);
+    std::vector<SourcePacket> encoded;
+    std::vector<FrameTimestamp> muxed;
+    auto writeReady = [&](bool flush) {
+        while (muxed.size() < encoded.size() && tracker.hasFrame(flush)) {
+            muxed.push_back(tracker.popFrame());
+        }
+    };
+
+    for (const SourcePacket& packet : IBBP) {
+        tracker.pushPacket(packet.pts, packet.dts, 1);
+        displayQueue.push(packet, packet.picOrderCnt, packet.type == 'I');
+        while (displayQueue.ready(false)) {
+            encoded.push_back(displayQueue.pop());
+        }
+        writeReady(false);
+    }
+    while (displayQueue.ready(true)) {
+        encoded.push_back(displayQueue.pop());
+    }
+    writeReady(true);
+
+    CHECK_EQ(encoded.size(), IBBP.size());
+    CHECK_EQ(muxed.size(), IBBP.size());
+    for (size_t i = 0; i < muxed.size() && i < encoded.size(); ++i) {
+        // Each encoded frame is muxed with its own source picture's PTS.
+        CHECK_EQ(muxed[i].pts, encoded[i].pts);
+        CHECK_EQ(muxed[i].pts, static_cast<int64_t>(i));
+        CHECK_EQ(muxed[i].duration, 1);
+        // The output has no reordering, so the DTS can be the PTS.
+        CHECK_EQ(muxed[i].dts, muxed[i].pts);
+        if (i > 0) {
+            CHECK(muxed[i].dts > muxed[i - 1].dts);
+        }
+    }
+}
+
+TEST_CASE(ptsWaitsForTheReorderDelay) {
+    Timebase timebase{ 1, 25 };
+    TimestampTracker tracker(timebase, timebase, Timebase{ 25, 1 }, 2);
+    tracker.pushPacket(0, -2, 1);
+    tracker.pushPacket(3, -1, 1);
+    CHECK(!tracker.hasFrame(false));
+    CHECK(tracker.hasFrame(true));
+    // B1 could still be behind P3; it arrives next.
+    tracker.pushPacket(1, 0, 1);
+    CHECK(tracker.hasFrame(false));
+    CHECK_EQ(tracker.popFrame().pts, 0);
+    CHECK(!tracker.hasFrame(false));
+    CHECK_EQ(tracker.popFrame().pts, 1);
+    CHECK_EQ(tracker.popFrame().pts, 3);
+    CHECK_EQ(tracker.getPendingCount(), 0u);
+    CHECK_THROWS(tracker.popFrame(), std::logic_error);
+}
+
+TEST_CASE(outputReorderDelayHoldsTheDtsBack) {
+    Timebase timebase{ 1, 25 };
+    TimestampTracker tracker(timebase, timebase, Timebase{ 25, 1 }, 0, 2);
+    for (int64_t pts = 0; pts < 4; ++pts) {
+        tracker.pushPacket(pts, pts, 1);
+    }
+    for (int64_t pts = 0; pts < 4; ++pts) {
+        FrameTimestamp frame = tracker.popFrame();
+        CHECK_EQ(frame.pts, pts);
+        CHECK_EQ(frame.dts, pts - 2);
+    }
+}
+
+TEST_CASE(timestampsAreRescaled) {
+    // 1/90000 input, 1/1000 output at 25 fps: 3600 ticks per frame in, 40 out.
+    TimestampTracker tracker(Timebase{ 1, 90000 }, Timebase{ 1, 1000 }, Timebase{ 25, 1 }, 0);
+    tracker.pushPacket(9000, 9000, 3600);
+    tracker.pushPacket(12600, 12600, 0);
+    FrameTimestamp first = tracker.popFrame();
+    CHECK_EQ(first.pts, 100);
+    CHECK_EQ(first.duration, 40);
+    FrameTimestamp second = tracker.popFrame();
+    CHECK_EQ(second.pts, 140);
+    CHECK_EQ(second.duration, 40);
+}
+
+TEST_CASE(missingAndRepeatedPtsAreRepaired) {
+    Timebase timebase{ 1, 25 };
+    TimestampTracker tracker(timebase, timebase, Timebase{ 25, 1 }, 0);
+    tracker.pushPacket(0, 0, 1);
+    // Without reordering a missing PTS is the DTS, or follows the previous packet.
+    tracker.pushPacket(AV_NOPTS_VALUE, 1, 1);
+    tracker.pushPacket(AV_NOPTS_VALUE, AV_NOPTS_VALUE, 1);
+    // A repeated PTS is moved past the one before it.
+    tracker.pushPacket(2, 3, 1);
+    std::vector<int64_t> pts;
+    while (tracker.hasFrame(true)) {
+        FrameTimestamp frame = tracker.popFrame();
+        CHECK(frame.dts <= frame.pts);
+        pts.push_back(frame.pts);
+    }
+    CHECK_EQ(pts.size(), 4u);
+    for (size_t i = 1; i < pts.size(); ++i) {
+        CHECK(pts[i] > pts[i - 1]);
+    }
+    CHECK(tracker.getSynthesizedCount() + tracker.getCorrectedCount() > 0);
+}
+
+TEST_CASE(resumeContinuesAfterTheLastFrame) {
+    Timebase timebase{ 1, 25 };
+    TimestampTracker tracker(timebase, timebase, Timebase{ 25, 1 }, 0);
+    tracker.resumeAfter(10, 10);
+    tracker.pushPacket(5, 5, 1);
+    FrameTimestamp frame = tracker.popFrame();
+    CHECK(frame.pts > 10);
+    CHECK(frame.dts > 10);
+}
+
+TEST_CASE(invalidTimebaseThrows) {
+    CHECK_THROWS(TimestampTracker(Timebase{ 0, 1 }, Timebase{ 1, 25 }, Timebase{ 25, 1 }, 0), std::invalid_argument);
+    CHECK_THROWS(TimestampTracker(Timebase{ 1, 25 }, Timebase{ 1, 25 }, Timebase{ 0, 1 }, 0), std::invalid_argument);
+}
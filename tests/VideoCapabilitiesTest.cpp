@@ -0,0 +1,53 @@
+#include "TestHarness.hpp"
+#include "VideoCapabilities.hpp"
+
+#include <stdexcept>
+
+using VideoCapabilityUtils::alignUp;
+using VideoCapabilityUtils::selectBitstreamRange;
+
+TEST_CASE(alignUpRoundsToMultiples) {
+    CHECK_EQ(alignUp(0, 256), 0u);
+    CHECK_EQ(alignUp(1, 256), 256u);
+    CHECK_EQ(alignUp(256, 256), 256u);
+    CHECK_EQ(alignUp(257, 96), 288u);
+    CHECK_EQ(alignUp(257, 0), 257u);
+    CHECK_EQ(alignUp(257, 1), 257u);
+}
+
+TEST_CASE(exactRangeWithoutSizeClasses) {
+    CHECK_EQ(selectBitstreamRange(1000, 256, 1 << 20, 0), 1024u);
+    CHECK_EQ(selectBitstreamRange(1024, 256, 1 << 20, 0), 1024u);
+    CHECK_EQ(selectBitstreamRange(1000, 0, 1 << 20, 0), 1000u);
+}
+
+TEST_CASE(sizeClassesArePowersOfTwo) {
+    CHECK_EQ(selectBitstreamRange(1, 256, 1 << 20, 4096), 4096u);
+    CHECK_EQ(selectBitstreamRange(4096, 256, 1 << 20, 4096), 4096u);
+    CHECK_EQ(selectBitstreamRange(4097, 256, 1 << 20, 4096), 8192u);
+    CHECK_EQ(selectBitstreamRange(300000, 256, 1 << 20, 4096), 524288u);
+}
+
+// Frames of similar size share a range, so a command buffer recorded for one is reused.
+TEST_CASE(similarPacketsShareARange) {
+    VkDeviceSize first = selectBitstreamRange(40000, 256, 1 << 20, 4096);
+    for (VkDeviceSize size = 32769; size <= 65536; size += 977) {
+        CHECK_EQ(selectBitstreamRange(size, 256, 1 << 20, 4096), first);
+    }
+}
+
+TEST_CASE(sizeClassesKeepTheAlignment) {
+    VkDeviceSize range = selectBitstreamRange(5000, 768, 1 << 20, 4096);
+    CHECK_EQ(range % 768, 0u);
+    CHECK(range >= 8192);
+}
+
+TEST_CASE(rangeIsClampedToTheBuffer) {
+    CHECK_EQ(selectBitstreamRange(9000, 256, 10240, 4096), 10240u);
+    CHECK_EQ(selectBitstreamRange(10240, 256, 10240, 4096), 10240u);
+}
+
+TEST_CASE(oversizedPacketThrows) {
+    CHECK_THROWS(selectBitstreamRange(10241, 256, 10240, 4096), std::runtime_error);
+    CHECK_THROWS(selectBitstreamRange(10241, 256, 10240, 0), std::runtime_error);
+}
@@ -0,0 +1,152 @@
+#include "TestHarness.hpp"
+#include "VideoSessionCache.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Handles are only compared, so any distinct value will do.
+    VkVideoSessionKHR fakeSession(uintptr_t id) {
+        return (VkVideoSessionKHR)id;
+    }
+
+    VideoSessionKey key1080p() {
+        VideoSessionKey key;
+        key.decode = true;
+        key.decodeProfileIdc = 100;
+        key.chromaFormatIdc = 1;
+        key.sourceBitDepth = 8;
+        key.encodeProfileIdc = 1;
+        key.outputBitDepth = 8;
+        key.decodePictureFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+        key.encodePictureFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+        key.maxCodedExtent = { 1920, 1088 };
+        key.decodeDpbSlots = 17;
+        key.decodeActiveReferences = 16;
+        key.encodeDpbSlots = 2;
+        key.encodeActiveReferences = 1;
+        return key;
+    }
+
+    VideoSessions sessions(uintptr_t id) {
+        VideoSessions set;
+        set.decodeSession = fakeSession(id);
+        set.encodeSession = fakeSession(id + 1);
+        set.dpbExtent = { 1920, 1088 };
+        return set;
+    }
+
+    // Records the encode session of every set destroyed.
+    struct DestroyLog {
+        std::vector<VkVideoSessionKHR> destroyed;
+
+        VideoSessionCache::Destroyer destroyer() {
+            return [this](VideoSessions& set) { destroyed.push_back(set.encodeSession); };
+        }
+    };
+}
+
+TEST_CASE(aSetIsReusedForAnEqualKey) {
+    DestroyLog log;
+    VideoSessionCache cache(1, log.destroyer());
+    VideoSessions set;
+    CHECK(!cache.checkOut(key1080p(), set));
+    cache.checkIn(key1080p(), sessions(0x10));
+    CHECK(cache.checkOut(key1080p(), set));
+    CHECK(set.decodeSession == fakeSession(0x10));
+    CHECK(set.encodeSession == fakeSession(0x11));
+    CHECK_EQ(set.dpbExtent.width, 1920u);
+    // Checked out sets belong to the job.
+    VideoSessions other;
+    CHECK(!cache.checkOut(key1080p(), other));
+    CHECK(log.destroyed.empty());
+
+    VideoSessionCacheStats stats = cache.getStats();
+    CHECK_EQ(stats.hits, 1u);
+    CHECK_EQ(stats.misses, 2u);
+    CHECK_EQ(stats.idle, 0u);
+}
+
+TEST_CASE(anyDifferenceInTheKeyMisses) {
+    DestroyLog log;
+    VideoSessionCache cache(1, log.destroyer());
+    cache.checkIn(key1080p(), sessions(0x10));
+
+    std::vector<VideoSessionKey> keys(9, key1080p());
+    keys[0].decode = false;
+    keys[1].decodeProfileIdc = 77;
+    keys[2].sourceBitDepth = 10;
+    keys[3].outputBitDepth = 10;
+    keys[4].encodePictureFormat = VK_FORMAT_UNDEFINED;
+    keys[5].maxCodedExtent.width = 3840;
+    keys[6].maxCodedExtent.height = 1080;
+    keys[7].decodeDpbSlots = 5;
+    keys[8].encodeActiveReferences = 0;
+    VideoSessions set;
+    for (const VideoSessionKey& key : keys) {
+        CHECK(key != key1080p());
+        CHECK(!cache.checkOut(key, set));
+    }
+    CHECK(set.encodeSession == VK_NULL_HANDLE);
+    CHECK(cache.checkOut(key1080p(), set));
+}
+
+TEST_CASE(theOldestSetsAreDestroyedBeyondTheCapacity) {
+    DestroyLog log;
+    {
+        VideoSessionCache cache(2, log.destroyer());
+        cache.checkIn(key1080p(), sessions(0x10));
+        cache.checkIn(key1080p(), sessions(0x20));
+        cache.checkIn(key1080p(), sessions(0x30));
+        CHECK_EQ(log.destroyed.size(), 1u);
+        CHECK(log.destroyed[0] == fakeSession(0x11));
+        CHECK_EQ(cache.getStats().evictions, 1u);
+
+        // The most recent set comes out first.
+        VideoSessions set;
+        CHECK(cache.checkOut(key1080p(), set));
+        CHECK(set.decodeSession == fakeSession(0x30));
+    }
+    // The rest go with the cache.
+    CHECK_EQ(log.destroyed.size(), 2u);
+    CHECK(log.destroyed[1] == fakeSession(0x21));
+}
+
+TEST_CASE(capacityZeroKeepsNothing) {
+    DestroyLog log;
+    VideoSessionCache cache(0, log.destroyer());
+    cache.checkIn(key1080p(), sessions(0x10));
+    CHECK_EQ(log.destroyed.size(), 1u);
+    VideoSessions set;
+    CHECK(!cache.checkOut(key1080p(), set));
+}
+
+TEST_CASE(concurrentJobsEachGetTheirOwnSet) {
+    DestroyLog log;
+    constexpr int JOBS = 4;
+    VideoSessionCache cache(JOBS, log.destroyer());
+    for (int i = 0; i < JOBS; ++i) {
+        cache.checkIn(key1080p(), sessions(0x100 * (i + 1)));
+    }
+    std::vector<VkVideoSessionKHR> taken(JOBS);
+    std::vector<std::thread> jobs;
+    for (int i = 0; i < JOBS; ++i) {
+        jobs.emplace_back([&cache, &taken, i] {
+            VideoSessions set;
+            if (cache.checkOut(key1080p(), set)) {
+                taken[i] = set.decodeSession;
+            }
+        });
+    }
+    for (std::thread& job : jobs) {
+        job.join();
+    }
+    for (int i = 0; i < JOBS; ++i) {
+        CHECK(taken[i] != VK_NULL_HANDLE);
+        for (int j = 0; j < i; ++j) {
+            CHECK(taken[i] != taken[j]);
+        }
+    }
+    CHECK_EQ(cache.getStats().idle, 0u);
+}
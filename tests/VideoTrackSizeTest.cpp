@@ -0,0 +1,40 @@
+#include "TestHarness.hpp"
+#include "VideoTrackSize.hpp"
+
+#include <stdexcept>
+
+TEST_CASE(fixedTrackOnlyTakesItsOwnSize) {
+    VideoTrackSize track(1920, 1080);
+    CHECK(!track.allowsChanges());
+    track.change(1920, 1080);
+    CHECK_EQ(track.getChangeCount(), 0u);
+    CHECK_THROWS(track.change(1280, 720), std::runtime_error);
+    CHECK_THROWS(track.change(1920, 1088), std::runtime_error);
+    CHECK_EQ(track.getPictureWidth(), 1920);
+    CHECK_EQ(track.getPictureHeight(), 1080);
+}
+
+TEST_CASE(declaredTrackTakesSizesUpToTheMaximum) {
+    VideoTrackSize track(1280, 720);
+    track.allowChanges(1920, 1080);
+    CHECK(track.allowsChanges());
+    CHECK_EQ(track.getWidth(), 1920);
+    CHECK_EQ(track.getHeight(), 1080);
+    track.change(640, 360);
+    track.change(1920, 1080);
+    track.change(1920, 1080);
+    CHECK_EQ(track.getChangeCount(), 2u);
+    CHECK_THROWS(track.change(2560, 1080), std::runtime_error);
+    CHECK_THROWS(track.change(1920, 1200), std::runtime_error);
+    CHECK_EQ(track.getPictureWidth(), 1920);
+}
+
+TEST_CASE(declaredSizeCoversTheInitialSize) {
+    // A maximum below the initial size in one dimension still declares the initial one.
+    VideoTrackSize track(1920, 800);
+    track.allowChanges(1280, 1080);
+    CHECK_EQ(track.getWidth(), 1920);
+    CHECK_EQ(track.getHeight(), 1080);
+    track.change(1920, 1080);
+    CHECK_EQ(track.getChangeCount(), 1u);
+}